@@ -0,0 +1,77 @@
+# Copyright 2023 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Generate a header-only CAN message layer from a DBC file at build time.
+#
+#   libhal_canrouter_generate_dbc(
+#     TARGET <target>
+#     DBC <path/to/bus.dbc>
+#     [NAMESPACE <namespace>]
+#     [OUTPUT <path/to/bus.hpp>])
+#
+# The header is written to ${CMAKE_CURRENT_BINARY_DIR}/dbc/<name>.hpp unless
+# OUTPUT is given, is regenerated whenever the DBC changes, and its directory
+# is added to the include path of <target>, so sources can simply
+# `#include <bus.hpp>`.
+#
+# A Python 3 interpreter is only looked up when the function is called, so
+# projects that never generate a header do not need one.
+
+# Installed packages place the generator next to this file, source trees keep
+# it in tools/
+if(EXISTS "${CMAKE_CURRENT_LIST_DIR}/dbc_codegen.py")
+  set(LIBHAL_CANROUTER_DBC_CODEGEN "${CMAKE_CURRENT_LIST_DIR}/dbc_codegen.py")
+else()
+  set(LIBHAL_CANROUTER_DBC_CODEGEN
+    "${CMAKE_CURRENT_LIST_DIR}/../tools/dbc_codegen.py")
+endif()
+
+function(libhal_canrouter_generate_dbc)
+  cmake_parse_arguments(ARG "" "TARGET;DBC;NAMESPACE;OUTPUT" "" ${ARGN})
+
+  if(NOT ARG_TARGET OR NOT ARG_DBC)
+    message(FATAL_ERROR
+      "libhal_canrouter_generate_dbc requires TARGET and DBC arguments")
+  endif()
+
+  find_package(Python3 COMPONENTS Interpreter)
+  if(NOT Python3_Interpreter_FOUND)
+    message(FATAL_ERROR
+      "libhal_canrouter_generate_dbc requires a Python 3 interpreter")
+  endif()
+
+  get_filename_component(dbc "${ARG_DBC}" ABSOLUTE)
+  get_filename_component(name "${dbc}" NAME_WE)
+
+  if(NOT ARG_OUTPUT)
+    set(ARG_OUTPUT "${CMAKE_CURRENT_BINARY_DIR}/dbc/${name}.hpp")
+  endif()
+
+  set(namespace_args)
+  if(ARG_NAMESPACE)
+    set(namespace_args --namespace ${ARG_NAMESPACE})
+  endif()
+
+  add_custom_command(
+    OUTPUT "${ARG_OUTPUT}"
+    COMMAND Python3::Interpreter "${LIBHAL_CANROUTER_DBC_CODEGEN}"
+            "${dbc}" "${ARG_OUTPUT}" ${namespace_args}
+    DEPENDS "${dbc}" "${LIBHAL_CANROUTER_DBC_CODEGEN}"
+    COMMENT "Generating ${name}.hpp from ${name}.dbc"
+    VERBATIM)
+
+  target_sources(${ARG_TARGET} PRIVATE "${ARG_OUTPUT}")
+  get_filename_component(output_directory "${ARG_OUTPUT}" DIRECTORY)
+  target_include_directories(${ARG_TARGET} PRIVATE "${output_directory}")
+endfunction()
@@ -32,7 +32,7 @@ class libhal_canrouter_conan(ConanFile):
     topics = ("can", "canrouter", "libhal", "driver")
     settings = "compiler", "build_type", "os", "arch"
     exports_sources = ("include/*", "tests/*", "LICENSE", "CMakeLists.txt",
-                       "src/*")
+                       "src/*", "cmake/*", "tools/dbc_codegen.py")
     generators = "CMakeToolchain", "CMakeDeps"
 
     @property
@@ -86,6 +86,14 @@ class libhal_canrouter_conan(ConanFile):
              "*.hpp",
              dst=os.path.join(self.package_folder, "include"),
              src=os.path.join(self.source_folder, "include"))
+        copy(self,
+             "*.cmake",
+             dst=os.path.join(self.package_folder, "cmake"),
+             src=os.path.join(self.source_folder, "cmake"))
+        copy(self,
+             "dbc_codegen.py",
+             dst=os.path.join(self.package_folder, "cmake"),
+             src=os.path.join(self.source_folder, "tools"))
 
         cmake = CMake(self)
         cmake.install()
@@ -93,3 +101,9 @@ class libhal_canrouter_conan(ConanFile):
     def package_info(self):
         self.cpp_info.libs = ["libhal-canrouter"]
         self.cpp_info.set_property("cmake_target_name", "libhal::canrouter")
+        self.cpp_info.builddirs = ["cmake"]
+        self.cpp_info.set_property("cmake_build_modules",
+                                   ["cmake/libhal-canrouter-dbc.cmake"])
+        if self.settings.os == "Linux":
+            # The SocketCAN adapter runs a receive thread
+            self.cpp_info.system_libs = ["pthread"]
@@ -0,0 +1,249 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include <libhal/can.hpp>
+#include <libhal/error.hpp>
+
+#include "can_router.hpp"
+
+namespace hal {
+/**
+ * @brief An (ID, mask) hardware acceptance filter
+ *
+ * A frame is accepted when the bits of its ID selected by the mask equal the
+ * same bits of the filter's ID. As `can::message_t` has no extended flag, IDs
+ * above 0x7FF are considered extended and standard and extended IDs never
+ * share a filter.
+ */
+struct can_acceptance_filter
+{
+  static constexpr can::id_t standard_mask = 0x7FF;
+  static constexpr can::id_t extended_mask = 0x1FFF'FFFF;
+
+  can::id_t id = 0;
+  can::id_t mask = standard_mask;
+  bool extended = false;
+
+  /**
+   * @brief Filter that accepts exactly one ID
+   *
+   * @param p_id - ID to accept
+   * @return constexpr can_acceptance_filter - exact match filter
+   */
+  static constexpr can_acceptance_filter exact(can::id_t p_id)
+  {
+    const bool extended = p_id > standard_mask;
+    return { .id = p_id,
+             .mask = extended ? extended_mask : standard_mask,
+             .extended = extended };
+  }
+
+  /**
+   * @brief Determine if the filter accepts an ID
+   *
+   * @param p_id - ID of a received frame
+   * @return true - the frame passes this filter
+   * @return false - the frame is rejected by this filter
+   */
+  [[nodiscard]] constexpr bool matches(can::id_t p_id) const
+  {
+    return (p_id > standard_mask) == extended && (p_id & mask) == (id & mask);
+  }
+
+  /**
+   * @brief Number of distinct IDs that pass the filter
+   *
+   * @return constexpr std::uint64_t - size of the accepted ID space
+   */
+  [[nodiscard]] constexpr std::uint64_t accepted_ids() const
+  {
+    const auto width = extended ? 29 : 11;
+    const auto fixed = std::popcount(mask & (extended ? extended_mask
+                                                      : standard_mask));
+    return std::uint64_t{ 1 } << (width - fixed);
+  }
+};
+
+/**
+ * @brief Hardware acceptance filter banks of a CAN peripheral
+ *
+ * Implemented by platform drivers whose controller can drop frames in
+ * hardware before they reach the receive interrupt.
+ */
+class can_filter_bank
+{
+public:
+  /**
+   * @brief Number of (ID, mask) filters the hardware provides
+   *
+   * @return std::size_t - filter count
+   */
+  [[nodiscard]] std::size_t capacity()
+  {
+    return driver_capacity();
+  }
+
+  /**
+   * @brief Replace every hardware filter
+   *
+   * Frames matching any filter are accepted, all other frames are dropped.
+   * Unused banks must be disabled.
+   *
+   * @param p_filters - filters to install, no more than `capacity()`
+   * @return status - success or failure
+   */
+  [[nodiscard]] status program(
+    std::span<const can_acceptance_filter> p_filters)
+  {
+    return driver_program(p_filters);
+  }
+
+  virtual ~can_filter_bank() = default;
+
+private:
+  virtual std::size_t driver_capacity() = 0;
+  virtual status driver_program(
+    std::span<const can_acceptance_filter> p_filters) = 0;
+};
+
+/**
+ * @brief Compute a small set of acceptance filters covering a set of IDs
+ *
+ * IDs are added one at a time. While there are free banks each ID gets an
+ * exact filter. Once the banks are full, the two filters (counting the new
+ * ID's exact filter) whose merge adds the fewest falsely accepted IDs are
+ * merged, and filters made redundant by the merge are dropped. Every added ID
+ * is always accepted; only the false accept rate depends on the bank count.
+ *
+ * Runs in O(banks^2) per ID using only the caller's storage, so it can run on
+ * the target whenever the route table changes.
+ */
+class can_filter_optimizer
+{
+public:
+  /**
+   * @brief Construct a new optimizer
+   *
+   * @param p_filters - one element per available hardware filter bank. Must
+   * outlive the optimizer.
+   */
+  explicit can_filter_optimizer(std::span<can_acceptance_filter> p_filters);
+
+  /**
+   * @brief Make sure an ID passes the filters
+   *
+   * @param p_id - ID to accept
+   * @return status - std::errc::not_enough_memory if there are no banks, or
+   * if a single bank would have to hold both standard and extended IDs
+   */
+  [[nodiscard]] status add(can::id_t p_id);
+
+  /**
+   * @brief Make sure every ID in a list passes the filters
+   *
+   * @param p_ids - IDs to accept
+   * @return status - error from `add()`
+   */
+  [[nodiscard]] status add(std::span<const can::id_t> p_ids);
+
+  /**
+   * @brief Make sure every ID from p_first to p_last passes the filters
+   *
+   * The range is split into aligned power of two blocks, each taking one
+   * masked filter, so ranges such as the 128 COB-IDs of a CANopen function
+   * code take a single bank.
+   *
+   * @param p_first - first ID to accept
+   * @param p_last - last ID to accept, inclusive
+   * @return status - std::errc::invalid_argument if p_first is above p_last,
+   * or the error from `add()`
+   */
+  [[nodiscard]] status add_range(can::id_t p_first, can::id_t p_last);
+
+  /**
+   * @brief Add the ID of every route in a router
+   *
+   * Only routes are added. Components that receive frames through taps, such
+   * as `canopen_dispatcher` and `can_liveness_monitor`, have no routes, so
+   * their IDs must be added with `add(std::span)` or `add_range()` or the
+   * hardware will drop their frames. `can_bus_load_estimator` only sees the
+   * frames that pass the filters.
+   *
+   * @param p_router - router whose routes must be accepted
+   * @return status - error from `add()`
+   */
+  [[nodiscard]] status add(can_router& p_router);
+
+  /**
+   * @brief Remove every filter
+   *
+   */
+  void clear();
+
+  /**
+   * @brief Filters that accept every added ID
+   *
+   * @return std::span<const can_acceptance_filter> - filters in use
+   */
+  [[nodiscard]] std::span<const can_acceptance_filter> filters() const
+  {
+    return m_filters.first(m_used);
+  }
+
+  /**
+   * @brief Number of IDs accepted by the filters
+   *
+   * @return std::uint64_t - accepted IDs, counting overlapping filters once
+   * per filter
+   */
+  [[nodiscard]] std::uint64_t accepted_ids() const;
+
+private:
+  [[nodiscard]] status insert(const can_acceptance_filter& p_candidate);
+
+  std::span<can_acceptance_filter> m_filters;
+  std::size_t m_used = 0;
+};
+
+/**
+ * @brief Program a filter bank to accept every route of a router
+ *
+ * Frames consumed only by taps are dropped by the programmed filters. When
+ * taps need frames without routes, fill a `can_filter_optimizer` with the
+ * router and the tap IDs instead and program its filters:
+ *
+ *     hal::can_filter_optimizer optimizer(storage);
+ *     HAL_CHECK(optimizer.add(router));
+ *     // CANopen heartbeats of every node
+ *     HAL_CHECK(optimizer.add_range(0x700, 0x77F));
+ *     HAL_CHECK(bank.program(optimizer.filters()));
+ *
+ * @param p_router - router whose routes must be accepted
+ * @param p_bank - hardware filters to program
+ * @param p_storage - working storage, at least `p_bank.capacity()` elements
+ * for the best result
+ * @return status - error from the optimizer or the filter bank
+ */
+[[nodiscard]] status can_program_filters(
+  can_router& p_router,
+  can_filter_bank& p_bank,
+  std::span<can_acceptance_filter> p_storage);
+}  // namespace hal
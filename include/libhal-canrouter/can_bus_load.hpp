@@ -0,0 +1,168 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <libhal/can.hpp>
+#include <libhal/steady_clock.hpp>
+#include <libhal/units.hpp>
+
+#include "can_router.hpp"
+
+namespace hal {
+/**
+ * @brief Number of bits a classic CAN data or remote frame occupies on the bus
+ *
+ * Includes the start of frame, arbitration, control, data, CRC, ACK and end of
+ * frame fields plus the 3 bit interframe space. Stuff bits are estimated using
+ * the worst case bound for the stuffed region of the frame, so bus load
+ * computed from this value is conservative. IDs above 0x7FF are counted as
+ * extended frames.
+ *
+ * @param p_message - message to measure
+ * @return constexpr std::uint32_t - bits on the wire, including stuffing
+ */
+constexpr std::uint32_t can_frame_bits(const can::message_t& p_message)
+{
+  constexpr std::uint32_t standard_overhead = 47;
+  constexpr std::uint32_t standard_stuffable = 34;
+  constexpr std::uint32_t extended_overhead = 67;
+  constexpr std::uint32_t extended_stuffable = 54;
+
+  const bool extended = p_message.id > 0x7FF;
+  const std::uint32_t length = p_message.length > 8 ? 8 : p_message.length;
+  const std::uint32_t data_bits = p_message.is_remote_request ? 0 : length * 8;
+  const std::uint32_t overhead =
+    extended ? extended_overhead : standard_overhead;
+  const std::uint32_t stuffable =
+    (extended ? extended_stuffable : standard_stuffable) + data_bits;
+
+  return overhead + data_bits + ((stuffable - 1) / 4);
+}
+
+/**
+ * @brief Sliding window bus load and frame rate estimator
+ *
+ * Add the estimator to a can_router as a tap to count every frame received
+ * and every frame sent through `can_router::bus()`:
+ *
+ *     auto tap = router.add_tap(std::ref(estimator));
+ *
+ * Frames dropped by hardware acceptance filters never reach the router, so
+ * with filters programmed the estimate covers only the accepted traffic.
+ *
+ * The window is split into a fixed number of slots, so memory use is
+ * constant and recording a frame is a handful of arithmetic operations.
+ * Queries cover the most recent full window, or the time since construction
+ * if a full window has not elapsed yet.
+ *
+ * Recording and querying both modify the window. Query from the same context
+ * as the receive interrupt or with the receive interrupt masked.
+ */
+class can_bus_load_estimator
+{
+public:
+  static constexpr std::size_t window_slots = 16;
+
+  /**
+   * @brief Construct a new bus load estimator
+   *
+   * @param p_clock - clock used to place frames into the window
+   * @param p_baud_rate - nominal bit rate of the bus
+   * @param p_window - length of the sliding window
+   */
+  can_bus_load_estimator(hal::steady_clock& p_clock,
+                         hal::hertz p_baud_rate,
+                         hal::time_duration p_window);
+
+  /**
+   * @brief Record a message as a can_router tap
+   *
+   * @param p_message - message seen by the router
+   * @param p_direction - unused, received and sent frames are both counted
+   */
+  void operator()(const can::message_t& p_message,
+                  can_router::direction p_direction);
+
+  /**
+   * @brief Record a frame that occupied the bus
+   *
+   * @param p_message - frame to count
+   */
+  void record(const can::message_t& p_message);
+
+  /**
+   * @brief Percentage of bus time occupied by frames within the window
+   *
+   * @return float - bus load from 0.0f to 100.0f. May exceed 100 when the
+   * worst case stuffing estimate overshoots on a saturated bus.
+   */
+  [[nodiscard]] float load();
+
+  /**
+   * @brief Average frame rate within the window
+   *
+   * @return float - frames per second
+   */
+  [[nodiscard]] float frames_per_second();
+
+  /**
+   * @brief Total number of frames recorded since construction
+   *
+   * @return std::uint64_t - frame count
+   */
+  [[nodiscard]] std::uint64_t total_frames() const
+  {
+    return m_total_frames;
+  }
+
+  /**
+   * @brief Total number of bits recorded since construction
+   *
+   * @return std::uint64_t - bit count including estimated stuffing
+   */
+  [[nodiscard]] std::uint64_t total_bits() const
+  {
+    return m_total_bits;
+  }
+
+private:
+  struct slot
+  {
+    std::uint32_t bits = 0;
+    std::uint32_t frames = 0;
+  };
+
+  /// Expire slots that have left the window and return the current tick
+  std::uint64_t advance();
+  /// Seconds covered by the window at p_now
+  [[nodiscard]] float window_seconds(std::uint64_t p_now) const;
+
+  hal::steady_clock* m_clock;
+  hal::hertz m_clock_frequency;
+  hal::hertz m_baud_rate;
+  std::uint64_t m_slot_ticks;
+  std::uint64_t m_start_tick;
+  std::uint64_t m_current_slot;
+  std::array<slot, window_slots> m_slots{};
+  std::uint32_t m_window_bits = 0;
+  std::uint32_t m_window_frames = 0;
+  std::uint64_t m_total_bits = 0;
+  std::uint64_t m_total_frames = 0;
+};
+}  // namespace hal
@@ -0,0 +1,269 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+
+#include <libhal/can.hpp>
+#include <libhal/error.hpp>
+#include <libhal/functional.hpp>
+#include <libhal/units.hpp>
+
+#include "can_router.hpp"
+
+/**
+ * Binary CAN capture format
+ *
+ * A capture is a 16 byte header followed by a stream of records. All multi
+ * byte fields are little endian.
+ *
+ * Header:
+ *
+ *     [magic "HCAP": 4] [version: u16] [header size: u16]
+ *     [tick frequency in Hz: u32] [reserved: u32]
+ *
+ * Record:
+ *
+ *     [timestamp delta: LEB128 varint] [bus index: u8] [flags: u8]
+ *     [id: u16 or u32] [payload: length bytes]
+ *
+ * The timestamp delta is the number of ticks since the previous record, or
+ * since tick 0 for the first record. The flags byte holds the length in bits
+ * 0-3, extended ID in bit 4, remote request in bit 5 and transmit direction
+ * in bit 6. Extended frames carry a 4 byte ID, standard frames 2 bytes.
+ * Remote frames carry no payload.
+ */
+namespace hal {
+struct can_capture_record
+{
+  can::message_t message;
+  /// Absolute time of the frame in capture ticks
+  std::uint64_t timestamp = 0;
+  /// Index of the bus the frame was seen on
+  std::uint8_t bus = 0;
+  can_router::direction direction = can_router::direction::receive;
+};
+
+struct can_capture_format
+{
+  static constexpr std::array<hal::byte, 4> magic = { 'H', 'C', 'A', 'P' };
+  static constexpr std::uint16_t version = 1;
+  static constexpr std::size_t header_size = 16;
+  static constexpr std::size_t max_record_size = 10 + 1 + 1 + 4 + 8;
+};
+
+/**
+ * @brief Append-only writer for the binary capture format
+ *
+ * Records are encoded into a caller supplied buffer and handed to the sink in
+ * large blocks, so the sink (a file, flash, a network socket) is called once
+ * per buffer rather than once per frame. Writing is not meant for interrupt
+ * context; feed it from the application loop or a deferred queue.
+ */
+class can_capture_writer
+{
+public:
+  using sink = hal::callback<hal::status(std::span<const hal::byte> p_data)>;
+
+  /**
+   * @brief Create a capture writer
+   *
+   * The header is placed in the buffer immediately and reaches the sink with
+   * the first flush.
+   *
+   * @param p_buffer - staging buffer, must hold at least
+   * `can_capture_format::max_record_size` bytes. Must outlive the writer.
+   * @param p_tick_frequency - frequency of record timestamps in Hz
+   * @param p_sink - destination for encoded blocks
+   * @return result<can_capture_writer> - writer or std::errc::invalid_argument
+   * if the buffer is too small
+   */
+  static result<can_capture_writer> create(std::span<hal::byte> p_buffer,
+                                           std::uint32_t p_tick_frequency,
+                                           sink p_sink);
+
+  /**
+   * @brief Append a record to the capture
+   *
+   * Records must be written in timestamp order.
+   *
+   * @param p_record - record to append
+   * @return status - error from the sink if a flush was needed and failed
+   */
+  [[nodiscard]] status write(const can_capture_record& p_record);
+
+  /**
+   * @brief Hand every buffered byte to the sink
+   *
+   * @return status - error from the sink
+   */
+  [[nodiscard]] status flush();
+
+  /**
+   * @brief Number of records written since creation
+   *
+   * @return std::uint64_t - record count
+   */
+  [[nodiscard]] std::uint64_t records() const
+  {
+    return m_records;
+  }
+
+private:
+  can_capture_writer(std::span<hal::byte> p_buffer, sink p_sink);
+
+  std::span<hal::byte> m_buffer;
+  sink m_sink;
+  std::size_t m_used = 0;
+  std::uint64_t m_last_timestamp = 0;
+  std::uint64_t m_records = 0;
+};
+
+/**
+ * @brief Zero-copy reader for the binary capture format
+ *
+ * Decodes records directly out of the capture bytes, such as a memory mapped
+ * file, without copying or allocating.
+ */
+class can_capture_reader
+{
+public:
+  /**
+   * @brief Create a reader over a complete capture
+   *
+   * @param p_capture - capture bytes starting at the header. Must outlive the
+   * reader.
+   * @return result<can_capture_reader> - reader or std::errc::invalid_argument
+   * if the header is missing or unsupported
+   */
+  static result<can_capture_reader> create(
+    std::span<const hal::byte> p_capture);
+
+  /**
+   * @brief Frequency of record timestamps
+   *
+   * @return std::uint32_t - ticks per second
+   */
+  [[nodiscard]] std::uint32_t tick_frequency() const
+  {
+    return m_tick_frequency;
+  }
+
+  /**
+   * @brief Decode the next record
+   *
+   * @param p_record - destination for the decoded record
+   * @return true - a record was decoded
+   * @return false - end of capture reached, or the last record is truncated
+   */
+  [[nodiscard]] bool next(can_capture_record& p_record);
+
+  /**
+   * @brief Determine if reading stopped on an incomplete record
+   *
+   * @return true - the capture ends in the middle of a record
+   * @return false - the capture ended cleanly or has not been fully read
+   */
+  [[nodiscard]] bool truncated() const
+  {
+    return m_truncated;
+  }
+
+  /**
+   * @brief Start reading again from the first record
+   *
+   */
+  void rewind();
+
+  /**
+   * @brief Feed every remaining record to a callable
+   *
+   * For replaying into a router:
+   *
+   *     reader.for_each([&router](const can_capture_record& p_record) {
+   *       router(p_record.message);
+   *     });
+   *
+   * @tparam F - callable with signature void(const can_capture_record&)
+   * @param p_handler - called once per record
+   * @return std::size_t - number of records decoded
+   */
+  template<typename F>
+  std::size_t for_each(F&& p_handler)
+  {
+    std::size_t count = 0;
+    can_capture_record record{};
+    while (next(record)) {
+      p_handler(record);
+      count++;
+    }
+    return count;
+  }
+
+private:
+  can_capture_reader(std::span<const hal::byte> p_capture,
+                     std::uint32_t p_tick_frequency);
+
+  std::span<const hal::byte> m_capture;
+  std::size_t m_position;
+  std::uint64_t m_timestamp = 0;
+  std::uint32_t m_tick_frequency;
+  bool m_truncated = false;
+};
+
+/**
+ * @brief Parse one line of a candump log
+ *
+ * Accepts the `candump -l` log format, for example:
+ *
+ *     (1436509052.249713) can0 123#11223344
+ *     (1436509052.249800) can1 18FEF100#R
+ *
+ * Remote frames may carry a length digit after the `R`. As `can::message_t`
+ * has no extended flag, IDs above 0x7FF are considered extended.
+ *
+ * @param p_line - a single line without the trailing newline
+ * @param p_tick_frequency - tick frequency to convert the timestamp into
+ * @param p_interface - if not null, set to the interface name in p_line
+ * @return std::optional<can_capture_record> - decoded frame with bus index 0,
+ * or std::nullopt if the line is not a valid frame
+ */
+std::optional<can_capture_record> parse_candump(
+  std::string_view p_line,
+  std::uint32_t p_tick_frequency,
+  std::string_view* p_interface = nullptr);
+
+/**
+ * @brief Format a record as one line of a candump log
+ *
+ * The inverse of `parse_candump()`. No newline is appended.
+ *
+ * @param p_record - frame to format
+ * @param p_interface - interface name to print for the frame
+ * @param p_tick_frequency - tick frequency of the record's timestamp
+ * @param p_buffer - destination for the text
+ * @return std::string_view - formatted text within p_buffer, or empty if
+ * p_buffer is too small
+ */
+std::string_view format_candump(const can_capture_record& p_record,
+                                std::string_view p_interface,
+                                std::uint32_t p_tick_frequency,
+                                std::span<char> p_buffer);
+}  // namespace hal
@@ -0,0 +1,109 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+
+#include <libhal/can.hpp>
+#include <libhal/steady_clock.hpp>
+#include <libhal/units.hpp>
+
+#include "can_router.hpp"
+
+namespace hal {
+/**
+ * @brief Only pass frames along when their contents change
+ *
+ * Status frames are often sent periodically with the same payload. Wrapping
+ * a route handler in a change filter drops repeats, so the handler only runs
+ * when the data actually changes:
+ *
+ *     hal::can_change_filter on_change(handle_status);
+ *     auto route = router.add_message_callback(0x210, std::ref(on_change));
+ *
+ * A frame is a repeat when its length, remote request flag and the payload
+ * bytes within its length equal the last frame passed on. The comparison is
+ * a single 64-bit compare of the payload.
+ *
+ * Given a clock and a maximum silence, a repeat is still passed on once that
+ * much time has elapsed since the last frame passed on, so the handler is
+ * refreshed even when nothing changes.
+ */
+class can_change_filter
+{
+public:
+  /**
+   * @brief Construct a filter that passes on changes only
+   *
+   * @param p_handler - handler for changed frames
+   */
+  explicit can_change_filter(can_router::message_handler p_handler);
+
+  /**
+   * @brief Construct a filter that passes on changes and periodic refreshes
+   *
+   * @param p_handler - handler for changed frames
+   * @param p_clock - clock used to measure silence
+   * @param p_max_silence - longest time without passing a frame on
+   */
+  can_change_filter(can_router::message_handler p_handler,
+                    hal::steady_clock& p_clock,
+                    hal::time_duration p_max_silence);
+
+  /**
+   * @brief Pass a frame to the handler if it differs from the last one
+   *
+   * @param p_message - frame received for the route
+   */
+  void operator()(const can::message_t& p_message);
+
+  /**
+   * @brief Pass the next frame on regardless of its contents
+   *
+   */
+  void reset();
+
+  /**
+   * @brief Number of frames passed to the handler
+   *
+   * @return std::uint32_t - dispatched frame count
+   */
+  [[nodiscard]] std::uint32_t passed() const
+  {
+    return m_passed;
+  }
+
+  /**
+   * @brief Number of repeated frames dropped
+   *
+   * @return std::uint32_t - suppressed frame count
+   */
+  [[nodiscard]] std::uint32_t suppressed() const
+  {
+    return m_suppressed;
+  }
+
+private:
+  can_router::message_handler m_handler;
+  hal::steady_clock* m_clock = nullptr;
+  std::uint64_t m_max_silence_ticks = 0;
+  std::uint64_t m_last_tick = 0;
+  std::uint64_t m_last_payload = 0;
+  std::uint32_t m_passed = 0;
+  std::uint32_t m_suppressed = 0;
+  /// Length and remote flag of the last frame, or a value no frame can have
+  std::uint16_t m_last_header = 0xFFFF;
+};
+}  // namespace hal
@@ -0,0 +1,216 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+#include <libhal/can.hpp>
+#include <libhal/error.hpp>
+#include <libhal/functional.hpp>
+#include <libhal/steady_clock.hpp>
+#include <libhal/units.hpp>
+
+#include "can_router.hpp"
+#include "timer_wheel.hpp"
+
+namespace hal {
+/**
+ * @brief A request frame and how to recognize its response
+ */
+struct can_request
+{
+  /// Frame sent through the router's bus
+  hal::can::message_t message{};
+  /// ID the response arrives on
+  hal::can::id_t response_id = 0;
+  /// If set, the response must also hold this value in the correlator's token
+  /// byte. Allows several requests to be outstanding on one response ID.
+  std::optional<hal::byte> token{};
+  /// Time to wait for the response before reporting a timeout
+  hal::time_duration timeout{};
+};
+
+/**
+ * @brief Match responses to outstanding requests of query-reply protocols
+ *
+ * Protocols such as UDS and XCP send a request on one ID and reply on
+ * another. The correlator sends requests through the router's bus and keeps
+ * each in a fixed table keyed on the response ID and an optional token byte of
+ * the response payload. Install the correlator as the handler of every
+ * response ID:
+ *
+ *     std::array<hal::can_correlator::pending_request, 16> table;
+ *     hal::can_correlator correlator(router, clock, 1ms, table);
+ *     auto route = router.add_message_callback(0x7E8, std::ref(correlator));
+ *
+ *     HAL_CHECK(correlator.request(
+ *       { .message = read_vin, .response_id = 0x7E8, .timeout = 50ms },
+ *       on_vin,
+ *       on_no_reply));
+ *
+ * Each received frame is looked up with at most two hash probes, one for a
+ * request with the frame's token and one for a request without a token, so the
+ * cost does not grow with the number of outstanding requests. Timeouts are
+ * kept in a timer wheel and reported by `poll()`. Nothing is allocated after
+ * construction.
+ *
+ * A request is removed from the table before its callback runs, so callbacks
+ * may issue follow-up requests. `request()`, `poll()` and the receive path all
+ * modify the table. Call them from the same context as the receive interrupt
+ * or with the receive interrupt masked.
+ *
+ * The correlator cannot be moved or copied.
+ */
+class can_correlator
+{
+public:
+  using response_handler = hal::callback<hal::can::handler>;
+  using timeout_handler = hal::callback<void()>;
+
+  /**
+   * @brief Storage for one outstanding request
+   *
+   * Only constructed by the caller as the correlator's table.
+   */
+  class pending_request : public timer_wheel::timer
+  {
+  public:
+    pending_request() = default;
+    pending_request(pending_request& p_other) = delete;
+    pending_request& operator=(pending_request& p_other) = delete;
+    ~pending_request() = default;
+
+  private:
+    friend class can_correlator;
+
+    response_handler m_on_response = can_router::noop;
+    timeout_handler m_on_timeout = []() {};
+    /// Next request in the same hash bucket or in the free list
+    pending_request* m_next = nullptr;
+    /// Head of the hash bucket with the same index as this entry
+    pending_request* m_bucket = nullptr;
+    hal::can::id_t m_response_id = 0;
+    hal::byte m_token = 0;
+    bool m_has_token = false;
+  };
+
+  /**
+   * @brief Construct a new correlator
+   *
+   * @param p_router - router whose bus requests are sent on
+   * @param p_clock - clock used to time out requests
+   * @param p_resolution - granularity of timeouts. Timeouts are reported
+   * between the request timeout and the timeout plus this resolution after the
+   * request is sent, not counting how often `poll()` is called.
+   * @param p_table - storage for outstanding requests, which also sets the
+   * maximum number of them
+   * @param p_token_byte - index of the token byte in response payloads
+   */
+  can_correlator(can_router& p_router,
+                 hal::steady_clock& p_clock,
+                 hal::time_duration p_resolution,
+                 std::span<pending_request> p_table,
+                 std::uint8_t p_token_byte = 0);
+
+  can_correlator(can_correlator& p_other) = delete;
+  can_correlator& operator=(can_correlator& p_other) = delete;
+  ~can_correlator();
+
+  /**
+   * @brief Send a request and wait for its response
+   *
+   * @param p_request - request frame and its response key
+   * @param p_on_response - called with the response frame
+   * @param p_on_timeout - called from `poll()` if no response arrives in time
+   * @return status - std::errc::resource_unavailable_try_again if the table is
+   * full, std::errc::device_or_resource_busy if a request with the same
+   * response key is already outstanding, or the error from sending the frame.
+   * No callback is called for a request that returns an error.
+   */
+  [[nodiscard]] status request(const can_request& p_request,
+                               response_handler p_on_response,
+                               timeout_handler p_on_timeout = []() {});
+
+  /**
+   * @brief Abandon an outstanding request without calling its callbacks
+   *
+   * @param p_response_id - response ID of the request
+   * @param p_token - token of the request, if it has one
+   * @return true - the request was outstanding and has been removed
+   * @return false - no such request was outstanding
+   */
+  bool cancel(hal::can::id_t p_response_id,
+              std::optional<hal::byte> p_token = std::nullopt);
+
+  /**
+   * @brief Complete the outstanding request that a frame responds to
+   *
+   * Frames that match no outstanding request are counted by `unmatched()`.
+   *
+   * @param p_message - frame received on a response ID
+   */
+  void operator()(const can::message_t& p_message);
+
+  /**
+   * @brief Report every request whose timeout has passed
+   *
+   * Should be called periodically, at least as often as the resolution for
+   * prompt detection.
+   */
+  void poll();
+
+  /**
+   * @brief Number of requests waiting for a response
+   *
+   * @return std::size_t - outstanding request count
+   */
+  [[nodiscard]] std::size_t outstanding() const
+  {
+    return m_outstanding;
+  }
+
+  /**
+   * @brief Number of received frames that matched no outstanding request
+   *
+   * @return std::uint32_t - unmatched frame count
+   */
+  [[nodiscard]] std::uint32_t unmatched() const
+  {
+    return m_unmatched;
+  }
+
+private:
+  [[nodiscard]] std::uint64_t current_tick();
+  [[nodiscard]] pending_request*& bucket(hal::can::id_t p_id,
+                                         std::optional<hal::byte> p_token);
+  [[nodiscard]] pending_request** find(hal::can::id_t p_id,
+                                       std::optional<hal::byte> p_token);
+  void release(pending_request** p_link);
+
+  can_router* m_router;
+  hal::steady_clock* m_clock;
+  std::uint64_t m_clock_ticks_per_tick;
+  hal::time_duration m_resolution;
+  std::span<pending_request> m_table;
+  timer_wheel m_wheel;
+  pending_request* m_free = nullptr;
+  std::size_t m_outstanding = 0;
+  std::uint32_t m_unmatched = 0;
+  std::uint8_t m_token_byte;
+};
+}  // namespace hal
@@ -0,0 +1,164 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+
+#include <libhal/can.hpp>
+#include <libhal/functional.hpp>
+#include <libhal/steady_clock.hpp>
+#include <libhal/units.hpp>
+
+#include "can_router.hpp"
+#include "timer_wheel.hpp"
+
+namespace hal {
+/**
+ * @brief Detect periodic CAN messages that have stopped arriving
+ *
+ * Each monitored route is a regular can_router route with an expected period.
+ * Every received frame re-arms that route's deadline in a hierarchical timer
+ * wheel, which is a constant time operation no matter how many IDs are being
+ * monitored. When `poll()` observes that a deadline has passed, the timeout
+ * handler is called with the ID of the silent route. A route reports a
+ * timeout once per silence; the next frame for that ID arms it again.
+ *
+ * `poll()` and the can_router receive path both modify the timer wheel. Call
+ * `poll()` from the same context as the receive interrupt or with the
+ * receive interrupt masked.
+ *
+ * The monitor cannot be moved or copied once routes have been added to it.
+ */
+class can_deadline_monitor
+{
+public:
+  using timeout_handler = hal::callback<void(hal::can::id_t p_id)>;
+
+  /**
+   * @brief A can_router route with a receive deadline
+   *
+   * Removes its route from the router and its deadline from the monitor when
+   * destroyed. Cannot be moved, so it must be stored directly in the variable
+   * it was returned into.
+   */
+  class monitored_route : public timer_wheel::timer
+  {
+  public:
+    monitored_route(monitored_route& p_other) = delete;
+    monitored_route& operator=(monitored_route& p_other) = delete;
+    ~monitored_route();
+
+    /**
+     * @brief ID of the messages this route monitors
+     *
+     * @return hal::can::id_t - monitored ID
+     */
+    [[nodiscard]] hal::can::id_t id() const
+    {
+      return m_id;
+    }
+
+    /**
+     * @brief Determine if this route is currently past its deadline
+     *
+     * @return true - the deadline expired and no message has arrived since
+     * @return false - a message was received within the expected period
+     */
+    [[nodiscard]] bool timed_out() const
+    {
+      return !pending();
+    }
+
+    /**
+     * @brief Number of times this route has missed its deadline
+     *
+     * @return std::uint32_t - timeout count
+     */
+    [[nodiscard]] std::uint32_t timeouts() const
+    {
+      return m_timeouts;
+    }
+
+  private:
+    friend class can_deadline_monitor;
+
+    monitored_route(can_deadline_monitor& p_monitor,
+                    can_router& p_router,
+                    hal::can::id_t p_id,
+                    std::uint64_t p_period,
+                    can_router::message_handler p_handler);
+
+    can_deadline_monitor* m_monitor;
+    std::uint64_t m_period;
+    hal::can::id_t m_id;
+    std::uint32_t m_timeouts = 0;
+    can_router::route_item m_route;
+  };
+
+  /**
+   * @brief Construct a new deadline monitor
+   *
+   * @param p_clock - clock used to timestamp message arrival and deadlines
+   * @param p_resolution - granularity of deadlines. Timeouts are reported
+   * between one period and one period plus this resolution after the last
+   * message, not counting how often `poll()` is called.
+   * @param p_on_timeout - called from `poll()` with the ID of each route that
+   * has missed its deadline
+   */
+  can_deadline_monitor(hal::steady_clock& p_clock,
+                       hal::time_duration p_resolution,
+                       timeout_handler p_on_timeout);
+
+  can_deadline_monitor(can_deadline_monitor& p_other) = delete;
+  can_deadline_monitor& operator=(can_deadline_monitor& p_other) = delete;
+
+  /**
+   * @brief Add a route to the router with an expected receive period
+   *
+   * The deadline is armed immediately, so an ID that never arrives is reported
+   * one period after this call.
+   *
+   * @param p_router - router to add the route to
+   * @param p_id - ID of the periodic message
+   * @param p_period - maximum time allowed between messages
+   * @param p_handler - callback to be executed when a p_id message is received
+   * @return monitored_route - route that must be stored in a variable
+   */
+  [[nodiscard]] monitored_route watch(
+    can_router& p_router,
+    hal::can::id_t p_id,
+    hal::time_duration p_period,
+    can_router::message_handler p_handler = can_router::noop);
+
+  /**
+   * @brief Report every route whose deadline has passed
+   *
+   * Should be called periodically, at least as often as the resolution for
+   * prompt detection. Work is proportional to elapsed resolution ticks and the
+   * number of expired routes, not the number of monitored routes.
+   */
+  void poll();
+
+private:
+  [[nodiscard]] std::uint64_t current_tick();
+  void rearm(monitored_route& p_route);
+
+  hal::steady_clock* m_clock;
+  std::uint64_t m_clock_ticks_per_tick;
+  hal::time_duration m_resolution;
+  timer_wheel m_wheel;
+  timeout_handler m_on_timeout;
+};
+}  // namespace hal
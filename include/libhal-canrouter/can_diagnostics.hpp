@@ -0,0 +1,383 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include <libhal/can.hpp>
+#include <libhal/error.hpp>
+#include <libhal/functional.hpp>
+#include <libhal/steady_clock.hpp>
+#include <libhal/units.hpp>
+
+#include "can_router.hpp"
+
+/**
+ * CAN diagnostics protocol
+ *
+ * A client asks for a snapshot by sending a frame whose first payload byte is
+ * a command to the request ID:
+ *
+ *     0x01 - take a snapshot and stream it
+ *     0x02 - stop streaming the current snapshot
+ *
+ * The server answers on the response ID with a stream of chunks, one classic
+ * frame each:
+ *
+ *     [control: u8] [snapshot bytes: 1 to 7]
+ *
+ * The control byte holds a sequence number in bits 0-5, counting from 0 at
+ * the first chunk of each snapshot and wrapping after 63, the last chunk flag
+ * in bit 6 and the first chunk flag in bit 7. A snapshot is a sequence of
+ * records. All multi byte fields are little endian.
+ *
+ *     begin:    [0x00] [version: u8] [flags: u8]
+ *     route:    [0x01] [id: u32] [hits: u32]
+ *     counter:  [0x02] [key: u8] [value: u32]
+ *     queue:    [0x03] [index: u8] [high-water mark: u16] [capacity: u16]
+ *               [dropped: u32]
+ *     bus load: [0x04] [load in 0.01%: u16] [frames per second: u32]
+ *
+ * The begin record is always first, and bit 0 of its flags is set when the
+ * snapshot did not fit the server's buffer and later records are missing.
+ * Counter key 0 holds the number of frames that matched no route, the other
+ * keys are chosen by the application.
+ */
+namespace hal {
+struct can_diagnostics_format
+{
+  static constexpr std::uint8_t version = 1;
+  static constexpr hal::byte request_snapshot = 0x01;
+  static constexpr hal::byte request_cancel = 0x02;
+  static constexpr hal::byte sequence_mask = 0x3F;
+  static constexpr hal::byte last_chunk = 0x40;
+  static constexpr hal::byte first_chunk = 0x80;
+  static constexpr std::size_t chunk_size = 7;
+  static constexpr hal::byte truncated_flag = 0x01;
+  static constexpr std::uint8_t unrouted_counter = 0;
+  static constexpr std::size_t begin_size = 3;
+  static constexpr std::size_t route_size = 9;
+  static constexpr std::size_t counter_size = 6;
+  static constexpr std::size_t queue_size = 10;
+  static constexpr std::size_t bus_load_size = 7;
+};
+
+enum class can_diagnostics_record_type : hal::byte
+{
+  begin = 0x00,
+  route = 0x01,
+  counter = 0x02,
+  queue = 0x03,
+  bus_load = 0x04,
+};
+
+/**
+ * @brief One decoded snapshot record
+ *
+ * Only the fields of the record's type are set, the rest are zero.
+ */
+struct can_diagnostics_record
+{
+  can_diagnostics_record_type type = can_diagnostics_record_type::begin;
+  /// Protocol version of a begin record
+  std::uint8_t version = 0;
+  /// Begin record of a snapshot that is missing records
+  bool truncated = false;
+  /// ID of a route record
+  hal::can::id_t id = 0;
+  /// Counter key or queue index
+  std::uint8_t key = 0;
+  /// Hits of a route, value of a counter or frames dropped by a queue
+  std::uint32_t count = 0;
+  /// Most frames a queue has held at once
+  std::uint16_t high_water = 0;
+  /// Frames a queue can hold
+  std::uint16_t capacity = 0;
+  /// Bus load in percent
+  float load = 0.0f;
+  /// Frames on the bus per second
+  std::uint32_t frames_per_second = 0;
+};
+
+/**
+ * @brief Records appended to a snapshot by the application
+ *
+ * Records that do not fit the server's buffer are left out and the snapshot
+ * is marked as truncated.
+ */
+class can_diagnostics_report
+{
+public:
+  /**
+   * @brief Add an application defined counter
+   *
+   * @param p_key - key of the counter, 1 to 255
+   * @param p_value - value of the counter
+   */
+  void counter(std::uint8_t p_key, std::uint32_t p_value);
+
+  /**
+   * @brief Add the statistics of a queue
+   *
+   *     p_report.queue(0,
+   *                    dispatcher.high_water(0),
+   *                    dispatcher_capacity,
+   *                    dispatcher.dropped());
+   *
+   * @param p_index - queue number chosen by the application
+   * @param p_high_water - most elements the queue has held at once, saturated
+   * at 65535
+   * @param p_capacity - elements the queue can hold, saturated at 65535
+   * @param p_dropped - elements lost because the queue was full
+   */
+  void queue(std::uint8_t p_index,
+             std::size_t p_high_water,
+             std::size_t p_capacity,
+             std::uint32_t p_dropped);
+
+  /**
+   * @brief Add the bus load, such as from a can_bus_load_estimator
+   *
+   * @param p_load - bus load in percent, saturated at 655.35
+   * @param p_frames_per_second - frame rate
+   */
+  void bus_load(float p_load, float p_frames_per_second);
+
+  /**
+   * @brief Determine if a record did not fit the snapshot
+   *
+   * @return true - at least one record was left out
+   * @return false - every record fit
+   */
+  [[nodiscard]] bool truncated() const
+  {
+    return m_truncated;
+  }
+
+private:
+  friend class can_diagnostics_server;
+
+  explicit can_diagnostics_report(std::span<hal::byte> p_buffer);
+
+  void begin();
+  void route(hal::can::id_t p_id, std::uint32_t p_hits);
+  [[nodiscard]] hal::byte* reserve(can_diagnostics_record_type p_type,
+                                   std::size_t p_size);
+
+  std::span<hal::byte> m_buffer;
+  std::size_t m_used = 0;
+  bool m_truncated = false;
+};
+
+/**
+ * @brief Answer diagnostic requests over CAN with router statistics
+ *
+ * For units whose only port is the CAN bus. On request the server takes a
+ * snapshot of the router's route table with the hits of every route, the
+ * number of unrouted frames and any statistics added by the application's
+ * report handler, then streams it on the response ID through
+ * `can_router::bus()`:
+ *
+ *     std::array<hal::byte, 512> buffer;
+ *     hal::can_diagnostics_server diagnostics(
+ *       router, clock, 0x7F0, 0x7F1, 2ms, buffer,
+ *       [&](hal::can_diagnostics_report& p_report) {
+ *         p_report.bus_load(load.load(), load.frames_per_second());
+ *         p_report.queue(
+ *           0, dispatcher.high_water(0), 32, dispatcher.dropped());
+ *       });
+ *     while (true) {
+ *       (void)diagnostics.poll();
+ *     }
+ *
+ * The receive path only notes the request. Snapshots are taken and chunks
+ * sent from `poll()` in the application loop, at most one chunk per chunk
+ * interval, so a snapshot never takes more of the bus than the interval
+ * allows regardless of how many routes there are. Use a response ID of low
+ * priority so that chunks lose arbitration to control traffic.
+ *
+ * Route hits and the report handler are read from the application loop
+ * while frames may be counted in the receive interrupt, so a snapshot is a
+ * close approximation rather than an atomic copy.
+ */
+class can_diagnostics_server
+{
+public:
+  using report_handler =
+    hal::callback<void(can_diagnostics_report& p_report)>;
+
+  /**
+   * @brief Construct a new diagnostics server
+   *
+   * @param p_router - router to report on and to send chunks through
+   * @param p_clock - clock used to pace chunks
+   * @param p_request_id - ID of request frames
+   * @param p_response_id - ID of response chunks
+   * @param p_chunk_interval - shortest time between two chunks
+   * @param p_buffer - storage for a snapshot, 9 bytes per route plus the
+   * application's records. Must outlive the server. A buffer too small for
+   * even the begin record gets a begin record marked as truncated and
+   * nothing else.
+   * @param p_report - called while taking a snapshot to add application
+   * statistics
+   */
+  can_diagnostics_server(can_router& p_router,
+                         hal::steady_clock& p_clock,
+                         hal::can::id_t p_request_id,
+                         hal::can::id_t p_response_id,
+                         hal::time_duration p_chunk_interval,
+                         std::span<hal::byte> p_buffer,
+                         report_handler p_report = {});
+
+  can_diagnostics_server(can_diagnostics_server& p_other) = delete;
+  can_diagnostics_server& operator=(can_diagnostics_server& p_other) =
+    delete;
+
+  /**
+   * @brief Handle requests and send the next chunk when it is due
+   *
+   * Call from the application loop. A chunk that fails to send is sent again
+   * on a later call.
+   *
+   * @return status - error from the bus if a chunk failed to send
+   */
+  [[nodiscard]] status poll();
+
+  /**
+   * @brief Determine if a snapshot is being streamed
+   *
+   * @return true - chunks of a snapshot remain to be sent
+   * @return false - idle
+   */
+  [[nodiscard]] bool streaming() const
+  {
+    return m_streaming;
+  }
+
+  /**
+   * @brief Number of snapshots streamed completely
+   *
+   * @return std::uint32_t - snapshot count
+   */
+  [[nodiscard]] std::uint32_t snapshots() const
+  {
+    return m_snapshots;
+  }
+
+private:
+  void request(const can::message_t& p_message);
+  void take_snapshot();
+
+  can_router* m_router;
+  hal::steady_clock* m_clock;
+  hal::can::id_t m_response_id;
+  std::uint64_t m_chunk_interval;
+  std::span<hal::byte> m_buffer;
+  report_handler m_report;
+  /// Snapshot being streamed, in m_buffer or m_truncated_begin
+  std::span<const hal::byte> m_snapshot{};
+  /// Sent when the buffer cannot hold even the begin record
+  std::array<hal::byte, can_diagnostics_format::begin_size> m_truncated_begin{};
+  std::size_t m_sent = 0;
+  std::uint64_t m_last_chunk = 0;
+  std::uint32_t m_snapshots = 0;
+  /// Last command received, written by the receive path only
+  std::atomic<hal::byte> m_command = 0;
+  /// Number of commands received, written by the receive path only
+  std::atomic<std::uint32_t> m_commands = 0;
+  /// Number of commands handled by `poll()`
+  std::uint32_t m_commands_handled = 0;
+  std::uint8_t m_sequence = 0;
+  bool m_streaming = false;
+  bool m_chunk_sent = false;
+  can_router::route_item m_route;
+};
+
+/**
+ * @brief Reassemble snapshots from response chunks
+ *
+ * Feed every frame seen on the response ID in order. Snapshots with a
+ * missing or repeated chunk are discarded.
+ */
+class can_diagnostics_decoder
+{
+public:
+  /**
+   * @brief Construct a new decoder
+   *
+   * @param p_buffer - storage for one snapshot. Must outlive the decoder.
+   */
+  explicit can_diagnostics_decoder(std::span<hal::byte> p_buffer);
+
+  /**
+   * @brief Add a chunk to the snapshot being reassembled
+   *
+   * @param p_chunk - frame received on the response ID
+   * @return true - the chunk completed a snapshot, available from
+   * `snapshot()` until the next call
+   * @return false - more chunks are needed
+   */
+  [[nodiscard]] bool feed(const can::message_t& p_chunk);
+
+  /**
+   * @brief Bytes of the last completed snapshot
+   *
+   * @return std::span<const hal::byte> - snapshot, for `parse()`
+   */
+  [[nodiscard]] std::span<const hal::byte> snapshot() const
+  {
+    return m_buffer.first(m_complete ? m_used : 0);
+  }
+
+  /**
+   * @brief Number of snapshots discarded because of lost chunks or lack of
+   * space
+   *
+   * @return std::uint32_t - discarded snapshot count
+   */
+  [[nodiscard]] std::uint32_t discarded() const
+  {
+    return m_discarded;
+  }
+
+  /**
+   * @brief Decode every record of a snapshot
+   *
+   * @param p_snapshot - bytes of a complete snapshot
+   * @param p_handler - called once per record, in order
+   * @return true - every record was decoded
+   * @return false - the snapshot ends in the middle of a record or holds an
+   * unknown record type. Records before it were passed to p_handler.
+   */
+  static bool parse(
+    std::span<const hal::byte> p_snapshot,
+    const hal::callback<void(const can_diagnostics_record& p_record)>&
+      p_handler);
+
+private:
+  void discard();
+
+  std::span<hal::byte> m_buffer;
+  std::size_t m_used = 0;
+  std::uint32_t m_discarded = 0;
+  std::uint8_t m_sequence = 0;
+  bool m_receiving = false;
+  bool m_complete = false;
+};
+}  // namespace hal
@@ -0,0 +1,162 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <span>
+#include <utility>
+
+#include <libhal/can.hpp>
+#include <libhal/error.hpp>
+#include <libhal/functional.hpp>
+#include <libhal/units.hpp>
+
+namespace hal {
+/**
+ * @brief Payload length in bytes for a CAN FD data length code
+ *
+ * @param p_dlc - data length code, 0 to 15
+ * @return constexpr std::uint8_t - payload length, 0 to 64
+ */
+constexpr std::uint8_t can_fd_dlc_to_length(std::uint8_t p_dlc)
+{
+  constexpr std::array<std::uint8_t, 16> lengths = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64,
+  };
+  return lengths[p_dlc & 0x0F];
+}
+
+/**
+ * @brief Smallest CAN FD data length code that holds a payload
+ *
+ * @param p_length - payload length in bytes, clamped to 64
+ * @return constexpr std::uint8_t - data length code, 0 to 15
+ */
+constexpr std::uint8_t can_fd_length_to_dlc(std::uint8_t p_length)
+{
+  std::uint8_t dlc = 0;
+  while (dlc < 15 && can_fd_dlc_to_length(dlc) < p_length) {
+    dlc++;
+  }
+  return dlc;
+}
+
+/**
+ * @brief CAN FD peripheral control interface
+ *
+ * Mirrors `hal::can` for controllers that send and receive frames with up to
+ * 64 byte payloads. FD controllers also deliver classic frames through this
+ * interface with `fd_format` cleared.
+ */
+class can_fd
+{
+public:
+  struct settings
+  {
+    /// Bit rate of the arbitration phase
+    hertz baud_rate = 500.0e3f;
+    /// Bit rate of the data phase of frames sent with bit rate switching
+    hertz data_baud_rate = 2.0e6f;
+  };
+
+  using id_t = can::id_t;
+
+  struct message_t
+  {
+    id_t id;
+    std::array<hal::byte, 64> payload{};
+    /// Payload length in bytes, one of the lengths a DLC can encode
+    std::uint8_t length = 0;
+    /// Frame uses the FD format, otherwise it is a classic frame
+    bool fd_format = true;
+    /// Data phase is sent at the data bit rate (BRS)
+    bool bit_rate_switch = false;
+    /// Transmitter is error passive (ESI)
+    bool error_state_indicator = false;
+    /// Classic frames only, FD frames have no remote request
+    bool is_remote_request = false;
+
+    /**
+     * @brief Bytes of the payload that are part of the frame
+     *
+     * @return std::span<const hal::byte> - the first `length` payload bytes
+     */
+    [[nodiscard]] std::span<const hal::byte> data() const
+    {
+      return { payload.data(), std::min<std::size_t>(length, 64) };
+    }
+  };
+
+  struct send_t
+  {};
+
+  using handler = void(const message_t& p_message);
+
+  /**
+   * @brief Configure the bit rates of the bus
+   *
+   * @param p_settings - arbitration and data phase bit rates
+   * @return status - success or failure
+   */
+  [[nodiscard]] status configure(const settings& p_settings)
+  {
+    return driver_configure(p_settings);
+  }
+
+  /**
+   * @brief Take the peripheral out of bus off and rejoin the bus
+   *
+   * @return status - success or failure
+   */
+  [[nodiscard]] status bus_on()
+  {
+    return driver_bus_on();
+  }
+
+  /**
+   * @brief Send a frame
+   *
+   * @param p_message - frame to send
+   * @return result<send_t> - success or failure
+   */
+  [[nodiscard]] result<send_t> send(const message_t& p_message)
+  {
+    return driver_send(p_message);
+  }
+
+  /**
+   * @brief Set the handler for received frames
+   *
+   * The handler receives a reference to the driver's frame buffer, valid only
+   * for the duration of the call.
+   *
+   * @param p_handler - called from the receive interrupt for every frame
+   */
+  void on_receive(hal::callback<handler> p_handler)
+  {
+    driver_on_receive(std::move(p_handler));
+  }
+
+  virtual ~can_fd() = default;
+
+private:
+  virtual status driver_configure(const settings& p_settings) = 0;
+  virtual status driver_bus_on() = 0;
+  virtual result<send_t> driver_send(const message_t& p_message) = 0;
+  virtual void driver_on_receive(hal::callback<handler> p_handler) = 0;
+};
+}  // namespace hal
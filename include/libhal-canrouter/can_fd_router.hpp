@@ -0,0 +1,102 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <libhal-util/static_list.hpp>
+
+#include "can_fd.hpp"
+
+namespace hal {
+/**
+ * @brief Route CAN FD frames received on an FD bus to callbacks based on ID.
+ *
+ * The FD counterpart of `can_router`. Handlers receive a reference to the
+ * frame delivered by the driver, so the 64 byte payload is never copied
+ * during dispatch; use `can_fd::message_t::data()` for the valid bytes. The
+ * classic `can_router` is unchanged and keeps its 8 byte message path.
+ */
+class can_fd_router
+{
+public:
+  static constexpr auto noop =
+    []([[maybe_unused]] const can_fd::message_t& p_message) {};
+
+  using message_handler = hal::callback<hal::can_fd::handler>;
+
+  struct route
+  {
+    hal::can_fd::id_t id = 0;
+    message_handler handler = noop;
+  };
+
+  using route_item = static_list<route>::item;
+
+  static result<can_fd_router> create(hal::can_fd& p_can);
+
+  /**
+   * @brief Construct a new CAN FD message router
+   *
+   * @param p_can - CAN FD peripheral to route messages for
+   */
+  explicit can_fd_router(hal::can_fd& p_can);
+
+  can_fd_router() = delete;
+  can_fd_router(can_fd_router& p_other) = delete;
+  can_fd_router& operator=(can_fd_router& p_other) = delete;
+  can_fd_router& operator=(can_fd_router&& p_other) noexcept;
+  can_fd_router(can_fd_router&& p_other) noexcept;
+  ~can_fd_router();
+
+  /**
+   * @brief Get a reference to the CAN FD peripheral driver
+   *
+   * @return can_fd& reference to the CAN FD peripheral driver
+   */
+  [[nodiscard]] hal::can_fd& bus();
+
+  /**
+   * @brief Set a callback for when messages with a specific ID is received
+   *
+   * @param p_id - Associated ID of messages to be stored.
+   * @param p_handler - callback to be executed when a p_id message is received.
+   * @return route_item - route item from the linked list that must be stored
+   * in a variable
+   */
+  [[nodiscard]] route_item add_message_callback(
+    hal::can_fd::id_t p_id,
+    message_handler p_handler = noop);
+
+  /**
+   * @brief Get the list of handlers
+   *
+   * @return const static_list<route>& list of all of the message handlers.
+   */
+  [[nodiscard]] const static_list<route>& handlers();
+
+  /**
+   * @brief Message routing interrupt service handler
+   *
+   * Searches the static list and finds the first ID associated with the message
+   * and run's that route's callback.
+   *
+   * @param p_message - message received from the bus
+   */
+  void operator()(const can_fd::message_t& p_message);
+
+private:
+  static_list<route> m_handlers{};
+  hal::can_fd* m_can = nullptr;
+};
+}  // namespace hal
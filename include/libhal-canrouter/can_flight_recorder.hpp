@@ -0,0 +1,252 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include <libhal/can.hpp>
+#include <libhal/functional.hpp>
+#include <libhal/steady_clock.hpp>
+#include <libhal/units.hpp>
+
+#include "can_router.hpp"
+
+namespace hal {
+/**
+ * @brief Record the most recent CAN traffic into a fixed size buffer
+ *
+ * Add the recorder to a can_router as a tap to capture every frame before it
+ * is routed, along with frames sent through `can_router::bus()`:
+ *
+ *     auto tap = router.add_tap(std::ref(recorder));
+ *
+ * Frames are stored in a byte ring supplied by the caller. When the ring is
+ * full the oldest frames are overwritten. Each frame is encoded compactly:
+ *
+ *     [flags] [timestamp delta varint] [id: 2 or 4 bytes] [payload: length]
+ *
+ * The flags byte holds the length in bits 0-3, extended ID in bit 4, remote
+ * request in bit 5 and transmit direction in bit 6. Timestamps are stored as
+ * the LEB128 encoded number of clock ticks since the previous frame, so a
+ * frame with a short payload takes a fraction of the 24 bytes a
+ * `can::message_t` plus a 64-bit timestamp would need.
+ *
+ * As a tap, the recorder stamps frames with its own clock by default. The
+ * router's receive timestamps are in ticks of the router's clock or of the
+ * driver's hardware timer, which need not match the recorder's clock. When
+ * they do match, construct the recorder with `timestamp_source::router` to
+ * record when frames arrived rather than when they were routed.
+ *
+ * Recording a frame touches at most `max_record_size` bytes for the new frame
+ * plus a bounded number of oldest frames that must be overwritten, so the
+ * per-frame cost is bounded. The longest time spent in `record()` is
+ * measured with the clock and available from `worst_case_record_ticks()`.
+ *
+ * On a fault, call `freeze()` to stop recording, then `dump()` to read the
+ * captured traffic from oldest to newest.
+ */
+class can_flight_recorder
+{
+public:
+  /// Largest encoding of a single frame in bytes
+  static constexpr std::size_t max_record_size = 1 + 10 + 4 + 8;
+
+  struct record_t
+  {
+    can::message_t message;
+    can_router::direction direction;
+    /// Clock ticks at which the frame was received, or recorded if the
+    /// receive time was not known
+    std::uint64_t timestamp;
+  };
+
+  using dump_handler = hal::callback<void(const record_t& p_record)>;
+
+  /// Timestamps recorded for frames seen as a can_router tap
+  enum class timestamp_source : std::uint8_t
+  {
+    /// Ticks of the recorder's clock when the tap runs
+    recorder_clock,
+    /// The router's receive timestamp, which must be in ticks of the
+    /// recorder's clock. Frames without one use the recorder's clock.
+    router,
+  };
+
+  /**
+   * @brief Construct a new flight recorder
+   *
+   * @param p_clock - clock used to timestamp frames
+   * @param p_buffer - storage for encoded frames. Must outlive the recorder.
+   * @param p_source - timestamps to record for frames seen as a tap
+   */
+  can_flight_recorder(
+    hal::steady_clock& p_clock,
+    std::span<hal::byte> p_buffer,
+    timestamp_source p_source = timestamp_source::recorder_clock);
+
+  /**
+   * @brief Record a message as a can_router tap
+   *
+   * @param p_message - message seen by the router
+   * @param p_direction - whether the message was received or sent
+   */
+  void operator()(const can::message_t& p_message,
+                  can_router::direction p_direction);
+
+  /**
+   * @brief Record a timestamped message as a can_router tap
+   *
+   * @param p_message - message seen by the router
+   * @param p_direction - whether the message was received or sent
+   * @param p_timestamp - receive time of the message from the router, or 0
+   * if unknown. Only recorded with `timestamp_source::router`, otherwise
+   * the current time is recorded.
+   */
+  void operator()(const can::message_t& p_message,
+                  can_router::direction p_direction,
+                  std::uint64_t p_timestamp);
+
+  /**
+   * @brief Record a frame into the ring
+   *
+   * Does nothing while the recorder is frozen.
+   *
+   * @param p_message - frame to record
+   * @param p_direction - whether the message was received or sent
+   */
+  void record(
+    const can::message_t& p_message,
+    can_router::direction p_direction = can_router::direction::receive);
+
+  /**
+   * @brief Record a frame into the ring with a known timestamp
+   *
+   * Does nothing while the recorder is frozen. Timestamps earlier than the
+   * newest recorded frame, which happen when a timestamped frame is routed
+   * after later frames, are recorded as the time of the newest frame.
+   *
+   * @param p_message - frame to record
+   * @param p_direction - whether the message was received or sent
+   * @param p_timestamp - time of the frame in ticks of the recorder's clock
+   */
+  void record(const can::message_t& p_message,
+              can_router::direction p_direction,
+              std::uint64_t p_timestamp);
+
+  /**
+   * @brief Stop recording so that the captured traffic can be read out
+   *
+   */
+  void freeze();
+
+  /**
+   * @brief Continue recording after a freeze
+   *
+   */
+  void resume();
+
+  /**
+   * @brief Determine if the recorder is frozen
+   *
+   * @return true - frames are currently being ignored
+   * @return false - frames are being recorded
+   */
+  [[nodiscard]] bool frozen() const
+  {
+    return m_frozen;
+  }
+
+  /**
+   * @brief Discard every recorded frame
+   *
+   */
+  void clear();
+
+  /**
+   * @brief Decode every recorded frame from oldest to newest
+   *
+   * Freeze the recorder first if frames could be recorded concurrently.
+   *
+   * @param p_handler - called once per frame
+   */
+  void dump(const dump_handler& p_handler) const;
+
+  /**
+   * @brief Number of frames currently held in the ring
+   *
+   * @return std::size_t - frame count
+   */
+  [[nodiscard]] std::size_t size() const
+  {
+    return m_count;
+  }
+
+  /**
+   * @brief Number of bytes of the ring holding frames
+   *
+   * @return std::size_t - bytes used
+   */
+  [[nodiscard]] std::size_t bytes_used() const
+  {
+    return m_used;
+  }
+
+  /**
+   * @brief Number of frames lost to make room for newer frames
+   *
+   * @return std::uint32_t - overwritten frame count
+   */
+  [[nodiscard]] std::uint32_t overwritten() const
+  {
+    return m_overwritten;
+  }
+
+  /**
+   * @brief Longest time a single call to `record()` has taken
+   *
+   * @return std::uint64_t - duration in clock ticks
+   */
+  [[nodiscard]] std::uint64_t worst_case_record_ticks() const
+  {
+    return m_worst_case_record_ticks;
+  }
+
+private:
+  [[nodiscard]] std::size_t wrap(std::size_t p_position) const;
+  [[nodiscard]] std::size_t record_size(std::size_t p_position) const;
+  [[nodiscard]] std::uint64_t read_delta(std::size_t p_position,
+                                         std::size_t* p_length) const;
+  void drop_oldest();
+  void encode(const can::message_t& p_message,
+              can_router::direction p_direction,
+              std::uint64_t p_timestamp,
+              std::uint64_t p_start);
+
+  hal::steady_clock* m_clock;
+  std::span<hal::byte> m_buffer;
+  timestamp_source m_source;
+  std::size_t m_head = 0;
+  std::size_t m_tail = 0;
+  std::size_t m_used = 0;
+  std::size_t m_count = 0;
+  std::uint64_t m_tail_timestamp = 0;
+  std::uint64_t m_head_timestamp = 0;
+  std::uint64_t m_worst_case_record_ticks = 0;
+  std::uint32_t m_overwritten = 0;
+  bool m_frozen = false;
+};
+}  // namespace hal
@@ -0,0 +1,203 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include <libhal/can.hpp>
+#include <libhal/functional.hpp>
+#include <libhal/steady_clock.hpp>
+#include <libhal/units.hpp>
+
+#include "can_router.hpp"
+
+namespace hal {
+/**
+ * @brief Measure route handlers against an execution time budget
+ *
+ * Each budgeted handler wraps a route handler, timestamps it with the clock
+ * before and after it runs and records the worst duration seen. Runs longer
+ * than the handler's budget are overruns, which are counted per handler and
+ * logged by ID into a fixed diagnostics table supplied by the caller. Use a
+ * steady_clock backed by a cycle counter for sub-microsecond budgets.
+ *
+ *     std::array<hal::can_handler_budget::overrun_record, 8> table;
+ *     hal::can_handler_budget budget(cycle_clock, table);
+ *     auto parse = budget.wrap(parse_status, 20us);
+ *     auto route = router.add_message_callback(0x200, std::ref(parse));
+ *
+ * A handler can demote itself after repeated overruns, for example by moving
+ * its can_priority_dispatcher route to deferred dispatch:
+ *
+ *     auto slow = budget.wrap(build_report, 50us);
+ *     auto route = dispatcher.add(router, 0x300, std::ref(slow));
+ *     slow.demote_after(3, [&route]() {
+ *       route.set_dispatch_class(hal::can_dispatch_class::deferred);
+ *     });
+ *
+ * Costs two clock reads, a subtraction and two compares per frame when the
+ * budget is met. The budget and its handlers must be used from one context
+ * at a time, normally the receive ISR.
+ */
+class can_handler_budget
+{
+public:
+  /**
+   * @brief Diagnostics table entry for an ID whose handler overran
+   */
+  struct overrun_record
+  {
+    /// ID of the frame whose handler overran
+    hal::can::id_t id = 0;
+    /// Number of overruns for this ID
+    std::uint32_t overruns = 0;
+    /// Longest handler run for this ID in clock ticks
+    std::uint64_t worst_ticks = 0;
+  };
+
+  /**
+   * @brief Route handler with an execution time budget
+   *
+   * Install in a route with std::ref so that its statistics stay observable.
+   */
+  class budgeted_handler
+  {
+  public:
+    /**
+     * @brief Run the handler and check its duration against the budget
+     *
+     * @param p_message - frame received for the route
+     */
+    void operator()(const can::message_t& p_message);
+
+    /**
+     * @brief Call a demotion callback once after repeated overruns
+     *
+     * @param p_overruns - number of overruns that trigger the demotion, 0
+     * disables demotion
+     * @param p_demote - called once, from the context running the handler,
+     * when this handler's overrun count reaches p_overruns
+     */
+    void demote_after(std::uint32_t p_overruns, hal::callback<void()> p_demote);
+
+    /**
+     * @brief Number of runs that exceeded the budget
+     *
+     * @return std::uint32_t - overrun count
+     */
+    [[nodiscard]] std::uint32_t overruns() const
+    {
+      return m_overruns;
+    }
+
+    /**
+     * @brief Longest run of the handler, whether or not it overran
+     *
+     * @return std::uint64_t - worst case duration in clock ticks
+     */
+    [[nodiscard]] std::uint64_t worst_ticks() const
+    {
+      return m_worst_ticks;
+    }
+
+    /**
+     * @brief Determine if the demotion callback has been called
+     *
+     * @return true - overrun count reached the demotion threshold
+     * @return false - handler has not been demoted
+     */
+    [[nodiscard]] bool demoted() const
+    {
+      return m_demoted;
+    }
+
+  private:
+    friend class can_handler_budget;
+
+    budgeted_handler(can_handler_budget& p_budget,
+                     can_router::message_handler p_handler,
+                     std::uint64_t p_budget_ticks);
+
+    can_handler_budget* m_budget;
+    can_router::message_handler m_handler;
+    hal::callback<void()> m_demote;
+    std::uint64_t m_budget_ticks;
+    std::uint64_t m_worst_ticks = 0;
+    std::uint32_t m_overruns = 0;
+    std::uint32_t m_demote_after = 0;
+    bool m_demoted = false;
+  };
+
+  /**
+   * @brief Construct a new handler budget
+   *
+   * @param p_clock - clock used to time handlers
+   * @param p_table - storage for the diagnostics table, one entry per ID that
+   * overruns. Overruns of further IDs are only counted by `unrecorded()`.
+   */
+  can_handler_budget(hal::steady_clock& p_clock,
+                     std::span<overrun_record> p_table);
+
+  can_handler_budget(can_handler_budget& p_other) = delete;
+  can_handler_budget& operator=(can_handler_budget& p_other) = delete;
+
+  /**
+   * @brief Wrap a route handler with an execution time budget
+   *
+   * @param p_handler - handler to time
+   * @param p_budget - longest time the handler may run without an overrun
+   * @return budgeted_handler - handler to install in a route
+   */
+  [[nodiscard]] budgeted_handler wrap(can_router::message_handler p_handler,
+                                      hal::time_duration p_budget);
+
+  /**
+   * @brief IDs whose handlers have overrun, in order of first overrun
+   *
+   * @return std::span<const overrun_record> - used diagnostics table entries
+   */
+  [[nodiscard]] std::span<const overrun_record> records() const
+  {
+    return m_table.first(m_used);
+  }
+
+  /**
+   * @brief Overruns of IDs that did not fit in the diagnostics table
+   *
+   * @return std::uint32_t - overruns missing from `records()`
+   */
+  [[nodiscard]] std::uint32_t unrecorded() const
+  {
+    return m_unrecorded;
+  }
+
+  /**
+   * @brief Empty the diagnostics table
+   *
+   * Per handler statistics are unaffected.
+   */
+  void clear();
+
+private:
+  void record(hal::can::id_t p_id, std::uint64_t p_ticks);
+
+  hal::steady_clock* m_clock;
+  std::span<overrun_record> m_table;
+  std::size_t m_used = 0;
+  std::uint32_t m_unrecorded = 0;
+};
+}  // namespace hal
@@ -0,0 +1,354 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#include <libhal/can.hpp>
+#include <libhal/steady_clock.hpp>
+
+#include "can_router.hpp"
+
+namespace hal {
+/**
+ * @brief Log-scale histograms of route handler latency and duration
+ *
+ * Each timed handler wraps a route handler and records two values per frame
+ * in clock ticks: the latency from the frame's receive timestamp to the
+ * start of the handler, and the duration of the handler. Give the router the
+ * same clock so that receive timestamps are taken on ISR entry, or use a
+ * driver whose hardware timestamps count in the same ticks:
+ *
+ *     hal::can_router router(can, cycle_clock);
+ *     hal::can_latency_histogram<> control(cycle_clock);
+ *     auto torque = control.wrap(router, on_torque_request);
+ *     auto route = router.add_message_callback(0x050, std::ref(torque));
+ *
+ * Wrap the handlers of several routes with one histogram to measure a
+ * priority class as a whole. Deferred routes of a can_priority_dispatcher
+ * take their receive timestamp from the dispatcher instead:
+ *
+ *     auto report = background.wrap(dispatcher, build_report);
+ *     auto route = dispatcher.add(
+ *       router, 0x300, std::ref(report), hal::can_dispatch_class::deferred);
+ *
+ * Bucket 0 to 3 hold exactly 0 to 3 ticks. Above that every power of two is
+ * split into four buckets, so a bucket is at most 25% wide relative to its
+ * lower bound, and the last bucket also holds everything longer. Frames
+ * without a receive timestamp only record their duration.
+ *
+ * A frame costs two clock reads, two bucket lookups and two counter updates.
+ * Counters are only written by the context running the handlers, one context
+ * per histogram, with relaxed atomic loads and stores. `snapshot()` and
+ * `reset()` can be called from any other single context without stopping
+ * the writer. With Enabled false the timed handlers only forward to the
+ * wrapped handler and the histogram holds no counters, so measurements can
+ * be compiled out of release builds without changing the code using them.
+ *
+ * @tparam Buckets - number of buckets, a multiple of 4 of at least 8. With
+ * 64 buckets the last bucket starts at 114,688 ticks.
+ * @tparam Enabled - false to compile every measurement out
+ */
+template<std::size_t Buckets = 64, bool Enabled = true>
+class can_latency_histogram
+{
+public:
+  static_assert(Buckets >= 8 && Buckets % 4 == 0,
+                "Buckets must be a multiple of 4 of at least 8");
+  static_assert(Buckets <= 4 * 63, "Bucket bounds must fit in 64 bits");
+
+  /**
+   * @brief Counts of one measured value, per bucket
+   */
+  struct distribution
+  {
+    std::array<std::uint32_t, Buckets> buckets{};
+
+    /**
+     * @brief Number of values recorded
+     *
+     * @return std::uint64_t - sum of every bucket
+     */
+    [[nodiscard]] std::uint64_t count() const
+    {
+      std::uint64_t total = 0;
+      for (const auto bucket : buckets) {
+        total += bucket;
+      }
+      return total;
+    }
+
+    /**
+     * @brief Upper bound of the values at a fraction of the distribution
+     *
+     * For example `percentile(0.99f) < 100us_in_ticks` proves that 99% of
+     * frames were handled within 100us.
+     *
+     * @param p_fraction - fraction of values, from 0.0 to 1.0
+     * @return std::uint64_t - largest value the bucket holding that fraction
+     * of values can contain, 0 if nothing has been recorded
+     */
+    [[nodiscard]] std::uint64_t percentile(float p_fraction) const
+    {
+      const auto total = count();
+      if (total == 0) {
+        return 0;
+      }
+      const auto rank = static_cast<double>(p_fraction) * total;
+      std::uint64_t seen = 0;
+      for (std::size_t bucket = 0; bucket < Buckets; bucket++) {
+        seen += buckets[bucket];
+        if (seen != 0 && static_cast<double>(seen) >= rank) {
+          return upper_bound(bucket);
+        }
+      }
+      return upper_bound(Buckets - 1);
+    }
+  };
+
+  struct snapshot_t
+  {
+    /// Ticks from the receive timestamp to the start of the handler
+    distribution latency;
+    /// Ticks the handler ran for
+    distribution duration;
+  };
+
+  /**
+   * @brief Route handler measured into a histogram
+   *
+   * Install in a route with std::ref, or move it into the route.
+   */
+  class timed_handler
+  {
+  public:
+    /**
+     * @brief Run the handler and record its latency and duration
+     *
+     * @param p_message - frame received for the route
+     */
+    void operator()(const can::message_t& p_message)
+    {
+      if constexpr (Enabled) {
+        auto& clock = *m_histogram->m_clock;
+        const auto start = clock.uptime().ticks;
+        const auto received = m_receive_timestamp(m_source);
+        m_handler(p_message);
+        const auto stop = clock.uptime().ticks;
+        if (received != 0) {
+          m_histogram->m_latency.add(start > received ? start - received : 0);
+        }
+        m_histogram->m_duration.add(stop - start);
+      } else {
+        m_handler(p_message);
+      }
+    }
+
+  private:
+    friend class can_latency_histogram;
+
+    using timestamp_source = std::uint64_t (*)(const void* p_source);
+
+    timed_handler(can_latency_histogram& p_histogram,
+                  const void* p_source,
+                  timestamp_source p_receive_timestamp,
+                  can_router::message_handler p_handler)
+      : m_histogram(&p_histogram)
+      , m_source(p_source)
+      , m_receive_timestamp(p_receive_timestamp)
+      , m_handler(std::move(p_handler))
+    {
+    }
+
+    can_latency_histogram* m_histogram;
+    const void* m_source;
+    timestamp_source m_receive_timestamp;
+    can_router::message_handler m_handler;
+  };
+
+  /**
+   * @brief Construct a new latency histogram
+   *
+   * @param p_clock - clock used to time handlers, counting in the same ticks
+   * as the receive timestamps
+   */
+  explicit can_latency_histogram(hal::steady_clock& p_clock)
+    : m_clock(&p_clock)
+  {
+  }
+
+  can_latency_histogram(can_latency_histogram& p_other) = delete;
+  can_latency_histogram& operator=(can_latency_histogram& p_other) = delete;
+
+  /**
+   * @brief Wrap a route handler to measure it into this histogram
+   *
+   * @tparam Source - can_router, can_priority_dispatcher or any type with a
+   * `receive_timestamp()` member valid while the handler runs
+   * @param p_source - provides the receive timestamp of the frame being
+   * handled. Must outlive the returned handler.
+   * @param p_handler - handler to measure
+   * @return timed_handler - handler to install in a route
+   */
+  template<typename Source>
+  [[nodiscard]] timed_handler wrap(const Source& p_source,
+                                   can_router::message_handler p_handler)
+  {
+    return timed_handler(
+      *this,
+      &p_source,
+      [](const void* p_erased) -> std::uint64_t {
+        return static_cast<const Source*>(p_erased)->receive_timestamp();
+      },
+      std::move(p_handler));
+  }
+
+  /**
+   * @brief Copy the counts recorded since construction or the last reset
+   *
+   * @return snapshot_t - latency and duration distributions, empty when
+   * measurements are compiled out
+   */
+  [[nodiscard]] snapshot_t snapshot() const
+  {
+    snapshot_t result{};
+    if constexpr (Enabled) {
+      m_latency.copy(result.latency);
+      m_duration.copy(result.duration);
+    }
+    return result;
+  }
+
+  /**
+   * @brief Start counting again from zero
+   *
+   * Frames being recorded while resetting are counted either before or after
+   * the reset.
+   */
+  void reset()
+  {
+    if constexpr (Enabled) {
+      m_latency.reset();
+      m_duration.reset();
+    }
+  }
+
+  /**
+   * @brief Bucket a value in clock ticks is counted in
+   *
+   * @param p_ticks - measured value
+   * @return std::size_t - bucket index
+   */
+  [[nodiscard]] static constexpr std::size_t bucket_of(std::uint64_t p_ticks)
+  {
+    if (p_ticks < 4) {
+      return static_cast<std::size_t>(p_ticks);
+    }
+    // Four buckets per power of two, picked by the two bits below the
+    // leading one
+    const auto width = static_cast<std::size_t>(std::bit_width(p_ticks));
+    const auto fraction = (p_ticks >> (width - 3)) & 0b11;
+    const auto bucket = (width - 2) * 4 + static_cast<std::size_t>(fraction);
+    return bucket < Buckets ? bucket : Buckets - 1;
+  }
+
+  /**
+   * @brief Smallest value counted in a bucket
+   *
+   * @param p_bucket - bucket index
+   * @return std::uint64_t - lower bound in clock ticks
+   */
+  [[nodiscard]] static constexpr std::uint64_t lower_bound(
+    std::size_t p_bucket)
+  {
+    if (p_bucket < 4) {
+      return p_bucket;
+    }
+    const auto width = p_bucket / 4 + 2;
+    return (std::uint64_t{ 4 } + p_bucket % 4) << (width - 3);
+  }
+
+  /**
+   * @brief Largest value counted in a bucket
+   *
+   * @param p_bucket - bucket index
+   * @return std::uint64_t - upper bound in clock ticks, the maximum value for
+   * the last bucket
+   */
+  [[nodiscard]] static constexpr std::uint64_t upper_bound(
+    std::size_t p_bucket)
+  {
+    if (p_bucket + 1 >= Buckets) {
+      return std::numeric_limits<std::uint64_t>::max();
+    }
+    return lower_bound(p_bucket + 1) - 1;
+  }
+
+private:
+  /**
+   * @brief Bucket counters written by one context, and the counts at the
+   * last reset kept by the reader so the writer never has to be stopped
+   */
+  class counters
+  {
+  public:
+    void add(std::uint64_t p_ticks)
+    {
+      auto& counter = m_counts[bucket_of(p_ticks)];
+      // Only the context running the handlers writes counters, so a load
+      // and store is enough and avoids a read-modify-write.
+      counter.store(counter.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+    }
+
+    void copy(distribution& p_distribution) const
+    {
+      for (std::size_t bucket = 0; bucket < Buckets; bucket++) {
+        p_distribution.buckets[bucket] =
+          m_counts[bucket].load(std::memory_order_relaxed) -
+          m_baseline[bucket];
+      }
+    }
+
+    void reset()
+    {
+      for (std::size_t bucket = 0; bucket < Buckets; bucket++) {
+        m_baseline[bucket] = m_counts[bucket].load(std::memory_order_relaxed);
+      }
+    }
+
+  private:
+    std::array<std::atomic<std::uint32_t>, Buckets> m_counts{};
+    std::array<std::uint32_t, Buckets> m_baseline{};
+  };
+
+  /// Takes no space when measurements are compiled out
+  struct no_counters
+  {};
+
+  using counters_t = std::conditional_t<Enabled, counters, no_counters>;
+
+  hal::steady_clock* m_clock;
+  [[no_unique_address]] counters_t m_latency{};
+  [[no_unique_address]] counters_t m_duration{};
+};
+}  // namespace hal
@@ -0,0 +1,143 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include <libhal/can.hpp>
+#include <libhal/functional.hpp>
+#include <libhal/steady_clock.hpp>
+#include <libhal/units.hpp>
+
+#include "can_router.hpp"
+
+namespace hal {
+/**
+ * @brief Track which of many nodes are alive from their heartbeat frames
+ *
+ * The monitor watches a set of heartbeat IDs through a router tap, so the IDs
+ * need no routes of their own. Hardware filters computed from the route table
+ * drop them, so add the IDs with `can_filter_optimizer::add()` when
+ * programming filters. Each node is one compact entry holding its ID,
+ * the tick it was last seen and whether it is online. A frame from an offline
+ * node brings it online immediately. `poll()` checks a fixed number of nodes
+ * per call in round-robin order and takes silent nodes offline, so the work
+ * per poll stays the same no matter how many nodes are monitored:
+ *
+ *     std::array<hal::can_liveness_monitor::node, 3> nodes{ {
+ *       { .id = 0x701 }, { .id = 0x702 }, { .id = 0x710 },
+ *     } };
+ *     hal::can_liveness_monitor liveness(
+ *       router, clock, 1ms, 300ms, nodes, on_transition);
+ *
+ * A node is reported offline between the timeout and the timeout plus one
+ * resolution plus one full round-robin pass after its last frame. Nodes start
+ * offline and are reported online by their first frame.
+ *
+ * The transition handler is called from the receive path for online
+ * transitions and from `poll()` for offline transitions. Call `poll()` from
+ * the same context as the receive interrupt or with the receive interrupt
+ * masked.
+ *
+ * The monitor cannot be moved or copied.
+ */
+class can_liveness_monitor
+{
+public:
+  /**
+   * @brief Liveness of one monitored node
+   */
+  struct node
+  {
+    /// Heartbeat ID of the node, set by the caller
+    hal::can::id_t id = 0;
+    /// Tick of the last heartbeat, in units of the monitor's resolution
+    std::uint32_t last_seen = 0;
+    /// Whether the node's heartbeat has been received within the timeout
+    bool online = false;
+  };
+
+  using transition_handler =
+    hal::callback<void(hal::can::id_t p_id, bool p_online)>;
+
+  /**
+   * @brief Construct a new liveness monitor
+   *
+   * @param p_router - router whose received frames are monitored
+   * @param p_clock - clock used to timestamp heartbeats
+   * @param p_resolution - granularity of the last seen timestamps
+   * @param p_timeout - silence after which a node is considered offline
+   * @param p_nodes - nodes to monitor, with their IDs set. Sorted by ID by
+   * the constructor.
+   * @param p_on_transition - called with the ID of each node that comes
+   * online or goes offline
+   * @param p_checks_per_poll - number of nodes checked by each `poll()`
+   */
+  can_liveness_monitor(can_router& p_router,
+                       hal::steady_clock& p_clock,
+                       hal::time_duration p_resolution,
+                       hal::time_duration p_timeout,
+                       std::span<node> p_nodes,
+                       transition_handler p_on_transition,
+                       std::size_t p_checks_per_poll = 1);
+
+  can_liveness_monitor(can_liveness_monitor& p_other) = delete;
+  can_liveness_monitor& operator=(can_liveness_monitor& p_other) = delete;
+
+  /**
+   * @brief Take the next nodes in round-robin order offline if silent
+   *
+   * Should be called periodically. Checks the number of nodes given to the
+   * constructor each call.
+   */
+  void poll();
+
+  /**
+   * @brief Monitored nodes sorted by ID
+   *
+   * @return std::span<const node> - liveness of every monitored node
+   */
+  [[nodiscard]] std::span<const node> nodes() const
+  {
+    return m_nodes;
+  }
+
+  /**
+   * @brief Number of monitored nodes that are online
+   *
+   * @return std::size_t - online node count
+   */
+  [[nodiscard]] std::size_t online() const
+  {
+    return m_online;
+  }
+
+private:
+  void receive(const can::message_t& p_message);
+  [[nodiscard]] std::uint32_t current_tick();
+
+  hal::steady_clock* m_clock;
+  std::uint64_t m_clock_ticks_per_tick;
+  std::uint32_t m_timeout;
+  std::span<node> m_nodes;
+  transition_handler m_on_transition;
+  std::size_t m_checks_per_poll;
+  std::size_t m_cursor = 0;
+  std::size_t m_online = 0;
+  can_router::tap_item m_tap;
+};
+}  // namespace hal
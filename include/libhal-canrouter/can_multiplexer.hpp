@@ -0,0 +1,163 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <system_error>
+#include <utility>
+
+#include <libhal/can.hpp>
+#include <libhal/error.hpp>
+
+#include "can_router.hpp"
+#include "can_signal.hpp"
+
+namespace hal {
+/**
+ * @brief Dispatch multiplexed frames of one ID on their selector byte
+ *
+ * Multiplexed frames carry a selector in one payload byte that determines the
+ * layout of the rest of the payload. The multiplexer holds a table of
+ * sub-routes indexed directly by the selector value, so each frame reaches
+ * the one handler for its layout instead of every handler checking the
+ * selector itself. Install it as the handler of the ID's route:
+ *
+ *     hal::can_multiplexer<4> mux;
+ *     (void)mux.set_handler(0, handle_page_0);
+ *     (void)mux.set_handler(1, handle_page_1);
+ *     auto route = router.add_message_callback(0x300, std::ref(mux));
+ *
+ * Frames too short to hold the selector, with a selector of N or above, or
+ * with a selector that has no sub-route go to the fallback handler.
+ *
+ * @tparam N - number of selector values in the table, starting at 0
+ */
+template<std::size_t N>
+class can_multiplexer
+{
+public:
+  static_assert(N > 0 && N <= 256, "Selector is a single byte");
+
+  using message_handler = can_router::message_handler;
+
+  /**
+   * @brief Construct a new multiplexer
+   *
+   * @param p_selector_byte - index of the payload byte holding the selector
+   */
+  explicit can_multiplexer(std::uint8_t p_selector_byte = 0)
+    : m_selector_byte(p_selector_byte)
+  {
+  }
+
+  /**
+   * @brief Set the sub-route for a selector value
+   *
+   * @param p_selector - selector value
+   * @param p_handler - callback for frames with this selector
+   * @return status - std::errc::result_out_of_range if p_selector is not below
+   * N
+   */
+  [[nodiscard]] status set_handler(std::uint8_t p_selector,
+                                   message_handler p_handler)
+  {
+    if (p_selector >= N) {
+      return hal::new_error(std::errc::result_out_of_range);
+    }
+    m_handlers[p_selector] = std::move(p_handler);
+    return hal::success();
+  }
+
+  /**
+   * @brief Set a sub-route that receives frames decoded into a typed message
+   *
+   * @tparam T - message type satisfying can_message_layout
+   * @tparam F - callable with signature void(const T&)
+   * @param p_selector - selector value
+   * @param p_handler - callback for decoded frames with this selector
+   * @return status - std::errc::result_out_of_range if p_selector is not below
+   * N
+   */
+  template<can_message_layout T, typename F>
+  [[nodiscard]] status set_typed_handler(std::uint8_t p_selector,
+                                         F&& p_handler)
+  {
+    return set_handler(
+      p_selector,
+      [handler = std::forward<F>(p_handler)](const can::message_t& p_message) {
+        handler(can_decode<T>(p_message));
+      });
+  }
+
+  /**
+   * @brief Remove the sub-route for a selector value
+   *
+   * @param p_selector - selector value, ignored if not below N
+   */
+  void clear_handler(std::uint8_t p_selector)
+  {
+    if (p_selector < N) {
+      m_handlers[p_selector] = nullptr;
+    }
+  }
+
+  /**
+   * @brief Set the handler for frames without a sub-route
+   *
+   * @param p_handler - callback for unmatched frames
+   */
+  void set_fallback(message_handler p_handler)
+  {
+    m_fallback = std::move(p_handler);
+  }
+
+  /**
+   * @brief Number of frames that were given to the fallback handler
+   *
+   * @return std::uint32_t - unmatched frame count
+   */
+  [[nodiscard]] std::uint32_t unmatched() const
+  {
+    return m_unmatched;
+  }
+
+  /**
+   * @brief Dispatch a frame to the sub-route for its selector
+   *
+   * @param p_message - frame of the multiplexed ID
+   */
+  void operator()(const can::message_t& p_message)
+  {
+    if (p_message.length > m_selector_byte) {
+      const auto selector = p_message.payload[m_selector_byte];
+      if (selector < N && m_handlers[selector]) {
+        m_handlers[selector](p_message);
+        return;
+      }
+    }
+
+    m_unmatched++;
+    m_fallback(p_message);
+  }
+
+private:
+  std::array<message_handler, N> m_handlers{};
+  message_handler m_fallback = can_router::noop;
+  std::uint32_t m_unmatched = 0;
+  std::uint8_t m_selector_byte;
+};
+}  // namespace hal
@@ -0,0 +1,345 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+#include <libhal/can.hpp>
+
+#include "can_router.hpp"
+#include "spsc_queue.hpp"
+
+namespace hal {
+/**
+ * @brief Where a prioritized route's handler is executed
+ */
+enum class can_dispatch_class : std::uint8_t
+{
+  /// Handler runs inside can_router::operator(), typically the receive ISR
+  immediate,
+  /// Frame is queued and the handler runs later from `drain()`
+  deferred,
+};
+
+/**
+ * @brief Split routes between the receive ISR and the application
+ *
+ * Every route added through the dispatcher declares a dispatch class. Routes
+ * of the immediate class run their handler inside the receive path exactly as
+ * a plain can_router route does, so safety critical IDs keep their latency.
+ * Routes of the deferred class copy the frame into a fixed capacity lock-free
+ * queue for their priority level and return, keeping heavy handlers out of
+ * the ISR. The application calls `drain()` to run the queued handlers,
+ * highest priority (level 0) first.
+ *
+ * The receive path is the only producer and `drain()` the only consumer of
+ * each queue, so neither side needs to mask interrupts. The class of a route
+ * is a single load from the route itself and can be changed at runtime with
+ * `set_dispatch_class()`.
+ *
+ *     hal::can_priority_dispatcher<2, 32> dispatcher;
+ *     auto brake = dispatcher.add(router, 0x010, on_brake);
+ *     auto log = dispatcher.add(
+ *       router, 0x400, on_log, hal::can_dispatch_class::deferred, 1);
+ *     while (true) {
+ *       dispatcher.drain();
+ *     }
+ *
+ * Deferred frames keep the receive timestamp the router gave them, which
+ * handlers run by `drain()` read from `receive_timestamp()`. Immediate
+ * handlers read it from the router as usual.
+ *
+ * Destroying a route removes it from the router and discards its queued
+ * frames, so destroy deferred routes from the context that calls `drain()`.
+ * The dispatcher cannot be moved or copied once routes have been added to
+ * it.
+ *
+ * @tparam Priorities - number of deferred priority levels
+ * @tparam Capacity - frames each priority level can hold, a power of two
+ */
+template<std::size_t Priorities, std::size_t Capacity>
+class can_priority_dispatcher
+{
+public:
+  static_assert(Priorities > 0 && Priorities <= 256,
+                "Priority is a single byte");
+
+  /**
+   * @brief A can_router route with a dispatch class and priority
+   *
+   * Removes its route from the router and discards its queued frames when
+   * destroyed. Cannot be moved, so it must be stored directly in the
+   * variable it was returned into.
+   */
+  class prioritized_route
+  {
+  public:
+    prioritized_route(prioritized_route& p_other) = delete;
+    prioritized_route& operator=(prioritized_route& p_other) = delete;
+
+    ~prioritized_route()
+    {
+      {
+        // Leaving the router first stops new frames being queued
+        auto removed = std::move(m_route);
+      }
+      m_dispatcher->forget(*this);
+    }
+
+    /**
+     * @brief ID of the messages this route receives
+     *
+     * @return hal::can::id_t - route ID
+     */
+    [[nodiscard]] hal::can::id_t id() const
+    {
+      return m_id;
+    }
+
+    /**
+     * @brief Deferred priority level of this route, 0 being the highest
+     *
+     * @return std::uint8_t - priority level
+     */
+    [[nodiscard]] std::uint8_t priority() const
+    {
+      return m_priority;
+    }
+
+    /**
+     * @brief Where this route's handler currently runs
+     *
+     * @return can_dispatch_class - current dispatch class
+     */
+    [[nodiscard]] can_dispatch_class dispatch_class() const
+    {
+      return m_class.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Change where this route's handler runs
+     *
+     * Safe to call from any context. Frames already queued are still
+     * delivered by `drain()`.
+     *
+     * @param p_class - new dispatch class
+     */
+    void set_dispatch_class(can_dispatch_class p_class)
+    {
+      m_class.store(p_class, std::memory_order_relaxed);
+    }
+
+  private:
+    friend class can_priority_dispatcher;
+
+    prioritized_route(can_priority_dispatcher& p_dispatcher,
+                      can_router& p_router,
+                      hal::can::id_t p_id,
+                      can_router::message_handler p_handler,
+                      can_dispatch_class p_class,
+                      std::uint8_t p_priority)
+      : m_dispatcher(&p_dispatcher)
+      , m_router(&p_router)
+      , m_handler(std::move(p_handler))
+      , m_id(p_id)
+      , m_class(p_class)
+      , m_priority(p_priority)
+      , m_route(p_router.add_message_callback(
+          p_id,
+          [this](const can::message_t& p_message) { receive(p_message); }))
+    {
+    }
+
+    void receive(const can::message_t& p_message)
+    {
+      if (m_class.load(std::memory_order_relaxed) ==
+          can_dispatch_class::immediate) {
+        m_handler(p_message);
+        return;
+      }
+      m_dispatcher->defer(*this, p_message, m_router->receive_timestamp());
+    }
+
+    can_priority_dispatcher* m_dispatcher;
+    can_router* m_router;
+    can_router::message_handler m_handler;
+    hal::can::id_t m_id;
+    std::atomic<can_dispatch_class> m_class;
+    std::uint8_t m_priority;
+    can_router::route_item m_route;
+  };
+
+  can_priority_dispatcher() = default;
+  can_priority_dispatcher(can_priority_dispatcher& p_other) = delete;
+  can_priority_dispatcher& operator=(can_priority_dispatcher& p_other) =
+    delete;
+
+  /**
+   * @brief Add a route to the router with a dispatch class
+   *
+   * @param p_router - router to add the route to
+   * @param p_id - ID of the messages to receive
+   * @param p_handler - callback to be executed when a p_id message is received
+   * @param p_class - run the handler in the receive path or from `drain()`
+   * @param p_priority - deferred priority level, 0 being the highest. Levels
+   * at or above Priorities are treated as the lowest level.
+   * @return prioritized_route - route that must be stored in a variable
+   */
+  [[nodiscard]] prioritized_route add(
+    can_router& p_router,
+    hal::can::id_t p_id,
+    can_router::message_handler p_handler,
+    can_dispatch_class p_class = can_dispatch_class::immediate,
+    std::uint8_t p_priority = 0)
+  {
+    const auto priority = static_cast<std::uint8_t>(
+      std::min<std::size_t>(p_priority, Priorities - 1));
+    return prioritized_route(
+      *this, p_router, p_id, std::move(p_handler), p_class, priority);
+  }
+
+  /**
+   * @brief Run the handlers of queued frames, highest priority first
+   *
+   * A frame queued at a higher priority while draining is run before any
+   * further lower priority frames.
+   *
+   * @param p_limit - maximum number of handlers to run in this call
+   * @return std::size_t - number of handlers run
+   */
+  std::size_t drain(
+    std::size_t p_limit = std::numeric_limits<std::size_t>::max())
+  {
+    std::size_t count = 0;
+    entry pending{};
+
+    while (count < p_limit) {
+      bool found = false;
+      for (auto& queue : m_queues) {
+        if (queue.pop(pending)) {
+          found = true;
+          break;
+        }
+      }
+      if (!found) {
+        break;
+      }
+      // Frames of destroyed routes are left in the queue without a route
+      if (pending.route == nullptr) {
+        continue;
+      }
+      m_receive_timestamp = pending.timestamp;
+      pending.route->m_handler(pending.message);
+      count++;
+    }
+
+    return count;
+  }
+
+  /**
+   * @brief Get the receive timestamp of the frame being drained
+   *
+   * Valid inside handlers run by `drain()`.
+   *
+   * @return std::uint64_t - receive time the router gave the frame, in ticks
+   * of the router's clock, or 0 if it had none
+   */
+  [[nodiscard]] std::uint64_t receive_timestamp() const
+  {
+    return m_receive_timestamp;
+  }
+
+  /**
+   * @brief Number of frames waiting to be drained at a priority level
+   *
+   * @param p_priority - priority level, 0 being the highest
+   * @return std::size_t - queued frame count, 0 for levels out of range
+   */
+  [[nodiscard]] std::size_t pending(std::uint8_t p_priority) const
+  {
+    if (p_priority >= Priorities) {
+      return 0;
+    }
+    return m_queues[p_priority].size();
+  }
+
+  /**
+   * @brief Most frames a priority level has held at once
+   *
+   * Sizing Capacity well above the high-water mark under peak traffic keeps
+   * deferred frames from being dropped.
+   *
+   * @param p_priority - priority level, 0 being the highest
+   * @return std::size_t - high-water mark, 0 for levels out of range
+   */
+  [[nodiscard]] std::size_t high_water(std::uint8_t p_priority) const
+  {
+    if (p_priority >= Priorities) {
+      return 0;
+    }
+    return m_queues[p_priority].high_water();
+  }
+
+  /**
+   * @brief Number of deferred frames discarded because their queue was full
+   *
+   * @return std::uint32_t - dropped frame count
+   */
+  [[nodiscard]] std::uint32_t dropped() const
+  {
+    return m_dropped.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct entry
+  {
+    can::message_t message;
+    prioritized_route* route;
+    std::uint64_t timestamp;
+  };
+
+  void defer(prioritized_route& p_route,
+             const can::message_t& p_message,
+             std::uint64_t p_timestamp)
+  {
+    if (!m_queues[p_route.m_priority].push(
+          { p_message, &p_route, p_timestamp })) {
+      // Only the receive path writes this counter, so a plain increment
+      // through load and store is enough and avoids a read-modify-write.
+      m_dropped.store(m_dropped.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
+    }
+  }
+
+  void forget(prioritized_route& p_route)
+  {
+    m_queues[p_route.m_priority].visit([&p_route](entry& p_entry) {
+      if (p_entry.route == &p_route) {
+        p_entry.route = nullptr;
+      }
+    });
+  }
+
+  std::array<spsc_queue<entry, Capacity>, Priorities> m_queues{};
+  std::atomic<std::uint32_t> m_dropped = 0;
+  std::uint64_t m_receive_timestamp = 0;
+};
+}  // namespace hal
@@ -14,8 +14,17 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <utility>
+
 #include <libhal-util/static_list.hpp>
 #include <libhal/can.hpp>
+#include <libhal/steady_clock.hpp>
+
+#include "can_signal.hpp"
 
 namespace hal {
 /**
@@ -30,14 +39,139 @@ public:
 
   using message_handler = hal::callback<hal::can::handler>;
 
+  /**
+   * @brief Message count written by the receive context only
+   *
+   * Safe to read from other threads, such as the application loop while a
+   * SocketCAN driver receives on its own thread. Copies take the current
+   * count.
+   */
+  class counter
+  {
+  public:
+    counter() = default;
+
+    counter(const counter& p_other)
+      : m_count(p_other.load())
+    {
+    }
+
+    counter& operator=(const counter& p_other)
+    {
+      m_count.store(p_other.load(), std::memory_order_relaxed);
+      return *this;
+    }
+
+    /**
+     * @brief Count one message, from the receive context only
+     *
+     */
+    void increment()
+    {
+      // Only the receive context writes the count, so a load and store is
+      // enough and avoids a read-modify-write.
+      m_count.store(m_count.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Current count
+     *
+     * @return std::uint32_t - messages counted so far
+     */
+    [[nodiscard]] std::uint32_t load() const
+    {
+      return m_count.load(std::memory_order_relaxed);
+    }
+
+    operator std::uint32_t() const
+    {
+      return load();
+    }
+
+  private:
+    std::atomic<std::uint32_t> m_count = 0;
+  };
+
+  /**
+   * @brief Bumps the router's route generation when its route is moved
+   *
+   * Moving a route_item moves its route to a new address, which
+   * `dispatch()` must notice to drop a cached pointer to the old one.
+   */
+  class move_tracker
+  {
+  public:
+    move_tracker() = default;
+
+    explicit move_tracker(std::uint32_t* p_generation)
+      : m_generation(p_generation)
+    {
+    }
+
+    move_tracker(move_tracker&& p_other) noexcept
+      : m_generation(p_other.m_generation)
+    {
+      bump();
+    }
+
+    move_tracker& operator=(move_tracker&& p_other) noexcept
+    {
+      m_generation = p_other.m_generation;
+      bump();
+      return *this;
+    }
+
+    /**
+     * @brief Point at the generation of the router now owning the route
+     *
+     * @param p_generation - generation counter of the router
+     */
+    void track(std::uint32_t* p_generation)
+    {
+      m_generation = p_generation;
+    }
+
+  private:
+    void bump()
+    {
+      if (m_generation) {
+        (*m_generation)++;
+      }
+    }
+
+    std::uint32_t* m_generation = nullptr;
+  };
+
   struct route
   {
     hal::can::id_t id = 0;
     message_handler handler = noop;
+    /// Number of messages routed to the handler
+    counter hits{};
+    /// Tells the router when this route moves
+    move_tracker tracker{};
   };
 
   using route_item = static_list<route>::item;
 
+  /**
+   * @brief Direction of a message observed by a tap
+   *
+   */
+  enum class direction : std::uint8_t
+  {
+    /// Message was received from the bus and is about to be routed
+    receive,
+    /// Message was successfully sent through `bus()`
+    transmit,
+  };
+
+  using tap_handler = hal::callback<void(const can::message_t& p_message,
+                                          direction p_direction,
+                                          std::uint64_t p_timestamp)>;
+  using tap_item = static_list<tap_handler>::item;
+
   static result<can_router> create(hal::can& p_can);
 
   /**
@@ -47,6 +181,18 @@ public:
    */
   explicit can_router(hal::can& p_can);
 
+  /**
+   * @brief Construct a new can message router that timestamps messages
+   *
+   * Every message received without a timestamp from the driver is stamped
+   * with the uptime of the clock on entry to the router, which is as close
+   * to the receive interrupt as software gets.
+   *
+   * @param p_can - can peripheral to route messages for
+   * @param p_clock - clock used to timestamp received and sent messages
+   */
+  can_router(hal::can& p_can, hal::steady_clock& p_clock);
+
   can_router() = delete;
   can_router(can_router& p_other) = delete;
   can_router& operator=(can_router& p_other) = delete;
@@ -58,7 +204,8 @@ public:
    * @brief Get a reference to the can peripheral driver
    *
    * Used to send can messages through the same port that the can_router is
-   * using.
+   * using. Messages sent successfully through this reference are reported to
+   * every tap with `direction::transmit`.
    *
    * @return can& reference to the can peripheral driver
    */
@@ -88,6 +235,76 @@ public:
     hal::can::id_t p_id,
     message_handler p_handler);
 
+  /**
+   * @brief Set a callback that receives messages with a specific ID decoded
+   * into a typed message
+   *
+   * The payload is decoded with `can_decode<T>()` before the handler is
+   * called, so the handler never touches raw bytes:
+   *
+   *     auto route = router.add_typed_callback<wheel_speed_t>(
+   *       0x120, [](const wheel_speed_t& p_speed) { ... });
+   *
+   * @tparam T - message type satisfying can_message_layout
+   * @tparam F - callable with signature void(const T&)
+   * @param p_id - Associated ID of messages to be decoded.
+   * @param p_handler - callback to be executed with the decoded message.
+   * @return auto - route item from the linked list that must be stored stored
+   * in a variable
+   */
+  template<can_message_layout T, typename F>
+  [[nodiscard]] static_list<route>::item add_typed_callback(
+    hal::can::id_t p_id,
+    F&& p_handler)
+  {
+    return add_message_callback(
+      p_id,
+      [handler = std::forward<F>(p_handler)](
+        const can::message_t& p_message) mutable {
+        handler(can_decode<T>(p_message));
+      });
+  }
+
+  /**
+   * @brief Observe every message passing through the router
+   *
+   * Taps are called for each received message before it is routed, and for
+   * each message sent successfully through `bus()`. Taps are meant for
+   * lightweight bookkeeping such as statistics and recording, and run in the
+   * same context as the route handlers.
+   *
+   * Taps are given the message timestamp in ticks of the router's clock, or
+   * 0 when the message has none. See `receive_timestamp()`.
+   *
+   * @param p_tap - callback to be executed for every message
+   * @return tap_item - tap item from the linked list that must be stored in a
+   * variable
+   */
+  [[nodiscard]] tap_item add_tap(tap_handler p_tap);
+
+  /**
+   * @brief Observe every message passing through the router, without
+   * timestamps
+   *
+   * @tparam F - callable with signature void(const message_t&, direction)
+   * @param p_tap - callback to be executed for every message
+   * @return tap_item - tap item from the linked list that must be stored in a
+   * variable
+   */
+  template<typename F>
+  requires(
+    !std::is_invocable_v<F&, const can::message_t&, direction, std::uint64_t> &&
+    std::is_invocable_v<F&, const can::message_t&, direction>)
+  [[nodiscard]] tap_item add_tap(F&& p_tap)
+  {
+    return add_tap(tap_handler(
+      [tap = std::forward<F>(p_tap)](const can::message_t& p_message,
+                                     direction p_direction,
+                                     std::uint64_t) mutable {
+        tap(p_message, p_direction);
+      }));
+  }
+
   /**
    * @brief Get the list of handlers
    *
@@ -108,8 +325,95 @@ public:
    */
   void operator()(const can::message_t& p_message);
 
+  /**
+   * @brief Message routing interrupt service handler for drivers that
+   * timestamp messages in hardware
+   *
+   * @param p_message - message received from the bus
+   * @param p_timestamp - receive time of the message in ticks of the
+   * router's clock, or 0 if unknown
+   */
+  void operator()(const can::message_t& p_message, std::uint64_t p_timestamp);
+
+  /**
+   * @brief Route a batch of messages in one call
+   *
+   * For drivers that hand over several frames at once from a DMA buffer or
+   * hardware FIFO. Equivalent to calling the router on each message in
+   * order, but the route found for a message is reused for the messages
+   * directly after it with the same ID, so bursts and FIFO runs of one ID
+   * search the route list once.
+   *
+   * Messages without a timestamp from the driver share one timestamp taken
+   * from the router's clock when the batch is handed over.
+   *
+   * Handlers and taps may add, remove and move routes, including their own,
+   * while a batch is being dispatched. The cached route is looked up again
+   * whenever the route list changes.
+   *
+   * @param p_messages - messages received from the bus, oldest first
+   * @param p_timestamps - receive time of each message in ticks of the
+   * router's clock, in the same order as the messages. May be shorter than
+   * the messages or empty.
+   */
+  void dispatch(std::span<const can::message_t> p_messages,
+                std::span<const std::uint64_t> p_timestamps = {});
+
+  /**
+   * @brief Get the receive timestamp of the message being routed
+   *
+   * Valid inside route handlers and taps. Handlers that defer work should
+   * copy it along with the message.
+   *
+   * @return std::uint64_t - receive time in ticks of the router's clock, or
+   * 0 if the driver gave none and the router has no clock
+   */
+  [[nodiscard]] std::uint64_t receive_timestamp() const;
+
+  /**
+   * @brief Number of received messages that matched no route
+   *
+   * Messages of a route added without a callback count as routed.
+   *
+   * @return std::uint32_t - unrouted message count
+   */
+  [[nodiscard]] std::uint32_t unrouted() const;
+
 private:
+  /**
+   * @brief can driver handed out by `bus()` which reports sent messages to
+   * the router's taps before forwarding them to the real driver.
+   *
+   */
+  class bus_proxy : public hal::can
+  {
+  public:
+    explicit bus_proxy(can_router& p_router);
+
+  private:
+    status driver_configure(const settings& p_settings) override;
+    status driver_bus_on() override;
+    result<send_t> driver_send(const message_t& p_message) override;
+    void driver_on_receive(hal::callback<handler> p_handler) override;
+
+    can_router* m_router;
+  };
+
+  void notify_taps(const can::message_t& p_message,
+                   direction p_direction,
+                   std::uint64_t p_timestamp);
+  [[nodiscard]] route* find(hal::can::id_t p_id);
+  [[nodiscard]] std::uint64_t now();
+
   static_list<route> m_handlers{};
+  static_list<tap_handler> m_taps{};
   hal::can* m_can = nullptr;
+  hal::steady_clock* m_clock = nullptr;
+  std::uint64_t m_receive_timestamp = 0;
+  counter m_unrouted{};
+  /// Bumped whenever a route is added or moved, so `dispatch()` can drop its
+  /// cache
+  std::uint32_t m_generation = 0;
+  bus_proxy m_bus{ *this };
 };
 }  // namespace hal
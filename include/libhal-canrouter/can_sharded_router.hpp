@@ -0,0 +1,460 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <libhal/can.hpp>
+#include <libhal/error.hpp>
+
+#include "can_router.hpp"
+#include "spsc_queue.hpp"
+
+namespace hal {
+/**
+ * @brief Router that spreads dispatch across worker threads, for hosts only
+ *
+ * Routes are sharded by a hash of their ID. Each shard is a can_router of its
+ * own run by its own worker thread, so handlers of different shards run in
+ * parallel and a gateway aggregating many buses scales with cores instead of
+ * being bound by a single dispatch path.
+ *
+ * Frames enter through a fixed number of inputs, typically one per bus. Each
+ * input holds a lock-free single producer, single consumer queue per shard,
+ * so every input must be fed from a single thread and no two threads ever
+ * contend on a queue. All frames of an ID from one input pass through the
+ * same queue to the same worker, so they reach their handler in the order
+ * they were posted.
+ *
+ *     hal::can_sharded_router<> router(4, 2);
+ *     auto engine = router.add_message_callback(0x0C0, on_engine);
+ *     auto can0 = HAL_CHECK(
+ *       hal::socketcan::create(HAL_CHECK(hal::socketcan_open("can0"))));
+ *     auto can1 = HAL_CHECK(
+ *       hal::socketcan::create(HAL_CHECK(hal::socketcan_open("can1"))));
+ *     can0.on_receive(std::ref(router.input(0)));
+ *     can1.on_receive(std::ref(router.input(1)));
+ *
+ * Handlers run on the worker thread of their shard. Routes can be added and
+ * removed at any time from threads other than the workers. A shard's routes
+ * are locked while its worker drains a batch, so a handler must not add a
+ * route to, or destroy a route of, this router: doing so from a handler of
+ * the same shard deadlocks, and from handlers of two shards that change each
+ * other's routes can deadlock. Hand such changes to another thread instead.
+ *
+ * Shard routers have no bus of their own. Their `can_router::bus()` fails
+ * every send with std::errc::operation_not_supported, so handlers that reply
+ * must send through the driver of the input, which must then be safe to call
+ * from the worker threads. A worker with nothing to do spins briefly and
+ * then sleeps until an input wakes it. Frames posted to a full queue are
+ * dropped and counted.
+ *
+ * Uses std::thread, so it is not available to bare metal applications.
+ *
+ * @tparam QueueCapacity - frames each input can queue for each shard, a power
+ * of two
+ */
+template<std::size_t QueueCapacity = 1024>
+class can_sharded_router
+{
+  struct shard;
+
+public:
+  /// Frames a worker handles from one queue before moving to the next
+  static constexpr std::size_t batch_size = 64;
+
+  /**
+   * @brief A route of the sharded router
+   *
+   * Removes itself from its shard when destroyed, which takes the shard's
+   * lock, so it must not be destroyed by a handler of this router. A route
+   * may outlive the router, and destroying it then does nothing.
+   */
+  class route
+  {
+  public:
+    route(route&& p_other) noexcept
+      : m_lock(p_other.m_lock)
+    {
+      std::lock_guard lock(*m_lock);
+      m_item = std::move(p_other.m_item);
+    }
+
+    route& operator=(route&& p_other) = delete;
+    route(route& p_other) = delete;
+    route& operator=(route& p_other) = delete;
+
+    ~route()
+    {
+      std::lock_guard lock(*m_lock);
+      m_item.reset();
+    }
+
+  private:
+    friend class can_sharded_router;
+
+    route(std::shared_ptr<std::mutex> p_lock, can_router::route_item p_item)
+      : m_lock(std::move(p_lock))
+      , m_item(std::move(p_item))
+    {
+    }
+
+    // Shared with the shard, so the lock outlives the router. The shard's
+    // can_router detaches the item when it is destroyed.
+    std::shared_ptr<std::mutex> m_lock;
+    std::optional<can_router::route_item> m_item;
+  };
+
+  /**
+   * @brief Ingress queues of one input, for the frames of one producer thread
+   *
+   * Can be installed directly as the receive handler of a hal::can driver.
+   */
+  class ingress
+  {
+  public:
+    ingress(ingress& p_other) = delete;
+    ingress& operator=(ingress& p_other) = delete;
+
+    /**
+     * @brief Queue a frame for the shard of its ID
+     *
+     * @param p_message - frame to route
+     * @return true - the frame was queued
+     * @return false - the shard's queue was full and the frame was dropped
+     */
+    bool post(const can::message_t& p_message)
+    {
+      auto& target = *m_router->m_shards[m_router->shard_of(p_message.id)];
+      const bool queued = push(p_message);
+      fence();
+      wake(target);
+      return queued;
+    }
+
+    /**
+     * @brief Queue a batch of frames, waking each worker at most once
+     *
+     * @param p_messages - frames to route
+     * @return std::size_t - number of frames queued, the rest were dropped
+     */
+    std::size_t post(std::span<const can::message_t> p_messages)
+    {
+      std::size_t queued = 0;
+      for (const auto& message : p_messages) {
+        queued += push(message);
+      }
+      fence();
+      for (auto& each : m_router->m_shards) {
+        wake(*each);
+      }
+      return queued;
+    }
+
+    /**
+     * @brief Queue a frame, for use as a hal::can receive handler
+     *
+     * @param p_message - frame to route
+     */
+    void operator()(const can::message_t& p_message)
+    {
+      static_cast<void>(post(p_message));
+    }
+
+    /**
+     * @brief Number of frames dropped because a queue was full
+     *
+     * @return std::uint64_t - dropped frame count
+     */
+    [[nodiscard]] std::uint64_t dropped() const
+    {
+      return m_dropped.load(std::memory_order_relaxed);
+    }
+
+  private:
+    friend class can_sharded_router;
+
+    using queue = spsc_queue<can::message_t, QueueCapacity>;
+
+    explicit ingress(can_sharded_router& p_router)
+      : m_router(&p_router)
+    {
+      for (std::size_t i = 0; i < p_router.m_shards.size(); i++) {
+        m_queues.push_back(std::make_unique<queue>());
+      }
+    }
+
+    bool push(const can::message_t& p_message)
+    {
+      const auto index = m_router->shard_of(p_message.id);
+      if (!m_queues[index]->push(p_message)) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      return true;
+    }
+
+    static void fence()
+    {
+      // Pairs with the fence in the worker, so either the worker sees the
+      // frames or this sees the worker asleep
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    static void wake(shard& p_shard)
+    {
+      if (p_shard.sleeping.load(std::memory_order_relaxed)) {
+        p_shard.signal.fetch_add(1, std::memory_order_release);
+        p_shard.signal.notify_one();
+      }
+    }
+
+    can_sharded_router* m_router;
+    std::vector<std::unique_ptr<queue>> m_queues;
+    std::atomic<std::uint64_t> m_dropped = 0;
+  };
+
+  /**
+   * @brief Construct the router and start its workers
+   *
+   * @param p_shards - number of shards and worker threads, at least 1
+   * @param p_inputs - number of inputs, one per producer thread
+   */
+  can_sharded_router(std::size_t p_shards, std::size_t p_inputs)
+  {
+    for (std::size_t i = 0; i < std::max<std::size_t>(p_shards, 1); i++) {
+      m_shards.push_back(std::make_unique<shard>());
+    }
+    for (std::size_t i = 0; i < p_inputs; i++) {
+      m_inputs.push_back(std::unique_ptr<ingress>(new ingress(*this)));
+    }
+    for (std::size_t i = 0; i < m_shards.size(); i++) {
+      m_shards[i]->worker = std::thread([this, i]() { run(i); });
+    }
+  }
+
+  can_sharded_router(can_sharded_router& p_other) = delete;
+  can_sharded_router& operator=(can_sharded_router& p_other) = delete;
+
+  /**
+   * @brief Handle every queued frame, then stop the workers
+   */
+  ~can_sharded_router()
+  {
+    m_stopping.store(true, std::memory_order_release);
+    for (auto& each : m_shards) {
+      each->signal.fetch_add(1, std::memory_order_release);
+      each->signal.notify_one();
+    }
+    for (auto& each : m_shards) {
+      each->worker.join();
+    }
+  }
+
+  /**
+   * @brief Add a route to the shard of its ID
+   *
+   * Takes the shard's lock, so it must not be called by a handler of this
+   * router.
+   *
+   * @param p_id - ID of the messages to route
+   * @param p_handler - callback run on the shard's worker thread
+   * @return route - removes the route when destroyed
+   */
+  [[nodiscard]] route add_message_callback(
+    hal::can::id_t p_id,
+    can_router::message_handler p_handler)
+  {
+    auto& target = *m_shards[shard_of(p_id)];
+    std::lock_guard lock(*target.lock);
+    return route(
+      target.lock,
+      target.router.add_message_callback(p_id, std::move(p_handler)));
+  }
+
+  /**
+   * @brief Input for one producer thread
+   *
+   * @param p_index - input index, below the number given at construction
+   * @return ingress& - the input's ingress queues
+   */
+  [[nodiscard]] ingress& input(std::size_t p_index)
+  {
+    return *m_inputs[p_index];
+  }
+
+  /**
+   * @brief Shard, and so worker thread, that handles an ID
+   *
+   * @param p_id - message ID
+   * @return std::size_t - shard index
+   */
+  [[nodiscard]] std::size_t shard_of(hal::can::id_t p_id) const
+  {
+    // Multiplicative hash spreads neighbouring IDs across shards, and the
+    // multiply-shift maps it onto any shard count without a division
+    const std::uint64_t hash = static_cast<std::uint32_t>(p_id * 0x9E37'79B1U);
+    return static_cast<std::size_t>((hash * m_shards.size()) >> 32);
+  }
+
+  /**
+   * @brief Number of shards and worker threads
+   *
+   * @return std::size_t - shard count
+   */
+  [[nodiscard]] std::size_t shards() const
+  {
+    return m_shards.size();
+  }
+
+  /**
+   * @brief Number of frames given to a shard's router so far
+   *
+   * @param p_shard - shard index
+   * @return std::uint64_t - handled frame count
+   */
+  [[nodiscard]] std::uint64_t handled(std::size_t p_shard) const
+  {
+    return m_shards[p_shard]->handled.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Number of frames given to every shard's router so far
+   *
+   * @return std::uint64_t - handled frame count
+   */
+  [[nodiscard]] std::uint64_t handled() const
+  {
+    std::uint64_t total = 0;
+    for (std::size_t i = 0; i < m_shards.size(); i++) {
+      total += handled(i);
+    }
+    return total;
+  }
+
+private:
+  /// Empty polls before a worker goes to sleep
+  static constexpr std::uint32_t spin_limit = 64;
+
+  /// Driver for the shard routers, which only ever receive through the
+  /// sharded router and have no bus of their own
+  class shard_bus : public hal::can
+  {
+  private:
+    status driver_configure(const settings&) override
+    {
+      return hal::success();
+    }
+
+    status driver_bus_on() override
+    {
+      return hal::success();
+    }
+
+    result<send_t> driver_send(const message_t&) override
+    {
+      return hal::new_error(std::errc::operation_not_supported);
+    }
+
+    void driver_on_receive(hal::callback<handler>) override
+    {
+    }
+  };
+
+  struct shard
+  {
+    shard_bus bus;
+    can_router router{ bus };
+    std::shared_ptr<std::mutex> lock = std::make_shared<std::mutex>();
+    std::atomic<std::uint32_t> signal = 0;
+    std::atomic<bool> sleeping = false;
+    std::atomic<std::uint64_t> handled = 0;
+    std::thread worker;
+  };
+
+  std::size_t drain(std::size_t p_index)
+  {
+    auto& drained = *m_shards[p_index];
+    std::size_t count = 0;
+    std::array<can::message_t, batch_size> batch;
+
+    std::lock_guard lock(*drained.lock);
+    for (auto& input : m_inputs) {
+      auto& queue = *input->m_queues[p_index];
+      std::size_t popped = 0;
+      while (popped < batch_size && queue.pop(batch[popped])) {
+        popped++;
+      }
+      drained.router.dispatch(std::span(batch.data(), popped));
+      count += popped;
+    }
+    drained.handled.fetch_add(count, std::memory_order_release);
+    return count;
+  }
+
+  [[nodiscard]] bool pending(std::size_t p_index) const
+  {
+    return std::any_of(m_inputs.begin(), m_inputs.end(), [p_index](auto& p) {
+      return !p->m_queues[p_index]->empty();
+    });
+  }
+
+  void run(std::size_t p_index)
+  {
+    auto& own = *m_shards[p_index];
+    std::uint32_t idle = 0;
+
+    while (true) {
+      if (drain(p_index) != 0) {
+        idle = 0;
+        continue;
+      }
+      // Queued frames are handled before stopping
+      if (m_stopping.load(std::memory_order_acquire)) {
+        return;
+      }
+      if (++idle < spin_limit) {
+        std::this_thread::yield();
+        continue;
+      }
+
+      const auto seen = own.signal.load(std::memory_order_acquire);
+      own.sleeping.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (!pending(p_index) && !m_stopping.load(std::memory_order_acquire)) {
+        own.signal.wait(seen, std::memory_order_acquire);
+      }
+      own.sleeping.store(false, std::memory_order_relaxed);
+      idle = 0;
+    }
+  }
+
+  std::vector<std::unique_ptr<shard>> m_shards;
+  std::vector<std::unique_ptr<ingress>> m_inputs;
+  std::atomic<bool> m_stopping = false;
+};
+}  // namespace hal
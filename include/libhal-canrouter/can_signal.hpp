@@ -0,0 +1,299 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include <libhal/can.hpp>
+#include <libhal/units.hpp>
+
+namespace hal {
+/**
+ * @brief Bit numbering of a signal within a CAN payload
+ *
+ */
+enum class can_byte_order : std::uint8_t
+{
+  /// Intel byte order, start bit is the signal's least significant bit
+  little_endian,
+  /// Motorola byte order, start bit is the signal's most significant bit
+  /// using the DBC numbering where bit 7 of byte 0 is followed by bit 0 of
+  /// byte 0 and then bit 15 of byte 1.
+  big_endian,
+};
+
+/**
+ * @brief Description of a signal packed into a classic CAN payload
+ *
+ * Follows the DBC conventions for start bit, length, byte order, sign, scale
+ * and offset. The physical value of a signal is `raw * scale + offset`.
+ */
+struct can_signal
+{
+  std::uint8_t start_bit = 0;
+  std::uint8_t length = 1;
+  can_byte_order byte_order = can_byte_order::little_endian;
+  bool is_signed = false;
+  float scale = 1.0f;
+  float offset = 0.0f;
+
+  /**
+   * @brief Position of the signal's least significant bit within the payload
+   * word used for its byte order
+   *
+   * @return constexpr std::uint32_t - right shift needed to extract the raw
+   * value
+   */
+  [[nodiscard]] constexpr std::uint32_t shift() const
+  {
+    if (byte_order == can_byte_order::little_endian) {
+      return start_bit;
+    }
+    const std::uint32_t msb = (7 - start_bit / 8) * 8 + start_bit % 8;
+    return msb - (length - 1);
+  }
+
+  /**
+   * @brief Mask covering length bits
+   *
+   * @return constexpr std::uint64_t - right aligned mask
+   */
+  [[nodiscard]] constexpr std::uint64_t mask() const
+  {
+    return length >= 64 ? ~std::uint64_t{ 0 }
+                        : (std::uint64_t{ 1 } << length) - 1;
+  }
+
+  /**
+   * @brief Extract the raw, sign extended value of the signal
+   *
+   * Branch free: both byte orders are loaded and selected, and sign extension
+   * is done with an xor and subtract. When the signal is a constant
+   * expression the selection, shift and mask fold into the caller.
+   *
+   * @param p_payload - CAN payload
+   * @return constexpr std::int64_t - raw value, sign extended if is_signed
+   */
+  [[nodiscard]] constexpr std::int64_t raw(
+    const std::array<hal::byte, 8>& p_payload) const
+  {
+    std::uint64_t little = 0;
+    std::uint64_t big = 0;
+    for (std::size_t i = 0; i < p_payload.size(); i++) {
+      little |= std::uint64_t{ p_payload[i] } << (8 * i);
+      big |= std::uint64_t{ p_payload[i] } << (8 * (7 - i));
+    }
+
+    const auto word =
+      (byte_order == can_byte_order::little_endian) ? little : big;
+    const auto value = (word >> shift()) & mask();
+    const auto sign =
+      is_signed ? (std::uint64_t{ 1 } << (length - 1)) : std::uint64_t{ 0 };
+
+    return static_cast<std::int64_t>((value ^ sign) - sign);
+  }
+
+  /**
+   * @brief Extract the physical value of the signal
+   *
+   * @param p_payload - CAN payload
+   * @return constexpr float - raw * scale + offset
+   */
+  [[nodiscard]] constexpr float decode(
+    const std::array<hal::byte, 8>& p_payload) const
+  {
+    return static_cast<float>(raw(p_payload)) * scale + offset;
+  }
+
+  /**
+   * @brief Store a raw value into the signal's bits
+   *
+   * Bits outside of the signal are left untouched and the raw value is
+   * truncated to the signal's length.
+   *
+   * @param p_payload - CAN payload to modify
+   * @param p_raw - raw value to store
+   */
+  constexpr void insert(std::array<hal::byte, 8>& p_payload,
+                        std::int64_t p_raw) const
+  {
+    const bool little_endian = byte_order == can_byte_order::little_endian;
+    const auto bits = (static_cast<std::uint64_t>(p_raw) & mask()) << shift();
+    const auto clear = ~(mask() << shift());
+
+    for (std::size_t i = 0; i < p_payload.size(); i++) {
+      const auto position = 8 * (little_endian ? i : 7 - i);
+      const auto keep = static_cast<hal::byte>(clear >> position);
+      const auto set = static_cast<hal::byte>(bits >> position);
+      p_payload[i] = static_cast<hal::byte>((p_payload[i] & keep) | set);
+    }
+  }
+
+  /**
+   * @brief Store a physical value into the signal's bits
+   *
+   * The value is converted with `(value - offset) / scale` and rounded to the
+   * nearest raw value.
+   *
+   * @param p_payload - CAN payload to modify
+   * @param p_value - physical value to store
+   */
+  constexpr void encode(std::array<hal::byte, 8>& p_payload,
+                        float p_value) const
+  {
+    const auto scaled = (p_value - offset) / scale;
+    const auto rounded = scaled + (scaled < 0.0f ? -0.5f : 0.5f);
+    insert(p_payload, static_cast<std::int64_t>(rounded));
+  }
+};
+
+/**
+ * @brief Binds a can_signal to a data member of a decoded message type
+ *
+ * Floating point members receive the physical value. Integral, enum and bool
+ * members receive the raw value.
+ *
+ * @tparam Class - decoded message type
+ * @tparam T - member type
+ */
+template<typename Class, typename T>
+struct can_field
+{
+  T Class::*member;
+  can_signal signal;
+};
+
+template<typename Class, typename T>
+can_field(T Class::*, can_signal) -> can_field<Class, T>;
+
+/**
+ * @brief A type that describes its own CAN payload layout
+ *
+ * The type must be default constructible and provide a static constexpr
+ * function `can_fields()` returning a tuple of can_field:
+ *
+ *     struct wheel_speed_t
+ *     {
+ *       float front_left;
+ *       float front_right;
+ *
+ *       static constexpr auto can_fields()
+ *       {
+ *         return std::tuple{
+ *           hal::can_field{ &wheel_speed_t::front_left,
+ *                           { .start_bit = 0, .length = 16, .scale = 0.01f } },
+ *           hal::can_field{ &wheel_speed_t::front_right,
+ *                           { .start_bit = 16, .length = 16, .scale = 0.01f }
+ *           },
+ *         };
+ *       }
+ *     };
+ */
+template<typename T>
+concept can_message_layout = std::is_default_constructible_v<T> && requires {
+  {
+    std::tuple_size<decltype(T::can_fields())>::value
+  };
+};
+
+/**
+ * @brief Decode a CAN payload into a typed message
+ *
+ * The field list is a constant expression, so each field's extraction
+ * compiles down to a load, shift, mask and (for floats) multiply-add.
+ *
+ * @tparam T - message type satisfying can_message_layout
+ * @param p_payload - CAN payload
+ * @return constexpr T - decoded message
+ */
+template<can_message_layout T>
+[[nodiscard]] constexpr T can_decode(const std::array<hal::byte, 8>& p_payload)
+{
+  constexpr auto fields = T::can_fields();
+  T decoded{};
+
+  std::apply(
+    [&decoded, &p_payload](const auto&... p_field) {
+      (
+        [&] {
+          using member_t =
+            std::remove_cvref_t<decltype(decoded.*(p_field.member))>;
+          if constexpr (std::is_floating_point_v<member_t>) {
+            decoded.*(p_field.member) =
+              static_cast<member_t>(p_field.signal.decode(p_payload));
+          } else {
+            decoded.*(p_field.member) =
+              static_cast<member_t>(p_field.signal.raw(p_payload));
+          }
+        }(),
+        ...);
+    },
+    fields);
+
+  return decoded;
+}
+
+/**
+ * @brief Decode a CAN message into a typed message
+ *
+ * @tparam T - message type satisfying can_message_layout
+ * @param p_message - received CAN message
+ * @return constexpr T - decoded message
+ */
+template<can_message_layout T>
+[[nodiscard]] constexpr T can_decode(const can::message_t& p_message)
+{
+  return can_decode<T>(p_message.payload);
+}
+
+/**
+ * @brief Encode a typed message into a CAN payload
+ *
+ * The inverse of `can_decode()`. Bits not covered by a field are zero.
+ *
+ * @tparam T - message type satisfying can_message_layout
+ * @param p_message - message to encode
+ * @return constexpr std::array<hal::byte, 8> - encoded payload
+ */
+template<can_message_layout T>
+[[nodiscard]] constexpr std::array<hal::byte, 8> can_encode(const T& p_message)
+{
+  constexpr auto fields = T::can_fields();
+  std::array<hal::byte, 8> payload{};
+
+  std::apply(
+    [&p_message, &payload](const auto&... p_field) {
+      (
+        [&] {
+          const auto value = p_message.*(p_field.member);
+          using member_t = std::remove_cvref_t<decltype(value)>;
+          if constexpr (std::is_floating_point_v<member_t>) {
+            p_field.signal.encode(payload, static_cast<float>(value));
+          } else {
+            p_field.signal.insert(payload, static_cast<std::int64_t>(value));
+          }
+        }(),
+        ...);
+    },
+    fields);
+
+  return payload;
+}
+}  // namespace hal
@@ -0,0 +1,85 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include <libhal/can.hpp>
+
+#include "can_signal.hpp"
+
+/**
+ * Batch signal extraction for offline analysis
+ *
+ * Decodes one signal out of a contiguous array of messages, typically every
+ * frame of one ID pulled from a capture, into a column. On x86 the batch is
+ * processed with AVX2 or SSE2, selected at runtime based on the CPU; every
+ * other target uses a scalar loop over `can_signal::raw()`. All instruction
+ * sets produce results identical to `can_signal::raw()` and
+ * `can_signal::decode()`.
+ */
+namespace hal {
+/**
+ * @brief Instruction sets used by the batch decoder
+ *
+ */
+enum class can_batch_isa : std::uint8_t
+{
+  scalar,
+  sse2,
+  avx2,
+};
+
+/**
+ * @brief Best instruction set supported by this CPU
+ *
+ * @return can_batch_isa - instruction set used by default
+ */
+[[nodiscard]] can_batch_isa can_batch_best_isa();
+
+/**
+ * @brief Extract the physical value of a signal from every message
+ *
+ * @param p_messages - messages to decode
+ * @param p_signal - signal to extract
+ * @param p_column - destination, element i receives the value of message i
+ * @param p_isa - instruction set to use, lowered to `can_batch_best_isa()`
+ * if unsupported
+ * @return std::size_t - number of values written, the smaller of the two
+ * span sizes
+ */
+std::size_t can_batch_decode(std::span<const can::message_t> p_messages,
+                             const can_signal& p_signal,
+                             std::span<float> p_column,
+                             can_batch_isa p_isa = can_batch_best_isa());
+
+/**
+ * @brief Extract the raw, sign extended value of a signal from every message
+ *
+ * @param p_messages - messages to decode
+ * @param p_signal - signal to extract
+ * @param p_column - destination, element i receives the value of message i
+ * @param p_isa - instruction set to use, lowered to `can_batch_best_isa()`
+ * if unsupported
+ * @return std::size_t - number of values written, the smaller of the two
+ * span sizes
+ */
+std::size_t can_batch_decode_raw(std::span<const can::message_t> p_messages,
+                                 const can_signal& p_signal,
+                                 std::span<std::int64_t> p_column,
+                                 can_batch_isa p_isa = can_batch_best_isa());
+}  // namespace hal
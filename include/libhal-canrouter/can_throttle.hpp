@@ -0,0 +1,120 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+
+#include <libhal/can.hpp>
+#include <libhal/steady_clock.hpp>
+#include <libhal/units.hpp>
+
+#include "can_router.hpp"
+
+namespace hal {
+/**
+ * @brief Pass every Nth frame of a route to its handler
+ *
+ *     hal::can_decimator every_tenth(update_display, 10);
+ *     auto route = router.add_message_callback(0x120, std::ref(every_tenth));
+ *
+ * The first frame is always passed on. Costs one compare and decrement per
+ * frame.
+ */
+class can_decimator
+{
+public:
+  /**
+   * @brief Construct a new decimator
+   *
+   * @param p_handler - handler for passed frames
+   * @param p_factor - pass one frame out of every p_factor. 0 and 1 pass
+   * every frame.
+   */
+  can_decimator(can_router::message_handler p_handler, std::uint32_t p_factor);
+
+  /**
+   * @brief Pass the frame on if it is the Nth since the last one passed
+   *
+   * @param p_message - frame received for the route
+   */
+  void operator()(const can::message_t& p_message);
+
+  /**
+   * @brief Number of frames dropped
+   *
+   * @return std::uint32_t - suppressed frame count
+   */
+  [[nodiscard]] std::uint32_t suppressed() const
+  {
+    return m_suppressed;
+  }
+
+private:
+  can_router::message_handler m_handler;
+  std::uint32_t m_factor;
+  std::uint32_t m_countdown = 0;
+  std::uint32_t m_suppressed = 0;
+};
+
+/**
+ * @brief Pass frames of a route to its handler no faster than a set rate
+ *
+ *     hal::can_rate_limiter ten_hertz(send_telemetry, clock, 100ms);
+ *     auto route = router.add_message_callback(0x120, std::ref(ten_hertz));
+ *
+ * A frame is passed on when at least the minimum interval has elapsed since
+ * the last frame that was passed on. Costs one clock read, subtraction and
+ * compare per frame.
+ */
+class can_rate_limiter
+{
+public:
+  /**
+   * @brief Construct a new rate limiter
+   *
+   * @param p_handler - handler for passed frames
+   * @param p_clock - clock used to measure intervals
+   * @param p_min_interval - shortest time between two frames passed on
+   */
+  can_rate_limiter(can_router::message_handler p_handler,
+                   hal::steady_clock& p_clock,
+                   hal::time_duration p_min_interval);
+
+  /**
+   * @brief Pass the frame on if the minimum interval has elapsed
+   *
+   * @param p_message - frame received for the route
+   */
+  void operator()(const can::message_t& p_message);
+
+  /**
+   * @brief Number of frames dropped
+   *
+   * @return std::uint32_t - suppressed frame count
+   */
+  [[nodiscard]] std::uint32_t suppressed() const
+  {
+    return m_suppressed;
+  }
+
+private:
+  can_router::message_handler m_handler;
+  hal::steady_clock* m_clock;
+  std::uint64_t m_min_interval_ticks;
+  std::uint64_t m_last_tick = 0;
+  std::uint32_t m_suppressed = 0;
+  bool m_started = false;
+};
+}  // namespace hal
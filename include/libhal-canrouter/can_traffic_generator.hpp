@@ -0,0 +1,190 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include <libhal/can.hpp>
+#include <libhal/units.hpp>
+
+namespace hal {
+/**
+ * @brief How the payload of a generated stream changes from frame to frame
+ */
+enum class can_payload_pattern : std::uint8_t
+{
+  /// Payload never changes
+  fixed,
+  /// Byte 0 is a rolling counter, like an alive counter
+  counter,
+  /// Bytes 0 and 1 hold a little endian value that takes a small random step
+  /// each frame, like a sensor reading
+  random_walk,
+  /// Every byte is random each frame
+  random,
+};
+
+/**
+ * @brief One periodic message of a synthetic traffic profile
+ */
+struct can_traffic_stream
+{
+  /// Message ID, extended when above 0x7FF
+  hal::can::id_t id = 0;
+  /// Nominal time between releases
+  hal::time_duration period = std::chrono::milliseconds(10);
+  /// Each release is delayed from its nominal time by a uniformly random
+  /// amount below this. Keep below the period.
+  hal::time_duration jitter{};
+  /// Data length code, 0 to 8
+  std::uint8_t length = 8;
+  /// How the payload evolves
+  can_payload_pattern pattern = can_payload_pattern::counter;
+  /// Frames sent back to back on each release
+  std::uint8_t burst = 1;
+  /// Payload of the first frame
+  std::array<hal::byte, 8> payload{};
+
+  /// Generator state, set by the generator's constructor
+  std::uint64_t nominal = 0;
+  /// Generator state, set by the generator's constructor
+  std::uint64_t due = 0;
+  /// Generator state, set by the generator's constructor
+  std::uint8_t remaining = 0;
+};
+
+/**
+ * @brief Fill a profile with streams resembling a vehicle network
+ *
+ * Periods are drawn from those common on vehicle buses, from 10ms to 1s, and
+ * assigned so that lower, higher priority IDs are sent more often. Most
+ * messages use all 8 bytes with counters and slowly changing signals, and a
+ * few are sent in bursts. Jitter is 2% of the period.
+ *
+ * @param p_streams - profile to fill, one stream per message
+ * @param p_seed - seed that determines the profile
+ * @param p_extended_fraction - fraction of streams using extended IDs
+ */
+void can_make_vehicle_profile(std::span<can_traffic_stream> p_streams,
+                              std::uint64_t p_seed,
+                              float p_extended_fraction = 0.0f);
+
+/**
+ * @brief Deterministic synthetic CAN traffic from a profile of streams
+ *
+ * Produces the frames of every stream of the profile in the order they would
+ * be released, each with its release time. The same profile and seed always
+ * produce the same frames on every platform, so benchmarks and tests are
+ * repeatable. Streams start at a random phase within their period.
+ *
+ *     std::array<hal::can_traffic_stream, 64> profile;
+ *     hal::can_make_vehicle_profile(profile, 1);
+ *     hal::can_traffic_generator traffic(profile, 1);
+ *     traffic.generate_until(100ms, [&](const auto& p_frame) {
+ *       router(p_frame.message);
+ *     });
+ *
+ * To drive a can_virtual_bus, send each frame from a node once the bus time
+ * reaches the frame's time. Streams are kept in a binary heap ordered by
+ * release time inside the profile's storage, so the profile is reordered and
+ * each frame costs O(log streams) with no allocation.
+ */
+class can_traffic_generator
+{
+public:
+  /**
+   * @brief A generated frame and its release time
+   */
+  struct frame
+  {
+    hal::time_duration time{};
+    can::message_t message{};
+  };
+
+  /**
+   * @brief Construct a new traffic generator
+   *
+   * @param p_profile - streams to generate, which the generator reorders and
+   * keeps its state in
+   * @param p_seed - seed that determines phases, jitter and random payloads
+   */
+  can_traffic_generator(std::span<can_traffic_stream> p_profile,
+                        std::uint64_t p_seed);
+
+  /**
+   * @brief Produce the next frame in release order
+   *
+   * @return frame - next frame, or a default frame if the profile is empty
+   */
+  [[nodiscard]] frame next();
+
+  /**
+   * @brief Produce frames in release order
+   *
+   * @param p_frames - destination for the frames
+   * @return std::size_t - number of frames produced, 0 if the profile is
+   * empty
+   */
+  std::size_t generate(std::span<frame> p_frames);
+
+  /**
+   * @brief Produce every frame released up to a point in time
+   *
+   * @tparam F - callable with signature void(const frame&)
+   * @param p_end - frames released at or before this time are produced
+   * @param p_sink - called with each frame in release order
+   * @return std::size_t - number of frames produced
+   */
+  template<typename F>
+  std::size_t generate_until(hal::time_duration p_end, F&& p_sink)
+  {
+    std::size_t count = 0;
+    while (!m_streams.empty() && next_time() <= p_end) {
+      p_sink(next());
+      count++;
+    }
+    return count;
+  }
+
+  /**
+   * @brief Release time of the frame `next()` will produce
+   *
+   * @return hal::time_duration - release time, or the maximum duration if the
+   * profile is empty
+   */
+  [[nodiscard]] hal::time_duration next_time() const
+  {
+    if (m_streams.empty()) {
+      return hal::time_duration::max();
+    }
+    return hal::time_duration(m_streams[0].due);
+  }
+
+private:
+  void emit(frame& p_frame);
+  [[nodiscard]] std::uint64_t random();
+  void release(can_traffic_stream& p_stream);
+  [[nodiscard]] bool has_earlier_child(std::size_t p_index,
+                                       std::uint64_t p_due) const;
+  void sift_down(std::size_t p_index);
+
+  std::span<can_traffic_stream> m_streams;
+  std::uint64_t m_random;
+};
+}  // namespace hal
@@ -0,0 +1,237 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <libhal-util/static_list.hpp>
+#include <libhal/can.hpp>
+#include <libhal/functional.hpp>
+#include <libhal/steady_clock.hpp>
+#include <libhal/units.hpp>
+
+namespace hal {
+/**
+ * @brief Simulated CAN bus connecting many in-process nodes
+ *
+ * Each node attached to the bus is a `hal::can` driver, so a can_router and
+ * everything built on it can be attached to a node exactly as it would be to
+ * a hardware peripheral. Frames sent by nodes wait in the node's transmit
+ * mailboxes until the bus transmits them. Each transmission arbitrates
+ * between every pending frame on the bus bit by bit on the identifier, as
+ * real controllers do, and delivers the winner to every other node.
+ *
+ *     hal::can_virtual_bus bus(500'000);
+ *     auto ecu = bus.attach();
+ *     auto tester = bus.attach();
+ *     hal::can_router ecu_router(ecu);
+ *     hal::can_router tester_router(tester);
+ *     ...
+ *     bus.run_for(10ms);
+ *
+ * Time is simulated. Each frame occupies the bus for `can_frame_bits()` bit
+ * times at the bus baud rate, and `clock()` reports the simulated time, so
+ * timeouts, deadlines and bus load behave as they would on a real bus
+ * without waiting for them. Handlers run when their frame has finished
+ * transmitting and may send further frames, which arbitrate for the next
+ * transmission.
+ *
+ * The bus and its nodes cannot be moved or copied, and the bus must outlive
+ * its nodes.
+ */
+class can_virtual_bus
+{
+public:
+  /// Number of frames a node can have waiting to be transmitted
+  static constexpr std::size_t tx_mailboxes = 8;
+
+  /**
+   * @brief A node attached to the virtual bus
+   *
+   * Removes itself from the bus when destroyed. Cannot be moved, so it must
+   * be stored directly in the variable it was returned into.
+   */
+  class node : public hal::can
+  {
+  public:
+    node(node& p_other) = delete;
+    node& operator=(node& p_other) = delete;
+    ~node() override = default;
+
+    /**
+     * @brief Number of frames waiting in this node's transmit mailboxes
+     *
+     * @return std::size_t - pending frame count
+     */
+    [[nodiscard]] std::size_t pending() const
+    {
+      return m_pending;
+    }
+
+    /**
+     * @brief Number of frames this node has transmitted on the bus
+     *
+     * @return std::uint32_t - transmitted frame count
+     */
+    [[nodiscard]] std::uint32_t transmitted() const
+    {
+      return m_transmitted;
+    }
+
+    /**
+     * @brief Number of transmissions this node lost arbitration for
+     *
+     * @return std::uint32_t - lost arbitration count
+     */
+    [[nodiscard]] std::uint32_t lost_arbitration() const
+    {
+      return m_lost_arbitration;
+    }
+
+  private:
+    friend class can_virtual_bus;
+
+    explicit node(can_virtual_bus& p_bus);
+
+    status driver_configure(const settings& p_settings) override;
+    status driver_bus_on() override;
+    result<send_t> driver_send(const message_t& p_message) override;
+    void driver_on_receive(hal::callback<handler> p_handler) override;
+
+    /// Index of the mailbox holding the frame this node arbitrates with
+    [[nodiscard]] std::size_t next_mailbox() const;
+
+    can_virtual_bus* m_bus;
+    std::array<message_t, tx_mailboxes> m_mailboxes{};
+    hal::callback<handler> m_handler = [](const message_t&) {};
+    std::size_t m_pending = 0;
+    std::uint32_t m_transmitted = 0;
+    std::uint32_t m_lost_arbitration = 0;
+    static_list<node*>::item m_item;
+  };
+
+  /**
+   * @brief Construct a new virtual bus
+   *
+   * @param p_baud_rate - bit rate that sets the simulated frame durations
+   */
+  explicit can_virtual_bus(hal::hertz p_baud_rate = 100.0e3f);
+
+  can_virtual_bus(can_virtual_bus& p_other) = delete;
+  can_virtual_bus& operator=(can_virtual_bus& p_other) = delete;
+
+  /**
+   * @brief Attach a new node to the bus
+   *
+   * @return node - CAN driver of the node that must be stored in a variable
+   */
+  [[nodiscard]] node attach();
+
+  /**
+   * @brief Arbitrate and transmit one frame
+   *
+   * Advances simulated time by the duration of the frame, then delivers it
+   * to every node other than its sender.
+   *
+   * @return true - a frame was transmitted
+   * @return false - no node had a frame pending, time did not advance
+   */
+  bool step();
+
+  /**
+   * @brief Transmit frames for a span of simulated time
+   *
+   * Frames are transmitted back to back while any are pending. A frame that
+   * starts before the span ends is transmitted in full, so time may end up
+   * slightly past the span.
+   *
+   * @param p_duration - simulated time to run for
+   * @return std::size_t - number of frames transmitted
+   */
+  std::size_t run_for(hal::time_duration p_duration);
+
+  /**
+   * @brief Transmit frames until no node has a frame pending
+   *
+   * @param p_max_frames - stop after this many frames, which bounds nodes
+   * that respond to each other forever
+   * @return std::size_t - number of frames transmitted
+   */
+  std::size_t run_until_idle(std::size_t p_max_frames = 1'000'000);
+
+  /**
+   * @brief Clock reporting the simulated time in nanoseconds
+   *
+   * @return hal::steady_clock& - simulated clock
+   */
+  [[nodiscard]] hal::steady_clock& clock()
+  {
+    return m_clock;
+  }
+
+  /**
+   * @brief Current simulated time
+   *
+   * @return hal::time_duration - time since the bus was constructed
+   */
+  [[nodiscard]] hal::time_duration now() const
+  {
+    return hal::time_duration(m_now);
+  }
+
+  /**
+   * @brief Simulated time the bus has spent transmitting frames
+   *
+   * @return hal::time_duration - busy time since the bus was constructed
+   */
+  [[nodiscard]] hal::time_duration busy_time() const
+  {
+    return hal::time_duration(m_busy);
+  }
+
+  /**
+   * @brief Number of frames transmitted on the bus
+   *
+   * @return std::uint64_t - transmitted frame count
+   */
+  [[nodiscard]] std::uint64_t frames() const
+  {
+    return m_frames;
+  }
+
+private:
+  class simulated_clock : public hal::steady_clock
+  {
+  public:
+    explicit simulated_clock(can_virtual_bus& p_bus);
+
+  private:
+    frequency_t driver_frequency() override;
+    uptime_t driver_uptime() override;
+
+    can_virtual_bus* m_bus;
+  };
+
+  hal::hertz m_baud_rate;
+  double m_nanoseconds_per_bit;
+  std::uint64_t m_now = 0;
+  std::uint64_t m_busy = 0;
+  std::uint64_t m_frames = 0;
+  static_list<node*> m_nodes{};
+  simulated_clock m_clock{ *this };
+};
+}  // namespace hal
@@ -0,0 +1,360 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+#include <libhal/can.hpp>
+#include <libhal/error.hpp>
+#include <libhal/functional.hpp>
+#include <libhal/steady_clock.hpp>
+#include <libhal/units.hpp>
+
+#include "can_router.hpp"
+
+namespace hal {
+/**
+ * @brief Function code held in the upper 4 bits of an 11-bit CANopen COB-ID
+ */
+enum class canopen_function : std::uint8_t
+{
+  nmt = 0x0,
+  /// SYNC when sent with node ID 0
+  emergency = 0x1,
+  tpdo1 = 0x3,
+  rpdo1 = 0x4,
+  tpdo2 = 0x5,
+  rpdo2 = 0x6,
+  tpdo3 = 0x7,
+  rpdo3 = 0x8,
+  tpdo4 = 0x9,
+  rpdo4 = 0xA,
+  /// SDO server to client
+  sdo_response = 0xB,
+  /// SDO client to server
+  sdo_request = 0xC,
+  heartbeat = 0xE,
+};
+
+/**
+ * @brief Build the COB-ID of an object from its function code and node ID
+ *
+ * @param p_function - function code
+ * @param p_node - node ID, 1 to 127, or 0 for broadcast objects
+ * @return constexpr hal::can::id_t - 11-bit COB-ID
+ */
+constexpr hal::can::id_t canopen_cob_id(canopen_function p_function,
+                                        std::uint8_t p_node)
+{
+  return (static_cast<hal::can::id_t>(p_function) << 7) | (p_node & 0x7F);
+}
+
+/**
+ * @brief NMT commands sent by the network master
+ */
+enum class canopen_nmt_command : std::uint8_t
+{
+  start = 0x01,
+  stop = 0x02,
+  enter_pre_operational = 0x80,
+  reset_node = 0x81,
+  reset_communication = 0x82,
+};
+
+/**
+ * @brief NMT state reported in a node's heartbeat
+ */
+enum class canopen_nmt_state : std::uint8_t
+{
+  boot_up = 0x00,
+  stopped = 0x04,
+  operational = 0x05,
+  pre_operational = 0x7F,
+};
+
+/**
+ * @brief Contents of an EMCY frame
+ */
+struct canopen_emergency
+{
+  std::uint16_t error_code = 0;
+  std::uint8_t error_register = 0;
+  std::array<hal::byte, 5> manufacturer_data{};
+};
+
+/**
+ * @brief Result of an SDO transfer, using the CiA 301 abort codes
+ *
+ * Codes sent by the server in an abort frame are passed through unchanged, so
+ * values other than the ones listed here may be reported.
+ */
+enum class canopen_sdo_abort : std::uint32_t
+{
+  /// Transfer completed
+  none = 0,
+  toggle_bit = 0x0503'0000,
+  timeout = 0x0504'0000,
+  invalid_command = 0x0504'0001,
+  out_of_memory = 0x0504'0005,
+  general = 0x0800'0000,
+};
+
+/**
+ * @brief Dispatch CANopen traffic to per-node handler tables
+ *
+ * The dispatcher decodes the function code and node ID of every received
+ * 11-bit frame and routes TPDOs, SDO responses, EMCY and heartbeat frames to
+ * the handlers of that node. A 128 entry table maps node IDs onto the node
+ * storage supplied by the caller, so each frame costs one table lookup no
+ * matter how many nodes are attached, and memory is bounded by the storage.
+ *
+ *     std::array<hal::canopen_dispatcher::node, 4> nodes;
+ *     hal::canopen_dispatcher canopen(router, clock, 100ms, nodes);
+ *     HAL_CHECK(canopen.attach(5));
+ *     HAL_CHECK(canopen.on_pdo(5, 1, handle_position));
+ *     HAL_CHECK(canopen.nmt(hal::canopen_nmt_command::start, 5));
+ *
+ * The dispatcher also acts as an SDO client with one transfer in flight per
+ * node. Objects of up to 4 bytes are transferred expedited and larger objects
+ * with segmented transfers, into or out of a buffer supplied by the caller.
+ * Transfers whose server stops responding are aborted by `poll()`.
+ *
+ * Frames reach the dispatcher through a router tap, so no routes are needed
+ * for CANopen COB-IDs. Hardware filters computed from the route table drop
+ * them, so add the COB-IDs with `can_filter_optimizer::add_range()` when
+ * programming filters. `poll()`, the SDO functions and the receive path all
+ * modify the node table. Call them from the same context as the receive
+ * interrupt or with the receive interrupt masked.
+ *
+ * The dispatcher cannot be moved or copied.
+ */
+class canopen_dispatcher
+{
+public:
+  static constexpr std::uint8_t max_node_id = 127;
+
+  using pdo_handler = can_router::message_handler;
+  using emergency_handler =
+    hal::callback<void(std::uint8_t p_node, const canopen_emergency& p_emcy)>;
+  using heartbeat_handler =
+    hal::callback<void(std::uint8_t p_node, canopen_nmt_state p_state)>;
+  using sdo_handler = hal::callback<void(canopen_sdo_abort p_result,
+                                         std::span<const hal::byte> p_data)>;
+
+  /**
+   * @brief Storage for the handlers and SDO client state of one node
+   *
+   * Only constructed by the caller as the dispatcher's node storage.
+   */
+  class node
+  {
+  public:
+    node() = default;
+    node(node& p_other) = delete;
+    node& operator=(node& p_other) = delete;
+    ~node() = default;
+
+  private:
+    friend class canopen_dispatcher;
+
+    enum class sdo_state : std::uint8_t
+    {
+      idle,
+      upload,
+      upload_segment,
+      download,
+      download_segment,
+    };
+
+    void reset(std::uint8_t p_id);
+    void reset_sdo();
+
+    std::array<pdo_handler, 4> m_pdo{};
+    emergency_handler m_emergency{};
+    heartbeat_handler m_heartbeat{};
+    sdo_handler m_sdo_done{};
+    std::span<hal::byte> m_upload{};
+    std::span<const hal::byte> m_download{};
+    std::uint64_t m_sdo_deadline = 0;
+    std::size_t m_sdo_offset = 0;
+    std::uint16_t m_sdo_index = 0;
+    std::uint8_t m_sdo_subindex = 0;
+    sdo_state m_sdo_state = sdo_state::idle;
+    bool m_sdo_toggle = false;
+    std::optional<canopen_nmt_state> m_state{};
+    std::uint8_t m_id = 0;
+  };
+
+  /**
+   * @brief Construct a new CANopen dispatcher
+   *
+   * @param p_router - router to receive frames from and send frames through
+   * @param p_clock - clock used to time out SDO transfers
+   * @param p_sdo_timeout - longest time to wait for each SDO response
+   * @param p_nodes - storage for attached nodes, which also sets the maximum
+   * number of them
+   */
+  canopen_dispatcher(can_router& p_router,
+                     hal::steady_clock& p_clock,
+                     hal::time_duration p_sdo_timeout,
+                     std::span<node> p_nodes);
+
+  canopen_dispatcher(canopen_dispatcher& p_other) = delete;
+  canopen_dispatcher& operator=(canopen_dispatcher& p_other) = delete;
+
+  /**
+   * @brief Start dispatching frames of a node
+   *
+   * Attaching a node that is already attached does nothing.
+   *
+   * @param p_node - node ID, 1 to 127
+   * @return status - std::errc::invalid_argument if the node ID is out of
+   * range, std::errc::not_enough_memory if all node storage is in use
+   */
+  [[nodiscard]] status attach(std::uint8_t p_node);
+
+  /**
+   * @brief Stop dispatching frames of a node and free its storage
+   *
+   * An SDO transfer in flight is dropped without calling its handler.
+   *
+   * @param p_node - node ID
+   */
+  void detach(std::uint8_t p_node);
+
+  /**
+   * @brief Set the handler for a TPDO sent by a node
+   *
+   * @param p_node - node ID of an attached node
+   * @param p_pdo - PDO number, 1 to 4
+   * @param p_handler - called with each TPDO frame
+   * @return status - std::errc::invalid_argument if the node is not attached
+   * or the PDO number is out of range
+   */
+  [[nodiscard]] status on_pdo(std::uint8_t p_node,
+                              std::uint8_t p_pdo,
+                              pdo_handler p_handler);
+
+  /**
+   * @brief Set the handler for EMCY frames sent by a node
+   *
+   * @param p_node - node ID of an attached node
+   * @param p_handler - called with each decoded emergency
+   * @return status - std::errc::invalid_argument if the node is not attached
+   */
+  [[nodiscard]] status on_emergency(std::uint8_t p_node,
+                                    emergency_handler p_handler);
+
+  /**
+   * @brief Set the handler for heartbeats sent by a node
+   *
+   * @param p_node - node ID of an attached node
+   * @param p_handler - called with the state in each heartbeat
+   * @return status - std::errc::invalid_argument if the node is not attached
+   */
+  [[nodiscard]] status on_heartbeat(std::uint8_t p_node,
+                                    heartbeat_handler p_handler);
+
+  /**
+   * @brief NMT state from the last heartbeat of a node
+   *
+   * @param p_node - node ID
+   * @return std::optional<canopen_nmt_state> - last reported state, or
+   * std::nullopt if the node is not attached or has not sent a heartbeat
+   */
+  [[nodiscard]] std::optional<canopen_nmt_state> state(
+    std::uint8_t p_node) const;
+
+  /**
+   * @brief Send an NMT command
+   *
+   * @param p_command - command to send
+   * @param p_node - node ID, or 0 for every node
+   * @return status - error from sending the frame
+   */
+  [[nodiscard]] status nmt(canopen_nmt_command p_command,
+                           std::uint8_t p_node = 0);
+
+  /**
+   * @brief Read an object from a node's object dictionary
+   *
+   * @param p_node - node ID of an attached node
+   * @param p_index - object index
+   * @param p_subindex - object subindex
+   * @param p_buffer - destination for the object, which must remain valid
+   * until p_on_done is called
+   * @param p_on_done - called with the result and the bytes read
+   * @return status - std::errc::invalid_argument if the node is not attached,
+   * std::errc::device_or_resource_busy if a transfer to the node is in flight,
+   * or the error from sending the request. p_on_done is not called for a
+   * transfer that returns an error.
+   */
+  [[nodiscard]] status sdo_read(std::uint8_t p_node,
+                                std::uint16_t p_index,
+                                std::uint8_t p_subindex,
+                                std::span<hal::byte> p_buffer,
+                                sdo_handler p_on_done);
+
+  /**
+   * @brief Write an object in a node's object dictionary
+   *
+   * @param p_node - node ID of an attached node
+   * @param p_index - object index
+   * @param p_subindex - object subindex
+   * @param p_data - object value, which must remain valid until p_on_done is
+   * called
+   * @param p_on_done - called with the result and no data
+   * @return status - std::errc::invalid_argument if the node is not attached
+   * or p_data is empty, std::errc::device_or_resource_busy if a transfer to
+   * the node is in flight, or the error from sending the request. p_on_done is
+   * not called for a transfer that returns an error.
+   */
+  [[nodiscard]] status sdo_write(std::uint8_t p_node,
+                                 std::uint16_t p_index,
+                                 std::uint8_t p_subindex,
+                                 std::span<const hal::byte> p_data,
+                                 sdo_handler p_on_done);
+
+  /**
+   * @brief Abort every SDO transfer whose server has stopped responding
+   *
+   * Should be called periodically. Work is proportional to the node storage.
+   */
+  void poll();
+
+private:
+  [[nodiscard]] node* find(std::uint8_t p_node);
+  [[nodiscard]] const node* find(std::uint8_t p_node) const;
+  void receive(const can::message_t& p_message);
+  void receive_sdo(node& p_node, const can::message_t& p_message);
+  [[nodiscard]] status send_sdo(node& p_node,
+                                const std::array<hal::byte, 8>& p_payload);
+  void send_segment(node& p_node);
+  void abort(node& p_node, canopen_sdo_abort p_code);
+  void finish(node& p_node, canopen_sdo_abort p_code);
+
+  can_router* m_router;
+  hal::steady_clock* m_clock;
+  std::uint64_t m_sdo_timeout;
+  std::span<node> m_nodes;
+  /// Node storage index plus one for each node ID, 0 when not attached
+  std::array<std::uint8_t, max_node_id + 1> m_slots{};
+  can_router::tap_item m_tap;
+};
+}  // namespace hal
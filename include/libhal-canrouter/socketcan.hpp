@@ -0,0 +1,155 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+
+#include <libhal/can.hpp>
+#include <libhal/error.hpp>
+#include <libhal/functional.hpp>
+
+namespace hal {
+/**
+ * @brief Open a raw SocketCAN socket bound to a network interface
+ *
+ * Only available when building for Linux.
+ *
+ * @param p_interface - interface name such as "can0" or "vcan0"
+ * @return result<int> - non-blocking socket descriptor to hand to a
+ * `socketcan`, std::errc::invalid_argument if the name is too long,
+ * std::errc::no_such_device if there is no such interface, or the error of
+ * the failing system call
+ */
+[[nodiscard]] result<int> socketcan_open(std::string_view p_interface);
+
+/**
+ * @brief hal::can driver over a Linux SocketCAN raw socket
+ *
+ * Lets a can_router and everything built on it run unchanged on a Linux
+ * gateway or in CI against a real or virtual (vcan) interface:
+ *
+ *     auto socket = HAL_CHECK(hal::socketcan_open("can0"));
+ *     auto can = HAL_CHECK(hal::socketcan::create(socket));
+ *     hal::can_router router(can);
+ *
+ * Frames are received on a thread that is started when the first receive
+ * handler is installed, so the router's handlers run on that thread and, as
+ * with a driver calling them from an interrupt, changes to the routes must be
+ * synchronised with them. The thread sleeps in epoll_wait() and, once woken,
+ * reads every queued frame with recvmmsg() in batches of `batch_size`, so a
+ * busy bus costs far fewer than one system call per frame. Frames queued
+ * before a handler is installed stay in the socket until then. A handler
+ * may install another handler, for example by destroying or creating a
+ * router, and the new one takes over from the next frame.
+ *
+ * Bit rate and bus state belong to the network interface, so configure()
+ * and bus_on() only succeed, and the interface is set up with
+ * `ip link set can0 type can bitrate 500000 && ip link set can0 up`.
+ * send() writes one frame without blocking and fails with
+ * std::errc::resource_unavailable_try_again when the interface transmit
+ * queue is full.
+ *
+ * Cannot be copied. Moving stops the receive thread and starts a new one
+ * for the moved to driver, so move it before handing it to a router.
+ */
+class socketcan : public hal::can
+{
+public:
+  /// Frames read by a single recvmmsg() call
+  static constexpr std::size_t batch_size = 32;
+
+  /**
+   * @brief Counters for measuring the cost of the driver
+   *
+   * System calls per received frame are
+   * `(wait_calls + receive_calls) / received`.
+   */
+  struct statistics
+  {
+    /// Frames given to the receive handler
+    std::uint64_t received = 0;
+    /// Frames discarded as error frames or malformed
+    std::uint64_t dropped = 0;
+    /// Frames written to the socket
+    std::uint64_t sent = 0;
+    /// Calls to epoll_wait()
+    std::uint64_t wait_calls = 0;
+    /// Calls to recvmmsg()
+    std::uint64_t receive_calls = 0;
+  };
+
+  /**
+   * @brief Create a driver over an open socket
+   *
+   * @param p_socket - socket from socketcan_open() or any datagram socket
+   * carrying `struct can_frame` records, such as one end of a socketpair in
+   * tests. The driver takes ownership and closes it, also when creation
+   * fails.
+   * @return result<socketcan> - the driver, or the error of the
+   * epoll_create1(), eventfd() or epoll_ctl() call that failed while setting
+   * up the receive thread's wake ups
+   */
+  [[nodiscard]] static result<socketcan> create(int p_socket);
+
+  socketcan(socketcan& p_other) = delete;
+  socketcan& operator=(socketcan& p_other) = delete;
+  socketcan& operator=(socketcan&& p_other) = delete;
+  socketcan(socketcan&& p_other) noexcept;
+
+  /**
+   * @brief Stop the receive thread and close the socket
+   */
+  ~socketcan() override;
+
+  /**
+   * @brief Snapshot of the driver counters
+   *
+   * @return statistics - counters since construction
+   */
+  [[nodiscard]] statistics stats() const;
+
+private:
+  explicit socketcan(int p_socket);
+
+  status driver_configure(const settings& p_settings) override;
+  status driver_bus_on() override;
+  result<send_t> driver_send(const message_t& p_message) override;
+  void driver_on_receive(hal::callback<handler> p_handler) override;
+
+  void receive_loop();
+  int receive_pending();
+  bool stop_receiving();
+
+  int m_socket = -1;
+  int m_epoll = -1;
+  int m_stop = -1;
+  std::mutex m_handler_lock;
+  hal::callback<handler> m_handler = [](const message_t&) {};
+  /// Handler installed from within m_handler, taken over after it returns
+  std::optional<hal::callback<handler>> m_next_handler;
+  std::thread m_thread;
+  std::atomic<std::uint64_t> m_received = 0;
+  std::atomic<std::uint64_t> m_dropped = 0;
+  std::atomic<std::uint64_t> m_sent = 0;
+  std::atomic<std::uint64_t> m_wait_calls = 0;
+  std::atomic<std::uint64_t> m_receive_calls = 0;
+};
+}  // namespace hal
@@ -0,0 +1,162 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace hal {
+/**
+ * @brief Fixed capacity, lock-free single producer single consumer queue
+ *
+ * One context, such as an interrupt, may push while another, such as the
+ * application loop, pops. Each side only writes its own index, so no
+ * read-modify-write atomics are required and the queue works on cores
+ * without atomic exchange instructions.
+ *
+ * @tparam T - element type, copied in and out of the queue
+ * @tparam Capacity - maximum number of elements, a power of two
+ */
+template<typename T, std::size_t Capacity>
+class spsc_queue
+{
+public:
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+  static_assert(Capacity <= (std::size_t{ 1 } << 31),
+                "Capacity must fit the 32-bit indexes");
+
+  spsc_queue() = default;
+  spsc_queue(spsc_queue& p_other) = delete;
+  spsc_queue& operator=(spsc_queue& p_other) = delete;
+
+  /**
+   * @brief Append an element, producer side only
+   *
+   * @param p_value - element to copy into the queue
+   * @return true - element was queued
+   * @return false - queue is full and the element was not queued
+   */
+  bool push(const T& p_value)
+  {
+    const auto head = m_head.load(std::memory_order_relaxed);
+    const auto used = head - m_tail.load(std::memory_order_acquire);
+    if (used == Capacity) {
+      return false;
+    }
+    if (used >= m_high_water.load(std::memory_order_relaxed)) {
+      m_high_water.store(used + 1, std::memory_order_relaxed);
+    }
+    m_buffer[head & (Capacity - 1)] = p_value;
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Remove the oldest element, consumer side only
+   *
+   * @param p_value - destination for the element
+   * @return true - an element was removed into p_value
+   * @return false - queue is empty
+   */
+  bool pop(T& p_value)
+  {
+    const auto tail = m_tail.load(std::memory_order_relaxed);
+    if (tail == m_head.load(std::memory_order_acquire)) {
+      return false;
+    }
+    p_value = m_buffer[tail & (Capacity - 1)];
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Visit every queued element in order, consumer side only
+   *
+   * The producer does not touch queued elements until they are popped, so
+   * the visitor may modify them. Elements pushed while visiting may be
+   * missed.
+   *
+   * @param p_visitor - called with a reference to each queued element
+   */
+  template<typename Visitor>
+  void visit(Visitor&& p_visitor)
+  {
+    const auto head = m_head.load(std::memory_order_acquire);
+    for (auto tail = m_tail.load(std::memory_order_relaxed); tail != head;
+         tail++) {
+      p_visitor(m_buffer[tail & (Capacity - 1)]);
+    }
+  }
+
+  /**
+   * @brief Number of queued elements
+   *
+   * Exact when called from either side while the other side is idle,
+   * otherwise a snapshot.
+   *
+   * @return std::size_t - element count
+   */
+  [[nodiscard]] std::size_t size() const
+  {
+    return m_head.load(std::memory_order_acquire) -
+           m_tail.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Determine if the queue holds no elements
+   *
+   * @return true - nothing to pop
+   * @return false - at least one element is queued
+   */
+  [[nodiscard]] bool empty() const
+  {
+    return size() == 0;
+  }
+
+  /**
+   * @brief Most elements the queue has held at once
+   *
+   * Written by the producer, and can be read from either side.
+   *
+   * @return std::size_t - high-water mark since construction
+   */
+  [[nodiscard]] std::size_t high_water() const
+  {
+    return m_high_water.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Maximum number of elements
+   *
+   * @return constexpr std::size_t - Capacity
+   */
+  [[nodiscard]] static constexpr std::size_t capacity()
+  {
+    return Capacity;
+  }
+
+private:
+  std::array<T, Capacity> m_buffer{};
+  /// Number of elements ever pushed, written by the producer only
+  std::atomic<std::uint32_t> m_head = 0;
+  /// Number of elements ever popped, written by the consumer only
+  std::atomic<std::uint32_t> m_tail = 0;
+  /// Most elements ever queued at once, written by the producer only
+  std::atomic<std::uint32_t> m_high_water = 0;
+};
+}  // namespace hal
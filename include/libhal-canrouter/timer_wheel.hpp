@@ -0,0 +1,183 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace hal {
+/**
+ * @brief Hierarchical timer wheel with O(1) arm, re-arm and cancel
+ *
+ * Timers are intrusive nodes owned by the caller. Each level of the wheel
+ * holds 64 slots and each level covers 64x the range of the level below it,
+ * giving a span of 2^24 ticks before timers are clamped and re-cascaded.
+ * Arming a timer is a constant time list insert regardless of how many timers
+ * are pending, which makes it suitable for re-arming on every received frame.
+ *
+ * The wheel does not read a clock. The owner is responsible for converting
+ * time into wheel ticks and calling `advance()`.
+ *
+ * The wheel holds pointers into itself and into its timers, so neither may be
+ * moved or copied once a timer has been armed.
+ */
+class timer_wheel
+{
+public:
+  static constexpr std::size_t slot_bits = 6;
+  static constexpr std::size_t slots_per_level = 1 << slot_bits;
+  static constexpr std::size_t levels = 4;
+  static constexpr std::uint64_t max_span = std::uint64_t{ 1 }
+                                            << (slot_bits * levels);
+
+  /**
+   * @brief Intrusive timer node
+   *
+   * Embed or inherit from this type to associate a timer with an object. The
+   * expiry callback passed to `advance()` receives a reference to this node.
+   */
+  class timer
+  {
+  public:
+    timer() = default;
+    timer(timer& p_other) = delete;
+    timer& operator=(timer& p_other) = delete;
+    ~timer() = default;
+
+    /**
+     * @brief Determine if this timer is currently armed
+     *
+     * @return true - timer is in the wheel and will fire
+     * @return false - timer has fired or was never armed
+     */
+    [[nodiscard]] bool pending() const
+    {
+      return m_pprev != nullptr;
+    }
+
+    /**
+     * @brief Tick at which this timer will fire
+     *
+     * @return std::uint64_t - absolute wheel tick
+     */
+    [[nodiscard]] std::uint64_t expiry() const
+    {
+      return m_expiry;
+    }
+
+  private:
+    friend class timer_wheel;
+    timer* m_next = nullptr;
+    timer** m_pprev = nullptr;
+    std::uint64_t m_expiry = 0;
+  };
+
+  /**
+   * @brief Construct a new timer wheel
+   *
+   * @param p_start_tick - tick that the wheel considers to be "now"
+   */
+  explicit timer_wheel(std::uint64_t p_start_tick = 0);
+
+  timer_wheel(timer_wheel& p_other) = delete;
+  timer_wheel& operator=(timer_wheel& p_other) = delete;
+
+  /**
+   * @brief Arm or re-arm a timer to fire at an absolute tick
+   *
+   * If the timer is already pending it is first removed from its current
+   * slot. Expiry ticks that are already in the past fire on the next call to
+   * `advance()`.
+   *
+   * @param p_timer - timer to arm
+   * @param p_expiry - absolute tick at which the timer should fire
+   */
+  void arm(timer& p_timer, std::uint64_t p_expiry);
+
+  /**
+   * @brief Remove a timer from the wheel without firing it
+   *
+   * Does nothing if the timer is not pending.
+   *
+   * @param p_timer - timer to cancel
+   */
+  void cancel(timer& p_timer);
+
+  /**
+   * @brief The next tick that will be processed by `advance()`
+   *
+   * @return std::uint64_t - absolute wheel tick
+   */
+  [[nodiscard]] std::uint64_t now() const
+  {
+    return m_now;
+  }
+
+  /**
+   * @brief Number of timers currently armed
+   *
+   * @return std::size_t - pending timer count
+   */
+  [[nodiscard]] std::size_t size() const
+  {
+    return m_size;
+  }
+
+  /**
+   * @brief Process every tick up to and including p_tick
+   *
+   * Each expired timer is removed from the wheel before p_on_expire is
+   * called, so the callback may safely re-arm or cancel any timer, including
+   * the one that expired. Work is proportional to the number of elapsed ticks
+   * and expired timers, not to the number of pending timers. If the wheel is
+   * empty, elapsed ticks are skipped in constant time.
+   *
+   * @tparam F - callable with signature void(timer&)
+   * @param p_tick - current absolute tick
+   * @param p_on_expire - called once for each expired timer
+   */
+  template<typename F>
+  void advance(std::uint64_t p_tick, F&& p_on_expire)
+  {
+    while (m_now <= p_tick) {
+      if (m_size == 0) {
+        m_now = p_tick + 1;
+        return;
+      }
+
+      collect_expired();
+      while (m_expired) {
+        timer& current = *m_expired;
+        unlink(current);
+        p_on_expire(current);
+      }
+    }
+  }
+
+private:
+  using slot = timer*;
+
+  void collect_expired();
+  std::size_t cascade(std::size_t p_level, std::size_t p_index);
+  void insert(timer& p_timer);
+  void unlink(timer& p_timer);
+
+  std::array<std::array<slot, slots_per_level>, levels> m_wheel{};
+  timer* m_expired = nullptr;
+  std::uint64_t m_now = 0;
+  std::size_t m_size = 0;
+};
+}  // namespace hal
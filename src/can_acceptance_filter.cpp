@@ -0,0 +1,255 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "libhal-canrouter/can_acceptance_filter.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include <system_error>
+
+namespace hal {
+namespace {
+/// Smallest filter accepting everything both filters accept
+can_acceptance_filter merge(const can_acceptance_filter& p_first,
+                            const can_acceptance_filter& p_second)
+{
+  const auto mask = p_first.mask & p_second.mask & ~(p_first.id ^ p_second.id);
+  return { .id = p_first.id & mask,
+           .mask = mask,
+           .extended = p_first.extended };
+}
+
+/// Determine if everything p_inner accepts is accepted by p_outer
+bool covers(const can_acceptance_filter& p_outer,
+            const can_acceptance_filter& p_inner)
+{
+  return p_outer.extended == p_inner.extended &&
+         (p_inner.mask & p_outer.mask) == p_outer.mask &&
+         (p_inner.id & p_outer.mask) == (p_outer.id & p_outer.mask);
+}
+}  // namespace
+
+/**
+ * @brief Construct a new optimizer
+ *
+ * @param p_filters - one element per available hardware filter bank. Must
+ * outlive the optimizer.
+ */
+can_filter_optimizer::can_filter_optimizer(
+  std::span<can_acceptance_filter> p_filters)
+  : m_filters(p_filters)
+{
+}
+
+/**
+ * @brief Make sure an ID passes the filters
+ *
+ * @param p_id - ID to accept
+ * @return status - std::errc::not_enough_memory if there are no banks, or
+ * if a single bank would have to hold both standard and extended IDs
+ */
+status can_filter_optimizer::add(can::id_t p_id)
+{
+  return insert(can_acceptance_filter::exact(p_id));
+}
+
+/**
+ * @brief Make sure every ID in a list passes the filters
+ *
+ * @param p_ids - IDs to accept
+ * @return status - error from `add()`
+ */
+status can_filter_optimizer::add(std::span<const can::id_t> p_ids)
+{
+  for (const auto id : p_ids) {
+    HAL_CHECK(add(id));
+  }
+  return hal::success();
+}
+
+/**
+ * @brief Make sure every ID from p_first to p_last passes the filters
+ *
+ * The range is split into aligned power of two blocks, each taking one masked
+ * filter, so ranges such as the 128 COB-IDs of a CANopen function code take a
+ * single bank.
+ *
+ * @param p_first - first ID to accept
+ * @param p_last - last ID to accept, inclusive
+ * @return status - std::errc::invalid_argument if p_first is above p_last, or
+ * the error from `add()`
+ */
+status can_filter_optimizer::add_range(can::id_t p_first, can::id_t p_last)
+{
+  if (p_first > p_last || p_last > can_acceptance_filter::extended_mask) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+
+  std::uint64_t first = p_first;
+  const std::uint64_t end = std::uint64_t{ p_last } + 1;
+  while (first < end) {
+    // Largest block aligned to first that does not pass the end. Blocks never
+    // straddle 0x800 as it is aligned, so a block is all standard or all
+    // extended IDs.
+    std::uint64_t size = first == 0 ? std::bit_floor(end)
+                                    : first & (~first + 1);
+    while (first + size > end) {
+      size /= 2;
+    }
+
+    const bool extended = first > can_acceptance_filter::standard_mask;
+    const auto width = extended ? can_acceptance_filter::extended_mask
+                                : can_acceptance_filter::standard_mask;
+    HAL_CHECK(insert({
+      .id = static_cast<can::id_t>(first),
+      .mask = static_cast<can::id_t>(width & ~(size - 1)),
+      .extended = extended,
+    }));
+    first += size;
+  }
+  return hal::success();
+}
+
+status can_filter_optimizer::insert(const can_acceptance_filter& p_candidate)
+{
+  for (const auto& filter : filters()) {
+    if (covers(filter, p_candidate)) {
+      return hal::success();
+    }
+  }
+
+  auto candidate = p_candidate;
+  if (m_used < m_filters.size()) {
+    m_filters[m_used++] = candidate;
+    return hal::success();
+  }
+
+  // Banks are full: treat the candidate as element m_used and find the pair
+  // among the m_used + 1 filters whose merge accepts the fewest extra IDs.
+  auto at = [this, &candidate](std::size_t p_index) -> can_acceptance_filter& {
+    return p_index == m_used ? candidate : m_filters[p_index];
+  };
+
+  auto best_cost = std::numeric_limits<std::uint64_t>::max();
+  std::size_t best_first = 0;
+  std::size_t best_second = 0;
+  for (std::size_t i = 0; i <= m_used; i++) {
+    for (std::size_t j = i + 1; j <= m_used; j++) {
+      if (at(i).extended != at(j).extended) {
+        continue;
+      }
+      const auto merged = merge(at(i), at(j)).accepted_ids();
+      const auto separate = at(i).accepted_ids() + at(j).accepted_ids();
+      const auto cost = merged > separate ? merged - separate : 0;
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_first = i;
+        best_second = j;
+      }
+    }
+  }
+
+  if (best_cost == std::numeric_limits<std::uint64_t>::max()) {
+    return hal::new_error(std::errc::not_enough_memory);
+  }
+
+  const auto merged = merge(at(best_first), at(best_second));
+  // best_first < best_second, so best_first is always a bank. If the pair
+  // did not include the candidate, the candidate takes best_second's bank.
+  m_filters[best_first] = merged;
+  if (best_second != m_used) {
+    m_filters[best_second] = candidate;
+  }
+
+  // Drop filters the merge made redundant
+  std::size_t kept = 0;
+  for (std::size_t i = 0; i < m_used; i++) {
+    if (i != best_first && covers(merged, m_filters[i])) {
+      continue;
+    }
+    m_filters[kept++] = m_filters[i];
+  }
+  m_used = kept;
+
+  return hal::success();
+}
+
+/**
+ * @brief Add the ID of every route in a router
+ *
+ * Only routes are added. Components that receive frames through taps, such as
+ * `canopen_dispatcher` and `can_liveness_monitor`, have no routes, so their
+ * IDs must be added with `add(std::span)` or `add_range()` or the hardware
+ * will drop their frames. `can_bus_load_estimator` only sees the frames that
+ * pass the filters.
+ *
+ * @param p_router - router whose routes must be accepted
+ * @return status - error from `add()`
+ */
+status can_filter_optimizer::add(can_router& p_router)
+{
+  for (const auto& route : p_router.handlers()) {
+    HAL_CHECK(add(route.id));
+  }
+  return hal::success();
+}
+
+/**
+ * @brief Remove every filter
+ *
+ */
+void can_filter_optimizer::clear()
+{
+  m_used = 0;
+}
+
+/**
+ * @brief Number of IDs accepted by the filters
+ *
+ * @return std::uint64_t - accepted IDs, counting overlapping filters once
+ * per filter
+ */
+std::uint64_t can_filter_optimizer::accepted_ids() const
+{
+  std::uint64_t total = 0;
+  for (const auto& filter : filters()) {
+    total += filter.accepted_ids();
+  }
+  return total;
+}
+
+/**
+ * @brief Program a filter bank to accept every route of a router
+ *
+ * Frames consumed only by taps are dropped by the programmed filters. When
+ * taps need frames without routes, fill a `can_filter_optimizer` with the
+ * router and the tap IDs instead and program its filters.
+ *
+ * @param p_router - router whose routes must be accepted
+ * @param p_bank - hardware filters to program
+ * @param p_storage - working storage, at least `p_bank.capacity()` elements
+ * for the best result
+ * @return status - error from the optimizer or the filter bank
+ */
+status can_program_filters(can_router& p_router,
+                           can_filter_bank& p_bank,
+                           std::span<can_acceptance_filter> p_storage)
+{
+  const auto banks = std::min(p_bank.capacity(), p_storage.size());
+  can_filter_optimizer optimizer(p_storage.first(banks));
+  HAL_CHECK(optimizer.add(p_router));
+  return p_bank.program(optimizer.filters());
+}
+}  // namespace hal
@@ -0,0 +1,136 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "libhal-canrouter/can_bus_load.hpp"
+
+#include <algorithm>
+
+#include "clock_ticks.hpp"
+
+namespace hal {
+/**
+ * @brief Construct a new bus load estimator
+ *
+ * @param p_clock - clock used to place frames into the window
+ * @param p_baud_rate - nominal bit rate of the bus
+ * @param p_window - length of the sliding window
+ */
+can_bus_load_estimator::can_bus_load_estimator(hal::steady_clock& p_clock,
+                                               hal::hertz p_baud_rate,
+                                               hal::time_duration p_window)
+  : m_clock(&p_clock)
+  , m_clock_frequency(p_clock.frequency().operating_frequency)
+  , m_baud_rate(p_baud_rate)
+{
+  m_slot_ticks = std::max<std::uint64_t>(
+    clock_ticks(m_clock_frequency, p_window) / window_slots, 1);
+  m_start_tick = m_clock->uptime().ticks;
+  m_current_slot = m_start_tick / m_slot_ticks;
+}
+
+/**
+ * @brief Record a message as a can_router tap
+ *
+ * @param p_message - message seen by the router
+ * @param p_direction - unused, received and sent frames are both counted
+ */
+void can_bus_load_estimator::operator()(
+  const can::message_t& p_message,
+  [[maybe_unused]] can_router::direction p_direction)
+{
+  record(p_message);
+}
+
+/**
+ * @brief Record a frame that occupied the bus
+ *
+ * @param p_message - frame to count
+ */
+void can_bus_load_estimator::record(const can::message_t& p_message)
+{
+  advance();
+
+  const auto bits = can_frame_bits(p_message);
+  auto& current = m_slots[m_current_slot % window_slots];
+  current.bits += bits;
+  current.frames++;
+  m_window_bits += bits;
+  m_window_frames++;
+  m_total_bits += bits;
+  m_total_frames++;
+}
+
+/**
+ * @brief Percentage of bus time occupied by frames within the window
+ *
+ * @return float - bus load from 0.0f to 100.0f
+ */
+float can_bus_load_estimator::load()
+{
+  const auto now = advance();
+  const auto seconds = window_seconds(now);
+  if (seconds <= 0.0f || m_baud_rate <= 0.0f) {
+    return 0.0f;
+  }
+  return 100.0f * static_cast<float>(m_window_bits) / (m_baud_rate * seconds);
+}
+
+/**
+ * @brief Average frame rate within the window
+ *
+ * @return float - frames per second
+ */
+float can_bus_load_estimator::frames_per_second()
+{
+  const auto now = advance();
+  const auto seconds = window_seconds(now);
+  if (seconds <= 0.0f) {
+    return 0.0f;
+  }
+  return static_cast<float>(m_window_frames) / seconds;
+}
+
+std::uint64_t can_bus_load_estimator::advance()
+{
+  const auto now = m_clock->uptime().ticks;
+  const auto now_slot = now / m_slot_ticks;
+
+  if (now_slot > m_current_slot) {
+    const auto expired =
+      std::min<std::uint64_t>(now_slot - m_current_slot, window_slots);
+    for (std::uint64_t i = 1; i <= expired; i++) {
+      auto& stale = m_slots[(m_current_slot + i) % window_slots];
+      m_window_bits -= stale.bits;
+      m_window_frames -= stale.frames;
+      stale = {};
+    }
+    m_current_slot = now_slot;
+  }
+
+  return now;
+}
+
+float can_bus_load_estimator::window_seconds(std::uint64_t p_now) const
+{
+  // The window holds every full slot before the current one plus however much
+  // of the current slot has elapsed.
+  std::uint64_t window_start = 0;
+  if (m_current_slot >= window_slots - 1) {
+    window_start = (m_current_slot - (window_slots - 1)) * m_slot_ticks;
+  }
+  window_start = std::max(window_start, m_start_tick);
+
+  return static_cast<float>(p_now - window_start) / m_clock_frequency;
+}
+}  // namespace hal
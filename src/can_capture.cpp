@@ -0,0 +1,477 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "libhal-canrouter/can_capture.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <system_error>
+#include <utility>
+
+namespace hal {
+namespace {
+constexpr hal::byte length_mask = 0x0F;
+constexpr hal::byte extended_flag = 1 << 4;
+constexpr hal::byte remote_flag = 1 << 5;
+constexpr hal::byte transmit_flag = 1 << 6;
+constexpr std::uint64_t microseconds_per_second = 1'000'000;
+
+void write_le(hal::byte* p_destination,
+              std::uint32_t p_value,
+              std::size_t p_size)
+{
+  for (std::size_t i = 0; i < p_size; i++) {
+    p_destination[i] = static_cast<hal::byte>(p_value >> (8 * i));
+  }
+}
+
+std::uint32_t read_le(const hal::byte* p_source, std::size_t p_size)
+{
+  std::uint32_t value = 0;
+  for (std::size_t i = 0; i < p_size; i++) {
+    value |= static_cast<std::uint32_t>(p_source[i]) << (8 * i);
+  }
+  return value;
+}
+
+int hex_value(char p_character)
+{
+  if (p_character >= '0' && p_character <= '9') {
+    return p_character - '0';
+  }
+  if (p_character >= 'a' && p_character <= 'f') {
+    return p_character - 'a' + 10;
+  }
+  if (p_character >= 'A' && p_character <= 'F') {
+    return p_character - 'A' + 10;
+  }
+  return -1;
+}
+
+constexpr std::array<char, 16> hex_digits = { '0', '1', '2', '3', '4', '5',
+                                              '6', '7', '8', '9', 'A', 'B',
+                                              'C', 'D', 'E', 'F' };
+}  // namespace
+
+/**
+ * @brief Create a capture writer
+ *
+ * @param p_buffer - staging buffer
+ * @param p_tick_frequency - frequency of record timestamps in Hz
+ * @param p_sink - destination for encoded blocks
+ * @return result<can_capture_writer> - writer or std::errc::invalid_argument
+ * if the buffer is too small
+ */
+result<can_capture_writer> can_capture_writer::create(
+  std::span<hal::byte> p_buffer,
+  std::uint32_t p_tick_frequency,
+  sink p_sink)
+{
+  if (p_buffer.size() < can_capture_format::max_record_size ||
+      p_buffer.size() < can_capture_format::header_size) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+
+  can_capture_writer writer(p_buffer, std::move(p_sink));
+
+  auto* header = p_buffer.data();
+  std::copy(can_capture_format::magic.begin(),
+            can_capture_format::magic.end(),
+            header);
+  write_le(header + 4, can_capture_format::version, 2);
+  write_le(header + 6, can_capture_format::header_size, 2);
+  write_le(header + 8, p_tick_frequency, 4);
+  write_le(header + 12, 0, 4);
+  writer.m_used = can_capture_format::header_size;
+
+  return writer;
+}
+
+can_capture_writer::can_capture_writer(std::span<hal::byte> p_buffer,
+                                       sink p_sink)
+  : m_buffer(p_buffer)
+  , m_sink(std::move(p_sink))
+{
+}
+
+/**
+ * @brief Append a record to the capture
+ *
+ * @param p_record - record to append
+ * @return status - error from the sink if a flush was needed and failed
+ */
+status can_capture_writer::write(const can_capture_record& p_record)
+{
+  if (m_buffer.size() - m_used < can_capture_format::max_record_size) {
+    HAL_CHECK(flush());
+  }
+
+  auto* destination = m_buffer.data() + m_used;
+  std::size_t size = 0;
+
+  std::uint64_t delta = p_record.timestamp - m_last_timestamp;
+  do {
+    hal::byte next = delta & 0x7F;
+    delta >>= 7;
+    if (delta != 0) {
+      next |= 0x80;
+    }
+    destination[size++] = next;
+  } while (delta != 0);
+
+  const auto& message = p_record.message;
+  const auto length = std::min<std::uint8_t>(message.length, 8);
+  const bool extended = message.id > 0x7FF;
+  hal::byte flags = length;
+  if (extended) {
+    flags |= extended_flag;
+  }
+  if (message.is_remote_request) {
+    flags |= remote_flag;
+  }
+  if (p_record.direction == can_router::direction::transmit) {
+    flags |= transmit_flag;
+  }
+
+  destination[size++] = p_record.bus;
+  destination[size++] = flags;
+
+  const std::size_t id_size = extended ? 4 : 2;
+  write_le(destination + size, message.id, id_size);
+  size += id_size;
+
+  if (!message.is_remote_request) {
+    std::copy_n(message.payload.begin(), length, destination + size);
+    size += length;
+  }
+
+  m_used += size;
+  m_last_timestamp = p_record.timestamp;
+  m_records++;
+
+  return hal::success();
+}
+
+/**
+ * @brief Hand every buffered byte to the sink
+ *
+ * @return status - error from the sink
+ */
+status can_capture_writer::flush()
+{
+  if (m_used == 0) {
+    return hal::success();
+  }
+  HAL_CHECK(m_sink(m_buffer.first(m_used)));
+  m_used = 0;
+  return hal::success();
+}
+
+/**
+ * @brief Create a reader over a complete capture
+ *
+ * @param p_capture - capture bytes starting at the header
+ * @return result<can_capture_reader> - reader or std::errc::invalid_argument
+ * if the header is missing or unsupported
+ */
+result<can_capture_reader> can_capture_reader::create(
+  std::span<const hal::byte> p_capture)
+{
+  if (p_capture.size() < can_capture_format::header_size ||
+      !std::equal(can_capture_format::magic.begin(),
+                  can_capture_format::magic.end(),
+                  p_capture.begin())) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+
+  const auto version = read_le(&p_capture[4], 2);
+  const auto header_size = read_le(&p_capture[6], 2);
+  if (version != can_capture_format::version ||
+      header_size < can_capture_format::header_size ||
+      header_size > p_capture.size()) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+
+  can_capture_reader reader(p_capture, read_le(&p_capture[8], 4));
+  reader.m_position = header_size;
+  return reader;
+}
+
+can_capture_reader::can_capture_reader(std::span<const hal::byte> p_capture,
+                                       std::uint32_t p_tick_frequency)
+  : m_capture(p_capture)
+  , m_position(0)
+  , m_tick_frequency(p_tick_frequency)
+{
+}
+
+/**
+ * @brief Decode the next record
+ *
+ * @param p_record - destination for the decoded record
+ * @return true - a record was decoded
+ * @return false - end of capture reached, or the last record is truncated
+ */
+bool can_capture_reader::next(can_capture_record& p_record)
+{
+  const auto* data = m_capture.data();
+  const auto size = m_capture.size();
+  auto position = m_position;
+
+  if (position >= size) {
+    return false;
+  }
+
+  std::uint64_t delta = 0;
+  for (unsigned shift = 0;; shift += 7) {
+    if (position >= size || shift > 63) {
+      m_truncated = true;
+      return false;
+    }
+    const auto next = data[position++];
+    delta |= static_cast<std::uint64_t>(next & 0x7F) << shift;
+    if ((next & 0x80) == 0) {
+      break;
+    }
+  }
+
+  if (size - position < 2) {
+    m_truncated = true;
+    return false;
+  }
+
+  const auto bus = data[position++];
+  const auto flags = data[position++];
+  const std::size_t id_size = (flags & extended_flag) ? 4 : 2;
+  const std::size_t length = flags & length_mask;
+  const std::size_t payload_size = (flags & remote_flag) ? 0 : length;
+
+  if (size - position < id_size + payload_size || length > 8) {
+    m_truncated = true;
+    return false;
+  }
+
+  m_timestamp += delta;
+  p_record.timestamp = m_timestamp;
+  p_record.bus = bus;
+  p_record.direction = (flags & transmit_flag)
+                         ? can_router::direction::transmit
+                         : can_router::direction::receive;
+  p_record.message.id = read_le(data + position, id_size);
+  position += id_size;
+  p_record.message.length = static_cast<std::uint8_t>(length);
+  p_record.message.is_remote_request = (flags & remote_flag) != 0;
+  p_record.message.payload = {};
+  std::copy_n(data + position, payload_size, p_record.message.payload.begin());
+  position += payload_size;
+
+  m_position = position;
+  return true;
+}
+
+/**
+ * @brief Start reading again from the first record
+ *
+ */
+void can_capture_reader::rewind()
+{
+  m_position = read_le(&m_capture[6], 2);
+  m_timestamp = 0;
+  m_truncated = false;
+}
+
+/**
+ * @brief Parse one line of a candump log
+ *
+ * @param p_line - a single line without the trailing newline
+ * @param p_tick_frequency - tick frequency to convert the timestamp into
+ * @param p_interface - if not null, set to the interface name in p_line
+ * @return std::optional<can_capture_record> - decoded frame or std::nullopt
+ */
+std::optional<can_capture_record> parse_candump(
+  std::string_view p_line,
+  std::uint32_t p_tick_frequency,
+  std::string_view* p_interface)
+{
+  // (seconds.microseconds)
+  if (p_line.size() < 3 || p_line.front() != '(') {
+    return std::nullopt;
+  }
+  const auto dot = p_line.find('.');
+  const auto close = p_line.find(')');
+  if (dot == std::string_view::npos || close == std::string_view::npos ||
+      dot > close) {
+    return std::nullopt;
+  }
+
+  std::uint64_t seconds = 0;
+  std::uint64_t microseconds = 0;
+  const auto* line = p_line.data();
+  auto [seconds_end, seconds_error] =
+    std::from_chars(line + 1, line + dot, seconds);
+  auto [micro_end, micro_error] =
+    std::from_chars(line + dot + 1, line + close, microseconds);
+  if (seconds_error != std::errc{} || micro_error != std::errc{} ||
+      seconds_end != line + dot || micro_end != line + close) {
+    return std::nullopt;
+  }
+
+  // Scale the fractional part by the number of digits actually written
+  const auto fraction_digits = close - dot - 1;
+  for (auto digits = fraction_digits; digits < 6; digits++) {
+    microseconds *= 10;
+  }
+  for (auto digits = fraction_digits; digits > 6; digits--) {
+    microseconds /= 10;
+  }
+
+  // interface
+  auto rest = p_line.substr(close + 1);
+  const auto interface_start = rest.find_first_not_of(' ');
+  if (interface_start == std::string_view::npos) {
+    return std::nullopt;
+  }
+  rest = rest.substr(interface_start);
+  const auto interface_end = rest.find(' ');
+  if (interface_end == std::string_view::npos) {
+    return std::nullopt;
+  }
+  if (p_interface) {
+    *p_interface = rest.substr(0, interface_end);
+  }
+  rest = rest.substr(interface_end);
+  rest = rest.substr(std::min(rest.find_first_not_of(' '), rest.size()));
+
+  // id#data
+  const auto hash = rest.find('#');
+  if (hash == std::string_view::npos || hash == 0 || hash > 8) {
+    return std::nullopt;
+  }
+
+  can_capture_record record{};
+  record.timestamp =
+    seconds * p_tick_frequency +
+    (microseconds * p_tick_frequency) / microseconds_per_second;
+
+  hal::can::id_t id = 0;
+  for (std::size_t i = 0; i < hash; i++) {
+    const auto digit = hex_value(rest[i]);
+    if (digit < 0) {
+      return std::nullopt;
+    }
+    id = (id << 4) | static_cast<hal::can::id_t>(digit);
+  }
+  record.message.id = id;
+
+  auto data = rest.substr(hash + 1);
+  while (!data.empty() && (data.back() == ' ' || data.back() == '\r')) {
+    data.remove_suffix(1);
+  }
+
+  if (!data.empty() && (data.front() == 'R' || data.front() == 'r')) {
+    record.message.is_remote_request = true;
+    if (data.size() == 2 && data[1] >= '0' && data[1] <= '8') {
+      record.message.length = static_cast<std::uint8_t>(data[1] - '0');
+    } else if (data.size() != 1) {
+      return std::nullopt;
+    }
+    return record;
+  }
+
+  std::uint8_t length = 0;
+  for (std::size_t i = 0; i < data.size();) {
+    if (data[i] == '.') {
+      i++;
+      continue;
+    }
+    if (i + 1 >= data.size() || length >= 8) {
+      return std::nullopt;
+    }
+    const auto high = hex_value(data[i]);
+    const auto low = hex_value(data[i + 1]);
+    if (high < 0 || low < 0) {
+      return std::nullopt;
+    }
+    record.message.payload[length++] = static_cast<hal::byte>(high << 4 | low);
+    i += 2;
+  }
+  record.message.length = length;
+
+  return record;
+}
+
+/**
+ * @brief Format a record as one line of a candump log
+ *
+ * @param p_record - frame to format
+ * @param p_interface - interface name to print for the frame
+ * @param p_tick_frequency - tick frequency of the record's timestamp
+ * @param p_buffer - destination for the text
+ * @return std::string_view - formatted text within p_buffer, or empty if
+ * p_buffer is too small
+ */
+std::string_view format_candump(const can_capture_record& p_record,
+                                std::string_view p_interface,
+                                std::uint32_t p_tick_frequency,
+                                std::span<char> p_buffer)
+{
+  // "(" + 20 digit seconds + "." + 6 digits + ") " + interface + " " +
+  // 8 digit id + "#" + 16 hex digits
+  constexpr std::size_t fixed_size = 1 + 20 + 1 + 6 + 2 + 1 + 8 + 1 + 16;
+  if (p_tick_frequency == 0 ||
+      p_buffer.size() < fixed_size + p_interface.size()) {
+    return {};
+  }
+
+  const auto& message = p_record.message;
+  const auto seconds = p_record.timestamp / p_tick_frequency;
+  const auto microseconds = ((p_record.timestamp % p_tick_frequency) *
+                             microseconds_per_second) /
+                            p_tick_frequency;
+
+  char* out = p_buffer.data();
+  *out++ = '(';
+  out = std::to_chars(out, p_buffer.data() + p_buffer.size(), seconds).ptr;
+  *out++ = '.';
+  for (std::uint64_t divisor = 100'000; divisor != 0; divisor /= 10) {
+    *out++ = static_cast<char>('0' + (microseconds / divisor) % 10);
+  }
+  *out++ = ')';
+  *out++ = ' ';
+  out = std::copy(p_interface.begin(), p_interface.end(), out);
+  *out++ = ' ';
+
+  const int id_digits = (message.id > 0x7FF) ? 8 : 3;
+  for (int digit = id_digits - 1; digit >= 0; digit--) {
+    *out++ = hex_digits[(message.id >> (4 * digit)) & 0xF];
+  }
+  *out++ = '#';
+
+  if (message.is_remote_request) {
+    *out++ = 'R';
+    const auto length = std::min<std::uint8_t>(message.length, 8);
+    if (length != 0) {
+      *out++ = static_cast<char>('0' + length);
+    }
+  } else {
+    const auto length = std::min<std::uint8_t>(message.length, 8);
+    for (std::size_t i = 0; i < length; i++) {
+      *out++ = hex_digits[message.payload[i] >> 4];
+      *out++ = hex_digits[message.payload[i] & 0xF];
+    }
+  }
+
+  return { p_buffer.data(), static_cast<std::size_t>(out - p_buffer.data()) };
+}
+}  // namespace hal
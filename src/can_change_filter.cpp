@@ -0,0 +1,109 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "libhal-canrouter/can_change_filter.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "clock_ticks.hpp"
+
+namespace hal {
+namespace {
+/// Bytes beyond the frame's length are not part of the frame, so they are
+/// masked off before comparing.
+std::uint64_t payload_word(const can::message_t& p_message)
+{
+  std::uint64_t word = 0;
+  for (std::size_t i = 0; i < p_message.payload.size(); i++) {
+    word |= std::uint64_t{ p_message.payload[i] } << (8 * i);
+  }
+
+  const auto length = std::min<std::size_t>(p_message.length, 8);
+  const auto mask = length == 8 ? ~std::uint64_t{ 0 }
+                                : (std::uint64_t{ 1 } << (8 * length)) - 1;
+  return p_message.is_remote_request ? 0 : word & mask;
+}
+
+std::uint16_t header(const can::message_t& p_message)
+{
+  return static_cast<std::uint16_t>(p_message.length |
+                                    p_message.is_remote_request << 8);
+}
+}  // namespace
+
+/**
+ * @brief Construct a filter that passes on changes only
+ *
+ * @param p_handler - handler for changed frames
+ */
+can_change_filter::can_change_filter(can_router::message_handler p_handler)
+  : m_handler(std::move(p_handler))
+{
+}
+
+/**
+ * @brief Construct a filter that passes on changes and periodic refreshes
+ *
+ * @param p_handler - handler for changed frames
+ * @param p_clock - clock used to measure silence
+ * @param p_max_silence - longest time without passing a frame on
+ */
+can_change_filter::can_change_filter(can_router::message_handler p_handler,
+                                     hal::steady_clock& p_clock,
+                                     hal::time_duration p_max_silence)
+  : m_handler(std::move(p_handler))
+  , m_clock(&p_clock)
+{
+  m_max_silence_ticks = clock_ticks(p_clock, p_max_silence);
+}
+
+/**
+ * @brief Pass a frame to the handler if it differs from the last one
+ *
+ * @param p_message - frame received for the route
+ */
+void can_change_filter::operator()(const can::message_t& p_message)
+{
+  const auto payload = payload_word(p_message);
+  const auto frame_header = header(p_message);
+  bool changed = payload != m_last_payload || frame_header != m_last_header;
+
+  std::uint64_t now = 0;
+  if (m_clock) {
+    now = m_clock->uptime().ticks;
+    changed = changed || now - m_last_tick >= m_max_silence_ticks;
+  }
+
+  if (!changed) {
+    m_suppressed++;
+    return;
+  }
+
+  m_last_payload = payload;
+  m_last_header = frame_header;
+  m_last_tick = now;
+  m_passed++;
+  m_handler(p_message);
+}
+
+/**
+ * @brief Pass the next frame on regardless of its contents
+ *
+ */
+void can_change_filter::reset()
+{
+  m_last_header = 0xFFFF;
+}
+}  // namespace hal
@@ -0,0 +1,226 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "libhal-canrouter/can_correlator.hpp"
+
+#include <algorithm>
+#include <system_error>
+#include <utility>
+
+#include "clock_ticks.hpp"
+
+namespace hal {
+/**
+ * @brief Construct a new correlator
+ *
+ * @param p_router - router whose bus requests are sent on
+ * @param p_clock - clock used to time out requests
+ * @param p_resolution - granularity of timeouts
+ * @param p_table - storage for outstanding requests, which also sets the
+ * maximum number of them
+ * @param p_token_byte - index of the token byte in response payloads
+ */
+can_correlator::can_correlator(can_router& p_router,
+                               hal::steady_clock& p_clock,
+                               hal::time_duration p_resolution,
+                               std::span<pending_request> p_table,
+                               std::uint8_t p_token_byte)
+  : m_router(&p_router)
+  , m_clock(&p_clock)
+  , m_clock_ticks_per_tick(clock_ticks_per_tick(p_clock, p_resolution))
+  , m_resolution(std::max(p_resolution, hal::time_duration(1)))
+  , m_table(p_table)
+  , m_wheel(current_tick())
+  , m_token_byte(p_token_byte)
+{
+  for (auto& entry : m_table) {
+    entry.m_bucket = nullptr;
+    entry.m_next = m_free;
+    m_free = &entry;
+  }
+}
+
+can_correlator::~can_correlator()
+{
+  for (auto& entry : m_table) {
+    m_wheel.cancel(entry);
+  }
+}
+
+/**
+ * @brief Send a request and wait for its response
+ *
+ * @param p_request - request frame and its response key
+ * @param p_on_response - called with the response frame
+ * @param p_on_timeout - called from `poll()` if no response arrives in time
+ * @return status - std::errc::resource_unavailable_try_again if the table is
+ * full, std::errc::device_or_resource_busy if a request with the same response
+ * key is already outstanding, or the error from sending the frame.
+ */
+status can_correlator::request(const can_request& p_request,
+                               response_handler p_on_response,
+                               timeout_handler p_on_timeout)
+{
+  if (find(p_request.response_id, p_request.token) != nullptr) {
+    return hal::new_error(std::errc::device_or_resource_busy);
+  }
+  if (m_free == nullptr) {
+    return hal::new_error(std::errc::resource_unavailable_try_again);
+  }
+
+  auto& entry = *m_free;
+  m_free = entry.m_next;
+  entry.m_on_response = std::move(p_on_response);
+  entry.m_on_timeout = std::move(p_on_timeout);
+  entry.m_response_id = p_request.response_id;
+  entry.m_token = p_request.token.value_or(0);
+  entry.m_has_token = p_request.token.has_value();
+
+  auto& head = bucket(p_request.response_id, p_request.token);
+  entry.m_next = head;
+  head = &entry;
+  m_outstanding++;
+
+  // Round up so that a timeout is never reported early. The current tick may
+  // be nearly over, so add one to ensure the full timeout elapses.
+  const auto timeout =
+    (std::max<hal::time_duration::rep>(p_request.timeout.count(), 0) +
+     m_resolution.count() - 1) /
+    m_resolution.count();
+  m_wheel.arm(entry, current_tick() + static_cast<std::uint64_t>(timeout) + 1);
+
+  // The request is in the table before it is sent, so a response that
+  // arrives before send() returns still finds it.
+  auto sent = m_router->bus().send(p_request.message);
+  if (!sent) {
+    cancel(p_request.response_id, p_request.token);
+    return sent.error();
+  }
+
+  return hal::success();
+}
+
+/**
+ * @brief Abandon an outstanding request without calling its callbacks
+ *
+ * @param p_response_id - response ID of the request
+ * @param p_token - token of the request, if it has one
+ * @return true - the request was outstanding and has been removed
+ * @return false - no such request was outstanding
+ */
+bool can_correlator::cancel(hal::can::id_t p_response_id,
+                            std::optional<hal::byte> p_token)
+{
+  auto link = find(p_response_id, p_token);
+  if (link == nullptr) {
+    return false;
+  }
+  release(link);
+  return true;
+}
+
+/**
+ * @brief Complete the outstanding request that a frame responds to
+ *
+ * @param p_message - frame received on a response ID
+ */
+void can_correlator::operator()(const can::message_t& p_message)
+{
+  pending_request** link = nullptr;
+  if (p_message.length > m_token_byte) {
+    link = find(p_message.id, p_message.payload[m_token_byte]);
+  }
+  if (link == nullptr) {
+    link = find(p_message.id, std::nullopt);
+  }
+  if (link == nullptr) {
+    m_unmatched++;
+    return;
+  }
+
+  auto handler = std::move((*link)->m_on_response);
+  release(link);
+  handler(p_message);
+}
+
+/**
+ * @brief Report every request whose timeout has passed
+ */
+void can_correlator::poll()
+{
+  m_wheel.advance(current_tick(), [this](timer_wheel::timer& p_timer) {
+    auto& entry = static_cast<pending_request&>(p_timer);
+    std::optional<hal::byte> token;
+    if (entry.m_has_token) {
+      token = entry.m_token;
+    }
+
+    auto handler = std::move(entry.m_on_timeout);
+    release(find(entry.m_response_id, token));
+    handler();
+  });
+}
+
+std::uint64_t can_correlator::current_tick()
+{
+  return m_clock->uptime().ticks / m_clock_ticks_per_tick;
+}
+
+can_correlator::pending_request*& can_correlator::bucket(
+  hal::can::id_t p_id,
+  std::optional<hal::byte> p_token)
+{
+  // Requests without a token use key 0 so they never collide with a token
+  const std::uint32_t token = p_token ? *p_token + 1u : 0u;
+  const std::uint32_t hash =
+    (p_id ^ (token << 24) ^ (token >> 8)) * 0x9E37'79B1u;
+  // Map the hash onto the table without a division
+  const auto index =
+    (static_cast<std::uint64_t>(hash) * m_table.size()) >> 32;
+  return m_table[index].m_bucket;
+}
+
+can_correlator::pending_request** can_correlator::find(
+  hal::can::id_t p_id,
+  std::optional<hal::byte> p_token)
+{
+  if (m_table.empty()) {
+    return nullptr;
+  }
+
+  auto link = &bucket(p_id, p_token);
+  while (*link != nullptr) {
+    const auto& entry = **link;
+    if (entry.m_response_id == p_id &&
+        entry.m_has_token == p_token.has_value() &&
+        (!entry.m_has_token || entry.m_token == *p_token)) {
+      return link;
+    }
+    link = &(*link)->m_next;
+  }
+  return nullptr;
+}
+
+void can_correlator::release(pending_request** p_link)
+{
+  auto& entry = **p_link;
+  *p_link = entry.m_next;
+  m_wheel.cancel(entry);
+  entry.m_on_response = can_router::noop;
+  entry.m_on_timeout = []() {};
+  entry.m_next = m_free;
+  m_free = &entry;
+  m_outstanding--;
+}
+}  // namespace hal
@@ -0,0 +1,115 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "libhal-canrouter/can_deadline_monitor.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "clock_ticks.hpp"
+
+namespace hal {
+can_deadline_monitor::monitored_route::monitored_route(
+  can_deadline_monitor& p_monitor,
+  can_router& p_router,
+  hal::can::id_t p_id,
+  std::uint64_t p_period,
+  can_router::message_handler p_handler)
+  : m_monitor(&p_monitor)
+  , m_period(p_period)
+  , m_id(p_id)
+  , m_route(p_router.add_message_callback(
+      p_id,
+      [this, handler = std::move(p_handler)](const can::message_t& p_message) {
+        m_monitor->rearm(*this);
+        handler(p_message);
+      }))
+{
+  m_monitor->rearm(*this);
+}
+
+can_deadline_monitor::monitored_route::~monitored_route()
+{
+  m_monitor->m_wheel.cancel(*this);
+}
+
+/**
+ * @brief Construct a new deadline monitor
+ *
+ * @param p_clock - clock used to timestamp message arrival and deadlines
+ * @param p_resolution - granularity of deadlines
+ * @param p_on_timeout - called from `poll()` with the ID of each route that
+ * has missed its deadline
+ */
+can_deadline_monitor::can_deadline_monitor(hal::steady_clock& p_clock,
+                                           hal::time_duration p_resolution,
+                                           timeout_handler p_on_timeout)
+  : m_clock(&p_clock)
+  , m_clock_ticks_per_tick(clock_ticks_per_tick(p_clock, p_resolution))
+  , m_resolution(std::max(p_resolution, hal::time_duration(1)))
+  , m_wheel(current_tick())
+  , m_on_timeout(std::move(p_on_timeout))
+{
+}
+
+/**
+ * @brief Add a route to the router with an expected receive period
+ *
+ * @param p_router - router to add the route to
+ * @param p_id - ID of the periodic message
+ * @param p_period - maximum time allowed between messages
+ * @param p_handler - callback to be executed when a p_id message is received
+ * @return monitored_route - route that must be stored in a variable
+ */
+can_deadline_monitor::monitored_route can_deadline_monitor::watch(
+  can_router& p_router,
+  hal::can::id_t p_id,
+  hal::time_duration p_period,
+  can_router::message_handler p_handler)
+{
+  // Round up so that a deadline is never reported early
+  const auto period =
+    (p_period.count() + m_resolution.count() - 1) / m_resolution.count();
+
+  return monitored_route(*this,
+                         p_router,
+                         p_id,
+                         std::max<std::uint64_t>(period, 1),
+                         std::move(p_handler));
+}
+
+/**
+ * @brief Report every route whose deadline has passed
+ */
+void can_deadline_monitor::poll()
+{
+  m_wheel.advance(current_tick(), [this](timer_wheel::timer& p_timer) {
+    auto& route = static_cast<monitored_route&>(p_timer);
+    route.m_timeouts++;
+    m_on_timeout(route.m_id);
+  });
+}
+
+std::uint64_t can_deadline_monitor::current_tick()
+{
+  return m_clock->uptime().ticks / m_clock_ticks_per_tick;
+}
+
+void can_deadline_monitor::rearm(monitored_route& p_route)
+{
+  // The current tick may be nearly over, so add one to ensure that a full
+  // period elapses before the deadline is reported.
+  m_wheel.arm(p_route, current_tick() + p_route.m_period + 1);
+}
+}  // namespace hal
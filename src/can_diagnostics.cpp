@@ -0,0 +1,437 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "libhal-canrouter/can_diagnostics.hpp"
+
+#include <algorithm>
+
+#include "clock_ticks.hpp"
+
+namespace hal {
+namespace {
+using format = can_diagnostics_format;
+using record_type = can_diagnostics_record_type;
+
+hal::byte* put_u16(hal::byte* p_out, std::uint16_t p_value)
+{
+  p_out[0] = static_cast<hal::byte>(p_value);
+  p_out[1] = static_cast<hal::byte>(p_value >> 8);
+  return p_out + 2;
+}
+
+hal::byte* put_u32(hal::byte* p_out, std::uint32_t p_value)
+{
+  for (int i = 0; i < 4; i++) {
+    p_out[i] = static_cast<hal::byte>(p_value >> (8 * i));
+  }
+  return p_out + 4;
+}
+
+std::uint16_t get_u16(const hal::byte* p_in)
+{
+  return static_cast<std::uint16_t>(p_in[0] | p_in[1] << 8);
+}
+
+std::uint32_t get_u32(const hal::byte* p_in)
+{
+  std::uint32_t value = 0;
+  for (int i = 0; i < 4; i++) {
+    value |= static_cast<std::uint32_t>(p_in[i]) << (8 * i);
+  }
+  return value;
+}
+
+std::uint16_t saturate_u16(std::size_t p_value)
+{
+  return static_cast<std::uint16_t>(std::min<std::size_t>(p_value, 0xFFFF));
+}
+
+std::uint32_t saturate_u32(float p_value)
+{
+  if (!(p_value > 0.0f)) {
+    return 0;
+  }
+  if (p_value >= 4294967295.0f) {
+    return 0xFFFF'FFFF;
+  }
+  return static_cast<std::uint32_t>(p_value);
+}
+}  // namespace
+
+can_diagnostics_report::can_diagnostics_report(std::span<hal::byte> p_buffer)
+  : m_buffer(p_buffer)
+{
+}
+
+/**
+ * @brief Add an application defined counter
+ *
+ * @param p_key - key of the counter, 1 to 255
+ * @param p_value - value of the counter
+ */
+void can_diagnostics_report::counter(std::uint8_t p_key,
+                                     std::uint32_t p_value)
+{
+  if (auto* out = reserve(record_type::counter, format::counter_size)) {
+    *out++ = p_key;
+    put_u32(out, p_value);
+  }
+}
+
+/**
+ * @brief Add the statistics of a queue
+ *
+ * @param p_index - queue number chosen by the application
+ * @param p_high_water - most elements the queue has held at once, saturated
+ * at 65535
+ * @param p_capacity - elements the queue can hold, saturated at 65535
+ * @param p_dropped - elements lost because the queue was full
+ */
+void can_diagnostics_report::queue(std::uint8_t p_index,
+                                   std::size_t p_high_water,
+                                   std::size_t p_capacity,
+                                   std::uint32_t p_dropped)
+{
+  if (auto* out = reserve(record_type::queue, format::queue_size)) {
+    *out++ = p_index;
+    out = put_u16(out, saturate_u16(p_high_water));
+    out = put_u16(out, saturate_u16(p_capacity));
+    put_u32(out, p_dropped);
+  }
+}
+
+/**
+ * @brief Add the bus load, such as from a can_bus_load_estimator
+ *
+ * @param p_load - bus load in percent, saturated at 655.35
+ * @param p_frames_per_second - frame rate
+ */
+void can_diagnostics_report::bus_load(float p_load, float p_frames_per_second)
+{
+  if (auto* out = reserve(record_type::bus_load, format::bus_load_size)) {
+    const auto hundredths = saturate_u32(p_load * 100.0f + 0.5f);
+    out = put_u16(out, saturate_u16(hundredths));
+    put_u32(out, saturate_u32(p_frames_per_second + 0.5f));
+  }
+}
+
+void can_diagnostics_report::begin()
+{
+  if (auto* out = reserve(record_type::begin, format::begin_size)) {
+    out[0] = format::version;
+    out[1] = 0;
+  }
+}
+
+void can_diagnostics_report::route(hal::can::id_t p_id, std::uint32_t p_hits)
+{
+  if (auto* out = reserve(record_type::route, format::route_size)) {
+    out = put_u32(out, p_id);
+    put_u32(out, p_hits);
+  }
+}
+
+hal::byte* can_diagnostics_report::reserve(can_diagnostics_record_type p_type,
+                                           std::size_t p_size)
+{
+  // Once a record is left out, later ones are too, so a truncated snapshot
+  // is always a prefix of the complete one
+  if (m_truncated || m_buffer.size() - m_used < p_size) {
+    m_truncated = true;
+    return nullptr;
+  }
+  auto* out = &m_buffer[m_used];
+  m_used += p_size;
+  *out = static_cast<hal::byte>(p_type);
+  return out + 1;
+}
+
+/**
+ * @brief Construct a new diagnostics server
+ *
+ * @param p_router - router to report on and to send chunks through
+ * @param p_clock - clock used to pace chunks
+ * @param p_request_id - ID of request frames
+ * @param p_response_id - ID of response chunks
+ * @param p_chunk_interval - shortest time between two chunks
+ * @param p_buffer - storage for a snapshot, 9 bytes per route plus the
+ * application's records. Must outlive the server. A buffer too small for even
+ * the begin record gets a begin record marked as truncated and nothing else.
+ * @param p_report - called while taking a snapshot to add application
+ * statistics
+ */
+can_diagnostics_server::can_diagnostics_server(
+  can_router& p_router,
+  hal::steady_clock& p_clock,
+  hal::can::id_t p_request_id,
+  hal::can::id_t p_response_id,
+  hal::time_duration p_chunk_interval,
+  std::span<hal::byte> p_buffer,
+  report_handler p_report)
+  : m_router(&p_router)
+  , m_clock(&p_clock)
+  , m_response_id(p_response_id)
+  , m_chunk_interval(clock_ticks(p_clock, p_chunk_interval))
+  , m_buffer(p_buffer)
+  , m_report(std::move(p_report))
+  , m_route(p_router.add_message_callback(
+      p_request_id,
+      [this](const can::message_t& p_message) { request(p_message); }))
+{
+}
+
+/**
+ * @brief Handle requests and send the next chunk when it is due
+ *
+ * Call from the application loop. A chunk that fails to send is sent again on
+ * a later call.
+ *
+ * @return status - error from the bus if a chunk failed to send
+ */
+status can_diagnostics_server::poll()
+{
+  // When commands arrive faster than polls the last one wins
+  const auto commands = m_commands.load(std::memory_order_acquire);
+  if (commands != m_commands_handled) {
+    m_commands_handled = commands;
+    if (m_command.load(std::memory_order_relaxed) ==
+        format::request_snapshot) {
+      take_snapshot();
+    } else {
+      m_streaming = false;
+    }
+  }
+
+  if (!m_streaming) {
+    return success();
+  }
+
+  const auto now = m_clock->uptime().ticks;
+  if (m_chunk_sent && now - m_last_chunk < m_chunk_interval) {
+    return success();
+  }
+
+  const auto length =
+    std::min(format::chunk_size, m_snapshot.size() - m_sent);
+  can::message_t chunk{ .id = m_response_id,
+                        .length = static_cast<std::uint8_t>(length + 1) };
+  chunk.payload[0] = m_sequence & format::sequence_mask;
+  if (m_sent == 0) {
+    chunk.payload[0] |= format::first_chunk;
+  }
+  if (m_sent + length == m_snapshot.size()) {
+    chunk.payload[0] |= format::last_chunk;
+  }
+  std::copy_n(&m_snapshot[m_sent], length, chunk.payload.begin() + 1);
+
+  HAL_CHECK(m_router->bus().send(chunk));
+
+  m_chunk_sent = true;
+  m_last_chunk = now;
+  m_sent += length;
+  m_sequence++;
+  if (m_sent == m_snapshot.size()) {
+    m_streaming = false;
+    m_snapshots++;
+  }
+  return success();
+}
+
+void can_diagnostics_server::request(const can::message_t& p_message)
+{
+  if (p_message.length == 0) {
+    return;
+  }
+  const auto command = p_message.payload[0];
+  if (command != format::request_snapshot &&
+      command != format::request_cancel) {
+    return;
+  }
+  // Only the receive path writes these, so a load and store is enough and
+  // avoids a read-modify-write.
+  m_command.store(command, std::memory_order_relaxed);
+  m_commands.store(m_commands.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_release);
+}
+
+void can_diagnostics_server::take_snapshot()
+{
+  can_diagnostics_report report(m_buffer);
+  report.begin();
+  report.counter(format::unrouted_counter, m_router->unrouted());
+  for (const auto& route : m_router->handlers()) {
+    report.route(route.id, route.hits.load());
+  }
+  if (m_report) {
+    m_report(report);
+  }
+  if (report.m_used < format::begin_size) {
+    // Not even the begin record fit, answer with a begin record on its own so
+    // the client still learns that the snapshot was cut short
+    m_truncated_begin = { static_cast<hal::byte>(record_type::begin),
+                          format::version,
+                          format::truncated_flag };
+    m_snapshot = m_truncated_begin;
+  } else {
+    if (report.m_truncated) {
+      m_buffer[2] |= format::truncated_flag;
+    }
+    m_snapshot = m_buffer.first(report.m_used);
+  }
+
+  m_sent = 0;
+  m_sequence = 0;
+  m_streaming = true;
+}
+
+/**
+ * @brief Construct a new decoder
+ *
+ * @param p_buffer - storage for one snapshot. Must outlive the decoder.
+ */
+can_diagnostics_decoder::can_diagnostics_decoder(std::span<hal::byte> p_buffer)
+  : m_buffer(p_buffer)
+{
+}
+
+/**
+ * @brief Add a chunk to the snapshot being reassembled
+ *
+ * @param p_chunk - frame received on the response ID
+ * @return true - the chunk completed a snapshot, available from `snapshot()`
+ * until the next call
+ * @return false - more chunks are needed
+ */
+bool can_diagnostics_decoder::feed(const can::message_t& p_chunk)
+{
+  m_complete = false;
+  if (p_chunk.length < 2 || p_chunk.length > 8) {
+    return false;
+  }
+
+  const auto control = p_chunk.payload[0];
+  const auto sequence = control & format::sequence_mask;
+  if (control & format::first_chunk) {
+    if (m_receiving) {
+      discard();
+    }
+    m_receiving = true;
+    m_used = 0;
+    m_sequence = 0;
+  }
+  if (!m_receiving) {
+    return false;
+  }
+  if (sequence != m_sequence) {
+    discard();
+    return false;
+  }
+
+  const std::size_t length = p_chunk.length - 1u;
+  if (m_buffer.size() - m_used < length) {
+    discard();
+    return false;
+  }
+  std::copy_n(p_chunk.payload.begin() + 1, length, &m_buffer[m_used]);
+  m_used += length;
+  m_sequence = (m_sequence + 1) & format::sequence_mask;
+
+  if (control & format::last_chunk) {
+    m_receiving = false;
+    m_complete = true;
+  }
+  return m_complete;
+}
+
+/**
+ * @brief Decode every record of a snapshot
+ *
+ * @param p_snapshot - bytes of a complete snapshot
+ * @param p_handler - called once per record, in order
+ * @return true - every record was decoded
+ * @return false - the snapshot ends in the middle of a record or holds an
+ * unknown record type. Records before it were passed to p_handler.
+ */
+bool can_diagnostics_decoder::parse(
+  std::span<const hal::byte> p_snapshot,
+  const hal::callback<void(const can_diagnostics_record& p_record)>&
+    p_handler)
+{
+  while (!p_snapshot.empty()) {
+    can_diagnostics_record record{};
+    record.type = static_cast<record_type>(p_snapshot[0]);
+
+    std::size_t size = 0;
+    switch (record.type) {
+      case record_type::begin:
+        size = format::begin_size;
+        break;
+      case record_type::route:
+        size = format::route_size;
+        break;
+      case record_type::counter:
+        size = format::counter_size;
+        break;
+      case record_type::queue:
+        size = format::queue_size;
+        break;
+      case record_type::bus_load:
+        size = format::bus_load_size;
+        break;
+      default:
+        return false;
+    }
+    if (p_snapshot.size() < size) {
+      return false;
+    }
+
+    const auto* in = p_snapshot.data() + 1;
+    switch (record.type) {
+      case record_type::begin:
+        record.version = in[0];
+        record.truncated = (in[1] & format::truncated_flag) != 0;
+        break;
+      case record_type::route:
+        record.id = get_u32(in);
+        record.count = get_u32(in + 4);
+        break;
+      case record_type::counter:
+        record.key = in[0];
+        record.count = get_u32(in + 1);
+        break;
+      case record_type::queue:
+        record.key = in[0];
+        record.high_water = get_u16(in + 1);
+        record.capacity = get_u16(in + 3);
+        record.count = get_u32(in + 5);
+        break;
+      case record_type::bus_load:
+        record.load = static_cast<float>(get_u16(in)) / 100.0f;
+        record.frames_per_second = get_u32(in + 2);
+        break;
+    }
+
+    p_handler(record);
+    p_snapshot = p_snapshot.subspan(size);
+  }
+  return true;
+}
+
+void can_diagnostics_decoder::discard()
+{
+  m_receiving = false;
+  m_used = 0;
+  m_discarded++;
+}
+}  // namespace hal
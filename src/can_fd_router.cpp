@@ -0,0 +1,116 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "libhal-canrouter/can_fd_router.hpp"
+
+#include <functional>
+#include <utility>
+
+namespace hal {
+result<can_fd_router> can_fd_router::create(hal::can_fd& p_can)
+{
+  can_fd_router new_can_fd_router(p_can);
+  return new_can_fd_router;
+}
+
+/**
+ * @brief Construct a new CAN FD message router
+ *
+ * @param p_can - CAN FD peripheral to route messages for
+ */
+can_fd_router::can_fd_router(hal::can_fd& p_can)
+  : m_can(&p_can)
+{
+  m_can->on_receive(std::ref(*this));
+}
+
+can_fd_router& can_fd_router::operator=(can_fd_router&& p_other) noexcept
+{
+  m_handlers = std::move(p_other.m_handlers);
+  m_can = p_other.m_can;
+  m_can->on_receive(std::ref(*this));
+
+  p_other.m_can = nullptr;
+  return *this;
+}
+
+can_fd_router::can_fd_router(can_fd_router&& p_other) noexcept
+{
+  *this = std::move(p_other);
+}
+
+can_fd_router::~can_fd_router()
+{
+  if (m_can) {
+    m_can->on_receive(noop);
+  }
+}
+
+/**
+ * @brief Get a reference to the CAN FD peripheral driver
+ *
+ * @return can_fd& reference to the CAN FD peripheral driver
+ */
+[[nodiscard]] hal::can_fd& can_fd_router::bus()
+{
+  return *m_can;
+}
+
+/**
+ * @brief Set a callback for when messages with a specific ID is received
+ *
+ * @param p_id - Associated ID of messages to be stored.
+ * @param p_handler - callback to be executed when a p_id message is received.
+ * @return route_item - route item from the linked list that must be stored
+ * in a variable
+ */
+[[nodiscard]] can_fd_router::route_item can_fd_router::add_message_callback(
+  hal::can_fd::id_t p_id,
+  message_handler p_handler)
+{
+  return m_handlers.push_back(route{
+    .id = p_id,
+    .handler = std::move(p_handler),
+  });
+}
+
+/**
+ * @brief Get the list of handlers
+ *
+ * @return const static_list<route>& list of all of the message handlers.
+ */
+[[nodiscard]] const static_list<can_fd_router::route>&
+can_fd_router::handlers()
+{
+  return m_handlers;
+}
+
+/**
+ * @brief Message routing interrupt service handler
+ *
+ * Searches the static list and finds the first ID associated with the message
+ * and run's that route's callback.
+ *
+ * @param p_message - message received from the bus
+ */
+void can_fd_router::operator()(const can_fd::message_t& p_message)
+{
+  for (auto& list_handler : m_handlers) {
+    if (p_message.id == list_handler.id) {
+      list_handler.handler(p_message);
+      return;
+    }
+  }
+}
+}  // namespace hal
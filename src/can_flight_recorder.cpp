@@ -0,0 +1,319 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "libhal-canrouter/can_flight_recorder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace hal {
+namespace {
+constexpr hal::byte length_mask = 0x0F;
+constexpr hal::byte extended_flag = 1 << 4;
+constexpr hal::byte remote_flag = 1 << 5;
+constexpr hal::byte transmit_flag = 1 << 6;
+
+constexpr std::size_t id_size(hal::byte p_flags)
+{
+  return (p_flags & extended_flag) ? 4 : 2;
+}
+
+constexpr std::size_t payload_size(hal::byte p_flags)
+{
+  return (p_flags & remote_flag) ? 0 : (p_flags & length_mask);
+}
+}  // namespace
+
+/**
+ * @brief Construct a new flight recorder
+ *
+ * @param p_clock - clock used to timestamp frames
+ * @param p_buffer - storage for encoded frames. Must outlive the recorder.
+ * @param p_source - timestamps to record for frames seen as a tap
+ */
+can_flight_recorder::can_flight_recorder(hal::steady_clock& p_clock,
+                                         std::span<hal::byte> p_buffer,
+                                         timestamp_source p_source)
+  : m_clock(&p_clock)
+  , m_buffer(p_buffer)
+  , m_source(p_source)
+{
+}
+
+/**
+ * @brief Record a message as a can_router tap
+ *
+ * @param p_message - message seen by the router
+ * @param p_direction - whether the message was received or sent
+ */
+void can_flight_recorder::operator()(const can::message_t& p_message,
+                                     can_router::direction p_direction)
+{
+  record(p_message, p_direction);
+}
+
+/**
+ * @brief Record a timestamped message as a can_router tap
+ *
+ * @param p_message - message seen by the router
+ * @param p_direction - whether the message was received or sent
+ * @param p_timestamp - receive time of the message from the router, or 0 if
+ * unknown. Only recorded with `timestamp_source::router`, otherwise the
+ * current time is recorded.
+ */
+void can_flight_recorder::operator()(const can::message_t& p_message,
+                                     can_router::direction p_direction,
+                                     std::uint64_t p_timestamp)
+{
+  if (p_timestamp == 0 || m_source != timestamp_source::router) {
+    record(p_message, p_direction);
+  } else {
+    record(p_message, p_direction, p_timestamp);
+  }
+}
+
+/**
+ * @brief Record a frame into the ring
+ *
+ * @param p_message - frame to record
+ * @param p_direction - whether the message was received or sent
+ */
+void can_flight_recorder::record(const can::message_t& p_message,
+                                 can_router::direction p_direction)
+{
+  if (m_frozen) {
+    return;
+  }
+
+  const auto now = m_clock->uptime().ticks;
+  encode(p_message, p_direction, now, now);
+}
+
+/**
+ * @brief Record a frame into the ring with a known timestamp
+ *
+ * Timestamps earlier than the newest recorded frame, which happen when a
+ * timestamped frame is routed after later frames, are recorded as the time of
+ * the newest frame.
+ *
+ * @param p_message - frame to record
+ * @param p_direction - whether the message was received or sent
+ * @param p_timestamp - time of the frame in ticks of the recorder's clock
+ */
+void can_flight_recorder::record(const can::message_t& p_message,
+                                 can_router::direction p_direction,
+                                 std::uint64_t p_timestamp)
+{
+  if (m_frozen) {
+    return;
+  }
+
+  encode(p_message, p_direction, p_timestamp, m_clock->uptime().ticks);
+}
+
+void can_flight_recorder::encode(const can::message_t& p_message,
+                                 can_router::direction p_direction,
+                                 std::uint64_t p_timestamp,
+                                 std::uint64_t p_start)
+{
+  // Deltas are unsigned, so keep the ring in time order
+  const auto timestamp =
+    (m_count == 0) ? p_timestamp : std::max(p_timestamp, m_head_timestamp);
+
+  // Encode into a scratch buffer first so the size is known before making
+  // room in the ring.
+  std::array<hal::byte, max_record_size> encoded{};
+  std::size_t size = 0;
+
+  const auto length = std::min<std::uint8_t>(p_message.length, 8);
+  const bool extended = p_message.id > 0x7FF;
+  hal::byte flags = length;
+  if (extended) {
+    flags |= extended_flag;
+  }
+  if (p_message.is_remote_request) {
+    flags |= remote_flag;
+  }
+  if (p_direction == can_router::direction::transmit) {
+    flags |= transmit_flag;
+  }
+  encoded[size++] = flags;
+
+  std::uint64_t delta = (m_count == 0) ? 0 : timestamp - m_head_timestamp;
+  do {
+    hal::byte next = delta & 0x7F;
+    delta >>= 7;
+    if (delta != 0) {
+      next |= 0x80;
+    }
+    encoded[size++] = next;
+  } while (delta != 0);
+
+  for (std::size_t i = 0; i < id_size(flags); i++) {
+    encoded[size++] = static_cast<hal::byte>(p_message.id >> (8 * i));
+  }
+
+  const auto payload_length = payload_size(flags);
+  std::copy_n(
+    p_message.payload.begin(), payload_length, encoded.data() + size);
+  size += payload_length;
+
+  if (size > m_buffer.size()) {
+    return;
+  }
+
+  while (m_buffer.size() - m_used < size) {
+    drop_oldest();
+  }
+
+  // Copy in at most two pieces when the record wraps around the ring
+  const auto first = std::min(size, m_buffer.size() - m_head);
+  std::memcpy(&m_buffer[m_head], encoded.data(), first);
+  std::memcpy(m_buffer.data(), encoded.data() + first, size - first);
+
+  if (m_count == 0) {
+    m_tail_timestamp = timestamp;
+  }
+  m_head = wrap(m_head + size);
+  m_used += size;
+  m_count++;
+  m_head_timestamp = timestamp;
+
+  const auto elapsed = m_clock->uptime().ticks - p_start;
+  m_worst_case_record_ticks = std::max(m_worst_case_record_ticks, elapsed);
+}
+
+/**
+ * @brief Stop recording so that the captured traffic can be read out
+ *
+ */
+void can_flight_recorder::freeze()
+{
+  m_frozen = true;
+}
+
+/**
+ * @brief Continue recording after a freeze
+ *
+ */
+void can_flight_recorder::resume()
+{
+  m_frozen = false;
+}
+
+/**
+ * @brief Discard every recorded frame
+ *
+ */
+void can_flight_recorder::clear()
+{
+  m_head = 0;
+  m_tail = 0;
+  m_used = 0;
+  m_count = 0;
+  m_overwritten = 0;
+}
+
+/**
+ * @brief Decode every recorded frame from oldest to newest
+ *
+ * @param p_handler - called once per frame
+ */
+void can_flight_recorder::dump(const dump_handler& p_handler) const
+{
+  std::size_t position = m_tail;
+  std::uint64_t timestamp = m_tail_timestamp;
+
+  for (std::size_t i = 0; i < m_count; i++) {
+    const hal::byte flags = m_buffer[position];
+    std::size_t delta_length = 0;
+    const auto delta = read_delta(position, &delta_length);
+
+    // The oldest frame's delta refers to a frame that has been overwritten
+    if (i != 0) {
+      timestamp += delta;
+    }
+
+    record_t record{
+      .message = { .id = 0 },
+      .direction = (flags & transmit_flag) ? can_router::direction::transmit
+                                           : can_router::direction::receive,
+      .timestamp = timestamp,
+    };
+    record.message.length = flags & length_mask;
+    record.message.is_remote_request = (flags & remote_flag) != 0;
+
+    std::size_t field = wrap(position + 1 + delta_length);
+    for (std::size_t b = 0; b < id_size(flags); b++) {
+      record.message.id |= static_cast<hal::can::id_t>(m_buffer[field])
+                           << (8 * b);
+      field = wrap(field + 1);
+    }
+    for (std::size_t b = 0; b < payload_size(flags); b++) {
+      record.message.payload[b] = m_buffer[field];
+      field = wrap(field + 1);
+    }
+
+    p_handler(record);
+    position = field;
+  }
+}
+
+std::size_t can_flight_recorder::wrap(std::size_t p_position) const
+{
+  return (p_position >= m_buffer.size()) ? p_position - m_buffer.size()
+                                         : p_position;
+}
+
+std::uint64_t can_flight_recorder::read_delta(std::size_t p_position,
+                                              std::size_t* p_length) const
+{
+  std::uint64_t delta = 0;
+  std::size_t length = 0;
+  hal::byte next = 0;
+
+  do {
+    next = m_buffer[wrap(p_position + 1 + length)];
+    delta |= static_cast<std::uint64_t>(next & 0x7F) << (7 * length);
+    length++;
+  } while (next & 0x80);
+
+  *p_length = length;
+  return delta;
+}
+
+std::size_t can_flight_recorder::record_size(std::size_t p_position) const
+{
+  const hal::byte flags = m_buffer[p_position];
+  std::size_t delta_length = 0;
+  (void)read_delta(p_position, &delta_length);
+  return 1 + delta_length + id_size(flags) + payload_size(flags);
+}
+
+void can_flight_recorder::drop_oldest()
+{
+  const auto size = record_size(m_tail);
+  m_tail = wrap(m_tail + size);
+  m_used -= size;
+  m_count--;
+  m_overwritten++;
+
+  // The new oldest frame's delta is relative to the one just dropped
+  if (m_count != 0) {
+    std::size_t delta_length = 0;
+    m_tail_timestamp += read_delta(m_tail, &delta_length);
+  }
+}
+}  // namespace hal
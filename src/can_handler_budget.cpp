@@ -0,0 +1,134 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "libhal-canrouter/can_handler_budget.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "clock_ticks.hpp"
+
+namespace hal {
+can_handler_budget::budgeted_handler::budgeted_handler(
+  can_handler_budget& p_budget,
+  can_router::message_handler p_handler,
+  std::uint64_t p_budget_ticks)
+  : m_budget(&p_budget)
+  , m_handler(std::move(p_handler))
+  , m_budget_ticks(p_budget_ticks)
+{
+}
+
+/**
+ * @brief Run the handler and check its duration against the budget
+ *
+ * @param p_message - frame received for the route
+ */
+void can_handler_budget::budgeted_handler::operator()(
+  const can::message_t& p_message)
+{
+  const auto start = m_budget->m_clock->uptime().ticks;
+  m_handler(p_message);
+  const auto duration = m_budget->m_clock->uptime().ticks - start;
+
+  m_worst_ticks = std::max(m_worst_ticks, duration);
+  if (duration <= m_budget_ticks) {
+    return;
+  }
+
+  m_overruns++;
+  m_budget->record(p_message.id, duration);
+  if (!m_demoted && m_demote_after != 0 && m_overruns >= m_demote_after) {
+    m_demoted = true;
+    m_demote();
+  }
+}
+
+/**
+ * @brief Call a demotion callback once after repeated overruns
+ *
+ * @param p_overruns - number of overruns that trigger the demotion, 0
+ * disables demotion
+ * @param p_demote - called once, from the context running the handler, when
+ * this handler's overrun count reaches p_overruns
+ */
+void can_handler_budget::budgeted_handler::demote_after(
+  std::uint32_t p_overruns,
+  hal::callback<void()> p_demote)
+{
+  m_demote_after = p_overruns;
+  m_demote = std::move(p_demote);
+  m_demoted = false;
+}
+
+/**
+ * @brief Construct a new handler budget
+ *
+ * @param p_clock - clock used to time handlers
+ * @param p_table - storage for the diagnostics table, one entry per ID that
+ * overruns
+ */
+can_handler_budget::can_handler_budget(hal::steady_clock& p_clock,
+                                       std::span<overrun_record> p_table)
+  : m_clock(&p_clock)
+  , m_table(p_table)
+{
+}
+
+/**
+ * @brief Wrap a route handler with an execution time budget
+ *
+ * @param p_handler - handler to time
+ * @param p_budget - longest time the handler may run without an overrun
+ * @return budgeted_handler - handler to install in a route
+ */
+can_handler_budget::budgeted_handler can_handler_budget::wrap(
+  can_router::message_handler p_handler,
+  hal::time_duration p_budget)
+{
+  return budgeted_handler(
+    *this, std::move(p_handler), clock_ticks(*m_clock, p_budget));
+}
+
+/**
+ * @brief Empty the diagnostics table
+ */
+void can_handler_budget::clear()
+{
+  m_used = 0;
+  m_unrecorded = 0;
+}
+
+void can_handler_budget::record(hal::can::id_t p_id, std::uint64_t p_ticks)
+{
+  // Only runs on an overrun, so a linear search of the small table keeps the
+  // budgeted fast path free of any lookup.
+  std::size_t index = 0;
+  while (index < m_used && m_table[index].id != p_id) {
+    index++;
+  }
+
+  if (index == m_used) {
+    if (m_used == m_table.size()) {
+      m_unrecorded++;
+      return;
+    }
+    m_table[m_used++] = { .id = p_id };
+  }
+
+  auto& entry = m_table[index];
+  entry.overruns++;
+  entry.worst_ticks = std::max(entry.worst_ticks, p_ticks);
+}
+}  // namespace hal
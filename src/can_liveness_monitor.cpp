@@ -0,0 +1,124 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "libhal-canrouter/can_liveness_monitor.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include "clock_ticks.hpp"
+
+namespace hal {
+/**
+ * @brief Construct a new liveness monitor
+ *
+ * @param p_router - router whose received frames are monitored
+ * @param p_clock - clock used to timestamp heartbeats
+ * @param p_resolution - granularity of the last seen timestamps
+ * @param p_timeout - silence after which a node is considered offline
+ * @param p_nodes - nodes to monitor, with their IDs set. Sorted by ID by the
+ * constructor.
+ * @param p_on_transition - called with the ID of each node that comes online
+ * or goes offline
+ * @param p_checks_per_poll - number of nodes checked by each `poll()`
+ */
+can_liveness_monitor::can_liveness_monitor(can_router& p_router,
+                                           hal::steady_clock& p_clock,
+                                           hal::time_duration p_resolution,
+                                           hal::time_duration p_timeout,
+                                           std::span<node> p_nodes,
+                                           transition_handler p_on_transition,
+                                           std::size_t p_checks_per_poll)
+  : m_clock(&p_clock)
+  , m_clock_ticks_per_tick(clock_ticks_per_tick(p_clock, p_resolution))
+  , m_nodes(p_nodes)
+  , m_on_transition(std::move(p_on_transition))
+  , m_checks_per_poll(std::clamp<std::size_t>(p_checks_per_poll,
+                                              1,
+                                              std::max<std::size_t>(
+                                                p_nodes.size(), 1)))
+  , m_tap(p_router.add_tap([this](const can::message_t& p_message,
+                                  can_router::direction p_direction) {
+    if (p_direction == can_router::direction::receive) {
+      receive(p_message);
+    }
+  }))
+{
+  // Round up so that a node is never reported offline early
+  const auto resolution = std::max(p_resolution, hal::time_duration(1));
+  const auto timeout =
+    (std::max<hal::time_duration::rep>(p_timeout.count(), 0) +
+     resolution.count() - 1) /
+    resolution.count();
+  m_timeout = static_cast<std::uint32_t>(
+    std::min<hal::time_duration::rep>(
+      timeout, std::numeric_limits<std::int32_t>::max()));
+
+  std::sort(m_nodes.begin(), m_nodes.end(), [](auto& p_a, auto& p_b) {
+    return p_a.id < p_b.id;
+  });
+  for (auto& entry : m_nodes) {
+    entry.online = false;
+  }
+}
+
+/**
+ * @brief Take the next nodes in round-robin order offline if silent
+ */
+void can_liveness_monitor::poll()
+{
+  if (m_nodes.empty()) {
+    return;
+  }
+
+  const auto now = current_tick();
+  for (std::size_t i = 0; i < m_checks_per_poll; i++) {
+    auto& entry = m_nodes[m_cursor];
+    m_cursor = m_cursor + 1 == m_nodes.size() ? 0 : m_cursor + 1;
+
+    // Unsigned subtraction keeps working when the 32-bit tick wraps. The
+    // current tick may be nearly over, so require one more than the timeout.
+    if (entry.online && now - entry.last_seen > m_timeout) {
+      entry.online = false;
+      m_online--;
+      m_on_transition(entry.id, false);
+    }
+  }
+}
+
+void can_liveness_monitor::receive(const can::message_t& p_message)
+{
+  const auto entry = std::lower_bound(
+    m_nodes.begin(), m_nodes.end(), p_message.id, [](auto& p_node, auto p_id) {
+      return p_node.id < p_id;
+    });
+  if (entry == m_nodes.end() || entry->id != p_message.id) {
+    return;
+  }
+
+  entry->last_seen = current_tick();
+  if (!entry->online) {
+    entry->online = true;
+    m_online++;
+    m_on_transition(entry->id, true);
+  }
+}
+
+std::uint32_t can_liveness_monitor::current_tick()
+{
+  return static_cast<std::uint32_t>(m_clock->uptime().ticks /
+                                    m_clock_ticks_per_tick);
+}
+}  // namespace hal
@@ -35,10 +35,34 @@ can_router::can_router(hal::can& p_can)
   (void)m_can->on_receive(std::ref((*this)));
 }
 
+/**
+ * @brief Construct a new can message router that timestamps messages
+ *
+ * Every message received without a timestamp from the driver is stamped with
+ * the uptime of the clock on entry to the router, which is as close to the
+ * receive interrupt as software gets.
+ *
+ * @param p_can - can peripheral to route messages for
+ * @param p_clock - clock used to timestamp received and sent messages
+ */
+can_router::can_router(hal::can& p_can, hal::steady_clock& p_clock)
+  : m_can(&p_can)
+  , m_clock(&p_clock)
+{
+  (void)m_can->on_receive(std::ref((*this)));
+}
+
 can_router& can_router::operator=(can_router&& p_other) noexcept
 {
   m_handlers = std::move(p_other.m_handlers);
+  for (auto& route : m_handlers) {
+    route.tracker.track(&m_generation);
+  }
+  m_taps = std::move(p_other.m_taps);
   m_can = p_other.m_can;
+  m_clock = p_other.m_clock;
+  m_unrouted = p_other.m_unrouted;
+  m_generation = p_other.m_generation + 1;
   (void)m_can->on_receive(std::ref(*this));
 
   p_other.m_can = nullptr;
@@ -63,13 +87,14 @@ can_router::~can_router()
  * @brief Get a reference to the can peripheral driver
  *
  * Used to send can messages through the same port that the can_router is
- * using.
+ * using. Messages sent successfully through this reference are reported to
+ * every tap with `direction::transmit`.
  *
  * @return can& reference to the can peripheral driver
  */
 [[nodiscard]] hal::can& can_router::bus()
 {
-  return *m_can;
+  return m_bus;
 }
 
 /**
@@ -84,8 +109,10 @@ can_router::~can_router()
 [[nodiscard]] static_list<can_router::route>::item
 can_router::add_message_callback(hal::can::id_t p_id)
 {
+  m_generation++;
   return m_handlers.push_back(route{
     .id = p_id,
+    .tracker = move_tracker(&m_generation),
   });
 }
 
@@ -100,12 +127,29 @@ can_router::add_message_callback(hal::can::id_t p_id)
 [[nodiscard]] static_list<can_router::route>::item
 can_router::add_message_callback(hal::can::id_t p_id, message_handler p_handler)
 {
+  m_generation++;
   return m_handlers.push_back(route{
     .id = p_id,
     .handler = std::move(p_handler),
+    .tracker = move_tracker(&m_generation),
   });
 }
 
+/**
+ * @brief Observe every message passing through the router
+ *
+ * Taps are given the message timestamp in ticks of the router's clock, or 0
+ * when the message has none. See `receive_timestamp()`.
+ *
+ * @param p_tap - callback to be executed for every message
+ * @return tap_item - tap item from the linked list that must be stored in a
+ * variable
+ */
+[[nodiscard]] can_router::tap_item can_router::add_tap(tap_handler p_tap)
+{
+  return m_taps.push_back(std::move(p_tap));
+}
+
 /**
  * @brief Get the list of handlers
  *
@@ -128,12 +172,166 @@ can_router::add_message_callback(hal::can::id_t p_id, message_handler p_handler)
  * @param p_message - message received from the bus
  */
 void can_router::operator()(const can::message_t& p_message)
+{
+  (*this)(p_message, now());
+}
+
+/**
+ * @brief Message routing interrupt service handler for drivers that timestamp
+ * messages in hardware
+ *
+ * @param p_message - message received from the bus
+ * @param p_timestamp - receive time of the message in ticks of the router's
+ * clock, or 0 if unknown
+ */
+void can_router::operator()(const can::message_t& p_message,
+                            std::uint64_t p_timestamp)
+{
+  m_receive_timestamp = p_timestamp;
+  notify_taps(p_message, direction::receive, p_timestamp);
+
+  if (auto* found = find(p_message.id)) {
+    found->hits.increment();
+    found->handler(p_message);
+  } else {
+    m_unrouted.increment();
+  }
+}
+
+/**
+ * @brief Route a batch of messages in one call
+ *
+ * For drivers that hand over several frames at once from a DMA buffer or
+ * hardware FIFO. Equivalent to calling the router on each message in order,
+ * but the route found for a message is reused for the messages directly after
+ * it with the same ID, so bursts and FIFO runs of one ID search the route
+ * list once.
+ *
+ * Messages without a timestamp from the driver share one timestamp taken from
+ * the router's clock when the batch is handed over.
+ *
+ * Handlers and taps may add, remove and move routes, including their own,
+ * while a batch is being dispatched. The cached route is looked up again
+ * whenever the route list changes.
+ *
+ * @param p_messages - messages received from the bus, oldest first
+ * @param p_timestamps - receive time of each message in ticks of the router's
+ * clock, in the same order as the messages. May be shorter than the messages
+ * or empty.
+ */
+void can_router::dispatch(std::span<const can::message_t> p_messages,
+                          std::span<const std::uint64_t> p_timestamps)
+{
+  if (p_messages.empty()) {
+    return;
+  }
+
+  const auto batch_timestamp =
+    p_timestamps.size() < p_messages.size() ? now() : 0;
+  auto cached_id = p_messages[0].id;
+  auto* cached = find(cached_id);
+  // Adding or moving a route bumps the generation and removing one shrinks
+  // the list, so together they reveal any change made by a handler or tap
+  auto generation = m_generation;
+  auto route_count = m_handlers.size();
+  for (std::size_t i = 0; i < p_messages.size(); i++) {
+    const auto& message = p_messages[i];
+    m_receive_timestamp =
+      i < p_timestamps.size() ? p_timestamps[i] : batch_timestamp;
+    notify_taps(message, direction::receive, m_receive_timestamp);
+    if (message.id != cached_id || generation != m_generation ||
+        route_count != m_handlers.size()) {
+      cached_id = message.id;
+      cached = find(cached_id);
+      generation = m_generation;
+      route_count = m_handlers.size();
+    }
+    if (cached) {
+      cached->hits.increment();
+      cached->handler(message);
+    } else {
+      m_unrouted.increment();
+    }
+  }
+}
+
+/**
+ * @brief Get the receive timestamp of the message being routed
+ *
+ * Valid inside route handlers and taps. Handlers that defer work should copy
+ * it along with the message.
+ *
+ * @return std::uint64_t - receive time in ticks of the router's clock, or 0 if
+ * the driver gave none and the router has no clock
+ */
+[[nodiscard]] std::uint64_t can_router::receive_timestamp() const
+{
+  return m_receive_timestamp;
+}
+
+/**
+ * @brief Number of received messages that matched no route
+ *
+ * Messages of a route added without a callback count as routed.
+ *
+ * @return std::uint32_t - unrouted message count
+ */
+[[nodiscard]] std::uint32_t can_router::unrouted() const
+{
+  return m_unrouted.load();
+}
+
+void can_router::notify_taps(const can::message_t& p_message,
+                             direction p_direction,
+                             std::uint64_t p_timestamp)
+{
+  for (auto& tap : m_taps) {
+    tap(p_message, p_direction, p_timestamp);
+  }
+}
+
+std::uint64_t can_router::now()
+{
+  return m_clock ? m_clock->uptime().ticks : 0;
+}
+
+can_router::route* can_router::find(hal::can::id_t p_id)
 {
   for (auto& list_handler : m_handlers) {
-    if (p_message.id == list_handler.id) {
-      list_handler.handler(p_message);
-      return;
+    if (p_id == list_handler.id) {
+      return &list_handler;
     }
   }
+  return nullptr;
+}
+
+can_router::bus_proxy::bus_proxy(can_router& p_router)
+  : m_router(&p_router)
+{
+}
+
+status can_router::bus_proxy::driver_configure(const settings& p_settings)
+{
+  return m_router->m_can->configure(p_settings);
+}
+
+status can_router::bus_proxy::driver_bus_on()
+{
+  return m_router->m_can->bus_on();
+}
+
+result<can::send_t> can_router::bus_proxy::driver_send(
+  const message_t& p_message)
+{
+  auto sent = HAL_CHECK(m_router->m_can->send(p_message));
+  if (!m_router->m_taps.empty()) {
+    m_router->notify_taps(p_message, direction::transmit, m_router->now());
+  }
+  return sent;
+}
+
+void can_router::bus_proxy::driver_on_receive(hal::callback<handler> p_handler)
+{
+  (void)m_router->m_can->on_receive(std::move(p_handler));
 }
 }  // namespace hal
@@ -0,0 +1,282 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "libhal-canrouter/can_signal_batch.hpp"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace hal {
+namespace {
+#if defined(__x86_64__) || defined(__i386__)
+struct extract_params
+{
+  std::uint64_t mask;
+  std::uint64_t sign;
+  std::uint32_t shift;
+  bool big_endian;
+};
+
+extract_params make_params(const can_signal& p_signal)
+{
+  return {
+    .mask = p_signal.mask(),
+    .sign = p_signal.is_signed ? std::uint64_t{ 1 } << (p_signal.length - 1)
+                               : std::uint64_t{ 0 },
+    .shift = p_signal.shift(),
+    .big_endian = p_signal.byte_order == can_byte_order::big_endian,
+  };
+}
+
+/// The SIMD paths convert through 32-bit integers, so wider signals are
+/// decoded with the scalar path.
+bool fits_int32(const can_signal& p_signal)
+{
+  return p_signal.length < 32 || (p_signal.is_signed && p_signal.length == 32);
+}
+
+[[gnu::target("sse2")]] __m128i extract2_sse2(const can::message_t* p_messages,
+                                              const extract_params& p_params)
+{
+  auto words = _mm_unpacklo_epi64(
+    _mm_loadl_epi64(
+      reinterpret_cast<const __m128i*>(p_messages[0].payload.data())),
+    _mm_loadl_epi64(
+      reinterpret_cast<const __m128i*>(p_messages[1].payload.data())));
+
+  if (p_params.big_endian) {
+    // Swap the bytes of each 16-bit word, then reverse the words of each lane
+    words = _mm_or_si128(_mm_slli_epi16(words, 8), _mm_srli_epi16(words, 8));
+    words = _mm_shufflelo_epi16(words, _MM_SHUFFLE(0, 1, 2, 3));
+    words = _mm_shufflehi_epi16(words, _MM_SHUFFLE(0, 1, 2, 3));
+  }
+
+  const auto sign = _mm_set1_epi64x(static_cast<long long>(p_params.sign));
+  const auto mask = _mm_set1_epi64x(static_cast<long long>(p_params.mask));
+  const auto shift = _mm_cvtsi32_si128(static_cast<int>(p_params.shift));
+
+  const auto value = _mm_and_si128(_mm_srl_epi64(words, shift), mask);
+  return _mm_sub_epi64(_mm_xor_si128(value, sign), sign);
+}
+
+[[gnu::target("avx2")]] __m256i extract4_avx2(const can::message_t* p_messages,
+                                              const extract_params& p_params)
+{
+  constexpr auto stride = static_cast<long long>(sizeof(can::message_t));
+  const auto offsets = _mm256_setr_epi64x(0, stride, 2 * stride, 3 * stride);
+  const auto* base =
+    reinterpret_cast<const long long*>(p_messages->payload.data());
+  auto words = _mm256_i64gather_epi64(base, offsets, 1);
+
+  if (p_params.big_endian) {
+    const auto reverse = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0,
+                                          15, 14, 13, 12, 11, 10, 9, 8,
+                                          7, 6, 5, 4, 3, 2, 1, 0,
+                                          15, 14, 13, 12, 11, 10, 9, 8);
+    words = _mm256_shuffle_epi8(words, reverse);
+  }
+
+  const auto sign = _mm256_set1_epi64x(static_cast<long long>(p_params.sign));
+  const auto mask = _mm256_set1_epi64x(static_cast<long long>(p_params.mask));
+  const auto shift = _mm_cvtsi32_si128(static_cast<int>(p_params.shift));
+
+  const auto value = _mm256_and_si256(_mm256_srl_epi64(words, shift), mask);
+  return _mm256_sub_epi64(_mm256_xor_si256(value, sign), sign);
+}
+
+[[gnu::target("sse2")]] std::size_t decode_raw_sse2(
+  const can::message_t* p_messages,
+  std::size_t p_count,
+  const extract_params& p_params,
+  std::int64_t* p_column)
+{
+  std::size_t i = 0;
+  for (; i + 2 <= p_count; i += 2) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p_column + i),
+                     extract2_sse2(p_messages + i, p_params));
+  }
+  return i;
+}
+
+[[gnu::target("avx2")]] std::size_t decode_raw_avx2(
+  const can::message_t* p_messages,
+  std::size_t p_count,
+  const extract_params& p_params,
+  std::int64_t* p_column)
+{
+  std::size_t i = 0;
+  for (; i + 4 <= p_count; i += 4) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p_column + i),
+                        extract4_avx2(p_messages + i, p_params));
+  }
+  return i;
+}
+
+[[gnu::target("sse2")]] std::size_t decode_sse2(
+  const can::message_t* p_messages,
+  std::size_t p_count,
+  const can_signal& p_signal,
+  float* p_column)
+{
+  const auto params = make_params(p_signal);
+  const auto scale = _mm_set1_ps(p_signal.scale);
+  const auto offset = _mm_set1_ps(p_signal.offset);
+
+  std::size_t i = 0;
+  for (; i + 4 <= p_count; i += 4) {
+    // Low 32 bits of each sign extended 64-bit lane: [a0, a1, b0, b1]
+    const auto first = extract2_sse2(p_messages + i, params);
+    const auto second = extract2_sse2(p_messages + i + 2, params);
+    const auto packed =
+      _mm_unpacklo_epi64(_mm_shuffle_epi32(first, _MM_SHUFFLE(2, 0, 2, 0)),
+                         _mm_shuffle_epi32(second, _MM_SHUFFLE(2, 0, 2, 0)));
+    const auto value =
+      _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(packed), scale), offset);
+    _mm_storeu_ps(p_column + i, value);
+  }
+  return i;
+}
+
+[[gnu::target("avx2")]] std::size_t decode_avx2(
+  const can::message_t* p_messages,
+  std::size_t p_count,
+  const can_signal& p_signal,
+  float* p_column)
+{
+  const auto params = make_params(p_signal);
+  const auto scale = _mm256_set1_ps(p_signal.scale);
+  const auto offset = _mm256_set1_ps(p_signal.offset);
+  const auto low_halves = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+
+  std::size_t i = 0;
+  for (; i + 8 <= p_count; i += 8) {
+    const auto first = _mm256_permutevar8x32_epi32(
+      extract4_avx2(p_messages + i, params), low_halves);
+    const auto second = _mm256_permutevar8x32_epi32(
+      extract4_avx2(p_messages + i + 4, params), low_halves);
+    const auto packed = _mm256_permute2x128_si256(first, second, 0x20);
+    const auto value =
+      _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(packed), scale), offset);
+    _mm256_storeu_ps(p_column + i, value);
+  }
+  return i;
+}
+#endif
+}  // namespace
+
+/**
+ * @brief Best instruction set supported by this CPU
+ *
+ * @return can_batch_isa - instruction set used by default
+ */
+can_batch_isa can_batch_best_isa()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  static const auto best = []() {
+    if (__builtin_cpu_supports("avx2")) {
+      return can_batch_isa::avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+      return can_batch_isa::sse2;
+    }
+    return can_batch_isa::scalar;
+  }();
+  return best;
+#else
+  return can_batch_isa::scalar;
+#endif
+}
+
+/**
+ * @brief Extract the physical value of a signal from every message
+ *
+ * @param p_messages - messages to decode
+ * @param p_signal - signal to extract
+ * @param p_column - destination, element i receives the value of message i
+ * @param p_isa - instruction set to use, lowered to `can_batch_best_isa()`
+ * if unsupported
+ * @return std::size_t - number of values written, the smaller of the two
+ * span sizes
+ */
+std::size_t can_batch_decode(std::span<const can::message_t> p_messages,
+                             const can_signal& p_signal,
+                             std::span<float> p_column,
+                             can_batch_isa p_isa)
+{
+  const auto count = std::min(p_messages.size(), p_column.size());
+
+  std::size_t done = 0;
+#if defined(__x86_64__) || defined(__i386__)
+  auto isa = std::min(p_isa, can_batch_best_isa());
+  if (!fits_int32(p_signal)) {
+    isa = can_batch_isa::scalar;
+  }
+
+  if (isa == can_batch_isa::avx2) {
+    done = decode_avx2(p_messages.data(), count, p_signal, p_column.data());
+  } else if (isa == can_batch_isa::sse2) {
+    done = decode_sse2(p_messages.data(), count, p_signal, p_column.data());
+  }
+#else
+  static_cast<void>(p_isa);
+#endif
+
+  for (; done < count; done++) {
+    p_column[done] = p_signal.decode(p_messages[done].payload);
+  }
+  return count;
+}
+
+/**
+ * @brief Extract the raw, sign extended value of a signal from every message
+ *
+ * @param p_messages - messages to decode
+ * @param p_signal - signal to extract
+ * @param p_column - destination, element i receives the value of message i
+ * @param p_isa - instruction set to use, lowered to `can_batch_best_isa()`
+ * if unsupported
+ * @return std::size_t - number of values written, the smaller of the two
+ * span sizes
+ */
+std::size_t can_batch_decode_raw(std::span<const can::message_t> p_messages,
+                                 const can_signal& p_signal,
+                                 std::span<std::int64_t> p_column,
+                                 can_batch_isa p_isa)
+{
+  const auto count = std::min(p_messages.size(), p_column.size());
+
+  std::size_t done = 0;
+#if defined(__x86_64__) || defined(__i386__)
+  const auto isa = std::min(p_isa, can_batch_best_isa());
+  const auto params = make_params(p_signal);
+  if (isa == can_batch_isa::avx2) {
+    done =
+      decode_raw_avx2(p_messages.data(), count, params, p_column.data());
+  } else if (isa == can_batch_isa::sse2) {
+    done =
+      decode_raw_sse2(p_messages.data(), count, params, p_column.data());
+  }
+#else
+  static_cast<void>(p_isa);
+#endif
+
+  for (; done < count; done++) {
+    p_column[done] = p_signal.raw(p_messages[done].payload);
+  }
+  return count;
+}
+}  // namespace hal
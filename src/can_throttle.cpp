@@ -0,0 +1,87 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "libhal-canrouter/can_throttle.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "clock_ticks.hpp"
+
+namespace hal {
+/**
+ * @brief Construct a new decimator
+ *
+ * @param p_handler - handler for passed frames
+ * @param p_factor - pass one frame out of every p_factor. 0 and 1 pass
+ * every frame.
+ */
+can_decimator::can_decimator(can_router::message_handler p_handler,
+                             std::uint32_t p_factor)
+  : m_handler(std::move(p_handler))
+  , m_factor(std::max<std::uint32_t>(p_factor, 1))
+{
+}
+
+/**
+ * @brief Pass the frame on if it is the Nth since the last one passed
+ *
+ * @param p_message - frame received for the route
+ */
+void can_decimator::operator()(const can::message_t& p_message)
+{
+  if (m_countdown != 0) {
+    m_countdown--;
+    m_suppressed++;
+    return;
+  }
+
+  m_countdown = m_factor - 1;
+  m_handler(p_message);
+}
+
+/**
+ * @brief Construct a new rate limiter
+ *
+ * @param p_handler - handler for passed frames
+ * @param p_clock - clock used to measure intervals
+ * @param p_min_interval - shortest time between two frames passed on
+ */
+can_rate_limiter::can_rate_limiter(can_router::message_handler p_handler,
+                                   hal::steady_clock& p_clock,
+                                   hal::time_duration p_min_interval)
+  : m_handler(std::move(p_handler))
+  , m_clock(&p_clock)
+{
+  m_min_interval_ticks = clock_ticks(p_clock, p_min_interval);
+}
+
+/**
+ * @brief Pass the frame on if the minimum interval has elapsed
+ *
+ * @param p_message - frame received for the route
+ */
+void can_rate_limiter::operator()(const can::message_t& p_message)
+{
+  const auto now = m_clock->uptime().ticks;
+  if (m_started && now - m_last_tick < m_min_interval_ticks) {
+    m_suppressed++;
+    return;
+  }
+
+  m_started = true;
+  m_last_tick = now;
+  m_handler(p_message);
+}
+}  // namespace hal
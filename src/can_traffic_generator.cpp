@@ -0,0 +1,306 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "libhal-canrouter/can_traffic_generator.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace hal {
+namespace {
+/// splitmix64, chosen over the standard library engines and distributions
+/// because its output is identical on every platform
+std::uint64_t splitmix64(std::uint64_t& p_state)
+{
+  std::uint64_t z = (p_state += 0x9E37'79B9'7F4A'7C15);
+  z = (z ^ (z >> 30)) * 0xBF58'476D'1CE4'E5B9;
+  z = (z ^ (z >> 27)) * 0x94D0'49BB'1331'11EB;
+  return z ^ (z >> 31);
+}
+
+/// Uniform value in [0, p_bound) from the high half of the 128-bit product,
+/// which avoids a division. Built from 32-bit halves so that targets without
+/// a 128-bit type produce the same values.
+std::uint64_t below(std::uint64_t p_random, std::uint64_t p_bound)
+{
+  const std::uint64_t a_low = p_random & 0xFFFF'FFFF;
+  const std::uint64_t a_high = p_random >> 32;
+  const std::uint64_t b_low = p_bound & 0xFFFF'FFFF;
+  const std::uint64_t b_high = p_bound >> 32;
+
+  const auto low = a_low * b_low;
+  const auto middle_1 = a_high * b_low + (low >> 32);
+  const auto middle_2 = a_low * b_high + (middle_1 & 0xFFFF'FFFF);
+  return a_high * b_high + (middle_1 >> 32) + (middle_2 >> 32);
+}
+
+std::uint64_t nanoseconds(hal::time_duration p_duration)
+{
+  return static_cast<std::uint64_t>(
+    std::max<hal::time_duration::rep>(p_duration.count(), 0));
+}
+}  // namespace
+
+/**
+ * @brief Fill a profile with streams resembling a vehicle network
+ *
+ * @param p_streams - profile to fill, one stream per message
+ * @param p_seed - seed that determines the profile
+ * @param p_extended_fraction - fraction of streams using extended IDs
+ */
+void can_make_vehicle_profile(std::span<can_traffic_stream> p_streams,
+                              std::uint64_t p_seed,
+                              float p_extended_fraction)
+{
+  using namespace std::chrono_literals;
+
+  // Share of messages at each period on a typical powertrain and body bus
+  constexpr std::array<std::pair<hal::time_duration, std::uint32_t>, 7>
+    periods = { {
+      { 10ms, 20 },
+      { 20ms, 20 },
+      { 50ms, 15 },
+      { 100ms, 25 },
+      { 200ms, 5 },
+      { 500ms, 10 },
+      { 1000ms, 5 },
+    } };
+
+  auto state = p_seed;
+  const auto count = p_streams.size();
+  const auto extended = static_cast<std::size_t>(
+    static_cast<float>(count) * std::clamp(p_extended_fraction, 0.0f, 1.0f));
+  const auto standard = count - extended;
+
+  for (std::size_t i = 0; i < count; i++) {
+    auto& stream = p_streams[i];
+    stream = {};
+
+    // Spread unique IDs across the space so that arbitration order and
+    // lookups behave as on a real bus. Streams are in priority order.
+    if (i < standard) {
+      const std::uint64_t step = std::max<std::uint64_t>(0x780 / standard, 1);
+      stream.id = static_cast<hal::can::id_t>(
+        0x080 + i * step + below(splitmix64(state), step));
+    } else {
+      // J1939 style IDs: priority, PGN and a source address
+      const auto index = i - standard;
+      stream.id = static_cast<hal::can::id_t>(
+        0x0C00'0000 | (0xF000 + index) << 8 | below(splitmix64(state), 0xFE));
+    }
+
+    // Faster periods go to higher priority IDs
+    const auto rank = i < standard ? i : i - standard;
+    const auto group = i < standard ? standard : extended;
+    auto percentile = static_cast<std::uint32_t>(rank * 100 / group);
+    for (const auto& [period, share] : periods) {
+      stream.period = period;
+      if (percentile < share) {
+        break;
+      }
+      percentile -= share;
+    }
+    stream.jitter = stream.period / 50;
+
+    const auto length = below(splitmix64(state), 100);
+    stream.length = 8;
+    if (length >= 80) {
+      const auto short_length = 1 + below(splitmix64(state), 7);
+      stream.length = static_cast<std::uint8_t>(short_length);
+    }
+
+    const auto shape = below(splitmix64(state), 100);
+    if (shape < 50) {
+      stream.pattern = can_payload_pattern::counter;
+    } else if (shape < 80) {
+      stream.pattern = can_payload_pattern::random_walk;
+    } else if (shape < 95) {
+      stream.pattern = can_payload_pattern::fixed;
+    } else {
+      stream.pattern = can_payload_pattern::random;
+    }
+    stream.burst = below(splitmix64(state), 100) < 5 ? 3 : 1;
+
+    // Shifted out rather than copied, so that profiles do not depend on the
+    // byte order of the host
+    const auto initial = splitmix64(state);
+    for (std::size_t i = 0; i < stream.payload.size(); i++) {
+      stream.payload[i] = static_cast<hal::byte>(initial >> (8 * i));
+    }
+  }
+}
+
+/**
+ * @brief Construct a new traffic generator
+ *
+ * @param p_profile - streams to generate, which the generator reorders and
+ * keeps its state in
+ * @param p_seed - seed that determines phases, jitter and random payloads
+ */
+can_traffic_generator::can_traffic_generator(
+  std::span<can_traffic_stream> p_profile,
+  std::uint64_t p_seed)
+  : m_streams(p_profile)
+  , m_random(p_seed)
+{
+  for (auto& stream : m_streams) {
+    stream.period = std::max(stream.period, hal::time_duration(1));
+    stream.length = std::min<std::uint8_t>(stream.length, 8);
+    stream.burst = std::max<std::uint8_t>(stream.burst, 1);
+    stream.remaining = stream.burst;
+    // Start at a random phase within the first period
+    stream.nominal = below(random(), nanoseconds(stream.period));
+    release(stream);
+  }
+
+  for (auto i = m_streams.size() / 2; i-- > 0;) {
+    sift_down(i);
+  }
+}
+
+/**
+ * @brief Produce the next frame in release order
+ *
+ * @return frame - next frame, or a default frame if the profile is empty
+ */
+can_traffic_generator::frame can_traffic_generator::next()
+{
+  frame result;
+  if (!m_streams.empty()) {
+    emit(result);
+  }
+  return result;
+}
+
+/**
+ * @brief Produce frames in release order
+ *
+ * @param p_frames - destination for the frames
+ * @return std::size_t - number of frames produced, 0 if the profile is empty
+ */
+std::size_t can_traffic_generator::generate(std::span<frame> p_frames)
+{
+  if (m_streams.empty()) {
+    return 0;
+  }
+  for (auto& output : p_frames) {
+    emit(output);
+  }
+  return p_frames.size();
+}
+
+void can_traffic_generator::emit(frame& p_frame)
+{
+  auto& stream = m_streams[0];
+  // Work on a local copy of the payload and store it back whole, so it stays
+  // in a register instead of being read back after single byte stores
+  auto payload = stream.payload;
+  switch (stream.pattern) {
+    case can_payload_pattern::fixed:
+      break;
+    case can_payload_pattern::counter:
+      payload[0]++;
+      break;
+    case can_payload_pattern::random_walk: {
+      const auto step = static_cast<std::uint16_t>((random() % 7) - 3);
+      const auto value =
+        static_cast<std::uint16_t>(payload[0] | payload[1] << 8) + step;
+      payload[0] = static_cast<hal::byte>(value);
+      payload[1] = static_cast<hal::byte>(value >> 8);
+      break;
+    }
+    case can_payload_pattern::random: {
+      // Bytes taken by shifting rather than copied, so that the payload does
+      // not depend on the byte order of the host
+      const auto bytes = random();
+      for (std::size_t i = 0; i < payload.size(); i++) {
+        payload[i] = static_cast<hal::byte>(bytes >> (8 * i));
+      }
+      break;
+    }
+  }
+  stream.payload = payload;
+
+  // Written field by field, since building a frame and copying it out costs
+  // more than the rest of the generator
+  p_frame.time = hal::time_duration(stream.due);
+  p_frame.message.id = stream.id;
+  p_frame.message.payload = payload;
+  p_frame.message.length = stream.length;
+  p_frame.message.is_remote_request = false;
+
+  if (--stream.remaining == 0) {
+    stream.remaining = stream.burst;
+    stream.nominal += nanoseconds(stream.period);
+    release(stream);
+    sift_down(0);
+  }
+}
+
+std::uint64_t can_traffic_generator::random()
+{
+  return splitmix64(m_random);
+}
+
+void can_traffic_generator::release(can_traffic_stream& p_stream)
+{
+  // Jitter delays each release from a drift free nominal schedule
+  p_stream.due = p_stream.nominal;
+  if (const auto jitter = nanoseconds(p_stream.jitter); jitter != 0) {
+    p_stream.due += below(random(), jitter);
+  }
+}
+
+bool can_traffic_generator::has_earlier_child(std::size_t p_index,
+                                              std::uint64_t p_due) const
+{
+  const auto child = 2 * p_index + 1;
+  const auto size = m_streams.size();
+  return (child < size && m_streams[child].due < p_due) ||
+         (child + 1 < size && m_streams[child + 1].due < p_due);
+}
+
+void can_traffic_generator::sift_down(std::size_t p_index)
+{
+  const auto size = m_streams.size();
+  const auto due = m_streams[p_index].due;
+
+  // A stream that is still due first stays in place without being copied,
+  // the common case for small profiles
+  if (!has_earlier_child(p_index, due)) {
+    return;
+  }
+
+  const auto moving = m_streams[p_index];
+
+  // Move the hole down instead of swapping, so each level costs one copy
+  while (true) {
+    auto child = 2 * p_index + 1;
+    if (child >= size) {
+      break;
+    }
+    if (child + 1 < size) {
+      // Added rather than branched on, as the comparison is unpredictable
+      child += m_streams[child + 1].due < m_streams[child].due;
+    }
+    if (due <= m_streams[child].due) {
+      break;
+    }
+    m_streams[p_index] = m_streams[child];
+    p_index = child;
+  }
+
+  m_streams[p_index] = moving;
+}
+}  // namespace hal
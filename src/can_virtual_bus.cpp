@@ -0,0 +1,231 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "libhal-canrouter/can_virtual_bus.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <system_error>
+#include <utility>
+
+#include "libhal-canrouter/can_bus_load.hpp"
+
+namespace hal {
+namespace {
+/**
+ * @brief Arbitration field of a frame as a number, lower values win
+ *
+ * Lays out the bits in the order they are sent: the 11 bit base ID, then RTR
+ * for standard frames or SRR for extended frames, then IDE, then the 18 bit ID
+ * extension and RTR of extended frames. A dominant bit is 0, so comparing the
+ * numbers matches bitwise arbitration. Standard data frames beat extended
+ * frames with the same base ID, and data frames beat remote frames.
+ */
+std::uint64_t arbitration_key(const can::message_t& p_message)
+{
+  const std::uint64_t rtr = p_message.is_remote_request ? 1 : 0;
+  if (p_message.id <= 0x7FF) {
+    return std::uint64_t{ p_message.id } << 21 | rtr << 20;
+  }
+
+  const std::uint64_t base = (p_message.id >> 18) & 0x7FF;
+  const std::uint64_t extension = p_message.id & 0x3'FFFF;
+  return base << 21 | 1 << 20 | 1 << 19 | extension << 1 | rtr;
+}
+}  // namespace
+
+can_virtual_bus::node::node(can_virtual_bus& p_bus)
+  : m_bus(&p_bus)
+  , m_item(p_bus.m_nodes.push_back(this))
+{
+}
+
+status can_virtual_bus::node::driver_configure(const settings& p_settings)
+{
+  // Every node on a bus must use the bus bit rate
+  const auto error = std::abs(p_settings.baud_rate - m_bus->m_baud_rate);
+  if (error > m_bus->m_baud_rate * 0.01f) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+  return hal::success();
+}
+
+status can_virtual_bus::node::driver_bus_on()
+{
+  return hal::success();
+}
+
+result<can::send_t> can_virtual_bus::node::driver_send(
+  const message_t& p_message)
+{
+  if (m_pending == m_mailboxes.size()) {
+    return hal::new_error(std::errc::resource_unavailable_try_again);
+  }
+  m_mailboxes[m_pending++] = p_message;
+  return send_t{};
+}
+
+void can_virtual_bus::node::driver_on_receive(hal::callback<handler> p_handler)
+{
+  m_handler = std::move(p_handler);
+}
+
+std::size_t can_virtual_bus::node::next_mailbox() const
+{
+  // Controllers send their highest priority mailbox first, and the oldest
+  // of equal priority frames.
+  std::size_t best = 0;
+  for (std::size_t i = 1; i < m_pending; i++) {
+    if (arbitration_key(m_mailboxes[i]) < arbitration_key(m_mailboxes[best])) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+/**
+ * @brief Construct a new virtual bus
+ *
+ * @param p_baud_rate - bit rate that sets the simulated frame durations
+ */
+can_virtual_bus::can_virtual_bus(hal::hertz p_baud_rate)
+  : m_baud_rate(p_baud_rate)
+  , m_nanoseconds_per_bit(1e9 / static_cast<double>(p_baud_rate))
+{
+}
+
+/**
+ * @brief Attach a new node to the bus
+ *
+ * @return node - CAN driver of the node that must be stored in a variable
+ */
+can_virtual_bus::node can_virtual_bus::attach()
+{
+  return node(*this);
+}
+
+/**
+ * @brief Arbitrate and transmit one frame
+ *
+ * @return true - a frame was transmitted
+ * @return false - no node had a frame pending, time did not advance
+ */
+bool can_virtual_bus::step()
+{
+  node* winner = nullptr;
+  std::size_t winner_mailbox = 0;
+  std::uint64_t winner_key = 0;
+
+  for (auto* contender : m_nodes) {
+    if (contender->m_pending == 0) {
+      continue;
+    }
+    const auto mailbox = contender->next_mailbox();
+    const auto key = arbitration_key(contender->m_mailboxes[mailbox]);
+    // Identical arbitration fields from two nodes would end in an error frame
+    // on a real bus. The first attached node wins instead.
+    if (winner == nullptr || key < winner_key) {
+      winner = contender;
+      winner_mailbox = mailbox;
+      winner_key = key;
+    }
+  }
+
+  if (winner == nullptr) {
+    return false;
+  }
+
+  for (auto* contender : m_nodes) {
+    if (contender != winner && contender->m_pending != 0) {
+      contender->m_lost_arbitration++;
+    }
+  }
+
+  // Remove the frame from its mailbox, keeping the rest in send order
+  const auto message = winner->m_mailboxes[winner_mailbox];
+  for (auto i = winner_mailbox + 1; i < winner->m_pending; i++) {
+    winner->m_mailboxes[i - 1] = winner->m_mailboxes[i];
+  }
+  winner->m_pending--;
+  winner->m_transmitted++;
+
+  const auto duration = static_cast<std::uint64_t>(std::llround(
+    static_cast<double>(can_frame_bits(message)) * m_nanoseconds_per_bit));
+  m_now += duration;
+  m_busy += duration;
+  m_frames++;
+
+  for (auto* receiver : m_nodes) {
+    if (receiver != winner) {
+      receiver->m_handler(message);
+    }
+  }
+
+  return true;
+}
+
+/**
+ * @brief Transmit frames for a span of simulated time
+ *
+ * @param p_duration - simulated time to run for
+ * @return std::size_t - number of frames transmitted
+ */
+std::size_t can_virtual_bus::run_for(hal::time_duration p_duration)
+{
+  const auto end =
+    m_now + static_cast<std::uint64_t>(
+              std::max<hal::time_duration::rep>(p_duration.count(), 0));
+  std::size_t count = 0;
+
+  while (m_now < end && step()) {
+    count++;
+  }
+  if (m_now < end) {
+    m_now = end;
+  }
+
+  return count;
+}
+
+/**
+ * @brief Transmit frames until no node has a frame pending
+ *
+ * @param p_max_frames - stop after this many frames
+ * @return std::size_t - number of frames transmitted
+ */
+std::size_t can_virtual_bus::run_until_idle(std::size_t p_max_frames)
+{
+  std::size_t count = 0;
+  while (count < p_max_frames && step()) {
+    count++;
+  }
+  return count;
+}
+
+can_virtual_bus::simulated_clock::simulated_clock(can_virtual_bus& p_bus)
+  : m_bus(&p_bus)
+{
+}
+
+hal::steady_clock::frequency_t
+can_virtual_bus::simulated_clock::driver_frequency()
+{
+  return { .operating_frequency = 1.0e9f };
+}
+
+hal::steady_clock::uptime_t can_virtual_bus::simulated_clock::driver_uptime()
+{
+  return { .ticks = m_bus->m_now };
+}
+}  // namespace hal
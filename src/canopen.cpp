@@ -0,0 +1,602 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "libhal-canrouter/canopen.hpp"
+
+#include <algorithm>
+#include <system_error>
+#include <utility>
+
+#include "clock_ticks.hpp"
+
+namespace hal {
+namespace {
+// SDO command specifiers, held in the top 3 bits of the first payload byte
+constexpr hal::byte sdo_download_segment = 0 << 5;
+constexpr hal::byte sdo_initiate_download = 1 << 5;
+constexpr hal::byte sdo_initiate_upload = 2 << 5;
+constexpr hal::byte sdo_upload_segment = 3 << 5;
+constexpr hal::byte sdo_abort = 4 << 5;
+
+// Server command specifiers of the responses to the requests above
+constexpr std::uint8_t scs_upload_segment = 0;
+constexpr std::uint8_t scs_download_segment = 1;
+constexpr std::uint8_t scs_initiate_upload = 2;
+constexpr std::uint8_t scs_initiate_download = 3;
+constexpr std::uint8_t scs_abort = 4;
+
+constexpr std::size_t segment_size = 7;
+constexpr std::size_t expedited_size = 4;
+
+std::uint32_t read_u32(const std::array<hal::byte, 8>& p_payload)
+{
+  return static_cast<std::uint32_t>(p_payload[4]) |
+         static_cast<std::uint32_t>(p_payload[5]) << 8 |
+         static_cast<std::uint32_t>(p_payload[6]) << 16 |
+         static_cast<std::uint32_t>(p_payload[7]) << 24;
+}
+
+void write_u32(std::array<hal::byte, 8>& p_payload, std::uint32_t p_value)
+{
+  p_payload[4] = static_cast<hal::byte>(p_value);
+  p_payload[5] = static_cast<hal::byte>(p_value >> 8);
+  p_payload[6] = static_cast<hal::byte>(p_value >> 16);
+  p_payload[7] = static_cast<hal::byte>(p_value >> 24);
+}
+
+std::array<hal::byte, 8> sdo_header(hal::byte p_command,
+                                    std::uint16_t p_index,
+                                    std::uint8_t p_subindex)
+{
+  return { p_command,
+           static_cast<hal::byte>(p_index),
+           static_cast<hal::byte>(p_index >> 8),
+           p_subindex };
+}
+}  // namespace
+
+void canopen_dispatcher::node::reset_sdo()
+{
+  m_sdo_done = [](canopen_sdo_abort, std::span<const hal::byte>) {};
+  m_upload = {};
+  m_download = {};
+  m_sdo_state = sdo_state::idle;
+}
+
+void canopen_dispatcher::node::reset(std::uint8_t p_id)
+{
+  m_pdo.fill(can_router::noop);
+  m_emergency = [](std::uint8_t, const canopen_emergency&) {};
+  m_heartbeat = [](std::uint8_t, canopen_nmt_state) {};
+  reset_sdo();
+  m_state = std::nullopt;
+  m_id = p_id;
+}
+
+/**
+ * @brief Construct a new CANopen dispatcher
+ *
+ * @param p_router - router to receive frames from and send frames through
+ * @param p_clock - clock used to time out SDO transfers
+ * @param p_sdo_timeout - longest time to wait for each SDO response
+ * @param p_nodes - storage for attached nodes, which also sets the maximum
+ * number of them
+ */
+canopen_dispatcher::canopen_dispatcher(can_router& p_router,
+                                       hal::steady_clock& p_clock,
+                                       hal::time_duration p_sdo_timeout,
+                                       std::span<node> p_nodes)
+  : m_router(&p_router)
+  , m_clock(&p_clock)
+  , m_sdo_timeout(clock_ticks(p_clock, p_sdo_timeout))
+  , m_nodes(p_nodes.first(std::min<std::size_t>(p_nodes.size(), max_node_id)))
+  , m_tap(p_router.add_tap(
+      [this](const can::message_t& p_message,
+             can_router::direction p_direction) {
+        if (p_direction == can_router::direction::receive) {
+          receive(p_message);
+        }
+      }))
+{
+  for (auto& entry : m_nodes) {
+    entry.m_id = 0;
+  }
+}
+
+/**
+ * @brief Start dispatching frames of a node
+ *
+ * @param p_node - node ID, 1 to 127
+ * @return status - std::errc::invalid_argument if the node ID is out of range,
+ * std::errc::not_enough_memory if all node storage is in use
+ */
+status canopen_dispatcher::attach(std::uint8_t p_node)
+{
+  if (p_node == 0 || p_node > max_node_id) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+  if (m_slots[p_node] != 0) {
+    return hal::success();
+  }
+
+  for (std::size_t i = 0; i < m_nodes.size(); i++) {
+    if (m_nodes[i].m_id == 0) {
+      m_nodes[i].reset(p_node);
+      m_slots[p_node] = static_cast<std::uint8_t>(i + 1);
+      return hal::success();
+    }
+  }
+
+  return hal::new_error(std::errc::not_enough_memory);
+}
+
+/**
+ * @brief Stop dispatching frames of a node and free its storage
+ *
+ * @param p_node - node ID
+ */
+void canopen_dispatcher::detach(std::uint8_t p_node)
+{
+  auto* entry = find(p_node);
+  if (entry == nullptr) {
+    return;
+  }
+  entry->reset(0);
+  m_slots[p_node] = 0;
+}
+
+/**
+ * @brief Set the handler for a TPDO sent by a node
+ *
+ * @param p_node - node ID of an attached node
+ * @param p_pdo - PDO number, 1 to 4
+ * @param p_handler - called with each TPDO frame
+ * @return status - std::errc::invalid_argument if the node is not attached or
+ * the PDO number is out of range
+ */
+status canopen_dispatcher::on_pdo(std::uint8_t p_node,
+                                  std::uint8_t p_pdo,
+                                  pdo_handler p_handler)
+{
+  auto* entry = find(p_node);
+  if (entry == nullptr || p_pdo == 0 || p_pdo > entry->m_pdo.size()) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+  entry->m_pdo[p_pdo - 1] = std::move(p_handler);
+  return hal::success();
+}
+
+/**
+ * @brief Set the handler for EMCY frames sent by a node
+ *
+ * @param p_node - node ID of an attached node
+ * @param p_handler - called with each decoded emergency
+ * @return status - std::errc::invalid_argument if the node is not attached
+ */
+status canopen_dispatcher::on_emergency(std::uint8_t p_node,
+                                        emergency_handler p_handler)
+{
+  auto* entry = find(p_node);
+  if (entry == nullptr) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+  entry->m_emergency = std::move(p_handler);
+  return hal::success();
+}
+
+/**
+ * @brief Set the handler for heartbeats sent by a node
+ *
+ * @param p_node - node ID of an attached node
+ * @param p_handler - called with the state in each heartbeat
+ * @return status - std::errc::invalid_argument if the node is not attached
+ */
+status canopen_dispatcher::on_heartbeat(std::uint8_t p_node,
+                                        heartbeat_handler p_handler)
+{
+  auto* entry = find(p_node);
+  if (entry == nullptr) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+  entry->m_heartbeat = std::move(p_handler);
+  return hal::success();
+}
+
+/**
+ * @brief NMT state from the last heartbeat of a node
+ *
+ * @param p_node - node ID
+ * @return std::optional<canopen_nmt_state> - last reported state, or
+ * std::nullopt if the node is not attached or has not sent a heartbeat
+ */
+std::optional<canopen_nmt_state> canopen_dispatcher::state(
+  std::uint8_t p_node) const
+{
+  const auto* entry = find(p_node);
+  if (entry == nullptr) {
+    return std::nullopt;
+  }
+  return entry->m_state;
+}
+
+/**
+ * @brief Send an NMT command
+ *
+ * @param p_command - command to send
+ * @param p_node - node ID, or 0 for every node
+ * @return status - error from sending the frame
+ */
+status canopen_dispatcher::nmt(canopen_nmt_command p_command,
+                               std::uint8_t p_node)
+{
+  const can::message_t message{
+    .id = canopen_cob_id(canopen_function::nmt, 0),
+    .payload = { static_cast<hal::byte>(p_command), p_node },
+    .length = 2,
+  };
+  HAL_CHECK(m_router->bus().send(message));
+  return hal::success();
+}
+
+/**
+ * @brief Read an object from a node's object dictionary
+ *
+ * @param p_node - node ID of an attached node
+ * @param p_index - object index
+ * @param p_subindex - object subindex
+ * @param p_buffer - destination for the object, which must remain valid until
+ * p_on_done is called
+ * @param p_on_done - called with the result and the bytes read
+ * @return status - std::errc::invalid_argument if the node is not attached,
+ * std::errc::device_or_resource_busy if a transfer to the node is in flight,
+ * or the error from sending the request.
+ */
+status canopen_dispatcher::sdo_read(std::uint8_t p_node,
+                                    std::uint16_t p_index,
+                                    std::uint8_t p_subindex,
+                                    std::span<hal::byte> p_buffer,
+                                    sdo_handler p_on_done)
+{
+  auto* entry = find(p_node);
+  if (entry == nullptr) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+  if (entry->m_sdo_state != node::sdo_state::idle) {
+    return hal::new_error(std::errc::device_or_resource_busy);
+  }
+
+  entry->m_upload = p_buffer;
+  entry->m_sdo_offset = 0;
+  entry->m_sdo_index = p_index;
+  entry->m_sdo_subindex = p_subindex;
+  entry->m_sdo_state = node::sdo_state::upload;
+
+  entry->m_sdo_done = std::move(p_on_done);
+
+  auto sent =
+    send_sdo(*entry, sdo_header(sdo_initiate_upload, p_index, p_subindex));
+  if (!sent) {
+    entry->reset_sdo();
+  }
+  return sent;
+}
+
+/**
+ * @brief Write an object in a node's object dictionary
+ *
+ * @param p_node - node ID of an attached node
+ * @param p_index - object index
+ * @param p_subindex - object subindex
+ * @param p_data - object value, which must remain valid until p_on_done is
+ * called
+ * @param p_on_done - called with the result and no data
+ * @return status - std::errc::invalid_argument if the node is not attached or
+ * p_data is empty, std::errc::device_or_resource_busy if a transfer to the
+ * node is in flight, or the error from sending the request.
+ */
+status canopen_dispatcher::sdo_write(std::uint8_t p_node,
+                                     std::uint16_t p_index,
+                                     std::uint8_t p_subindex,
+                                     std::span<const hal::byte> p_data,
+                                     sdo_handler p_on_done)
+{
+  auto* entry = find(p_node);
+  if (entry == nullptr || p_data.empty()) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+  if (entry->m_sdo_state != node::sdo_state::idle) {
+    return hal::new_error(std::errc::device_or_resource_busy);
+  }
+
+  // Size indicated (s) is always set. Small objects also set expedited (e)
+  // and the number of unused data bytes (n).
+  auto payload = sdo_header(sdo_initiate_download | 0x01, p_index, p_subindex);
+  if (p_data.size() <= expedited_size) {
+    payload[0] |=
+      static_cast<hal::byte>(0x02 | ((expedited_size - p_data.size()) << 2));
+    std::copy(p_data.begin(), p_data.end(), payload.begin() + 4);
+    entry->m_sdo_offset = p_data.size();
+  } else {
+    write_u32(payload, static_cast<std::uint32_t>(p_data.size()));
+    entry->m_sdo_offset = 0;
+  }
+
+  entry->m_download = p_data;
+  entry->m_sdo_index = p_index;
+  entry->m_sdo_subindex = p_subindex;
+  entry->m_sdo_state = node::sdo_state::download;
+
+  entry->m_sdo_done = std::move(p_on_done);
+
+  auto sent = send_sdo(*entry, payload);
+  if (!sent) {
+    entry->reset_sdo();
+  }
+  return sent;
+}
+
+/**
+ * @brief Abort every SDO transfer whose server has stopped responding
+ */
+void canopen_dispatcher::poll()
+{
+  const auto now = m_clock->uptime().ticks;
+  for (auto& entry : m_nodes) {
+    if (entry.m_id != 0 && entry.m_sdo_state != node::sdo_state::idle &&
+        now >= entry.m_sdo_deadline) {
+      abort(entry, canopen_sdo_abort::timeout);
+    }
+  }
+}
+
+canopen_dispatcher::node* canopen_dispatcher::find(std::uint8_t p_node)
+{
+  if (p_node > max_node_id || m_slots[p_node] == 0) {
+    return nullptr;
+  }
+  return &m_nodes[m_slots[p_node] - 1];
+}
+
+const canopen_dispatcher::node* canopen_dispatcher::find(
+  std::uint8_t p_node) const
+{
+  if (p_node > max_node_id || m_slots[p_node] == 0) {
+    return nullptr;
+  }
+  return &m_nodes[m_slots[p_node] - 1];
+}
+
+void canopen_dispatcher::receive(const can::message_t& p_message)
+{
+  if (p_message.id > 0x7FF || p_message.is_remote_request) {
+    return;
+  }
+
+  auto* entry = find(static_cast<std::uint8_t>(p_message.id & 0x7F));
+  if (entry == nullptr) {
+    return;
+  }
+
+  const auto& payload = p_message.payload;
+  switch (static_cast<canopen_function>(p_message.id >> 7)) {
+    case canopen_function::emergency: {
+      canopen_emergency emergency{
+        .error_code = static_cast<std::uint16_t>(payload[0] | payload[1] << 8),
+        .error_register = payload[2],
+      };
+      std::copy_n(payload.begin() + 3,
+                  emergency.manufacturer_data.size(),
+                  emergency.manufacturer_data.begin());
+      entry->m_emergency(entry->m_id, emergency);
+      break;
+    }
+    case canopen_function::tpdo1:
+    case canopen_function::tpdo2:
+    case canopen_function::tpdo3:
+    case canopen_function::tpdo4:
+      // TPDO function codes are 3, 5, 7 and 9
+      entry->m_pdo[((p_message.id >> 7) - 3) / 2](p_message);
+      break;
+    case canopen_function::sdo_response:
+      receive_sdo(*entry, p_message);
+      break;
+    case canopen_function::heartbeat:
+      if (p_message.length >= 1) {
+        // Bit 7 is the node guarding toggle bit
+        const auto state = static_cast<canopen_nmt_state>(payload[0] & 0x7F);
+        entry->m_state = state;
+        entry->m_heartbeat(entry->m_id, state);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+void canopen_dispatcher::receive_sdo(node& p_node,
+                                     const can::message_t& p_message)
+{
+  using enum node::sdo_state;
+
+  if (p_node.m_sdo_state == idle) {
+    return;
+  }
+
+  const auto& payload = p_message.payload;
+  const auto command = payload[0];
+  const std::uint8_t specifier = command >> 5;
+  const auto toggle = (command & 0x10) != 0;
+  const auto index = static_cast<std::uint16_t>(payload[1] | payload[2] << 8);
+  const bool same_object =
+    index == p_node.m_sdo_index && payload[3] == p_node.m_sdo_subindex;
+
+  if (specifier == scs_abort) {
+    finish(p_node, static_cast<canopen_sdo_abort>(read_u32(payload)));
+    return;
+  }
+
+  switch (p_node.m_sdo_state) {
+    case upload: {
+      if (specifier != scs_initiate_upload || !same_object) {
+        break;
+      }
+      const bool expedited = (command & 0x02) != 0;
+      const bool size_indicated = (command & 0x01) != 0;
+
+      if (expedited) {
+        const std::size_t size =
+          size_indicated ? expedited_size - ((command >> 2) & 0x03)
+                         : expedited_size;
+        if (size > p_node.m_upload.size()) {
+          abort(p_node, canopen_sdo_abort::out_of_memory);
+          return;
+        }
+        std::copy_n(payload.begin() + 4, size, p_node.m_upload.begin());
+        p_node.m_sdo_offset = size;
+        finish(p_node, canopen_sdo_abort::none);
+        return;
+      }
+
+      if (size_indicated && read_u32(payload) > p_node.m_upload.size()) {
+        abort(p_node, canopen_sdo_abort::out_of_memory);
+        return;
+      }
+      p_node.m_sdo_state = upload_segment;
+      p_node.m_sdo_toggle = false;
+      send_segment(p_node);
+      return;
+    }
+    case upload_segment: {
+      if (specifier != scs_upload_segment) {
+        break;
+      }
+      if (toggle != p_node.m_sdo_toggle) {
+        abort(p_node, canopen_sdo_abort::toggle_bit);
+        return;
+      }
+      const std::size_t size = segment_size - ((command >> 1) & 0x07);
+      if (p_node.m_sdo_offset + size > p_node.m_upload.size()) {
+        abort(p_node, canopen_sdo_abort::out_of_memory);
+        return;
+      }
+      std::copy_n(payload.begin() + 1,
+                  size,
+                  p_node.m_upload.begin() + p_node.m_sdo_offset);
+      p_node.m_sdo_offset += size;
+
+      if (command & 0x01) {
+        finish(p_node, canopen_sdo_abort::none);
+        return;
+      }
+      p_node.m_sdo_toggle = !p_node.m_sdo_toggle;
+      send_segment(p_node);
+      return;
+    }
+    case download: {
+      if (specifier != scs_initiate_download || !same_object) {
+        break;
+      }
+      if (p_node.m_sdo_offset == p_node.m_download.size()) {
+        finish(p_node, canopen_sdo_abort::none);
+        return;
+      }
+      p_node.m_sdo_state = download_segment;
+      p_node.m_sdo_toggle = false;
+      send_segment(p_node);
+      return;
+    }
+    case download_segment: {
+      if (specifier != scs_download_segment) {
+        break;
+      }
+      if (toggle != p_node.m_sdo_toggle) {
+        abort(p_node, canopen_sdo_abort::toggle_bit);
+        return;
+      }
+      if (p_node.m_sdo_offset == p_node.m_download.size()) {
+        finish(p_node, canopen_sdo_abort::none);
+        return;
+      }
+      p_node.m_sdo_toggle = !p_node.m_sdo_toggle;
+      send_segment(p_node);
+      return;
+    }
+    default:
+      return;
+  }
+
+  abort(p_node, canopen_sdo_abort::invalid_command);
+}
+
+status canopen_dispatcher::send_sdo(node& p_node,
+                                    const std::array<hal::byte, 8>& p_payload)
+{
+  const can::message_t message{
+    .id = canopen_cob_id(canopen_function::sdo_request, p_node.m_id),
+    .payload = p_payload,
+    .length = 8,
+  };
+  p_node.m_sdo_deadline = m_clock->uptime().ticks + m_sdo_timeout;
+  HAL_CHECK(m_router->bus().send(message));
+  return hal::success();
+}
+
+void canopen_dispatcher::send_segment(node& p_node)
+{
+  std::array<hal::byte, 8> payload{};
+  const auto toggle = static_cast<hal::byte>(p_node.m_sdo_toggle ? 0x10 : 0);
+
+  if (p_node.m_sdo_state == node::sdo_state::upload_segment) {
+    payload[0] = sdo_upload_segment | toggle;
+  } else {
+    const auto remaining = p_node.m_download.subspan(p_node.m_sdo_offset);
+    const auto size = std::min(remaining.size(), segment_size);
+    const bool last = size == remaining.size();
+    payload[0] = static_cast<hal::byte>(
+      sdo_download_segment | toggle | ((segment_size - size) << 1) |
+      (last ? 0x01 : 0x00));
+    std::copy_n(remaining.begin(), size, payload.begin() + 1);
+    p_node.m_sdo_offset += size;
+  }
+
+  if (!send_sdo(p_node, payload)) {
+    finish(p_node, canopen_sdo_abort::general);
+  }
+}
+
+void canopen_dispatcher::abort(node& p_node, canopen_sdo_abort p_code)
+{
+  auto payload =
+    sdo_header(sdo_abort, p_node.m_sdo_index, p_node.m_sdo_subindex);
+  write_u32(payload, static_cast<std::uint32_t>(p_code));
+  // The transfer ends whether or not the server hears about it
+  static_cast<void>(send_sdo(p_node, payload));
+  finish(p_node, p_code);
+}
+
+void canopen_dispatcher::finish(node& p_node, canopen_sdo_abort p_code)
+{
+  std::span<const hal::byte> data{};
+  if (p_code == canopen_sdo_abort::none &&
+      p_node.m_sdo_state != node::sdo_state::download &&
+      p_node.m_sdo_state != node::sdo_state::download_segment) {
+    data = p_node.m_upload.first(p_node.m_sdo_offset);
+  }
+
+  // Idle before the handler runs, so it may start the next transfer
+  auto handler = std::move(p_node.m_sdo_done);
+  p_node.reset_sdo();
+  handler(p_code, data);
+}
+}  // namespace hal
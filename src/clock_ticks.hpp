@@ -0,0 +1,64 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include <libhal/steady_clock.hpp>
+#include <libhal/units.hpp>
+
+namespace hal {
+/**
+ * @brief Convert a duration into ticks of a clock running at p_frequency
+ *
+ * @param p_frequency - clock frequency
+ * @param p_time - duration to convert
+ * @return std::uint64_t - whole ticks in p_time, 0 for negative durations
+ */
+inline std::uint64_t clock_ticks(hal::hertz p_frequency,
+                                 hal::time_duration p_time)
+{
+  const auto ticks = static_cast<double>(p_frequency) *
+                     static_cast<double>(p_time.count()) / 1e9;
+  return static_cast<std::uint64_t>(std::max(ticks, 0.0));
+}
+
+/**
+ * @brief Convert a duration into ticks of a clock
+ *
+ * @param p_clock - clock whose ticks to count
+ * @param p_time - duration to convert
+ * @return std::uint64_t - whole ticks in p_time, 0 for negative durations
+ */
+inline std::uint64_t clock_ticks(hal::steady_clock& p_clock,
+                                 hal::time_duration p_time)
+{
+  return clock_ticks(p_clock.frequency().operating_frequency, p_time);
+}
+
+/**
+ * @brief Clock ticks per tick of a timer with the given resolution
+ *
+ * @param p_clock - clock that drives the timer
+ * @param p_resolution - length of one timer tick
+ * @return std::uint64_t - clock ticks per timer tick, at least 1
+ */
+inline std::uint64_t clock_ticks_per_tick(hal::steady_clock& p_clock,
+                                          hal::time_duration p_resolution)
+{
+  return std::max<std::uint64_t>(clock_ticks(p_clock, p_resolution), 1);
+}
+}  // namespace hal
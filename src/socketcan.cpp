@@ -0,0 +1,344 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "libhal-canrouter/socketcan.hpp"
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <utility>
+
+namespace hal {
+namespace {
+constexpr auto relaxed = std::memory_order_relaxed;
+
+/// Driver whose receive loop runs on this thread, if any
+thread_local const socketcan* receiving_driver = nullptr;
+
+can::message_t from_frame(const can_frame& p_frame)
+{
+  can::message_t message{};
+  const bool extended = p_frame.can_id & CAN_EFF_FLAG;
+  message.id = p_frame.can_id & (extended ? CAN_EFF_MASK : CAN_SFF_MASK);
+  message.is_remote_request = p_frame.can_id & CAN_RTR_FLAG;
+  message.length = std::min<std::uint8_t>(p_frame.can_dlc, 8);
+  std::copy_n(p_frame.data, message.payload.size(), message.payload.begin());
+  return message;
+}
+
+can_frame to_frame(const can::message_t& p_message)
+{
+  can_frame frame{};
+  // can::message_t has no extended flag, so IDs above 0x7FF are extended
+  frame.can_id = p_message.id & CAN_EFF_MASK;
+  if (p_message.id > CAN_SFF_MASK) {
+    frame.can_id |= CAN_EFF_FLAG;
+  }
+  if (p_message.is_remote_request) {
+    frame.can_id |= CAN_RTR_FLAG;
+  }
+  frame.can_dlc = std::min<std::uint8_t>(p_message.length, 8);
+  std::copy_n(p_message.payload.begin(), frame.can_dlc, frame.data);
+  return frame;
+}
+
+std::errc last_error()
+{
+  return static_cast<std::errc>(errno);
+}
+}  // namespace
+
+/**
+ * @brief Open a raw SocketCAN socket bound to a network interface
+ *
+ * Only available when building for Linux.
+ *
+ * @param p_interface - interface name such as "can0" or "vcan0"
+ * @return result<int> - non-blocking socket descriptor to hand to a
+ * `socketcan`, std::errc::invalid_argument if the name is too long,
+ * std::errc::no_such_device if there is no such interface, or the error of
+ * the failing system call
+ */
+result<int> socketcan_open(std::string_view p_interface)
+{
+  std::array<char, IFNAMSIZ> name{};
+  if (p_interface.empty() || p_interface.size() >= name.size()) {
+    return hal::new_error(std::errc::invalid_argument);
+  }
+  std::copy(p_interface.begin(), p_interface.end(), name.begin());
+
+  const auto index = ::if_nametoindex(name.data());
+  if (index == 0) {
+    return hal::new_error(std::errc::no_such_device);
+  }
+
+  const int socket =
+    ::socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, CAN_RAW);
+  if (socket < 0) {
+    return hal::new_error(last_error());
+  }
+
+  sockaddr_can address{};
+  address.can_family = AF_CAN;
+  address.can_ifindex = static_cast<int>(index);
+  if (::bind(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) <
+      0) {
+    const auto error = last_error();
+    ::close(socket);
+    return hal::new_error(error);
+  }
+
+  return socket;
+}
+
+/**
+ * @brief Create a driver over an open socket
+ *
+ * @param p_socket - socket from socketcan_open() or any datagram socket
+ * carrying `struct can_frame` records, such as one end of a socketpair in
+ * tests. The driver takes ownership and closes it, also when creation fails.
+ * @return result<socketcan> - the driver, or the error of the
+ * epoll_create1(), eventfd() or epoll_ctl() call that failed while setting up
+ * the receive thread's wake ups
+ */
+result<socketcan> socketcan::create(int p_socket)
+{
+  // Owns every descriptor from here on, so a failure closes them
+  socketcan driver(p_socket);
+
+  driver.m_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+  if (driver.m_epoll < 0) {
+    return hal::new_error(last_error());
+  }
+  driver.m_stop = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (driver.m_stop < 0) {
+    return hal::new_error(last_error());
+  }
+
+  epoll_event socket_event{ .events = EPOLLIN, .data = { .fd = p_socket } };
+  epoll_event stop_event{ .events = EPOLLIN, .data = { .fd = driver.m_stop } };
+  const int epoll = driver.m_epoll;
+  if (::epoll_ctl(epoll, EPOLL_CTL_ADD, p_socket, &socket_event) < 0 ||
+      ::epoll_ctl(epoll, EPOLL_CTL_ADD, driver.m_stop, &stop_event) < 0) {
+    return hal::new_error(last_error());
+  }
+
+  return driver;
+}
+
+socketcan::socketcan(int p_socket)
+  : m_socket(p_socket)
+{
+}
+
+socketcan::socketcan(socketcan&& p_other) noexcept
+{
+  // The receive thread refers to p_other, so stop it and start another one
+  // for this driver
+  const bool receiving = p_other.stop_receiving();
+  m_socket = std::exchange(p_other.m_socket, -1);
+  m_epoll = std::exchange(p_other.m_epoll, -1);
+  m_stop = std::exchange(p_other.m_stop, -1);
+  m_handler = std::exchange(p_other.m_handler, [](const message_t&) {});
+  m_received.store(p_other.m_received.load(relaxed), relaxed);
+  m_dropped.store(p_other.m_dropped.load(relaxed), relaxed);
+  m_sent.store(p_other.m_sent.load(relaxed), relaxed);
+  m_wait_calls.store(p_other.m_wait_calls.load(relaxed), relaxed);
+  m_receive_calls.store(p_other.m_receive_calls.load(relaxed), relaxed);
+  if (receiving) {
+    m_thread = std::thread(&socketcan::receive_loop, this);
+  }
+}
+
+/**
+ * @brief Stop the receive thread and close the socket
+ */
+socketcan::~socketcan()
+{
+  stop_receiving();
+  for (const int descriptor : { m_epoll, m_stop, m_socket }) {
+    if (descriptor >= 0) {
+      ::close(descriptor);
+    }
+  }
+}
+
+/**
+ * @brief Snapshot of the driver counters
+ *
+ * @return statistics - counters since construction
+ */
+socketcan::statistics socketcan::stats() const
+{
+  return {
+    .received = m_received.load(relaxed),
+    .dropped = m_dropped.load(relaxed),
+    .sent = m_sent.load(relaxed),
+    .wait_calls = m_wait_calls.load(relaxed),
+    .receive_calls = m_receive_calls.load(relaxed),
+  };
+}
+
+status socketcan::driver_configure(const settings&)
+{
+  // Bit rate is a property of the network interface
+  return hal::success();
+}
+
+status socketcan::driver_bus_on()
+{
+  return hal::success();
+}
+
+result<can::send_t> socketcan::driver_send(const message_t& p_message)
+{
+  const auto frame = to_frame(p_message);
+  if (::send(m_socket, &frame, sizeof(frame), MSG_DONTWAIT) < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+      return hal::new_error(std::errc::resource_unavailable_try_again);
+    }
+    return hal::new_error(last_error());
+  }
+  m_sent.fetch_add(1, relaxed);
+  return send_t{};
+}
+
+void socketcan::driver_on_receive(hal::callback<handler> p_handler)
+{
+  if (receiving_driver == this) {
+    // Called from the running handler, which holds m_handler_lock. The
+    // receive loop swaps it in once the handler returns.
+    m_next_handler = std::move(p_handler);
+    return;
+  }
+  {
+    std::lock_guard lock(m_handler_lock);
+    m_handler = std::move(p_handler);
+  }
+  if (!m_thread.joinable() && m_epoll >= 0) {
+    m_thread = std::thread(&socketcan::receive_loop, this);
+  }
+}
+
+void socketcan::receive_loop()
+{
+  receiving_driver = this;
+  std::array<epoll_event, 2> events{};
+
+  while (true) {
+    const int count = ::epoll_wait(m_epoll, events.data(), events.size(), -1);
+    m_wait_calls.fetch_add(1, relaxed);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+
+    bool readable = false;
+    bool hung_up = false;
+    for (int i = 0; i < count; i++) {
+      if (events[i].data.fd == m_stop) {
+        return;
+      }
+      readable = true;
+      hung_up = events[i].events & EPOLLHUP;
+    }
+
+    if (readable) {
+      const auto frames = receive_pending();
+      // Stop watching a socket that failed or whose peer went away, rather
+      // than waking for it forever
+      if (frames < 0 || (frames == 0 && hung_up)) {
+        ::epoll_ctl(m_epoll, EPOLL_CTL_DEL, m_socket, nullptr);
+      }
+    }
+  }
+}
+
+bool socketcan::stop_receiving()
+{
+  if (!m_thread.joinable()) {
+    return false;
+  }
+  std::uint64_t stop = 1;
+  static_cast<void>(::write(m_stop, &stop, sizeof(stop)));
+  m_thread.join();
+  // Clear the wake up, so a thread started later does not stop at once
+  static_cast<void>(::read(m_stop, &stop, sizeof(stop)));
+  return true;
+}
+
+int socketcan::receive_pending()
+{
+  std::array<can_frame, batch_size> frames;
+  std::array<iovec, batch_size> vectors;
+  std::array<mmsghdr, batch_size> headers{};
+  for (std::size_t i = 0; i < batch_size; i++) {
+    vectors[i] = { .iov_base = &frames[i], .iov_len = sizeof(can_frame) };
+    headers[i].msg_hdr.msg_iov = &vectors[i];
+    headers[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  int total = 0;
+  while (true) {
+    const int count = ::recvmmsg(
+      m_socket, headers.data(), batch_size, MSG_DONTWAIT, nullptr);
+    m_receive_calls.fetch_add(1, relaxed);
+    if (count < 0) {
+      // The interface going down is reported once and is not fatal
+      const bool transient = errno == EAGAIN || errno == EWOULDBLOCK ||
+                             errno == EINTR || errno == ENETDOWN;
+      return transient ? total : -1;
+    }
+
+    std::uint64_t dropped = 0;
+    {
+      std::lock_guard lock(m_handler_lock);
+      for (int i = 0; i < count; i++) {
+        const auto& frame = frames[i];
+        if (headers[i].msg_len != sizeof(can_frame) ||
+            (frame.can_id & CAN_ERR_FLAG)) {
+          dropped++;
+          continue;
+        }
+        m_handler(from_frame(frame));
+        if (m_next_handler) {
+          m_handler = std::move(*m_next_handler);
+          m_next_handler.reset();
+        }
+      }
+    }
+    m_received.fetch_add(count - dropped, relaxed);
+    m_dropped.fetch_add(dropped, relaxed);
+    total += count;
+
+    // A short batch emptied the queue, so skip the call that would only
+    // report EAGAIN. Later frames wake the thread again.
+    if (static_cast<std::size_t>(count) < batch_size) {
+      return total;
+    }
+  }
+}
+}  // namespace hal
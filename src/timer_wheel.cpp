@@ -0,0 +1,150 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "libhal-canrouter/timer_wheel.hpp"
+
+namespace hal {
+namespace {
+constexpr std::uint64_t slot_mask = timer_wheel::slots_per_level - 1;
+
+constexpr std::size_t level_index(std::uint64_t p_tick, std::size_t p_level)
+{
+  return static_cast<std::size_t>(
+    (p_tick >> (timer_wheel::slot_bits * p_level)) & slot_mask);
+}
+}  // namespace
+
+/**
+ * @brief Construct a new timer wheel
+ *
+ * @param p_start_tick - tick that the wheel considers to be "now"
+ */
+timer_wheel::timer_wheel(std::uint64_t p_start_tick)
+  : m_now(p_start_tick)
+{
+}
+
+/**
+ * @brief Arm or re-arm a timer to fire at an absolute tick
+ *
+ * @param p_timer - timer to arm
+ * @param p_expiry - absolute tick at which the timer should fire
+ */
+void timer_wheel::arm(timer& p_timer, std::uint64_t p_expiry)
+{
+  if (p_timer.pending()) {
+    unlink(p_timer);
+  }
+  p_timer.m_expiry = p_expiry;
+  insert(p_timer);
+  m_size++;
+}
+
+/**
+ * @brief Remove a timer from the wheel without firing it
+ *
+ * @param p_timer - timer to cancel
+ */
+void timer_wheel::cancel(timer& p_timer)
+{
+  if (p_timer.pending()) {
+    unlink(p_timer);
+  }
+}
+
+void timer_wheel::collect_expired()
+{
+  const auto index = level_index(m_now, 0);
+
+  // Once the lowest level wraps around, pull the next slot of each higher
+  // level down. Stop as soon as a level has not wrapped itself.
+  if (index == 0) {
+    for (std::size_t level = 1; level < levels; level++) {
+      if (cascade(level, level_index(m_now, level)) != 0) {
+        break;
+      }
+    }
+  }
+
+  m_now++;
+
+  // Move the slot's list onto the expired list so that the expiry callback
+  // can re-arm timers into this slot without them firing again this tick.
+  auto& head = m_wheel[0][index];
+  m_expired = head;
+  head = nullptr;
+  if (m_expired) {
+    m_expired->m_pprev = &m_expired;
+  }
+}
+
+std::size_t timer_wheel::cascade(std::size_t p_level, std::size_t p_index)
+{
+  auto& head = m_wheel[p_level][p_index];
+  timer* list = head;
+  head = nullptr;
+
+  while (list) {
+    timer* next = list->m_next;
+    insert(*list);
+    list = next;
+  }
+
+  return p_index;
+}
+
+void timer_wheel::insert(timer& p_timer)
+{
+  std::uint64_t expiry = p_timer.m_expiry;
+
+  if (expiry < m_now) {
+    expiry = m_now;
+  }
+
+  const auto delta = expiry - m_now;
+  std::size_t level = 0;
+
+  if (delta >= max_span) {
+    // Too far out to represent: park it in the furthest slot of the highest
+    // level. It will be re-inserted with its real expiry when that slot
+    // cascades.
+    expiry = m_now + max_span - 1;
+    level = levels - 1;
+  } else {
+    while (level + 1 < levels &&
+           delta >= (std::uint64_t{ 1 } << (slot_bits * (level + 1)))) {
+      level++;
+    }
+  }
+
+  auto& head = m_wheel[level][level_index(expiry, level)];
+  p_timer.m_next = head;
+  p_timer.m_pprev = &head;
+  if (head) {
+    head->m_pprev = &p_timer.m_next;
+  }
+  head = &p_timer;
+}
+
+void timer_wheel::unlink(timer& p_timer)
+{
+  *p_timer.m_pprev = p_timer.m_next;
+  if (p_timer.m_next) {
+    p_timer.m_next->m_pprev = p_timer.m_pprev;
+  }
+  p_timer.m_next = nullptr;
+  p_timer.m_pprev = nullptr;
+  m_size--;
+}
+}  // namespace hal
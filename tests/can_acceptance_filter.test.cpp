@@ -0,0 +1,326 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/can_acceptance_filter.hpp>
+
+#include <libhal-canrouter/canopen.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <vector>
+
+#include <boost/ut.hpp>
+
+#include "mocks.hpp"
+
+namespace hal {
+namespace {
+class mock_filter_bank : public hal::can_filter_bank
+{
+public:
+  std::vector<can_acceptance_filter> m_programmed{};
+
+private:
+  std::size_t driver_capacity() override
+  {
+    return 4;
+  }
+
+  status driver_program(
+    std::span<const can_acceptance_filter> p_filters) override
+  {
+    m_programmed.assign(p_filters.begin(), p_filters.end());
+    return success();
+  }
+};
+
+std::vector<can::id_t> random_standard_ids(std::mt19937& p_rng,
+                                           std::size_t p_count)
+{
+  std::uniform_int_distribution<can::id_t> distribution(0, 0x7FF);
+  std::set<can::id_t> ids;
+  while (ids.size() < p_count) {
+    ids.insert(distribution(p_rng));
+  }
+  return { ids.begin(), ids.end() };
+}
+
+/// Number of standard IDs accepted by any filter
+std::size_t accepted_standard_ids(
+  std::span<const can_acceptance_filter> p_filters)
+{
+  std::size_t accepted = 0;
+  for (can::id_t id = 0; id <= 0x7FF; id++) {
+    accepted += std::any_of(p_filters.begin(),
+                            p_filters.end(),
+                            [id](const can_acceptance_filter& p_filter) {
+                              return p_filter.matches(id);
+                            });
+  }
+  return accepted;
+}
+}  // namespace
+
+void can_acceptance_filter_test()
+{
+  using namespace boost::ut;
+  using namespace std::chrono_literals;
+
+  "can_acceptance_filter"_test = []() {
+    // Setup
+    constexpr auto exact = can_acceptance_filter::exact(0x123);
+    constexpr auto extended = can_acceptance_filter::exact(0x18FEF100);
+    constexpr can_acceptance_filter range{ .id = 0x120, .mask = 0x7F0 };
+
+    // Verify
+    expect(exact.matches(0x123));
+    expect(!exact.matches(0x122));
+    expect(that % 1 == exact.accepted_ids());
+    expect(extended.extended);
+    expect(extended.matches(0x18FEF100));
+    expect(!extended.matches(0x100));
+    expect(range.matches(0x12F));
+    expect(!range.matches(0x130));
+    expect(that % 16 == range.accepted_ids());
+  };
+
+  "can_filter_optimizer uses exact filters when banks allow"_test = []() {
+    // Setup
+    std::array<can_acceptance_filter, 8> banks{};
+    can_filter_optimizer optimizer(banks);
+
+    // Exercise
+    for (can::id_t id : { 0x100, 0x200, 0x300, 0x100, 0x18FEF100 }) {
+      expect(bool{ optimizer.add(id) });
+    }
+
+    // Verify
+    expect(that % 4 == optimizer.filters().size());
+    expect(that % 4 == optimizer.accepted_ids());
+  };
+
+  "can_filter_optimizer merges neighbouring IDs"_test = []() {
+    // Setup
+    std::array<can_acceptance_filter, 2> banks{};
+    can_filter_optimizer optimizer(banks);
+
+    // Exercise
+    for (can::id_t id : { 0x100, 0x101, 0x102, 0x103, 0x700 }) {
+      expect(bool{ optimizer.add(id) });
+    }
+
+    // Verify
+    // 0x100-0x103 fit exactly in one filter, 0x700 keeps its own
+    expect(that % 2 == optimizer.filters().size());
+    expect(that % 5 == optimizer.accepted_ids());
+  };
+
+  "can_filter_optimizer false accept rate on random ID sets"_test = []() {
+    // Setup
+    std::mt19937 rng(37);
+    int rejected = 0;
+    int worse_than_single_filter = 0;
+
+    for (const std::size_t id_count : { 8, 32, 128 }) {
+      for (const std::size_t bank_count : { 1, 4, 8, 14, 28 }) {
+        double false_accept_rate = 0.0;
+        constexpr int trials = 20;
+
+        for (int trial = 0; trial < trials; trial++) {
+          const auto ids = random_standard_ids(rng, id_count);
+          std::vector<can_acceptance_filter> banks(bank_count);
+          can_filter_optimizer optimizer(banks);
+
+          // Exercise
+          for (const auto id : ids) {
+            expect(bool{ optimizer.add(id) });
+          }
+
+          // Verify
+          const auto filters = optimizer.filters();
+          expect(filters.size() <= bank_count);
+          for (const auto id : ids) {
+            rejected += std::none_of(
+              filters.begin(),
+              filters.end(),
+              [id](const auto& p_filter) { return p_filter.matches(id); });
+          }
+
+          auto single = can_acceptance_filter::exact(ids[0]);
+          for (const auto id : ids) {
+            single.mask &= ~(single.id ^ id);
+            single.id &= single.mask;
+          }
+
+          const auto accepted = accepted_standard_ids(filters);
+          worse_than_single_filter += accepted > single.accepted_ids();
+          false_accept_rate += static_cast<double>(accepted - ids.size()) /
+                               static_cast<double>(0x800 - ids.size());
+        }
+
+        std::printf("acceptance filters: %3zu ids, %2zu banks: "
+                    "%5.1f%% false accepts\n",
+                    id_count,
+                    bank_count,
+                    100.0 * false_accept_rate / trials);
+      }
+    }
+
+    expect(that % 0 == rejected);
+    expect(that % 0 == worse_than_single_filter);
+  };
+
+  "can_filter_optimizer needs a bank per ID type"_test = []() {
+    // Setup
+    std::array<can_acceptance_filter, 1> banks{};
+    can_filter_optimizer optimizer(banks);
+    can_filter_optimizer no_banks(std::span<can_acceptance_filter>{});
+
+    // Exercise + Verify
+    expect(bool{ optimizer.add(0x100) });
+    expect(bool{ optimizer.add(0x101) });
+    expect(!optimizer.add(0x18FEF100));
+    expect(!no_banks.add(0x100));
+
+    optimizer.clear();
+    expect(that % 0 == optimizer.filters().size());
+    expect(bool{ optimizer.add(0x18FEF100) });
+  };
+
+  "can_filter_optimizer::add_range()"_test = []() {
+    // Setup
+    std::array<can_acceptance_filter, 8> banks{};
+    can_filter_optimizer optimizer(banks);
+
+    // Exercise + Verify: an aligned range takes one bank
+    expect(bool{ optimizer.add_range(0x700, 0x77F) });
+    expect(that % 1 == optimizer.filters().size());
+    expect(that % 128 == optimizer.accepted_ids());
+
+    // Exercise + Verify: an unaligned range is split into blocks
+    optimizer.clear();
+    expect(bool{ optimizer.add_range(0x101, 0x106) });
+    expect(that % 4 == optimizer.filters().size());
+    expect(that % 6 == optimizer.accepted_ids());
+    for (can::id_t id = 0x0FF; id <= 0x108; id++) {
+      const bool accepted = std::any_of(
+        optimizer.filters().begin(),
+        optimizer.filters().end(),
+        [id](const auto& p_filter) { return p_filter.matches(id); });
+      expect(that % (id >= 0x101 && id <= 0x106) == accepted) << id;
+    }
+
+    // Exercise + Verify: standard and extended IDs take separate banks
+    optimizer.clear();
+    expect(bool{ optimizer.add_range(0x7FE, 0x801) });
+    expect(that % 2 == optimizer.filters().size());
+    expect(!optimizer.filters()[0].extended);
+    expect(optimizer.filters()[1].extended);
+
+    // Exercise + Verify
+    expect(!optimizer.add_range(0x200, 0x100));
+    expect(!optimizer.add_range(0, 0x2000'0000));
+  };
+
+  "can_filter_optimizer accepts tap consumed IDs"_test = []() {
+    // Setup
+    mock_can can;
+    mock_clock clock;
+    can_router router(can);
+    std::array<canopen_dispatcher::node, 1> nodes;
+    canopen_dispatcher canopen(router, clock, 100ms, nodes);
+    std::vector<int> heartbeats;
+    int routed = 0;
+    expect(bool{ canopen.attach(5) });
+    expect(bool{ canopen.on_heartbeat(
+      5, [&heartbeats](std::uint8_t p_node, canopen_nmt_state) {
+        heartbeats.push_back(p_node);
+      }) });
+    auto route = router.add_message_callback(
+      0x100, [&routed](const can::message_t&) { routed++; });
+    mock_filter_bank bank;
+    std::array<can_acceptance_filter, 4> storage{};
+    // Delivers a frame to the router only if the programmed filters pass it
+    auto receive = [&bank, &router](can::id_t p_id) {
+      const can::message_t message{ .id = p_id,
+                                    .payload = { 0x05 },
+                                    .length = 1 };
+      if (std::any_of(bank.m_programmed.begin(),
+                      bank.m_programmed.end(),
+                      [p_id](const auto& p_filter) {
+                        return p_filter.matches(p_id);
+                      })) {
+        router(message);
+      }
+    };
+
+    // Exercise: filters from the route table alone
+    expect(bool{ can_program_filters(router, bank, storage) });
+    receive(0x100);
+    receive(canopen_cob_id(canopen_function::heartbeat, 5));
+
+    // Verify: the dispatcher has no route, so its heartbeat is dropped
+    expect(that % 1 == routed);
+    expect(heartbeats.empty());
+
+    // Exercise: add every heartbeat and the node's SDO responses
+    can_filter_optimizer optimizer(storage);
+    const std::array<can::id_t, 1> sdo_ids{
+      canopen_cob_id(canopen_function::sdo_response, 5),
+    };
+    expect(bool{ optimizer.add(router) });
+    expect(bool{ optimizer.add_range(0x700, 0x77F) });
+    expect(bool{ optimizer.add(sdo_ids) });
+    expect(bool{ bank.program(optimizer.filters()) });
+    receive(0x100);
+    receive(canopen_cob_id(canopen_function::heartbeat, 5));
+    receive(0x200);
+
+    // Verify
+    expect(that % 3 == bank.m_programmed.size());
+    expect(that % 2 == routed);
+    expect(heartbeats == std::vector<int>{ 5 });
+    // The heartbeat has no route, and 0x200 was dropped by the filters
+    expect(that % 1 == router.unrouted());
+  };
+
+  "can_program_filters() from router routes"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    mock_filter_bank bank;
+    std::array<can_acceptance_filter, 16> storage{};
+    std::vector<can_router::route_item> routes;
+    for (can::id_t id : { 0x100, 0x101, 0x110, 0x111, 0x200, 0x201, 0x7FF }) {
+      routes.push_back(router.add_message_callback(id));
+    }
+
+    // Exercise
+    const auto programmed = can_program_filters(router, bank, storage);
+
+    // Verify
+    expect(bool{ programmed });
+    expect(that % 4 == bank.m_programmed.size());
+    for (const auto& route : router.handlers()) {
+      expect(std::any_of(bank.m_programmed.begin(),
+                         bank.m_programmed.end(),
+                         [&route](const auto& p_filter) {
+                           return p_filter.matches(route.id);
+                         }));
+    }
+  };
+};
+}  // namespace hal
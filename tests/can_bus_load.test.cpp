@@ -0,0 +1,116 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/can_bus_load.hpp>
+
+#include <cmath>
+#include <functional>
+
+#include <boost/ut.hpp>
+
+#include "mocks.hpp"
+
+namespace hal {
+namespace {
+bool near(float p_actual, float p_expected, float p_tolerance = 0.01f)
+{
+  return std::abs(p_actual - p_expected) <= p_tolerance;
+}
+}  // namespace
+
+void can_bus_load_test()
+{
+  using namespace boost::ut;
+  using namespace std::chrono_literals;
+
+  "can_frame_bits()"_test = []() {
+    expect(that % 55 == can_frame_bits({ .id = 0x100, .length = 0 }));
+    expect(that % 135 == can_frame_bits({ .id = 0x100, .length = 8 }));
+    expect(that % 80 == can_frame_bits({ .id = 0x18FF0000, .length = 0 }));
+    expect(that % 160 == can_frame_bits({ .id = 0x18FF0000, .length = 8 }));
+    // Remote frames carry no data regardless of length
+    expect(that % 55 == can_frame_bits({ .id = 0x100,
+                                         .length = 8,
+                                         .is_remote_request = true }));
+    // Invalid lengths are clamped to 8 bytes
+    expect(that % 135 == can_frame_bits({ .id = 0x100, .length = 15 }));
+  };
+
+  "can_bus_load_estimator::load() + frames_per_second()"_test = []() {
+    // Setup
+    mock_clock clock;
+    clock.m_ticks = 5'000'000;
+    can_bus_load_estimator estimator(clock, 500'000.0f, 1s);
+
+    // Exercise: 1000 frames per second of 135 bits each for two seconds
+    for (int i = 0; i < 2000; i++) {
+      clock.m_ticks += 1'000;
+      estimator.record({ .id = 0x100, .length = 8 });
+    }
+
+    // Verify: 135'000 bits per second / 500'000 bps
+    expect(near(estimator.load(), 27.0f, 0.5f)) << estimator.load();
+    expect(near(estimator.frames_per_second(), 1000.0f, 10.0f));
+    expect(that % 2000 == estimator.total_frames());
+    expect(that % (2000 * 135) == estimator.total_bits());
+
+    // Exercise: bus goes silent for half a window
+    clock.m_ticks += 500'000;
+
+    // Verify
+    expect(near(estimator.load(), 13.5f, 1.0f)) << estimator.load();
+
+    // Exercise: silent for longer than the window
+    clock.m_ticks += 2'000'000;
+
+    // Verify
+    expect(near(estimator.load(), 0.0f));
+    expect(near(estimator.frames_per_second(), 0.0f));
+  };
+
+  "can_bus_load_estimator partial window"_test = []() {
+    // Setup
+    mock_clock clock;
+    can_bus_load_estimator estimator(clock, 1'000'000.0f, 1s);
+
+    // Exercise: 100ms of traffic is less than one window
+    for (int i = 0; i < 100; i++) {
+      clock.m_ticks += 1'000;
+      estimator.record({ .id = 0x18FF0000, .length = 8 });
+    }
+
+    // Verify: rate is measured over elapsed time, not the full window
+    expect(near(estimator.frames_per_second(), 1000.0f, 10.0f));
+    expect(near(estimator.load(), 16.0f, 0.5f)) << estimator.load();
+  };
+
+  "can_bus_load_estimator as can_router tap"_test = []() {
+    // Setup
+    mock_can mock;
+    mock_clock clock;
+    can_router router(mock);
+    can_bus_load_estimator estimator(clock, 500'000.0f, 1s);
+    auto tap = router.add_tap(std::ref(estimator));
+
+    // Exercise
+    router(can::message_t{ .id = 0x100, .length = 8 });
+    auto sent = router.bus().send(can::message_t{ .id = 0x101 });
+
+    // Verify
+    expect(bool{ sent });
+    expect(that % 2 == estimator.total_frames());
+    expect(that % (135 + 55) == estimator.total_bits());
+  };
+};
+}  // namespace hal
@@ -0,0 +1,273 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/can_capture.hpp>
+
+#include <array>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <libhal-util/can.hpp>
+
+#include <boost/ut.hpp>
+
+namespace hal {
+namespace {
+std::vector<can_capture_record> random_records(std::size_t p_count)
+{
+  std::mt19937 rng(7);
+  std::vector<can_capture_record> records;
+  std::uint64_t timestamp = 1'600'000'000'000'000;
+
+  for (std::size_t i = 0; i < p_count; i++) {
+    timestamp += rng() % 5'000;
+    can_capture_record record{
+      .message = {
+        .id = static_cast<hal::can::id_t>(
+          (rng() % 4) ? rng() % 0x800 : 0x800 + rng() % 0x1FFFF800),
+        .length = static_cast<std::uint8_t>(rng() % 9),
+        .is_remote_request = (rng() % 16) == 0,
+      },
+      .timestamp = timestamp,
+      .bus = static_cast<std::uint8_t>(rng() % 3),
+      .direction = (rng() % 2) ? can_router::direction::transmit
+                               : can_router::direction::receive,
+    };
+    if (!record.message.is_remote_request) {
+      for (std::size_t b = 0; b < record.message.length; b++) {
+        record.message.payload[b] = static_cast<hal::byte>(rng());
+      }
+    }
+    records.push_back(record);
+  }
+
+  return records;
+}
+
+std::vector<hal::byte> write_capture(
+  const std::vector<can_capture_record>& p_records,
+  std::size_t p_buffer_size,
+  int* p_sink_calls = nullptr)
+{
+  std::vector<hal::byte> output;
+  std::vector<hal::byte> buffer(p_buffer_size);
+  auto writer = can_capture_writer::create(
+                  buffer,
+                  1'000'000,
+                  [&output, p_sink_calls](std::span<const hal::byte> p_data) {
+                    output.insert(output.end(), p_data.begin(), p_data.end());
+                    if (p_sink_calls) {
+                      (*p_sink_calls)++;
+                    }
+                    return hal::success();
+                  })
+                  .value();
+
+  for (const auto& record : p_records) {
+    (void)writer.write(record);
+  }
+  (void)writer.flush();
+
+  return output;
+}
+}  // namespace
+
+void can_capture_test()
+{
+  using namespace boost::ut;
+
+  "can_capture_writer + can_capture_reader round trip"_test = []() {
+    // Setup
+    const auto expected = random_records(5000);
+    int sink_calls = 0;
+
+    // Exercise
+    const auto capture = write_capture(expected, 256, &sink_calls);
+    auto reader = can_capture_reader::create(capture).value();
+    std::vector<can_capture_record> actual;
+    const auto count =
+      reader.for_each([&actual](const can_capture_record& p_record) {
+        actual.push_back(p_record);
+      });
+
+    // Verify
+    expect(sink_calls > 1);
+    expect(that % 1'000'000 == reader.tick_frequency());
+    expect(!reader.truncated());
+    expect(that % expected.size() == count);
+    for (std::size_t i = 0; i < expected.size() && i < actual.size(); i++) {
+      expect(expected[i].message == actual[i].message);
+      expect(that % expected[i].timestamp == actual[i].timestamp);
+      expect(that % expected[i].bus == actual[i].bus);
+      expect(expected[i].direction == actual[i].direction);
+    }
+
+    // Exercise
+    reader.rewind();
+    can_capture_record first{};
+
+    // Verify
+    expect(reader.next(first));
+    expect(expected[0].message == first.message);
+  };
+
+  "can_capture_writer::create() buffer too small"_test = []() {
+    // Setup
+    std::array<hal::byte, can_capture_format::max_record_size - 1> buffer{};
+
+    // Exercise
+    auto writer = can_capture_writer::create(
+      buffer, 1'000'000, [](std::span<const hal::byte>) {
+        return hal::success();
+      });
+
+    // Verify
+    expect(!bool{ writer });
+  };
+
+  "can_capture_writer sink failure"_test = []() {
+    // Setup
+    std::array<hal::byte,
+               can_capture_format::header_size +
+                 can_capture_format::max_record_size>
+      buffer{};
+    auto writer =
+      can_capture_writer::create(buffer,
+                                 1'000'000,
+                                 [](std::span<const hal::byte>) -> status {
+                                   return hal::new_error();
+                                 })
+        .value();
+
+    // Exercise
+    auto first = writer.write({ .message = { .id = 0x100 } });
+    auto second = writer.write({ .message = { .id = 0x100 } });
+
+    // Verify
+    expect(bool{ first });
+    expect(!bool{ second });
+  };
+
+  "can_capture_reader::create() invalid header"_test = []() {
+    // Setup
+    std::array<hal::byte, 16> bad_magic{ 'H', 'C', 'A', 'X', 1, 0, 16 };
+    std::array<hal::byte, 16> bad_version{ 'H', 'C', 'A', 'P', 9, 0, 16 };
+    std::array<hal::byte, 4> too_short{ 'H', 'C', 'A', 'P' };
+
+    // Exercise + Verify
+    expect(!bool{ can_capture_reader::create(bad_magic) });
+    expect(!bool{ can_capture_reader::create(bad_version) });
+    expect(!bool{ can_capture_reader::create(too_short) });
+  };
+
+  "can_capture_reader::next() truncated"_test = []() {
+    // Setup
+    auto capture = write_capture(random_records(10), 256);
+    capture.pop_back();
+    auto reader = can_capture_reader::create(capture).value();
+
+    // Exercise
+    const auto count = reader.for_each([](const can_capture_record&) {});
+
+    // Verify
+    expect(that % 9 == count);
+    expect(reader.truncated());
+  };
+
+  "parse_candump()"_test = []() {
+    // Setup
+    std::string_view interface;
+
+    // Exercise
+    auto standard = parse_candump(
+      "(1436509052.249713) vcan0 044#2A366C2BBA", 1'000'000, &interface);
+    auto extended =
+      parse_candump("(0000000001.500000) can1 18FEF100#0102030405060708",
+                    1'000,
+                    nullptr);
+    auto remote = parse_candump("(1.000001) can0 123#R3", 1'000'000);
+    auto empty = parse_candump("(1.000001) can0 7FF#", 1'000'000);
+
+    // Verify
+    expect(bool{ standard });
+    expect(that % std::string_view("vcan0") == interface);
+    expect(that % 0x044 == standard->message.id);
+    expect(that % 5 == standard->message.length);
+    expect(that % 0x2A == standard->message.payload[0]);
+    expect(that % 0xBA == standard->message.payload[4]);
+    expect(that % 1'436'509'052'249'713ULL == standard->timestamp);
+
+    expect(bool{ extended });
+    expect(that % 0x18FEF100 == extended->message.id);
+    expect(that % 8 == extended->message.length);
+    expect(that % 1'500 == extended->timestamp);
+
+    expect(bool{ remote });
+    expect(remote->message.is_remote_request);
+    expect(that % 3 == remote->message.length);
+
+    expect(bool{ empty });
+    expect(that % 0 == empty->message.length);
+
+    expect(!parse_candump("", 1'000'000));
+    expect(!parse_candump("vcan0 044#2A", 1'000'000));
+    expect(!parse_candump("(1.0) vcan0 044#2", 1'000'000));
+    expect(!parse_candump("(1.0) vcan0 04G#", 1'000'000));
+    expect(!parse_candump("(1.0) vcan0 044#001122334455667788", 1'000'000));
+  };
+
+  "format_candump() + parse_candump() round trip"_test = []() {
+    // Setup
+    const auto records = random_records(1000);
+    std::array<char, 128> text{};
+    std::size_t text_bytes = 0;
+
+    for (const auto& record : records) {
+      // Exercise
+      const auto line = format_candump(record, "can0", 1'000'000, text);
+      text_bytes += line.size() + 1;
+      auto parsed = parse_candump(line, 1'000'000);
+
+      // Verify
+      expect(bool{ parsed }) << std::string(line);
+      if (!parsed) {
+        continue;
+      }
+      auto expected = record.message;
+      if (expected.is_remote_request) {
+        expected.payload = {};
+      }
+      expect(expected == parsed->message) << std::string(line);
+      expect(that % record.timestamp == parsed->timestamp);
+    }
+
+    // Verify: binary capture is much smaller than the text log
+    const auto binary_bytes = write_capture(records, 4096).size();
+    expect(text_bytes >= 3 * binary_bytes)
+      << text_bytes << " vs " << binary_bytes;
+  };
+
+  "format_candump() buffer too small"_test = []() {
+    // Setup
+    std::array<char, 16> text{};
+
+    // Exercise
+    auto line = format_candump({ .message = { .id = 0x100 } }, "can0", 1, text);
+
+    // Verify
+    expect(line.empty());
+  };
+};
+}  // namespace hal
@@ -0,0 +1,110 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/can_change_filter.hpp>
+
+#include <functional>
+
+#include <boost/ut.hpp>
+
+#include "mocks.hpp"
+
+namespace hal {
+void can_change_filter_test()
+{
+  using namespace boost::ut;
+  using namespace std::chrono_literals;
+
+  "can_change_filter drops repeats"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    int calls = 0;
+    can_change_filter on_change(
+      [&calls](const can::message_t&) { calls++; });
+    auto route = router.add_message_callback(0x210, std::ref(on_change));
+    const can::message_t frame{ .id = 0x210,
+                                .payload = { 0x01, 0x02 },
+                                .length = 2 };
+
+    // Exercise
+    // Steady state traffic at 100 Hz for one second with one change
+    for (int i = 0; i < 100; i++) {
+      auto message = frame;
+      message.payload[1] = i < 50 ? 0x02 : 0x03;
+      router(message);
+    }
+
+    // Verify
+    expect(that % 2 == calls);
+    expect(that % 2 == on_change.passed());
+    expect(that % 98 == on_change.suppressed());
+  };
+
+  "can_change_filter compares length, remote flag and used bytes"_test = []() {
+    // Setup
+    int calls = 0;
+    can_change_filter on_change(
+      [&calls](const can::message_t&) { calls++; });
+    const can::message_t frame{ .id = 0x210,
+                                .payload = { 0x01, 0x02 },
+                                .length = 2 };
+
+    // Exercise + Verify
+    on_change(frame);
+    expect(that % 1 == calls);
+
+    // Bytes past the length are not part of the frame
+    auto garbage = frame;
+    garbage.payload[5] = 0xAA;
+    on_change(garbage);
+    expect(that % 1 == calls);
+
+    auto longer = frame;
+    longer.length = 3;
+    on_change(longer);
+    expect(that % 2 == calls);
+
+    auto remote = longer;
+    remote.is_remote_request = true;
+    on_change(remote);
+    expect(that % 3 == calls);
+
+    on_change.reset();
+    on_change(remote);
+    expect(that % 4 == calls);
+  };
+
+  "can_change_filter refreshes after max silence"_test = []() {
+    // Setup
+    mock_clock clock;
+    int calls = 0;
+    can_change_filter on_change(
+      [&calls](const can::message_t&) { calls++; }, clock, 100ms);
+    const can::message_t frame{ .id = 0x210, .length = 0 };
+
+    // Exercise
+    // 100 Hz for one second
+    for (int i = 0; i < 100; i++) {
+      clock.m_ticks = static_cast<std::uint64_t>(i) * 10'000;
+      on_change(frame);
+    }
+
+    // Verify
+    // First frame plus a refresh every 100ms
+    expect(that % 10 == calls);
+    expect(that % 90 == on_change.suppressed());
+  };
+};
+}  // namespace hal
@@ -0,0 +1,226 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/can_correlator.hpp>
+
+#include <array>
+#include <functional>
+#include <vector>
+
+#include <boost/ut.hpp>
+
+#include "mocks.hpp"
+
+namespace hal {
+namespace {
+can::message_t reply(hal::can::id_t p_id, hal::byte p_token, hal::byte p_data)
+{
+  return { .id = p_id, .payload = { p_token, p_data }, .length = 2 };
+}
+}  // namespace
+
+void can_correlator_test()
+{
+  using namespace boost::ut;
+  using namespace std::chrono_literals;
+
+  "can_correlator completes a request with its response"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    mock_clock clock;
+    std::array<can_correlator::pending_request, 4> table;
+    can_correlator correlator(router, clock, 1ms, table);
+    auto route = router.add_message_callback(0x7E8, std::ref(correlator));
+    std::vector<int> responses;
+    int timeouts = 0;
+    const can::message_t read_vin{ .id = 0x7E0,
+                                   .payload = { 0x02, 0x09, 0x02 },
+                                   .length = 3 };
+
+    // Exercise
+    auto sent = correlator.request(
+      { .message = read_vin, .response_id = 0x7E8, .timeout = 50ms },
+      [&responses](const can::message_t& p_message) {
+        responses.push_back(p_message.payload[1]);
+      },
+      [&timeouts]() { timeouts++; });
+    router(reply(0x7E9, 0x10, 0x49));
+    router(reply(0x7E8, 0x10, 0x49));
+    router(reply(0x7E8, 0x10, 0x49));
+    clock.m_ticks = 100'000;
+    correlator.poll();
+
+    // Verify
+    expect(bool{ sent });
+    expect(that % 1 == can.m_sent.size());
+    expect(that % 0x7E0 == can.m_sent[0].id);
+    expect(responses == std::vector<int>{ 0x49 });
+    expect(that % 0 == timeouts);
+    expect(that % 0 == correlator.outstanding());
+    expect(that % 1 == correlator.unmatched());
+  };
+
+  "can_correlator reports a timeout"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    mock_clock clock;
+    std::array<can_correlator::pending_request, 4> table;
+    can_correlator correlator(router, clock, 1ms, table);
+    int responses = 0;
+    int timeouts = 0;
+
+    // Exercise + Verify
+    expect(bool{ correlator.request(
+      { .response_id = 0x7E8, .timeout = 10ms },
+      [&responses](const can::message_t&) { responses++; },
+      [&timeouts]() { timeouts++; }) });
+    clock.m_ticks = 9'999;
+    correlator.poll();
+    expect(that % 0 == timeouts);
+    clock.m_ticks = 11'000;
+    correlator.poll();
+    expect(that % 1 == timeouts);
+    expect(that % 0 == correlator.outstanding());
+
+    // A late response is unmatched
+    correlator(reply(0x7E8, 0, 0));
+    expect(that % 0 == responses);
+    expect(that % 1 == correlator.unmatched());
+  };
+
+  "can_correlator matches many outstanding requests by token"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    mock_clock clock;
+    std::array<can_correlator::pending_request, 64> table;
+    can_correlator correlator(router, clock, 1ms, table);
+    std::vector<int> completed;
+
+    for (int i = 0; i < 64; i++) {
+      const auto token = static_cast<hal::byte>(i * 3);
+      expect(bool{ correlator.request(
+        { .response_id = static_cast<hal::can::id_t>(0x600 + i % 2),
+          .token = token,
+          .timeout = 1s },
+        [&completed, token](const can::message_t& p_message) {
+          expect(that % token == p_message.payload[0]);
+          completed.push_back(p_message.payload[1]);
+        }) });
+    }
+
+    // Exercise
+    // Respond in reverse order
+    for (int i = 63; i >= 0; i--) {
+      correlator(reply(0x600 + i % 2,
+                       static_cast<hal::byte>(i * 3),
+                       static_cast<hal::byte>(i)));
+    }
+
+    // Verify
+    expect(that % 64 == completed.size());
+    expect(that % 63 == completed.front());
+    expect(that % 0 == completed.back());
+    expect(that % 0 == correlator.outstanding());
+    expect(that % 0 == correlator.unmatched());
+  };
+
+  "can_correlator prefers a token match over an untokened request"_test =
+    []() {
+      // Setup
+      mock_can can;
+      can_router router(can);
+      mock_clock clock;
+      std::array<can_correlator::pending_request, 4> table;
+      can_correlator correlator(router, clock, 1ms, table);
+      std::vector<int> calls;
+
+      expect(bool{ correlator.request(
+        { .response_id = 0x7E8, .timeout = 1s },
+        [&calls](const can::message_t&) { calls.push_back(0); }) });
+      expect(bool{ correlator.request(
+        { .response_id = 0x7E8, .token = 0x62, .timeout = 1s },
+        [&calls](const can::message_t&) { calls.push_back(1); }) });
+
+      // Exercise
+      correlator(reply(0x7E8, 0x7F, 0));
+      correlator(reply(0x7E8, 0x62, 0));
+
+      // Verify
+      expect(calls == std::vector<int>{ 0, 1 });
+    };
+
+  "can_correlator rejects requests it cannot track"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    mock_clock clock;
+    std::array<can_correlator::pending_request, 2> table;
+    can_correlator correlator(router, clock, 1ms, table);
+    const can_request first{ .response_id = 0x100, .timeout = 1s };
+
+    // Exercise + Verify
+    expect(bool{ correlator.request(first, can_router::noop) });
+    // Same response key already outstanding
+    expect(!correlator.request(first, can_router::noop));
+    expect(bool{ correlator.request(
+      { .response_id = 0x100, .token = 1, .timeout = 1s }, can_router::noop) });
+    // Table is full
+    expect(!correlator.request({ .response_id = 0x200, .timeout = 1s },
+                               can_router::noop));
+    expect(that % 2 == correlator.outstanding());
+    expect(that % 2 == can.m_sent.size());
+
+    expect(correlator.cancel(0x100));
+    expect(!correlator.cancel(0x100));
+    // Sending fails, so the request is not kept
+    can.m_send_error = std::errc::network_down;
+    expect(!correlator.request({ .response_id = 0x200, .timeout = 1s },
+                               can_router::noop));
+    expect(that % 1 == correlator.outstanding());
+  };
+
+  "can_correlator allows follow-up requests from a callback"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    mock_clock clock;
+    std::array<can_correlator::pending_request, 1> table;
+    can_correlator correlator(router, clock, 1ms, table);
+    int step = 0;
+    std::function<void(const can::message_t&)> next =
+      [&](const can::message_t&) {
+        step++;
+        if (step < 3) {
+          expect(bool{ correlator.request(
+            { .response_id = 0x7E8, .timeout = 1s }, std::ref(next)) });
+        }
+      };
+    expect(bool{ correlator.request({ .response_id = 0x7E8, .timeout = 1s },
+                                    std::ref(next)) });
+
+    // Exercise
+    for (int i = 0; i < 4; i++) {
+      correlator(reply(0x7E8, 0, 0));
+    }
+
+    // Verify
+    expect(that % 3 == step);
+    expect(that % 1 == correlator.unmatched());
+    expect(that % 3 == can.m_sent.size());
+  };
+};
+}  // namespace hal
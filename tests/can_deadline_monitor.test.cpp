@@ -0,0 +1,168 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/can_deadline_monitor.hpp>
+
+#include <vector>
+
+#include <libhal-util/can.hpp>
+#include <libhal/functional.hpp>
+
+#include <boost/ut.hpp>
+
+#include "mocks.hpp"
+
+namespace hal {
+void can_deadline_monitor_test()
+{
+  using namespace boost::ut;
+  using namespace std::chrono_literals;
+
+  "can_deadline_monitor::watch() forwards messages"_test = []() {
+    // Setup
+    static constexpr can::message_t expected{
+      .id = 0x111,
+      .payload = { 0xAA },
+      .length = 1,
+    };
+    mock_can mock;
+    mock_clock clock;
+    can_router router(mock);
+    can_deadline_monitor monitor(clock, 1ms, [](hal::can::id_t) {});
+    can::message_t actual{};
+
+    // Exercise
+    auto route = monitor.watch(
+      router, expected.id, 10ms, [&actual](const can::message_t& p_message) {
+        actual = p_message;
+      });
+    router(expected);
+
+    // Verify
+    expect(that % 1 == router.handlers().size());
+    expect(that % expected.id == route.id());
+    expect(expected == actual);
+    expect(!route.timed_out());
+  };
+
+  "can_deadline_monitor::poll() reports missing message"_test = []() {
+    // Setup
+    static constexpr can::message_t message{ .id = 0x222 };
+    mock_can mock;
+    mock_clock clock;
+    can_router router(mock);
+    std::vector<hal::can::id_t> timeouts;
+    can_deadline_monitor monitor(
+      clock, 1ms, [&timeouts](hal::can::id_t p_id) {
+        timeouts.push_back(p_id);
+      });
+    auto route = monitor.watch(router, message.id, 10ms);
+
+    // Exercise: keep the message arriving every 9ms
+    for (int i = 0; i < 10; i++) {
+      clock.m_ticks += 9'000;
+      router(message);
+      monitor.poll();
+    }
+
+    // Verify
+    expect(that % 0 == timeouts.size());
+
+    // Exercise: stop sending
+    clock.m_ticks += 10'000;
+    monitor.poll();
+
+    // Verify: exactly one period has passed, not late yet
+    expect(that % 0 == timeouts.size());
+
+    // Exercise
+    clock.m_ticks += 1'000;
+    monitor.poll();
+    clock.m_ticks += 50'000;
+    monitor.poll();
+
+    // Verify: reported only once per silence
+    expect(that % 1 == timeouts.size());
+    expect(that % message.id == timeouts.at(0));
+    expect(route.timed_out());
+    expect(that % 1 == route.timeouts());
+
+    // Exercise: message returns then stops again
+    router(message);
+    expect(!route.timed_out());
+    clock.m_ticks += 20'000;
+    monitor.poll();
+
+    // Verify
+    expect(that % 2 == timeouts.size());
+    expect(that % 2 == route.timeouts());
+  };
+
+  "can_deadline_monitor::poll() many routes"_test = []() {
+    // Setup
+    mock_can mock;
+    mock_clock clock;
+    can_router router(mock);
+    std::vector<hal::can::id_t> timeouts;
+    can_deadline_monitor monitor(
+      clock, 1ms, [&timeouts](hal::can::id_t p_id) {
+        timeouts.push_back(p_id);
+      });
+
+    auto route_a = monitor.watch(router, 0x100, 5ms);
+    auto route_b = monitor.watch(router, 0x101, 20ms);
+    auto route_c = monitor.watch(router, 0x102, 2s);
+
+    // Exercise
+    for (int i = 0; i < 100; i++) {
+      clock.m_ticks += 1'000;
+      if (i < 50) {
+        router(can::message_t{ .id = 0x100 });
+      }
+      router(can::message_t{ .id = 0x101 });
+      router(can::message_t{ .id = 0x102 });
+      monitor.poll();
+    }
+
+    // Verify
+    expect(that % 1 == timeouts.size());
+    expect(that % 0x100 == timeouts.at(0));
+    expect(route_a.timed_out());
+    expect(!route_b.timed_out());
+    expect(!route_c.timed_out());
+  };
+
+  "can_deadline_monitor::monitored_route::~monitored_route()"_test = []() {
+    // Setup
+    mock_can mock;
+    mock_clock clock;
+    can_router router(mock);
+    int counter = 0;
+    can_deadline_monitor monitor(
+      clock, 1ms, [&counter](hal::can::id_t) { counter++; });
+
+    // Exercise
+    {
+      auto route = monitor.watch(router, 0x100, 5ms);
+      expect(that % 1 == router.handlers().size());
+    }
+    clock.m_ticks += 100'000;
+    monitor.poll();
+
+    // Verify
+    expect(that % 0 == router.handlers().size());
+    expect(that % 0 == counter);
+  };
+};
+}  // namespace hal
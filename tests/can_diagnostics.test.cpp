@@ -0,0 +1,265 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/can_diagnostics.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+#include <boost/ut.hpp>
+
+#include "mocks.hpp"
+
+namespace hal {
+namespace {
+constexpr hal::can::id_t request_id = 0x7F0;
+constexpr hal::can::id_t response_id = 0x7F1;
+
+can::message_t command(hal::byte p_command)
+{
+  return { .id = request_id, .payload = { p_command }, .length = 1 };
+}
+
+/// Poll until the server is idle, advancing the clock by one interval
+/// between polls
+void stream(can_diagnostics_server& p_server, mock_clock& p_clock)
+{
+  for (int i = 0; i < 1000; i++) {
+    (void)p_server.poll();
+    if (!p_server.streaming()) {
+      return;
+    }
+    p_clock.m_ticks += 100;
+  }
+}
+
+std::vector<can_diagnostics_record> decode(
+  const std::deque<can::message_t>& p_chunks)
+{
+  std::array<hal::byte, 256> buffer{};
+  can_diagnostics_decoder decoder(buffer);
+  std::vector<can_diagnostics_record> records;
+  for (const auto& chunk : p_chunks) {
+    if (decoder.feed(chunk)) {
+      records.clear();
+      can_diagnostics_decoder::parse(
+        decoder.snapshot(),
+        [&records](const can_diagnostics_record& p_record) {
+          records.push_back(p_record);
+        });
+    }
+  }
+  return records;
+}
+}  // namespace
+
+void can_diagnostics_test()
+{
+  using namespace boost::ut;
+  using namespace std::chrono_literals;
+  using type = can_diagnostics_record_type;
+
+  "can_diagnostics_server streams router statistics"_test = []() {
+    // Setup
+    mock_can can;
+    mock_clock clock;
+    can_router router(can);
+    auto first = router.add_message_callback(0x100);
+    auto second = router.add_message_callback(0x18FF'0001);
+    std::array<hal::byte, 128> buffer{};
+    can_diagnostics_server server(
+      router,
+      clock,
+      request_id,
+      response_id,
+      100us,
+      buffer,
+      [](can_diagnostics_report& p_report) {
+        p_report.counter(1, 0xDEAD'BEEF);
+        p_report.queue(2, 5, 100'000, 7);
+        p_report.bus_load(42.5f, 1234.0f);
+      });
+    router(can::message_t{ .id = 0x100 });
+    router(can::message_t{ .id = 0x100 });
+    router(can::message_t{ .id = 0x18FF'0001 });
+    router(can::message_t{ .id = 0x300 });
+
+    // Exercise
+    router(command(can_diagnostics_format::request_snapshot));
+    stream(server, clock);
+    const auto records = decode(can.m_sent);
+
+    // Verify
+    // 3 + 6 + 3 * 9 + 6 + 10 + 7 bytes in chunks of 7
+    expect(that % 9 == can.m_sent.size());
+    expect(that % 1 == server.snapshots());
+    for (const auto& chunk : can.m_sent) {
+      expect(that % response_id == chunk.id);
+    }
+    expect(that % 8 == records.size());
+    expect(type::begin == records.at(0).type);
+    expect(that % can_diagnostics_format::version == records.at(0).version);
+    expect(!records.at(0).truncated);
+    expect(type::counter == records.at(1).type);
+    expect(that % can_diagnostics_format::unrouted_counter ==
+           records.at(1).key);
+    expect(that % 1 == records.at(1).count);
+    expect(type::route == records.at(2).type);
+    expect(that % 0x100 == records.at(2).id);
+    expect(that % 2 == records.at(2).count);
+    expect(that % 0x18FF'0001 == records.at(3).id);
+    expect(that % 1 == records.at(3).count);
+    expect(that % request_id == records.at(4).id);
+    expect(that % 1 == records.at(4).count);
+    expect(type::counter == records.at(5).type);
+    expect(that % 0xDEAD'BEEF == records.at(5).count);
+    expect(type::queue == records.at(6).type);
+    expect(that % 2 == records.at(6).key);
+    expect(that % 5 == records.at(6).high_water);
+    expect(that % 0xFFFF == records.at(6).capacity);
+    expect(that % 7 == records.at(6).count);
+    expect(type::bus_load == records.at(7).type);
+    expect(that % 42.5f == records.at(7).load);
+    expect(that % 1234 == records.at(7).frames_per_second);
+  };
+
+  "can_diagnostics_server paces chunks"_test = []() {
+    // Setup
+    mock_can can;
+    mock_clock clock;
+    can_router router(can);
+    std::array<hal::byte, 64> buffer{};
+    can_diagnostics_server server(
+      router, clock, request_id, response_id, 100us, buffer);
+
+    // Exercise + Verify
+    expect(bool{ server.poll() });
+    expect(that % 0 == can.m_sent.size());
+    router(command(can_diagnostics_format::request_snapshot));
+    expect(bool{ server.poll() });
+    expect(bool{ server.poll() });
+    expect(that % 1 == can.m_sent.size());
+    clock.m_ticks += 99;
+    expect(bool{ server.poll() });
+    expect(that % 1 == can.m_sent.size());
+    clock.m_ticks += 1;
+    can.m_send_error = std::errc::resource_unavailable_try_again;
+    expect(!server.poll());
+    can.m_send_error = std::errc{};
+    expect(bool{ server.poll() });
+    expect(that % 2 == can.m_sent.size());
+    expect(server.streaming());
+
+    // Cancelling stops the stream
+    router(command(can_diagnostics_format::request_cancel));
+    clock.m_ticks += 100;
+    expect(bool{ server.poll() });
+    expect(!server.streaming());
+    expect(that % 2 == can.m_sent.size());
+    expect(that % 0 == server.snapshots());
+  };
+
+  "can_diagnostics_server marks truncated snapshots"_test = []() {
+    // Setup
+    mock_can can;
+    mock_clock clock;
+    can_router router(can);
+    auto first = router.add_message_callback(0x100);
+    auto second = router.add_message_callback(0x101);
+    // Fits begin, the unrouted counter and one route
+    std::array<hal::byte, 20> buffer{};
+    can_diagnostics_server server(
+      router, clock, request_id, response_id, 1ms, buffer);
+
+    // Exercise
+    router(command(can_diagnostics_format::request_snapshot));
+    stream(server, clock);
+    const auto records = decode(can.m_sent);
+
+    // Verify
+    expect(that % 3 == records.size());
+    expect(records.at(0).truncated);
+    expect(that % 0x100 == records.at(2).id);
+  };
+
+  "can_diagnostics_server answers a tiny buffer with a begin record"_test =
+    []() {
+      // Setup
+      mock_can can;
+      mock_clock clock;
+      can_router router(can);
+      auto first = router.add_message_callback(0x100);
+      std::array<hal::byte, 2> buffer{};
+      can_diagnostics_server server(
+        router, clock, request_id, response_id, 1ms, buffer);
+
+      // Exercise
+      router(command(can_diagnostics_format::request_snapshot));
+      stream(server, clock);
+      const auto records = decode(can.m_sent);
+
+      // Verify
+      expect(that % 1 == can.m_sent.size());
+      expect(that % 1 == server.snapshots());
+      expect(that % 1 == records.size());
+      expect(type::begin == records.at(0).type);
+      expect(records.at(0).truncated);
+    };
+
+  "can_diagnostics_decoder discards snapshots with lost chunks"_test = []() {
+    // Setup
+    mock_can can;
+    mock_clock clock;
+    can_router router(can);
+    auto route = router.add_message_callback(0x100);
+    std::array<hal::byte, 64> buffer{};
+    can_diagnostics_server server(
+      router, clock, request_id, response_id, 1ms, buffer);
+    router(command(can_diagnostics_format::request_snapshot));
+    stream(server, clock);
+    auto chunks = can.m_sent;
+    std::array<hal::byte, 64> storage{};
+    can_diagnostics_decoder decoder(storage);
+    int completed = 0;
+
+    // Exercise
+    // A lost middle chunk, then the whole snapshot again
+    for (std::size_t i = 0; i < chunks.size(); i++) {
+      if (i != 1) {
+        completed += decoder.feed(chunks[i]);
+      }
+    }
+    for (const auto& chunk : chunks) {
+      completed += decoder.feed(chunk);
+    }
+
+    // Verify
+    // Begin, the unrouted counter and the routes of 0x100 and the requests
+    using format = can_diagnostics_format;
+    constexpr std::size_t expected_size =
+      format::begin_size + format::counter_size + 2 * format::route_size;
+    expect(that % 4 == chunks.size());
+    expect(that % 1 == completed);
+    expect(that % 1 == decoder.discarded());
+    expect(that % expected_size == decoder.snapshot().size());
+    expect(can_diagnostics_decoder::parse(decoder.snapshot(),
+                                          [](const auto&) {}));
+    expect(!can_diagnostics_decoder::parse(decoder.snapshot().first(5),
+                                           [](const auto&) {}));
+  };
+};
+}  // namespace hal
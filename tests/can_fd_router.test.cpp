@@ -0,0 +1,140 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/can_fd_router.hpp>
+
+#include <utility>
+
+#include <boost/ut.hpp>
+
+namespace hal {
+namespace {
+class mock_can_fd : public hal::can_fd
+{
+public:
+  message_t m_message{};
+  hal::callback<handler> m_handler{};
+
+private:
+  status driver_configure(const settings&) override
+  {
+    return success();
+  };
+
+  status driver_bus_on() override
+  {
+    return success();
+  }
+
+  result<send_t> driver_send(const message_t& p_message) override
+  {
+    m_message = p_message;
+    return send_t{};
+  };
+
+  void driver_on_receive(hal::callback<handler> p_handler) override
+  {
+    m_handler = std::move(p_handler);
+  }
+};
+}  // namespace
+
+void can_fd_router_test()
+{
+  using namespace boost::ut;
+
+  "can_fd_dlc_to_length() and can_fd_length_to_dlc()"_test = []() {
+    // Verify
+    static_assert(can_fd_dlc_to_length(8) == 8);
+    static_assert(can_fd_dlc_to_length(9) == 12);
+    static_assert(can_fd_dlc_to_length(15) == 64);
+    static_assert(can_fd_length_to_dlc(0) == 0);
+    static_assert(can_fd_length_to_dlc(8) == 8);
+    static_assert(can_fd_length_to_dlc(9) == 9);
+    static_assert(can_fd_length_to_dlc(33) == 14);
+    static_assert(can_fd_length_to_dlc(64) == 15);
+    static_assert(can_fd_length_to_dlc(200) == 15);
+
+    for (std::uint8_t dlc = 0; dlc < 16; dlc++) {
+      expect(that % dlc == can_fd_length_to_dlc(can_fd_dlc_to_length(dlc)));
+    }
+  };
+
+  "can_fd_router routes 64 byte frames by reference"_test = []() {
+    // Setup
+    mock_can_fd can;
+    can_fd_router router(can);
+    const can_fd::message_t* received = nullptr;
+    int other_calls = 0;
+    auto route = router.add_message_callback(
+      0x18DA00F1, [&received](const can_fd::message_t& p_message) {
+        received = &p_message;
+      });
+    auto other = router.add_message_callback(
+      0x100, [&other_calls](const can_fd::message_t&) { other_calls++; });
+
+    can_fd::message_t frame{ .id = 0x18DA00F1,
+                             .length = 64,
+                             .bit_rate_switch = true,
+                             .error_state_indicator = true };
+    for (std::size_t i = 0; i < frame.payload.size(); i++) {
+      frame.payload[i] = static_cast<hal::byte>(i);
+    }
+
+    // Exercise
+    // Deliver through the driver's registered receive handler
+    can.m_handler(frame);
+
+    // Verify
+    expect(&frame == received);
+    expect(that % 0 == other_calls);
+    expect(that % 64 == received->data().size());
+    expect(that % 63 == received->data()[63]);
+    expect(received->bit_rate_switch);
+    expect(received->error_state_indicator);
+    expect(that % 2 == router.handlers().size());
+  };
+
+  "can_fd_router data() covers only the frame length"_test = []() {
+    // Setup
+    const can_fd::message_t classic{ .id = 0x100,
+                                     .payload = { 1, 2, 3 },
+                                     .length = 3,
+                                     .fd_format = false };
+
+    // Exercise + Verify
+    expect(that % 3 == classic.data().size());
+    expect(that % 3 == classic.data().back());
+  };
+
+  "can_fd_router::bus() and move"_test = []() {
+    // Setup
+    mock_can_fd can;
+    int calls = 0;
+    auto created = can_fd_router::create(can);
+    expect(bool{ created });
+    auto router = std::move(created.value());
+    auto route = router.add_message_callback(
+      0x100, [&calls](const can_fd::message_t&) { calls++; });
+
+    // Exercise
+    can.m_handler(can_fd::message_t{ .id = 0x100, .length = 12 });
+    expect(bool{ router.bus().send(can_fd::message_t{ .id = 0x101 }) });
+
+    // Verify
+    expect(that % 1 == calls);
+    expect(that % 0x101 == can.m_message.id);
+  };
+};
+}  // namespace hal
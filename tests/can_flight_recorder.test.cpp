@@ -0,0 +1,271 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/can_flight_recorder.hpp>
+
+#include <array>
+#include <deque>
+#include <functional>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <libhal-util/can.hpp>
+
+#include <boost/ut.hpp>
+
+#include "mocks.hpp"
+
+namespace hal {
+namespace {
+std::vector<can_flight_recorder::record_t> dump_all(
+  const can_flight_recorder& p_recorder)
+{
+  std::vector<can_flight_recorder::record_t> records;
+  p_recorder.dump([&records](const can_flight_recorder::record_t& p_record) {
+    records.push_back(p_record);
+  });
+  return records;
+}
+}  // namespace
+
+void can_flight_recorder_test()
+{
+  using namespace boost::ut;
+
+  "can_flight_recorder::record() + dump()"_test = []() {
+    // Setup
+    static constexpr can::message_t standard{
+      .id = 0x123,
+      .payload = { 0x11, 0x22, 0x33 },
+      .length = 3,
+    };
+    static constexpr can::message_t extended{
+      .id = 0x18FEF100,
+      .payload = { 1, 2, 3, 4, 5, 6, 7, 8 },
+      .length = 8,
+    };
+    static constexpr can::message_t remote{
+      .id = 0x7FF,
+      .length = 4,
+      .is_remote_request = true,
+    };
+    mock_clock clock;
+    std::array<hal::byte, 256> buffer{};
+    can_flight_recorder recorder(clock, buffer);
+
+    // Exercise
+    clock.m_ticks = 1'000'000;
+    recorder.record(standard);
+    clock.m_ticks += 100;
+    recorder.record(extended, can_router::direction::transmit);
+    clock.m_ticks += 1'000'000'000;
+    recorder.record(remote);
+    auto records = dump_all(recorder);
+
+    // Verify
+    expect(that % 3 == recorder.size());
+    expect(that % 3 == records.size());
+    expect(standard == records[0].message);
+    expect(extended == records[1].message);
+    expect(remote == records[2].message);
+    expect(can_router::direction::receive == records[0].direction);
+    expect(can_router::direction::transmit == records[1].direction);
+    expect(that % 1'000'000 == records[0].timestamp);
+    expect(that % 1'000'100 == records[1].timestamp);
+    expect(that % 1'001'000'100 == records[2].timestamp);
+    // flags + delta + id + payload
+    expect(that % ((1 + 1 + 2 + 3) + (1 + 1 + 4 + 8) + (1 + 5 + 2)) ==
+           recorder.bytes_used());
+  };
+
+  "can_flight_recorder overwrites oldest"_test = []() {
+    // Setup
+    mock_clock clock;
+    std::array<hal::byte, 61> buffer{};
+    can_flight_recorder recorder(clock, buffer);
+    std::mt19937 rng(42);
+    std::deque<std::pair<can_flight_recorder::record_t, std::size_t>> expected;
+    std::size_t expected_bytes = 0;
+    std::uint32_t dropped = 0;
+
+    // Exercise + Verify: compare against a reference model after each frame
+    for (int i = 0; i < 2000; i++) {
+      clock.m_ticks += rng() % 300'000;
+      can::message_t message{
+        .id = static_cast<hal::can::id_t>(
+          (rng() % 2) ? rng() % 0x800 : 0x800 + rng() % 0x1FFFF800),
+        .length = static_cast<std::uint8_t>(rng() % 9),
+      };
+      for (std::size_t b = 0; b < message.length; b++) {
+        message.payload[b] = static_cast<hal::byte>(rng());
+      }
+
+      recorder.record(message);
+
+      std::size_t delta_bytes = 1;
+      if (!expected.empty()) {
+        auto delta = clock.m_ticks - expected.back().first.timestamp;
+        while (delta >>= 7) {
+          delta_bytes++;
+        }
+      }
+      const auto size =
+        1 + delta_bytes + (message.id > 0x7FF ? 4 : 2) + message.length;
+      expected.emplace_back(
+        can_flight_recorder::record_t{
+          message, can_router::direction::receive, clock.m_ticks },
+        size);
+      expected_bytes += size;
+      while (expected_bytes > buffer.size()) {
+        expected_bytes -= expected.front().second;
+        expected.pop_front();
+        dropped++;
+      }
+
+      auto records = dump_all(recorder);
+      expect(that % expected_bytes == recorder.bytes_used());
+      expect(that % expected.size() == records.size());
+      if (records.size() != expected.size()) {
+        break;
+      }
+      for (std::size_t r = 0; r < records.size(); r++) {
+        expect(expected[r].first.message == records[r].message);
+        expect(that % expected[r].first.timestamp == records[r].timestamp);
+      }
+    }
+
+    expect(that % dropped == recorder.overwritten());
+  };
+
+  "can_flight_recorder::freeze()"_test = []() {
+    // Setup
+    mock_clock clock;
+    std::array<hal::byte, 64> buffer{};
+    can_flight_recorder recorder(clock, buffer);
+    recorder.record({ .id = 0x100 });
+
+    // Exercise
+    recorder.freeze();
+    recorder.record({ .id = 0x101 });
+    auto frozen_records = dump_all(recorder);
+    recorder.resume();
+    recorder.record({ .id = 0x102 });
+
+    // Verify
+    expect(that % 1 == frozen_records.size());
+    expect(that % 0x100 == frozen_records.at(0).message.id);
+    expect(that % 2 == recorder.size());
+
+    // Exercise
+    recorder.clear();
+
+    // Verify
+    expect(that % 0 == recorder.size());
+    expect(that % 0 == dump_all(recorder).size());
+  };
+
+  "can_flight_recorder compact encoding"_test = []() {
+    // Setup: traffic at 1 kHz with a mix of payload lengths
+    mock_clock clock;
+    std::array<hal::byte, 4096> buffer{};
+    can_flight_recorder recorder(clock, buffer);
+    constexpr std::array<std::uint8_t, 4> lengths = { 2, 4, 8, 8 };
+
+    // Exercise
+    for (std::size_t i = 0; i < 10'000; i++) {
+      clock.m_ticks += 1'000;
+      recorder.record({
+        .id = static_cast<hal::can::id_t>(0x100 + (i % 16)),
+        .length = lengths[i % lengths.size()],
+      });
+    }
+
+    // Verify: a message_t plus 64-bit timestamp per frame would take
+    // 24 bytes, so at least twice as many frames must fit.
+    constexpr auto uncompressed_frames =
+      buffer.size() / (sizeof(can::message_t) + sizeof(std::uint64_t));
+    expect(recorder.size() >= 2 * uncompressed_frames) << recorder.size();
+  };
+
+  "can_flight_recorder as can_router tap"_test = []() {
+    // Setup
+    mock_can mock;
+    mock_clock clock;
+    can_router router(mock);
+    std::array<hal::byte, 64> buffer{};
+    can_flight_recorder recorder(clock, buffer);
+    auto tap = router.add_tap(std::ref(recorder));
+
+    // Exercise
+    router(can::message_t{ .id = 0x100 });
+    auto sent = router.bus().send(can::message_t{ .id = 0x200 });
+    auto records = dump_all(recorder);
+
+    // Verify
+    expect(bool{ sent });
+    expect(that % 2 == records.size());
+    expect(can_router::direction::receive == records.at(0).direction);
+    expect(can_router::direction::transmit == records.at(1).direction);
+  };
+
+  "can_flight_recorder keeps router receive timestamps"_test = []() {
+    // Setup
+    mock_can mock;
+    mock_clock clock;
+    can_router router(mock, clock);
+    std::array<hal::byte, 64> buffer{};
+    can_flight_recorder recorder(
+      clock, buffer, can_flight_recorder::timestamp_source::router);
+    auto tap = router.add_tap(std::ref(recorder));
+
+    // Exercise
+    clock.m_ticks = 900;
+    router(can::message_t{ .id = 0x100 }, 500);
+    // Arrived before the previous frame, but routed after it
+    router(can::message_t{ .id = 0x101 }, 400);
+    router(can::message_t{ .id = 0x102 });
+    auto records = dump_all(recorder);
+
+    // Verify
+    expect(that % 3 == records.size());
+    expect(that % 500 == records.at(0).timestamp);
+    expect(that % 500 == records.at(1).timestamp);
+    expect(that % 900 == records.at(2).timestamp);
+  };
+
+  "can_flight_recorder uses its own clock for taps by default"_test = []() {
+    // Setup
+    mock_can mock;
+    mock_clock router_clock;
+    mock_clock recorder_clock;
+    can_router router(mock, router_clock);
+    std::array<hal::byte, 64> buffer{};
+    can_flight_recorder recorder(recorder_clock, buffer);
+    auto tap = router.add_tap(std::ref(recorder));
+
+    // Exercise
+    router_clock.m_ticks = 1'000'000;
+    recorder_clock.m_ticks = 20;
+    router(can::message_t{ .id = 0x100 }, 500);
+    router(can::message_t{ .id = 0x101 });
+    auto records = dump_all(recorder);
+
+    // Verify
+    expect(that % 2 == records.size());
+    expect(that % 20 == records.at(0).timestamp);
+    expect(that % 20 == records.at(1).timestamp);
+  };
+};
+}  // namespace hal
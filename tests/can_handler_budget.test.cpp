@@ -0,0 +1,147 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/can_handler_budget.hpp>
+
+#include <array>
+#include <functional>
+
+#include <libhal-canrouter/can_priority_dispatcher.hpp>
+
+#include <boost/ut.hpp>
+
+#include "mocks.hpp"
+
+namespace hal {
+namespace {
+/// Handler that takes the number of microseconds in its first payload byte
+auto busy_handler(mock_clock& p_clock)
+{
+  return [&p_clock](const can::message_t& p_message) {
+    p_clock.m_ticks += p_message.payload[0];
+  };
+}
+
+can::message_t taking(hal::can::id_t p_id, std::uint8_t p_microseconds)
+{
+  return { .id = p_id, .payload = { p_microseconds }, .length = 1 };
+}
+}  // namespace
+
+void can_handler_budget_test()
+{
+  using namespace boost::ut;
+  using namespace std::chrono_literals;
+
+  "can_handler_budget records overruns by ID"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    mock_clock clock;
+    std::array<can_handler_budget::overrun_record, 4> table;
+    can_handler_budget budget(clock, table);
+    auto fast = budget.wrap(busy_handler(clock), 10us);
+    auto slow = budget.wrap(busy_handler(clock), 10us);
+    auto fast_route = router.add_message_callback(0x100, std::ref(fast));
+    auto slow_route = router.add_message_callback(0x200, std::ref(slow));
+
+    // Exercise
+    router(taking(0x100, 4));
+    router(taking(0x100, 10));
+    router(taking(0x200, 25));
+    router(taking(0x200, 5));
+    router(taking(0x200, 40));
+
+    // Verify
+    expect(that % 0 == fast.overruns());
+    expect(that % 10 == fast.worst_ticks());
+    expect(that % 2 == slow.overruns());
+    expect(that % 40 == slow.worst_ticks());
+    expect(that % 1 == budget.records().size());
+    expect(that % 0x200 == budget.records()[0].id);
+    expect(that % 2 == budget.records()[0].overruns);
+    expect(that % 40 == budget.records()[0].worst_ticks);
+    expect(that % 0 == budget.unrecorded());
+  };
+
+  "can_handler_budget counts overruns beyond the table"_test = []() {
+    // Setup
+    mock_clock clock;
+    std::array<can_handler_budget::overrun_record, 2> table;
+    can_handler_budget budget(clock, table);
+    auto handler = budget.wrap(busy_handler(clock), 1us);
+
+    // Exercise
+    handler(taking(0x100, 2));
+    handler(taking(0x101, 3));
+    handler(taking(0x102, 4));
+    handler(taking(0x101, 5));
+
+    // Verify
+    expect(that % 4 == handler.overruns());
+    expect(that % 2 == budget.records().size());
+    expect(that % 0x100 == budget.records()[0].id);
+    expect(that % 0x101 == budget.records()[1].id);
+    expect(that % 2 == budget.records()[1].overruns);
+    expect(that % 5 == budget.records()[1].worst_ticks);
+    expect(that % 1 == budget.unrecorded());
+
+    // Exercise
+    budget.clear();
+
+    // Verify
+    expect(budget.records().empty());
+    expect(that % 0 == budget.unrecorded());
+    expect(that % 4 == handler.overruns());
+  };
+
+  "can_handler_budget demotes a route after repeated overruns"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    mock_clock clock;
+    std::array<can_handler_budget::overrun_record, 4> table;
+    can_handler_budget budget(clock, table);
+    can_priority_dispatcher<1, 8> dispatcher;
+    auto slow = budget.wrap(busy_handler(clock), 10us);
+    auto route = dispatcher.add(router, 0x300, std::ref(slow));
+    int demotions = 0;
+    slow.demote_after(2, [&route, &demotions]() {
+      demotions++;
+      route.set_dispatch_class(can_dispatch_class::deferred);
+    });
+
+    // Exercise
+    router(taking(0x300, 50));
+    router(taking(0x300, 1));
+
+    // Verify
+    expect(can_dispatch_class::immediate == route.dispatch_class());
+
+    // Exercise
+    router(taking(0x300, 50));
+    router(taking(0x300, 50));
+    router(taking(0x300, 50));
+
+    // Verify
+    expect(slow.demoted());
+    expect(that % 1 == demotions);
+    expect(can_dispatch_class::deferred == route.dispatch_class());
+    expect(that % 2 == dispatcher.pending(0));
+    expect(that % 2 == dispatcher.drain());
+    expect(that % 4 == slow.overruns());
+    expect(that % 1 == demotions);
+  };
+};
+}  // namespace hal
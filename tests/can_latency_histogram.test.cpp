@@ -0,0 +1,173 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/can_latency_histogram.hpp>
+
+#include <functional>
+
+#include <libhal-canrouter/can_priority_dispatcher.hpp>
+
+#include <boost/ut.hpp>
+
+#include "mocks.hpp"
+
+namespace hal {
+namespace {
+/// Handler that takes the number of ticks in its first payload byte
+auto busy_handler(mock_clock& p_clock)
+{
+  return [&p_clock](const can::message_t& p_message) {
+    p_clock.m_ticks += p_message.payload[0];
+  };
+}
+
+can::message_t taking(hal::can::id_t p_id, std::uint8_t p_ticks)
+{
+  return { .id = p_id, .payload = { p_ticks }, .length = 1 };
+}
+}  // namespace
+
+void can_latency_histogram_test()
+{
+  using namespace boost::ut;
+  using histogram = can_latency_histogram<64>;
+
+  "can_latency_histogram buckets"_test = []() {
+    // Exercise + Verify
+    for (std::uint64_t ticks = 0; ticks < 8; ticks++) {
+      expect(that % ticks == histogram::bucket_of(ticks));
+    }
+    expect(that % 8 == histogram::bucket_of(8));
+    expect(that % 8 == histogram::bucket_of(9));
+    expect(that % 11 == histogram::bucket_of(15));
+    expect(that % 12 == histogram::bucket_of(16));
+    expect(that % 63 == histogram::bucket_of(114'688));
+    expect(that % 63 == histogram::bucket_of(1'000'000'000));
+    expect(that % 62 == histogram::bucket_of(114'687));
+    for (std::size_t bucket = 0; bucket < 63; bucket++) {
+      const auto lower = histogram::lower_bound(bucket);
+      const auto upper = histogram::upper_bound(bucket);
+      expect(that % bucket == histogram::bucket_of(lower));
+      expect(that % bucket == histogram::bucket_of(upper));
+      expect(that % upper + 1 == histogram::lower_bound(bucket + 1));
+    }
+  };
+
+  "can_latency_histogram measures latency and duration"_test = []() {
+    // Setup
+    mock_can can;
+    mock_clock clock;
+    can_router router(can, clock);
+    histogram control(clock);
+    auto timed = control.wrap(router, busy_handler(clock));
+    auto route = router.add_message_callback(0x050, std::ref(timed));
+
+    // Exercise
+    // Received at tick 100 and handled at tick 130
+    clock.m_ticks = 130;
+    router(taking(0x050, 5), 100);
+    clock.m_ticks = 200;
+    router(taking(0x050, 40), 198);
+    // Stamped by the router itself, so handled without latency
+    router(taking(0x050, 2));
+    const auto snapshot = control.snapshot();
+
+    // Verify
+    expect(that % 3 == snapshot.latency.count());
+    expect(that % 1 == snapshot.latency.buckets[histogram::bucket_of(30)]);
+    expect(that % 1 == snapshot.latency.buckets[2]);
+    expect(that % 1 == snapshot.latency.buckets[0]);
+    expect(that % 3 == snapshot.duration.count());
+    expect(that % 1 == snapshot.duration.buckets[5]);
+    expect(that % 1 == snapshot.duration.buckets[histogram::bucket_of(40)]);
+    expect(that % 1 == snapshot.duration.buckets[2]);
+    expect(that % 2 == snapshot.latency.percentile(0.5f));
+    expect(that % histogram::upper_bound(histogram::bucket_of(40)) ==
+           snapshot.duration.percentile(1.0f));
+  };
+
+  "can_latency_histogram::reset()"_test = []() {
+    // Setup
+    mock_clock clock;
+    mock_can can;
+    can_router router(can);
+    histogram control(clock);
+    auto timed = control.wrap(router, busy_handler(clock));
+
+    // Exercise
+    timed(taking(0x100, 3));
+    timed(taking(0x100, 3));
+    control.reset();
+    const auto cleared = control.snapshot();
+    timed(taking(0x100, 7));
+    const auto snapshot = control.snapshot();
+
+    // Verify
+    // The router has no clock, so there is no latency to record
+    expect(that % 0 == cleared.latency.count());
+    expect(that % 0 == cleared.duration.count());
+    expect(that % 0 == cleared.duration.percentile(0.99f));
+    expect(that % 0 == snapshot.latency.count());
+    expect(that % 1 == snapshot.duration.count());
+    expect(that % 1 == snapshot.duration.buckets[7]);
+  };
+
+  "can_latency_histogram of deferred routes"_test = []() {
+    // Setup
+    mock_can can;
+    mock_clock clock;
+    can_router router(can, clock);
+    can_priority_dispatcher<1, 4> dispatcher;
+    histogram background(clock);
+    auto timed = background.wrap(dispatcher, busy_handler(clock));
+    auto route = dispatcher.add(
+      router, 0x300, std::ref(timed), can_dispatch_class::deferred);
+
+    // Exercise
+    clock.m_ticks = 10;
+    router(taking(0x300, 1));
+    router(taking(0x300, 1));
+    clock.m_ticks = 1000;
+    dispatcher.drain();
+    const auto snapshot = background.snapshot();
+
+    // Verify
+    // Queued at tick 10, drained at 1000 and 1001, both in the 896 to 1023
+    // bucket
+    expect(that % 2 == snapshot.latency.count());
+    expect(that % 2 == snapshot.latency.buckets[histogram::bucket_of(990)]);
+    expect(that % 896 == histogram::lower_bound(histogram::bucket_of(991)));
+    expect(that % 2 == snapshot.duration.buckets[1]);
+  };
+
+  "can_latency_histogram compiled out"_test = []() {
+    // Setup
+    mock_can can;
+    mock_clock clock;
+    can_router router(can, clock);
+    can_latency_histogram<64, false> disabled(clock);
+    int calls = 0;
+    auto timed = disabled.wrap(
+      router, [&calls](const can::message_t&) { calls++; });
+
+    // Exercise
+    timed(taking(0x100, 0));
+
+    // Verify
+    expect(that % 1 == calls);
+    expect(that % 0 == disabled.snapshot().duration.count());
+    expect(sizeof(disabled) < sizeof(histogram));
+  };
+};
+}  // namespace hal
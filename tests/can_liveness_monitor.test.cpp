@@ -0,0 +1,143 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/can_liveness_monitor.hpp>
+
+#include <array>
+#include <vector>
+
+#include <boost/ut.hpp>
+
+#include "mocks.hpp"
+
+namespace hal {
+namespace {
+struct transition
+{
+  hal::can::id_t id;
+  bool online;
+  std::uint64_t time_ms;
+};
+}  // namespace
+
+void can_liveness_monitor_test()
+{
+  using namespace boost::ut;
+  using namespace std::chrono_literals;
+
+  "can_liveness_monitor tracks nodes dropping out"_test = []() {
+    // Setup
+    constexpr std::size_t node_count = 48;
+    mock_can can;
+    can_router router(can);
+    mock_clock clock;
+    std::array<can_liveness_monitor::node, node_count> nodes;
+    // Listed in reverse to show that the monitor sorts them
+    for (std::size_t i = 0; i < node_count; i++) {
+      nodes[i].id = static_cast<hal::can::id_t>(0x730 - i);
+    }
+    std::vector<transition> transitions;
+    can_liveness_monitor liveness(
+      router,
+      clock,
+      1ms,
+      300ms,
+      nodes,
+      [&transitions, &clock](hal::can::id_t p_id, bool p_online) {
+        transitions.push_back({ p_id, p_online, clock.m_ticks / 1000 });
+      },
+      4);
+
+    // Each node sends a heartbeat every 100ms, staggered by 2ms per node.
+    // Nodes 0x705 and 0x711 stop at 500ms. Node 0x71E stops at 800ms and
+    // comes back at 1500ms.
+    auto alive = [](hal::can::id_t p_id, std::uint64_t p_ms) {
+      if (p_id == 0x705 || p_id == 0x711) {
+        return p_ms < 500;
+      }
+      if (p_id == 0x71E) {
+        return p_ms < 800 || p_ms >= 1500;
+      }
+      return true;
+    };
+
+    // Exercise
+    for (std::uint64_t ms = 0; ms < 2000; ms++) {
+      clock.m_ticks = ms * 1000;
+      for (std::size_t i = 0; i < node_count; i++) {
+        const auto id = static_cast<hal::can::id_t>(0x701 + i);
+        if ((ms + 2 * i) % 100 == 0 && alive(id, ms)) {
+          router({ .id = id, .payload = { 0x05 }, .length = 1 });
+        }
+      }
+      // Not monitored
+      router({ .id = 0x123, .length = 0 });
+      liveness.poll();
+    }
+
+    // Verify
+    expect(that % node_count - 2 == liveness.online());
+    expect(that % 0x701 == liveness.nodes().front().id);
+    expect(that % 0x730 == liveness.nodes().back().id);
+
+    std::vector<transition> offline;
+    std::size_t online = 0;
+    for (const auto& event : transitions) {
+      if (event.online) {
+        online++;
+      } else {
+        offline.push_back(event);
+      }
+    }
+    // Every node once, plus 0x71E coming back
+    expect(that % node_count + 1 == online);
+    expect(that % 3 == offline.size());
+
+    // Last heartbeats: 0x705 at 492ms, 0x711 at 468ms, 0x71E at 742ms. Each
+    // is reported after the 300ms timeout and within one tick plus one
+    // round-robin pass of 12 polls.
+    const std::array<std::pair<hal::can::id_t, std::uint64_t>, 3> expected = {
+      { { 0x711, 468 }, { 0x705, 492 }, { 0x71E, 742 } }
+    };
+    for (std::size_t i = 0; i < offline.size() && i < expected.size(); i++) {
+      const auto [id, last_seen] = expected[i];
+      expect(that % id == offline[i].id);
+      expect(that % offline[i].time_ms > last_seen + 300);
+      expect(that % offline[i].time_ms <= last_seen + 300 + 1 + 12);
+    }
+    expect(transitions.back().online);
+    expect(that % 0x71E == transitions.back().id);
+  };
+
+  "can_liveness_monitor ignores transmitted frames"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    mock_clock clock;
+    std::array<can_liveness_monitor::node, 1> nodes{ { { .id = 0x701 } } };
+    int transitions = 0;
+    can_liveness_monitor liveness(
+      router, clock, 1ms, 10ms, nodes, [&transitions](hal::can::id_t, bool) {
+        transitions++;
+      });
+
+    // Exercise
+    expect(bool{ router.bus().send({ .id = 0x701, .length = 0 }) });
+
+    // Verify
+    expect(that % 0 == transitions);
+    expect(that % 0 == liveness.online());
+  };
+};
+}  // namespace hal
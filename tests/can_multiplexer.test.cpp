@@ -0,0 +1,119 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/can_multiplexer.hpp>
+
+#include <functional>
+#include <vector>
+
+#include <boost/ut.hpp>
+
+#include "mocks.hpp"
+
+namespace hal {
+namespace {
+struct page_1_t
+{
+  std::uint16_t voltage = 0;
+
+  static constexpr auto can_fields()
+  {
+    return std::tuple{
+      can_field{ &page_1_t::voltage, { .start_bit = 8, .length = 16 } },
+    };
+  }
+};
+
+can::message_t page(std::uint8_t p_selector, hal::byte p_data = 0)
+{
+  return { .id = 0x300,
+           .payload = { p_selector, p_data, 0x01 },
+           .length = 3 };
+}
+}  // namespace
+
+void can_multiplexer_test()
+{
+  using namespace boost::ut;
+
+  "can_multiplexer routes on selector"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    can_multiplexer<4> mux;
+    std::vector<int> calls;
+    std::uint16_t voltage = 0;
+
+    expect(bool{ mux.set_handler(
+      0, [&calls](const can::message_t&) { calls.push_back(0); }) });
+    expect(bool{ mux.set_handler(
+      2, [&calls](const can::message_t&) { calls.push_back(2); }) });
+    expect(bool{ mux.set_typed_handler<page_1_t>(
+      1, [&calls, &voltage](const page_1_t& p_page) {
+        calls.push_back(1);
+        voltage = p_page.voltage;
+      }) });
+    auto route = router.add_message_callback(0x300, std::ref(mux));
+
+    // Exercise
+    router(page(2));
+    router(page(0));
+    router(page(1, 0x34));
+
+    // Verify
+    expect(calls == std::vector<int>{ 2, 0, 1 });
+    expect(that % 0x0134 == voltage);
+    expect(that % 0 == mux.unmatched());
+  };
+
+  "can_multiplexer fallback"_test = []() {
+    // Setup
+    can_multiplexer<4> mux(1);
+    std::vector<can::message_t> fallback;
+    int calls = 0;
+    expect(bool{ mux.set_handler(
+      3, [&calls](const can::message_t&) { calls++; }) });
+    mux.set_fallback([&fallback](const can::message_t& p_message) {
+      fallback.push_back(p_message);
+    });
+
+    // Exercise
+    // Selector is byte 1
+    mux(page(0, 3));
+    // No sub-route for 2
+    mux(page(3, 2));
+    // Selector beyond the table
+    mux(page(3, 4));
+    // Payload too short to hold the selector
+    mux(can::message_t{ .id = 0x300, .payload = { 0x03, 0x03 }, .length = 1 });
+    mux.clear_handler(3);
+    mux(page(0, 3));
+
+    // Verify
+    expect(that % 1 == calls);
+    expect(that % 4 == fallback.size());
+    expect(that % 4 == mux.unmatched());
+  };
+
+  "can_multiplexer rejects selectors outside the table"_test = []() {
+    // Setup
+    can_multiplexer<4> mux;
+    can_multiplexer<256> full;
+
+    // Exercise + Verify
+    expect(!mux.set_handler(4, can_router::noop));
+    expect(bool{ full.set_handler(255, can_router::noop) });
+  };
+};
+}  // namespace hal
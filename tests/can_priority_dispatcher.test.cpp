@@ -0,0 +1,203 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/can_priority_dispatcher.hpp>
+
+#include <vector>
+
+#include <boost/ut.hpp>
+
+#include "mocks.hpp"
+
+namespace hal {
+namespace {
+can::message_t numbered(hal::can::id_t p_id, int p_number)
+{
+  return { .id = p_id,
+           .payload = { static_cast<hal::byte>(p_number) },
+           .length = 1 };
+}
+}  // namespace
+
+void can_priority_dispatcher_test()
+{
+  using namespace boost::ut;
+  using dispatch = can_dispatch_class;
+
+  "can_priority_dispatcher runs immediate routes inline"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    can_priority_dispatcher<2, 4> dispatcher;
+    std::vector<int> calls;
+    auto route =
+      dispatcher.add(router, 0x010, [&calls](const can::message_t& p_message) {
+        calls.push_back(p_message.payload[0]);
+      });
+
+    // Exercise
+    router(numbered(0x010, 7));
+
+    // Verify
+    expect(calls == std::vector<int>{ 7 });
+    expect(that % 0 == dispatcher.drain());
+    expect(dispatch::immediate == route.dispatch_class());
+    expect(that % 0x010 == route.id());
+  };
+
+  "can_priority_dispatcher drains deferred routes by priority"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    can_priority_dispatcher<3, 4> dispatcher;
+    std::vector<int> calls;
+    auto record = [&calls](const can::message_t& p_message) {
+      calls.push_back(p_message.payload[0]);
+    };
+    auto low = dispatcher.add(router, 0x300, record, dispatch::deferred, 2);
+    auto high = dispatcher.add(router, 0x100, record, dispatch::deferred, 0);
+    auto urgent = dispatcher.add(router, 0x010, record);
+
+    // Exercise
+    router(numbered(0x300, 1));
+    router(numbered(0x100, 2));
+    router(numbered(0x010, 3));
+    router(numbered(0x300, 4));
+    router(numbered(0x100, 5));
+
+    // Verify
+    expect(calls == std::vector<int>{ 3 });
+    expect(that % 2 == dispatcher.pending(0));
+    expect(that % 0 == dispatcher.pending(1));
+    expect(that % 2 == dispatcher.pending(2));
+
+    // Exercise
+    expect(that % 3 == dispatcher.drain(3));
+    expect(that % 1 == dispatcher.drain());
+
+    // Verify
+    expect(calls == std::vector<int>{ 3, 2, 5, 1, 4 });
+    expect(that % 0 == dispatcher.pending(2));
+  };
+
+  "can_priority_dispatcher discards frames of destroyed routes"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    can_priority_dispatcher<1, 8> dispatcher;
+    std::vector<int> calls;
+    auto record = [&calls](const can::message_t& p_message) {
+      calls.push_back(p_message.payload[0]);
+    };
+    auto kept = dispatcher.add(router, 0x100, record, dispatch::deferred);
+
+    // Exercise
+    {
+      auto destroyed =
+        dispatcher.add(router, 0x200, record, dispatch::deferred);
+      router(numbered(0x200, 1));
+      router(numbered(0x100, 2));
+      router(numbered(0x200, 3));
+    }
+    router(numbered(0x200, 4));
+    router(numbered(0x100, 5));
+
+    // Verify
+    expect(that % 4 == dispatcher.pending(0));
+    expect(that % 2 == dispatcher.drain());
+    expect(calls == std::vector<int>{ 2, 5 });
+    expect(that % 0 == dispatcher.pending(0));
+  };
+
+  "can_priority_dispatcher keeps receive timestamps"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    can_priority_dispatcher<1, 4> dispatcher;
+    std::vector<std::uint64_t> timestamps;
+    auto route = dispatcher.add(
+      router,
+      0x200,
+      [&timestamps, &dispatcher](const can::message_t&) {
+        timestamps.push_back(dispatcher.receive_timestamp());
+      },
+      dispatch::deferred);
+
+    // Exercise
+    router(numbered(0x200, 1), 100);
+    router(numbered(0x200, 2), 250);
+    router(numbered(0x200, 3), 300);
+    dispatcher.drain();
+
+    // Verify
+    expect(timestamps == std::vector<std::uint64_t>{ 100, 250, 300 });
+  };
+
+  "can_priority_dispatcher drops frames when a queue is full"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    can_priority_dispatcher<1, 2> dispatcher;
+    int calls = 0;
+    auto route = dispatcher.add(
+      router,
+      0x200,
+      [&calls](const can::message_t&) { calls++; },
+      dispatch::deferred,
+      // Out of range, treated as the lowest level
+      9);
+
+    // Exercise
+    for (int i = 0; i < 5; i++) {
+      router(numbered(0x200, i));
+    }
+
+    // Verify
+    expect(that % 0 == route.priority());
+    expect(that % 3 == dispatcher.dropped());
+    expect(that % 2 == dispatcher.high_water(0));
+    expect(that % 2 == dispatcher.drain());
+    expect(that % 2 == calls);
+    expect(that % 2 == dispatcher.high_water(0));
+    expect(that % 0 == dispatcher.high_water(1));
+  };
+
+  "can_priority_dispatcher switches class at runtime"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    can_priority_dispatcher<1, 4> dispatcher;
+    int calls = 0;
+    auto route = dispatcher.add(
+      router, 0x200, [&calls](const can::message_t&) { calls++; });
+
+    // Exercise
+    route.set_dispatch_class(dispatch::deferred);
+    router(numbered(0x200, 0));
+
+    // Verify
+    expect(that % 0 == calls);
+    expect(that % 1 == dispatcher.drain());
+    expect(that % 1 == calls);
+
+    // Exercise
+    route.set_dispatch_class(dispatch::immediate);
+    router(numbered(0x200, 0));
+
+    // Verify
+    expect(that % 2 == calls);
+    expect(that % 0 == dispatcher.pending(0));
+  };
+};
+}  // namespace hal
@@ -15,6 +15,9 @@
 #include <libhal-canrouter/can_router.hpp>
 
 #include <algorithm>
+#include <optional>
+#include <utility>
+#include <vector>
 
 #include <libhal-util/can.hpp>
 #include <libhal/functional.hpp>
@@ -63,6 +66,23 @@ private:
     m_handler = p_handler;
   };
 };
+
+class mock_clock : public hal::steady_clock
+{
+public:
+  std::uint64_t m_ticks = 0;
+
+private:
+  frequency_t driver_frequency() override
+  {
+    return { .operating_frequency = 1'000'000.0f };
+  }
+
+  uptime_t driver_uptime() override
+  {
+    return { .ticks = m_ticks };
+  }
+};
 }  // namespace
 
 void can_router_test()
@@ -272,6 +292,213 @@ void can_router_test()
     expect(expected3 == actual3);
   };
 
+  "can_router::add_tap()"_test = []() {
+    // Setup
+    static constexpr can::message_t received{
+      .id = 0x100,
+      .payload = { 0xAA },
+      .length = 1,
+    };
+    static constexpr can::message_t sent{
+      .id = 0x200,
+      .payload = { 0xBB },
+      .length = 1,
+    };
+    mock_can mock;
+    auto router = can_router::create(mock).value();
+    int route_counter = 0;
+    std::vector<std::pair<can::message_t, can_router::direction>> observed;
+
+    auto route = router.add_message_callback(
+      received.id,
+      [&route_counter](const can::message_t&) { route_counter++; });
+
+    // Exercise
+    {
+      auto tap = router.add_tap(
+        [&observed](const can::message_t& p_message,
+                    can_router::direction p_direction) {
+          observed.emplace_back(p_message, p_direction);
+        });
+
+      router(received);
+      router(can::message_t{ .id = 0x300 });
+      auto result = router.bus().send(sent);
+      expect(bool{ result });
+    }
+    router(received);
+
+    // Verify
+    expect(that % 2 == route_counter);
+    expect(that % 3 == observed.size());
+    expect(received == observed.at(0).first);
+    expect(can_router::direction::receive == observed.at(0).second);
+    expect(that % 0x300 == observed.at(1).first.id);
+    expect(can_router::direction::receive == observed.at(1).second);
+    expect(sent == observed.at(2).first);
+    expect(can_router::direction::transmit == observed.at(2).second);
+    expect(sent == mock.m_message);
+  };
+
+  "can_router::add_tap() failed send is not observed"_test = []() {
+    // Setup
+    mock_can mock;
+    auto router = can_router::create(mock).value();
+    int counter = 0;
+    auto tap = router.add_tap(
+      [&counter](const can::message_t&, can_router::direction) {
+        counter++;
+      });
+    mock.m_return_error_status = true;
+
+    // Exercise
+    auto result = router.bus().send(can::message_t{ .id = 0x200 });
+
+    // Verify
+    expect(!bool{ result });
+    expect(that % 0 == counter);
+  };
+
+  "can_router::dispatch()"_test = []() {
+    // Setup
+    mock_can mock;
+    auto router = can_router::create(mock).value();
+    std::vector<int> calls;
+    int tapped = 0;
+    auto first = router.add_message_callback(
+      0x100, [&calls](const can::message_t& p_message) {
+        calls.push_back(p_message.payload[0]);
+      });
+    auto second = router.add_message_callback(
+      0x200, [&calls](const can::message_t& p_message) {
+        calls.push_back(-p_message.payload[0]);
+      });
+    auto tap = router.add_tap(
+      [&tapped](const can::message_t&, can_router::direction) { tapped++; });
+    const std::vector<can::message_t> batch = {
+      { .id = 0x100, .payload = { 1 }, .length = 1 },
+      { .id = 0x100, .payload = { 2 }, .length = 1 },
+      { .id = 0x300, .payload = { 3 }, .length = 1 },
+      { .id = 0x300, .payload = { 4 }, .length = 1 },
+      { .id = 0x200, .payload = { 5 }, .length = 1 },
+      { .id = 0x100, .payload = { 6 }, .length = 1 },
+    };
+
+    // Exercise
+    router.dispatch(batch);
+    router.dispatch({});
+
+    // Verify
+    expect(calls == std::vector<int>{ 1, 2, -5, 6 });
+    expect(that % 6 == tapped);
+    expect(that % 3 == first.get().hits.load());
+    expect(that % 1 == second.get().hits.load());
+    expect(that % 2 == router.unrouted());
+  };
+
+  "can_router::dispatch() with routes changed by handlers"_test = []() {
+    // Setup
+    mock_can mock;
+    can_router router(mock);
+    int one_shot_calls = 0;
+    int late_calls = 0;
+    std::optional<can_router::route_item> one_shot;
+    std::optional<can_router::route_item> late;
+    one_shot = router.add_message_callback(
+      0x100, [&one_shot_calls, &one_shot](const can::message_t&) {
+        one_shot_calls++;
+        one_shot.reset();
+      });
+    auto adder = router.add_message_callback(
+      0x200, [&late, &late_calls, &router](const can::message_t&) {
+        if (!late) {
+          late = router.add_message_callback(
+            0x300, [&late_calls](const can::message_t&) { late_calls++; });
+        }
+      });
+    int moved_calls = 0;
+    int moving_frames = 0;
+    std::optional<can_router::route_item> unmoved;
+    std::optional<can_router::route_item> moved;
+    unmoved = router.add_message_callback(
+      0x400, [&moved_calls](const can::message_t&) { moved_calls++; });
+    // Moves the 0x400 route after the first 0x400 frame has been routed
+    auto mover = router.add_tap(
+      [&](const can::message_t& p_message, can_router::direction) {
+        if (p_message.id == 0x400 && moving_frames++ == 1) {
+          moved = std::move(*unmoved);
+          unmoved.reset();
+        }
+      });
+    const std::vector<can::message_t> batch = {
+      { .id = 0x100 }, { .id = 0x100 }, { .id = 0x100 }, { .id = 0x300 },
+      { .id = 0x200 }, { .id = 0x300 }, { .id = 0x400 }, { .id = 0x400 },
+      { .id = 0x400 },
+    };
+
+    // Exercise
+    router.dispatch(batch);
+
+    // Verify: the removed route is not called again, the added one is found
+    expect(that % 1 == one_shot_calls);
+    expect(!one_shot.has_value());
+    expect(that % 1 == late_calls);
+    expect(that % 3 == router.unrouted());
+    expect(that % 3 == moved_calls);
+    expect(that % 3 == moved->get().hits.load());
+  };
+
+  "can_router::receive_timestamp()"_test = []() {
+    // Setup
+    mock_can mock;
+    mock_clock clock;
+    can_router router(mock, clock);
+    std::vector<std::uint64_t> handled;
+    std::vector<std::uint64_t> tapped;
+    auto route = router.add_message_callback(
+      0x100, [&handled, &router](const can::message_t&) {
+        handled.push_back(router.receive_timestamp());
+      });
+    auto tap = router.add_tap([&tapped](const can::message_t&,
+                                        can_router::direction,
+                                        std::uint64_t p_timestamp) {
+      tapped.push_back(p_timestamp);
+    });
+    const std::vector<can::message_t> batch(3, { .id = 0x100 });
+    const std::vector<std::uint64_t> timestamps = { 40, 41 };
+
+    // Exercise
+    clock.m_ticks = 10;
+    router(can::message_t{ .id = 0x100 });
+    router(can::message_t{ .id = 0x100 }, 7);
+    clock.m_ticks = 50;
+    router.dispatch(batch, timestamps);
+    clock.m_ticks = 60;
+    auto sent = router.bus().send(can::message_t{ .id = 0x200 });
+
+    // Verify
+    expect(bool{ sent });
+    expect(handled == std::vector<std::uint64_t>{ 10, 7, 40, 41, 50 });
+    expect(tapped == std::vector<std::uint64_t>{ 10, 7, 40, 41, 50, 60 });
+  };
+
+  "can_router::receive_timestamp() without clock"_test = []() {
+    // Setup
+    mock_can mock;
+    can_router router(mock);
+    std::uint64_t handled = 1;
+    auto route = router.add_message_callback(
+      0x100, [&handled, &router](const can::message_t&) {
+        handled = router.receive_timestamp();
+      });
+
+    // Exercise + Verify
+    router(can::message_t{ .id = 0x100 });
+    expect(that % 0 == handled);
+    router(can::message_t{ .id = 0x100 }, 123);
+    expect(that % 123 == handled);
+  };
+
   "can_router::~can_router()"_test = []() {
     // Setup
     mock_can mock;
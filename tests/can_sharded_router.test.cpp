@@ -0,0 +1,197 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/can_sharded_router.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <boost/ut.hpp>
+
+namespace hal {
+namespace {
+template<typename Router>
+bool handled(const Router& p_router, std::uint64_t p_frames)
+{
+  using namespace std::chrono_literals;
+  const auto deadline = std::chrono::steady_clock::now() + 5s;
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (p_router.handled() >= p_frames) {
+      return true;
+    }
+    std::this_thread::sleep_for(1ms);
+  }
+  return false;
+}
+
+can::message_t numbered(hal::can::id_t p_id,
+                        std::uint8_t p_input,
+                        std::uint16_t p_number)
+{
+  return { .id = p_id,
+           .payload = { p_input,
+                        static_cast<hal::byte>(p_number),
+                        static_cast<hal::byte>(p_number >> 8) },
+           .length = 3 };
+}
+}  // namespace
+
+void can_sharded_router_test()
+{
+  using namespace boost::ut;
+
+  "can_sharded_router spreads IDs across shards"_test = []() {
+    // Setup
+    can_sharded_router<16> router(4, 1);
+    std::set<std::size_t> used;
+
+    // Exercise
+    for (hal::can::id_t id = 0x100; id < 0x110; id++) {
+      used.insert(router.shard_of(id));
+    }
+
+    // Verify
+    expect(that % 4 == router.shards());
+    expect(that % 4 == used.size());
+    expect(that % 0 == can_sharded_router<16>(0, 0).shard_of(0x123));
+  };
+
+  "can_sharded_router keeps per-ID order from every input"_test = []() {
+    // Setup
+    constexpr std::size_t ids = 16;
+    constexpr std::uint16_t frames = 1000;
+    can_sharded_router<64> router(4, 2);
+    // Each ID is only ever handled by its shard's worker, so the handler of
+    // an ID needs no lock for its own entries
+    std::array<std::array<std::uint16_t, 2>, ids> next{};
+    std::array<std::atomic<int>, ids> out_of_order{};
+    std::vector<can_sharded_router<64>::route> routes;
+    for (std::size_t i = 0; i < ids; i++) {
+      routes.push_back(router.add_message_callback(
+        0x200 + i, [&, i](const can::message_t& p_message) {
+          const auto input = p_message.payload[0];
+          const auto number = p_message.payload[1] | p_message.payload[2] << 8;
+          out_of_order[i] += number != next[i][input];
+          next[i][input] = static_cast<std::uint16_t>(number + 1);
+        }));
+    }
+
+    // Exercise
+    // One producer thread per input, retrying when a queue is full
+    auto produce = [&router](std::uint8_t p_input) {
+      for (std::uint16_t n = 0; n < frames; n++) {
+        for (hal::can::id_t id = 0x200; id < 0x200 + ids; id++) {
+          while (!router.input(p_input).post(numbered(id, p_input, n))) {
+            std::this_thread::yield();
+          }
+        }
+      }
+    };
+    std::thread first(produce, 0);
+    std::thread second(produce, 1);
+    first.join();
+    second.join();
+
+    // Verify
+    constexpr std::uint64_t total = 2 * ids * frames;
+    expect(handled(router, total));
+    for (std::size_t i = 0; i < ids; i++) {
+      expect(that % 0 == out_of_order[i].load());
+      expect(that % frames == next[i][0]);
+      expect(that % frames == next[i][1]);
+    }
+    expect(that % total == router.handled());
+  };
+
+  "can_sharded_router batches and removes routes"_test = []() {
+    // Setup
+    can_sharded_router<64> router(2, 1);
+    std::atomic<int> calls = 0;
+    std::vector<can::message_t> batch;
+    for (std::uint16_t n = 0; n < 10; n++) {
+      batch.push_back(numbered(0x300, 0, n));
+      batch.push_back(numbered(0x301, 0, n));
+    }
+
+    // Exercise
+    {
+      auto route = router.add_message_callback(
+        0x300, [&calls](const can::message_t&) { calls++; });
+      expect(that % 20 == router.input(0).post(batch));
+      expect(handled(router, 20));
+    }
+    expect(that % 20 == router.input(0).post(batch));
+    expect(handled(router, 40));
+
+    // Verify
+    expect(that % 10 == calls.load());
+    expect(that % 0 == router.input(0).dropped());
+  };
+
+  "can_sharded_router routes may outlive the router"_test = []() {
+    // Setup
+    std::atomic<int> calls = 0;
+    std::optional<can_sharded_router<16>> router;
+    router.emplace(2, 1);
+    auto route = router->add_message_callback(
+      0x500, [&calls](const can::message_t&) { calls++; });
+    expect(router->input(0).post(numbered(0x500, 0, 0)));
+    expect(handled(*router, 1));
+
+    // Exercise
+    router.reset();
+    auto moved = std::move(route);
+
+    // Verify: destroying both routes after the router must not touch it
+    expect(that % 1 == calls.load());
+  };
+
+  "can_sharded_router drops frames when a queue is full"_test = []() {
+    // Setup
+    can_sharded_router<4> router(1, 1);
+    std::atomic<bool> started = false;
+    std::atomic<bool> release = false;
+    auto route = router.add_message_callback(
+      0x400, [&started, &release](const can::message_t&) {
+        started = true;
+        while (!release) {
+          std::this_thread::yield();
+        }
+      });
+    auto& input = router.input(0);
+
+    // Exercise
+    expect(input.post(numbered(0x400, 0, 0)));
+    while (!started) {
+      std::this_thread::yield();
+    }
+    // The worker is blocked in the first handler, so 4 more fit
+    int queued = 0;
+    for (std::uint16_t n = 1; n < 10; n++) {
+      queued += input.post(numbered(0x400, 0, n));
+    }
+    release = true;
+
+    // Verify
+    expect(that % 4 == queued);
+    expect(that % 5 == input.dropped());
+    expect(handled(router, 5));
+  };
+};
+}  // namespace hal
@@ -0,0 +1,294 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/can_signal.hpp>
+
+#include <libhal-canrouter/can_router.hpp>
+
+#include <cstdint>
+#include <random>
+
+#include <boost/ut.hpp>
+
+#include "mocks.hpp"
+
+namespace hal {
+namespace {
+enum class gear_t : std::uint8_t
+{
+  park,
+  reverse,
+  neutral,
+  drive,
+};
+
+struct wheel_speed_t
+{
+  float front_left = 0.0f;
+  float front_right = 0.0f;
+  float rear_left = 0.0f;
+  float rear_right = 0.0f;
+
+  static constexpr auto can_fields()
+  {
+    constexpr can_signal speed{
+      .length = 16, .scale = 0.01f, .offset = -100.0f
+    };
+    auto at = [](can_signal p_signal, std::uint8_t p_start) {
+      p_signal.start_bit = p_start;
+      return p_signal;
+    };
+
+    return std::tuple{
+      can_field{ &wheel_speed_t::front_left, at(speed, 0) },
+      can_field{ &wheel_speed_t::front_right, at(speed, 16) },
+      can_field{ &wheel_speed_t::rear_left, at(speed, 32) },
+      can_field{ &wheel_speed_t::rear_right, at(speed, 48) },
+    };
+  }
+};
+
+struct powertrain_t
+{
+  std::int16_t torque = 0;
+  std::uint16_t rpm = 0;
+  gear_t gear = gear_t::park;
+  bool brake = false;
+  float temperature = 0.0f;
+
+  static constexpr auto can_fields()
+  {
+    return std::tuple{
+      can_field{ &powertrain_t::torque,
+                 { .start_bit = 7,
+                   .length = 12,
+                   .byte_order = can_byte_order::big_endian,
+                   .is_signed = true } },
+      can_field{ &powertrain_t::rpm,
+                 { .start_bit = 19,
+                   .length = 16,
+                   .byte_order = can_byte_order::big_endian } },
+      can_field{ &powertrain_t::gear, { .start_bit = 32, .length = 2 } },
+      can_field{ &powertrain_t::brake, { .start_bit = 34, .length = 1 } },
+      can_field{ &powertrain_t::temperature,
+                 { .start_bit = 40,
+                   .length = 8,
+                   .is_signed = true,
+                   .scale = 0.5f,
+                   .offset = 20.0f } },
+    };
+  }
+};
+
+// Hand written unpacking used as the reference for can_decode()
+wheel_speed_t unpack_wheel_speed(const std::array<hal::byte, 8>& p_payload)
+{
+  auto speed = [&p_payload](int p_byte) {
+    const auto raw = static_cast<std::uint16_t>(p_payload[p_byte] |
+                                                p_payload[p_byte + 1] << 8);
+    return static_cast<float>(raw) * 0.01f - 100.0f;
+  };
+  return { speed(0), speed(2), speed(4), speed(6) };
+}
+
+powertrain_t unpack_powertrain(const std::array<hal::byte, 8>& p_payload)
+{
+  powertrain_t result;
+
+  // 12 bits starting at the MSB of byte 0 and ending in the top of byte 1
+  auto torque =
+    static_cast<std::int32_t>(p_payload[0] << 4 | p_payload[1] >> 4);
+  if (torque & 0x800) {
+    torque -= 0x1000;
+  }
+  result.torque = static_cast<std::int16_t>(torque);
+
+  // 16 bits starting at bit 3 of byte 2 and ending at bit 4 of byte 4
+  const auto rpm = static_cast<std::uint32_t>(
+    (p_payload[2] & 0x0F) << 12 | p_payload[3] << 4 | p_payload[4] >> 4);
+  result.rpm = static_cast<std::uint16_t>(rpm);
+
+  result.gear = static_cast<gear_t>(p_payload[4] & 0x03);
+  result.brake = p_payload[4] & 0x04;
+  result.temperature =
+    static_cast<float>(static_cast<std::int8_t>(p_payload[5])) * 0.5f + 20.0f;
+  return result;
+}
+
+constexpr std::array<hal::byte, 8> constant_payload = {
+  0x10, 0x27, 0x00, 0x00, 0xFF, 0xFF, 0x88, 0x13,
+};
+
+// Decoding is usable in constant expressions
+static_assert(can_decode<wheel_speed_t>(constant_payload).front_left == 0.0f);
+static_assert(can_decode<wheel_speed_t>(constant_payload).front_right ==
+              -100.0f);
+static_assert(can_signal{ .start_bit = 7,
+                          .length = 8,
+                          .byte_order = can_byte_order::big_endian }
+                .shift() == 56);
+}  // namespace
+
+void can_signal_test()
+{
+  using namespace boost::ut;
+
+  "can_signal::raw() intel"_test = []() {
+    // Setup
+    constexpr std::array<hal::byte, 8> payload = { 0xA5, 0x3C, 0xF0 };
+    constexpr can_signal nibble{ .start_bit = 4, .length = 4 };
+    constexpr can_signal across{ .start_bit = 12, .length = 8 };
+    constexpr can_signal signed_across{ .start_bit = 12,
+                                        .length = 8,
+                                        .is_signed = true };
+
+    // Exercise + Verify
+    expect(that % 0xA == nibble.raw(payload));
+    expect(that % 0x03 == across.raw(payload));
+    expect(that % 0x03 == signed_across.raw(payload));
+    expect(that % -1 == can_signal{ .start_bit = 20,
+                                    .length = 4,
+                                    .is_signed = true }
+                          .raw(payload));
+  };
+
+  "can_signal::raw() motorola"_test = []() {
+    // Setup
+    constexpr std::array<hal::byte, 8> payload = { 0x12, 0x34, 0x56 };
+    constexpr auto motorola = can_byte_order::big_endian;
+
+    // Exercise + Verify
+    // Whole bytes read as big endian integers
+    expect(that % 0x1234 == can_signal{ .start_bit = 7,
+                                        .length = 16,
+                                        .byte_order = motorola }
+                              .raw(payload));
+    // Low nibble of byte 0 followed by byte 1
+    expect(that % 0x234 == can_signal{ .start_bit = 3,
+                                       .length = 12,
+                                       .byte_order = motorola }
+                             .raw(payload));
+    // A single bit is numbered the same in either byte order
+    expect(that % 1 == can_signal{ .start_bit = 4,
+                                   .length = 1,
+                                   .byte_order = motorola }
+                         .raw(payload));
+  };
+
+  "can_signal::raw() full width"_test = []() {
+    // Setup
+    constexpr std::array<hal::byte, 8> payload = { 0xFF, 0xFF, 0xFF, 0xFF,
+                                                   0xFF, 0xFF, 0xFF, 0xFF };
+    constexpr can_signal all{ .start_bit = 0, .length = 64, .is_signed = true };
+
+    // Exercise + Verify
+    expect(that % -1 == all.raw(payload));
+  };
+
+  "can_decode() matches hand written unpacking"_test = []() {
+    // Setup
+    std::mt19937 rng(30);
+    std::uniform_int_distribution<int> byte_distribution(0, 255);
+    int mismatches = 0;
+
+    // Exercise
+    for (int i = 0; i < 10'000; i++) {
+      std::array<hal::byte, 8> payload{};
+      for (auto& byte : payload) {
+        byte = static_cast<hal::byte>(byte_distribution(rng));
+      }
+
+      const auto speed = can_decode<wheel_speed_t>(payload);
+      const auto expected_speed = unpack_wheel_speed(payload);
+      const auto powertrain = can_decode<powertrain_t>(payload);
+      const auto expected_powertrain = unpack_powertrain(payload);
+
+      mismatches += speed.front_left != expected_speed.front_left ||
+                    speed.front_right != expected_speed.front_right ||
+                    speed.rear_left != expected_speed.rear_left ||
+                    speed.rear_right != expected_speed.rear_right;
+      mismatches += powertrain.torque != expected_powertrain.torque ||
+                    powertrain.rpm != expected_powertrain.rpm ||
+                    powertrain.gear != expected_powertrain.gear ||
+                    powertrain.brake != expected_powertrain.brake ||
+                    powertrain.temperature != expected_powertrain.temperature;
+    }
+
+    // Verify
+    expect(that % 0 == mismatches);
+  };
+
+  "can_router::add_typed_callback()"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    powertrain_t received{};
+    int calls = 0;
+    auto route = router.add_typed_callback<powertrain_t>(
+      0x120, [&](const powertrain_t& p_powertrain) {
+        received = p_powertrain;
+        calls++;
+      });
+    const can::message_t message{
+      .id = 0x120,
+      .payload = { 0xFF, 0xE0, 0x00, 0x10, 0x07, 0x14 },
+      .length = 6,
+    };
+
+    // Exercise
+    router(message);
+    router(can::message_t{ .id = 0x121, .length = 0 });
+
+    // Verify
+    expect(that % 1 == calls);
+    expect(that % -2 == received.torque);
+    expect(that % 0x0100 == received.rpm);
+    expect(gear_t::drive == received.gear);
+    expect(received.brake);
+    expect(that % 30.0f == received.temperature);
+  };
+
+  "can_router::add_typed_callback() stateful handler"_test = []() {
+    // Setup
+    struct torque_sum
+    {
+      int* total;
+      int calls = 0;
+
+      void operator()(const powertrain_t& p_powertrain)
+      {
+        calls++;
+        *total += p_powertrain.torque * calls;
+      }
+    };
+    mock_can can;
+    can_router router(can);
+    int total = 0;
+    auto route =
+      router.add_typed_callback<powertrain_t>(0x120, torque_sum{ &total });
+    const can::message_t message{
+      .id = 0x120,
+      .payload = { 0x00, 0x10 },
+      .length = 2,
+    };
+
+    // Exercise
+    router(message);
+    router(message);
+
+    // Verify: state kept between calls, 1 * 1 + 1 * 2
+    expect(that % 3 == total);
+  };
+};
+}  // namespace hal
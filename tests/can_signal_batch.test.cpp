@@ -0,0 +1,138 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/can_signal_batch.hpp>
+
+#include <array>
+#include <random>
+#include <vector>
+
+#include <boost/ut.hpp>
+
+namespace hal {
+namespace {
+std::vector<can::message_t> random_messages(std::size_t p_count)
+{
+  std::mt19937 rng(32);
+  std::uniform_int_distribution<int> byte_distribution(0, 255);
+  std::vector<can::message_t> messages(p_count);
+
+  for (auto& message : messages) {
+    message.id = 0x120;
+    message.length = 8;
+    for (auto& byte : message.payload) {
+      byte = static_cast<hal::byte>(byte_distribution(rng));
+    }
+  }
+  return messages;
+}
+
+constexpr auto motorola = can_byte_order::big_endian;
+
+constexpr std::array signals = {
+  can_signal{ .start_bit = 0, .length = 16, .scale = 0.01f },
+  can_signal{ .start_bit = 5, .length = 1 },
+  can_signal{ .start_bit = 12, .length = 9, .is_signed = true, .scale = 2.0f },
+  can_signal{ .start_bit = 7, .length = 16, .byte_order = motorola },
+  can_signal{ .start_bit = 19,
+              .length = 12,
+              .byte_order = motorola,
+              .is_signed = true,
+              .scale = 0.5f,
+              .offset = -40.0f },
+  can_signal{ .start_bit = 32, .length = 31, .offset = 1.0f },
+  can_signal{ .start_bit = 0, .length = 32, .is_signed = true },
+  // Too wide for the SIMD float path, decoded with the scalar fallback
+  can_signal{ .start_bit = 8, .length = 40, .scale = 0.001f },
+  can_signal{ .start_bit = 0, .length = 64, .is_signed = true },
+};
+
+constexpr std::array isas = {
+  can_batch_isa::scalar,
+  can_batch_isa::sse2,
+  can_batch_isa::avx2,
+};
+}  // namespace
+
+void can_signal_batch_test()
+{
+  using namespace boost::ut;
+
+  "can_batch_decode() matches can_signal::decode()"_test = []() {
+    // Setup
+    // Odd count so that every SIMD width leaves a scalar tail
+    const auto messages = random_messages(1003);
+    std::vector<float> column(messages.size());
+    int mismatches = 0;
+
+    for (const auto isa : isas) {
+      for (const auto& signal : signals) {
+        // Exercise
+        const auto count = can_batch_decode(messages, signal, column, isa);
+
+        // Verify
+        expect(that % messages.size() == count);
+        for (std::size_t i = 0; i < messages.size(); i++) {
+          mismatches += column[i] != signal.decode(messages[i].payload);
+        }
+      }
+    }
+
+    // Verify
+    expect(that % 0 == mismatches);
+  };
+
+  "can_batch_decode_raw() matches can_signal::raw()"_test = []() {
+    // Setup
+    const auto messages = random_messages(1003);
+    std::vector<std::int64_t> column(messages.size());
+    int mismatches = 0;
+
+    for (const auto isa : isas) {
+      for (const auto& signal : signals) {
+        // Exercise
+        const auto count = can_batch_decode_raw(messages, signal, column, isa);
+
+        // Verify
+        expect(that % messages.size() == count);
+        for (std::size_t i = 0; i < messages.size(); i++) {
+          mismatches += column[i] != signal.raw(messages[i].payload);
+        }
+      }
+    }
+
+    // Verify
+    expect(that % 0 == mismatches);
+  };
+
+  "can_batch_decode() stops at the shorter span"_test = []() {
+    // Setup
+    const auto messages = random_messages(10);
+    std::array<float, 6> column{};
+    std::array<std::int64_t, 20> raw_column{};
+    raw_column.fill(-7);
+
+    // Exercise
+    const auto count = can_batch_decode(messages, signals[0], column);
+    const auto raw_count =
+      can_batch_decode_raw(messages, signals[0], raw_column);
+
+    // Verify
+    expect(that % 6 == count);
+    expect(that % 10 == raw_count);
+    expect(that % -7 == raw_column[10]);
+    expect(that % -7 == raw_column[19]);
+  };
+};
+}  // namespace hal
@@ -0,0 +1,125 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/can_throttle.hpp>
+
+#include <functional>
+#include <vector>
+
+#include <boost/ut.hpp>
+
+#include "mocks.hpp"
+
+namespace hal {
+namespace {
+can::message_t numbered(int p_number)
+{
+  return { .id = 0x120,
+           .payload = { static_cast<hal::byte>(p_number) },
+           .length = 1 };
+}
+}  // namespace
+
+void can_throttle_test()
+{
+  using namespace boost::ut;
+  using namespace std::chrono_literals;
+
+  "can_decimator passes every Nth frame"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    std::vector<int> passed;
+    can_decimator every_fourth(
+      [&passed](const can::message_t& p_message) {
+        passed.push_back(p_message.payload[0]);
+      },
+      4);
+    auto route = router.add_message_callback(0x120, std::ref(every_fourth));
+
+    // Exercise
+    for (int i = 0; i < 10; i++) {
+      router(numbered(i));
+    }
+
+    // Verify
+    expect(passed == std::vector<int>{ 0, 4, 8 });
+    expect(that % 7 == every_fourth.suppressed());
+  };
+
+  "can_decimator with a factor of 0 or 1 passes everything"_test = []() {
+    // Setup
+    int calls = 0;
+    can_decimator zero([&calls](const can::message_t&) { calls++; }, 0);
+    can_decimator one([&calls](const can::message_t&) { calls++; }, 1);
+
+    // Exercise
+    for (int i = 0; i < 5; i++) {
+      zero(numbered(i));
+      one(numbered(i));
+    }
+
+    // Verify
+    expect(that % 10 == calls);
+    expect(that % 0 == zero.suppressed());
+    expect(that % 0 == one.suppressed());
+  };
+
+  "can_rate_limiter enforces a minimum interval"_test = []() {
+    // Setup
+    mock_clock clock;
+    clock.m_ticks = 5'000'000;
+    std::vector<int> passed;
+    can_rate_limiter ten_hertz(
+      [&passed](const can::message_t& p_message) {
+        passed.push_back(p_message.payload[0]);
+      },
+      clock,
+      100ms);
+
+    // Exercise
+    // 1 kHz for 300ms
+    for (int i = 0; i < 300; i++) {
+      clock.m_ticks += 1'000;
+      ten_hertz(numbered(i));
+    }
+
+    // Verify
+    expect(passed == std::vector<int>{ 0, 100, 200 });
+    expect(that % 297 == ten_hertz.suppressed());
+  };
+
+  "can_rate_limiter passes irregular frames after the interval"_test = []() {
+    // Setup
+    mock_clock clock;
+    int calls = 0;
+    can_rate_limiter limiter(
+      [&calls](const can::message_t&) { calls++; }, clock, 10ms);
+
+    // Exercise + Verify
+    limiter(numbered(0));
+    expect(that % 1 == calls);
+    clock.m_ticks = 9'999;
+    limiter(numbered(1));
+    expect(that % 1 == calls);
+    clock.m_ticks = 10'000;
+    limiter(numbered(2));
+    expect(that % 2 == calls);
+    clock.m_ticks = 50'000;
+    limiter(numbered(3));
+    expect(that % 3 == calls);
+    expect(that % 1 == limiter.suppressed());
+  };
+};
+}  // namespace hal
@@ -0,0 +1,213 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/can_traffic_generator.hpp>
+
+#include <algorithm>
+#include <array>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <libhal-canrouter/can_router.hpp>
+#include <libhal-canrouter/can_virtual_bus.hpp>
+
+#include <boost/ut.hpp>
+
+namespace hal {
+namespace {
+using namespace std::chrono_literals;
+
+std::array<can_traffic_stream, 4> small_profile()
+{
+  return { {
+    { .id = 0x100, .period = 10ms, .jitter = 1ms },
+    { .id = 0x200,
+      .period = 100ms,
+      .length = 4,
+      .pattern = can_payload_pattern::fixed,
+      .burst = 3,
+      .payload = { 0xAA, 0xBB } },
+    { .id = 0x300,
+      .period = 20ms,
+      .length = 2,
+      .pattern = can_payload_pattern::random_walk,
+      .payload = { 0x00, 0x80 } },
+    { .id = 0x18FF'0001, .period = 1s, .pattern = can_payload_pattern::random },
+  } };
+}
+
+bool same_frame(const can_traffic_generator::frame& p_a,
+                const can_traffic_generator::frame& p_b)
+{
+  return p_a.time == p_b.time && p_a.message.id == p_b.message.id &&
+         p_a.message.length == p_b.message.length &&
+         p_a.message.payload == p_b.message.payload;
+}
+}  // namespace
+
+void can_traffic_generator_test()
+{
+  using namespace boost::ut;
+
+  "can_traffic_generator is deterministic for a seed"_test = []() {
+    // Setup
+    auto profile_a = small_profile();
+    auto profile_b = small_profile();
+    auto profile_c = small_profile();
+    can_traffic_generator a(profile_a, 7);
+    can_traffic_generator b(profile_b, 7);
+    can_traffic_generator c(profile_c, 8);
+    std::vector<can_traffic_generator::frame> frames_a(10'000);
+    std::vector<can_traffic_generator::frame> frames_b(10'000);
+    std::vector<can_traffic_generator::frame> frames_c(10'000);
+
+    // Exercise
+    expect(that % 10'000 == a.generate(frames_a));
+    expect(that % 10'000 == b.generate(frames_b));
+    expect(that % 10'000 == c.generate(frames_c));
+
+    // Verify
+    expect(std::equal(
+      frames_a.begin(), frames_a.end(), frames_b.begin(), same_frame));
+    expect(!std::equal(
+      frames_a.begin(), frames_a.end(), frames_c.begin(), same_frame));
+  };
+
+  "can_traffic_generator follows periods, jitter and bursts"_test = []() {
+    // Setup
+    auto profile = small_profile();
+    can_traffic_generator traffic(profile, 3);
+    std::map<hal::can::id_t, std::vector<can_traffic_generator::frame>> by_id;
+    hal::time_duration last{};
+    bool ordered = true;
+
+    // Exercise
+    const auto count =
+      traffic.generate_until(10s, [&](const can_traffic_generator::frame& p) {
+        ordered = ordered && p.time >= last;
+        last = p.time;
+        by_id[p.message.id].push_back(p);
+      });
+
+    // Verify
+    expect(ordered);
+    expect(traffic.next_time() > 10s);
+    expect(that % 1000 <= by_id[0x100].size() && by_id[0x100].size() <= 1001);
+    expect(that % 300 <= by_id[0x200].size() && by_id[0x200].size() <= 303);
+    expect(that % 500 <= by_id[0x300].size() && by_id[0x300].size() <= 501);
+    expect(that % 10 <= by_id[0x18FF'0001].size() &&
+           by_id[0x18FF'0001].size() <= 11);
+    std::size_t total = 0;
+    for (const auto& [id, frames] : by_id) {
+      total += frames.size();
+    }
+    expect(that % count == total);
+
+    // 10ms period with up to 1ms of jitter
+    const auto& fast = by_id[0x100];
+    for (std::size_t i = 1; i < fast.size(); i++) {
+      const auto gap = fast[i].time - fast[i - 1].time;
+      expect(gap > 9ms && gap < 11ms) << "gap" << gap.count();
+      const auto expected =
+        static_cast<hal::byte>(fast[i - 1].message.payload[0] + 1);
+      expect(that % expected == fast[i].message.payload[0]);
+    }
+
+    // Bursts of 3 frames with a fixed payload
+    const auto& burst = by_id[0x200];
+    for (std::size_t i = 0; i + 2 < burst.size(); i += 3) {
+      expect(burst[i].time == burst[i + 2].time);
+      expect(that % 4 == burst[i].message.length);
+      expect(that % 0xAA == burst[i].message.payload[0]);
+      expect(that % 0xBB == burst[i].message.payload[1]);
+    }
+
+    // Small steps around the starting value
+    const auto& walk = by_id[0x300];
+    int drift = 0;
+    for (std::size_t i = 1; i < walk.size(); i++) {
+      auto value = [](const can_traffic_generator::frame& p_frame) {
+        return p_frame.message.payload[0] | p_frame.message.payload[1] << 8;
+      };
+      const auto step = value(walk[i]) - value(walk[i - 1]);
+      expect(step >= -3 && step <= 3) << "step" << step;
+      drift += step;
+    }
+    // Symmetric steps, so 500 of them stay near the start. Steps biased by
+    // half a unit would drift by about 250.
+    expect(drift > -150 && drift < 150) << "drift" << drift;
+  };
+
+  "can_make_vehicle_profile builds a realistic mix"_test = []() {
+    // Setup
+    std::array<can_traffic_stream, 64> profile;
+
+    // Exercise
+    can_make_vehicle_profile(profile, 11, 0.25f);
+
+    // Verify
+    std::set<hal::can::id_t> ids;
+    std::size_t extended = 0;
+    std::size_t ten_ms = 0;
+    for (const auto& stream : profile) {
+      ids.insert(stream.id);
+      extended += stream.id > 0x7FF;
+      ten_ms += stream.period == 10ms;
+      expect(stream.length >= 1 && stream.length <= 8);
+      expect(stream.jitter == stream.period / 50);
+    }
+    expect(that % 64 == ids.size());
+    expect(that % 16 == extended);
+    expect(ten_ms >= 8);
+    // Faster periods go to higher priority IDs
+    expect(profile[0].period == 10ms);
+    expect(profile[47].period == 1s);
+  };
+
+  "can_traffic_generator drives a virtual bus"_test = []() {
+    // Setup
+    std::array<can_traffic_stream, 16> profile;
+    can_make_vehicle_profile(profile, 5);
+    can_virtual_bus bus(500.0e3f);
+    auto sender = bus.attach();
+    auto receiver = bus.attach();
+    can_router router(receiver);
+    std::size_t received = 0;
+    auto tap = router.add_tap(
+      [&received](const can::message_t&, can_router::direction) {
+        received++;
+      });
+    can_traffic_generator traffic(profile, 5);
+    std::size_t generated = 0;
+
+    // Exercise
+    while (bus.now() < 1s) {
+      generated +=
+        traffic.generate_until(bus.now(), [&sender](const auto& p_frame) {
+          static_cast<void>(sender.send(p_frame.message));
+        });
+      if (!bus.step()) {
+        bus.run_for(std::min<hal::time_duration>(traffic.next_time(), 1s) -
+                    bus.now());
+      }
+    }
+    bus.run_until_idle();
+
+    // Verify
+    expect(generated > 100);
+    expect(that % generated == received);
+  };
+};
+}  // namespace hal
@@ -0,0 +1,190 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/can_virtual_bus.hpp>
+
+#include <vector>
+
+#include <libhal-canrouter/can_bus_load.hpp>
+#include <libhal-canrouter/can_router.hpp>
+
+#include <boost/ut.hpp>
+
+namespace hal {
+void can_virtual_bus_test()
+{
+  using namespace boost::ut;
+  using namespace std::chrono_literals;
+
+  "can_virtual_bus delivers frames to every other node"_test = []() {
+    // Setup
+    can_virtual_bus bus(500.0e3f);
+    auto first = bus.attach();
+    auto second = bus.attach();
+    auto third = bus.attach();
+    can_router first_router(first);
+    can_router second_router(second);
+    can_router third_router(third);
+    std::vector<int> calls;
+    auto first_route =
+      first_router.add_message_callback(0x100, [&calls](const can::message_t&) {
+        calls.push_back(1);
+      });
+    auto second_route = second_router.add_message_callback(
+      0x100, [&calls](const can::message_t&) { calls.push_back(2); });
+    auto third_route =
+      third_router.add_message_callback(0x100, [&calls](const can::message_t&) {
+        calls.push_back(3);
+      });
+    const can::message_t message{ .id = 0x100,
+                                  .payload = { 1, 2 },
+                                  .length = 2 };
+
+    // Exercise
+    expect(bool{ second_router.bus().send(message) });
+    expect(that % 1 == second.pending());
+    expect(calls.empty());
+    expect(bus.step());
+
+    // Verify
+    expect(calls == std::vector<int>{ 1, 3 });
+    expect(that % 0 == second.pending());
+    expect(that % 1 == second.transmitted());
+    expect(that % 1 == bus.frames());
+    // 2us bit time
+    const auto expected = can_frame_bits(message) * 2'000;
+    expect(that % expected == bus.now().count());
+    expect(that % expected == bus.clock().uptime().ticks);
+    expect(!bus.step());
+    expect(that % expected == bus.now().count());
+  };
+
+  "can_virtual_bus arbitrates on the identifier"_test = []() {
+    // Setup
+    can_virtual_bus bus(1.0e6f);
+    auto a = bus.attach();
+    auto b = bus.attach();
+    auto c = bus.attach();
+    auto listener = bus.attach();
+    std::vector<can::message_t> order;
+    listener.on_receive([&order](const can::message_t& p_message) {
+      order.push_back(p_message);
+    });
+
+    // Exercise
+    // Extended 0x08000000 has base ID 0x200, so it loses to standard 0x200
+    // data frames but beats standard 0x201.
+    expect(bool{ a.send({ .id = 0x201 }) });
+    expect(bool{ a.send({ .id = 0x200, .is_remote_request = true }) });
+    expect(bool{ b.send({ .id = 0x0800'0000 }) });
+    expect(bool{ b.send({ .id = 0x0800'0001 }) });
+    expect(bool{ c.send({ .id = 0x200 }) });
+    expect(bool{ c.send({ .id = 0x010 }) });
+    expect(that % 6 == bus.run_until_idle());
+
+    // Verify
+    expect(that % 6 == order.size());
+    const std::vector<std::pair<hal::can::id_t, bool>> expected = {
+      { 0x010, false },       { 0x200, false },       { 0x200, true },
+      { 0x0800'0000, false }, { 0x0800'0001, false }, { 0x201, false },
+    };
+    for (std::size_t i = 0; i < order.size(); i++) {
+      expect(that % expected[i].first == order[i].id);
+      expect(expected[i].second == order[i].is_remote_request);
+    }
+    expect(that % 2 == a.transmitted());
+    expect(that % 2 == c.transmitted());
+    expect(that % 4 == a.lost_arbitration());
+  };
+
+  "can_virtual_bus models timing and mailbox limits"_test = []() {
+    // Setup
+    can_virtual_bus bus(500.0e3f);
+    auto sender = bus.attach();
+    auto receiver = bus.attach();
+    std::vector<std::int64_t> arrivals;
+    receiver.on_receive([&arrivals, &bus](const can::message_t&) {
+      arrivals.push_back(bus.now().count());
+    });
+    const can::message_t full{ .id = 0x100, .length = 8 };
+    const auto frame_time = can_frame_bits(full) * 2'000;
+
+    // Exercise
+    for (std::size_t i = 0; i < can_virtual_bus::tx_mailboxes; i++) {
+      expect(bool{ sender.send(full) });
+    }
+    const bool overflowed = !sender.send(full);
+    // Only the frames starting in the first 3 frame times are sent
+    const auto sent = bus.run_for(hal::time_duration(frame_time * 3 - 1));
+
+    // Verify
+    expect(overflowed);
+    expect(that % 3 == sent);
+    expect(that % 3 == arrivals.size());
+    expect(that % frame_time == arrivals[0]);
+    expect(that % frame_time * 3 == arrivals[2]);
+
+    // Exercise
+    // An idle bus still advances time
+    bus.run_until_idle();
+    const auto busy_until = bus.now();
+    bus.run_for(1ms);
+
+    // Verify
+    expect(that % can_virtual_bus::tx_mailboxes == bus.frames());
+    expect(that % (busy_until + 1ms).count() == bus.now().count());
+    expect(that % busy_until.count() == bus.busy_time().count());
+  };
+
+  "can_virtual_bus nodes reply from their handlers"_test = []() {
+    // Setup
+    can_virtual_bus bus(500.0e3f);
+    auto tester = bus.attach();
+    auto ecu = bus.attach();
+    can_router tester_router(tester);
+    can_router ecu_router(ecu);
+    std::vector<std::int64_t> replies;
+    auto request_route = ecu_router.add_message_callback(
+      0x7E0, [&ecu_router](const can::message_t& p_message) {
+        auto reply = p_message;
+        reply.id = 0x7E8;
+        static_cast<void>(ecu_router.bus().send(reply));
+      });
+    auto reply_route = tester_router.add_message_callback(
+      0x7E8,
+      [&replies, &bus](const can::message_t&) {
+        replies.push_back(bus.now().count());
+      });
+
+    // Exercise
+    expect(bool{ tester_router.bus().send({ .id = 0x7E0, .length = 8 }) });
+    expect(that % 2 == bus.run_until_idle());
+
+    // Verify
+    expect(that % 1 == replies.size());
+    expect(that % 2 * can_frame_bits({ .id = 0x7E0, .length = 8 }) * 2'000 ==
+           replies[0]);
+  };
+
+  "can_virtual_bus rejects a mismatched baud rate"_test = []() {
+    // Setup
+    can_virtual_bus bus(500.0e3f);
+    auto node = bus.attach();
+
+    // Exercise + Verify
+    expect(bool{ node.configure({ .baud_rate = 500.0e3f }) });
+    expect(!node.configure({ .baud_rate = 250.0e3f }));
+  };
+};
+}  // namespace hal
@@ -0,0 +1,328 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/canopen.hpp>
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <vector>
+
+#include <boost/ut.hpp>
+
+#include "mocks.hpp"
+
+namespace hal {
+namespace {
+/// Minimal SDO server holding a single object, following CiA 301
+class sdo_server
+{
+public:
+  std::uint8_t m_node;
+  std::vector<hal::byte> m_object;
+  bool m_toggle = false;
+  std::size_t m_offset = 0;
+  bool m_corrupt_toggle = false;
+
+  can::message_t respond(const can::message_t& p_request)
+  {
+    std::array<hal::byte, 8> payload{};
+    const auto& request = p_request.payload;
+    const auto command = request[0];
+    std::copy_n(request.begin() + 1, 3, payload.begin() + 1);
+
+    switch (command >> 5) {
+      case 2:  // Initiate upload
+        m_offset = 0;
+        m_toggle = false;
+        if (m_object.size() <= 4) {
+          const auto unused = 4 - m_object.size();
+          payload[0] = static_cast<hal::byte>(0x43 | unused << 2);
+          std::copy(m_object.begin(), m_object.end(), payload.begin() + 4);
+        } else {
+          payload[0] = 0x41;
+          payload[4] = static_cast<hal::byte>(m_object.size());
+        }
+        break;
+      case 3: {  // Upload segment
+        const auto size = std::min<std::size_t>(7, m_object.size() - m_offset);
+        const bool last = m_offset + size == m_object.size();
+        const bool toggle = m_corrupt_toggle ? !m_toggle : m_toggle;
+        payload = {};
+        payload[0] = static_cast<hal::byte>((toggle ? 0x10 : 0) |
+                                            (7 - size) << 1 | (last ? 1 : 0));
+        std::copy_n(m_object.begin() + m_offset, size, payload.begin() + 1);
+        m_offset += size;
+        m_toggle = !m_toggle;
+        break;
+      }
+      case 1:  // Initiate download
+        m_offset = 0;
+        m_toggle = false;
+        m_object.clear();
+        if (command & 0x02) {
+          const auto size = 4 - ((command >> 2) & 0x03);
+          m_object.assign(request.begin() + 4, request.begin() + 4 + size);
+        }
+        payload[0] = 0x60;
+        break;
+      case 0: {  // Download segment
+        const auto size = 7 - ((command >> 1) & 0x07);
+        m_object.insert(
+          m_object.end(), request.begin() + 1, request.begin() + 1 + size);
+        payload = {};
+        payload[0] = static_cast<hal::byte>(0x20 | (command & 0x10));
+        break;
+      }
+      default:
+        payload[0] = 0x80;
+        payload[7] = 0x05;
+        payload[6] = 0x04;
+        payload[4] = 0x01;
+        break;
+    }
+
+    return { .id = 0x580u + m_node, .payload = payload, .length = 8 };
+  }
+};
+
+/// Answer SDO requests until the client stops sending
+void serve(can_router& p_router, mock_can& p_can, sdo_server& p_server)
+{
+  while (!p_can.m_sent.empty()) {
+    const auto request = p_can.m_sent.front();
+    p_can.m_sent.pop_front();
+    if (request.id == 0x600u + p_server.m_node && request.payload[0] != 0x80) {
+      p_router(p_server.respond(request));
+    }
+  }
+}
+}  // namespace
+
+void canopen_test()
+{
+  using namespace boost::ut;
+  using namespace std::chrono_literals;
+
+  "canopen_cob_id() combines function code and node ID"_test = []() {
+    expect(that % 0x185 == canopen_cob_id(canopen_function::tpdo1, 5));
+    expect(that % 0x60A == canopen_cob_id(canopen_function::sdo_request, 10));
+    expect(that % 0x77F == canopen_cob_id(canopen_function::heartbeat, 127));
+  };
+
+  "canopen_dispatcher routes PDO, EMCY and heartbeat by node"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    mock_clock clock;
+    std::array<canopen_dispatcher::node, 2> nodes;
+    canopen_dispatcher canopen(router, clock, 100ms, nodes);
+    std::vector<int> pdos;
+    std::vector<int> heartbeats;
+    canopen_emergency emergency{};
+
+    expect(bool{ canopen.attach(5) });
+    expect(bool{ canopen.attach(127) });
+    expect(bool{ canopen.on_pdo(5, 1, [&pdos](const can::message_t& p) {
+      pdos.push_back(10 + p.payload[0]);
+    }) });
+    expect(bool{ canopen.on_pdo(127, 4, [&pdos](const can::message_t& p) {
+      pdos.push_back(40 + p.payload[0]);
+    }) });
+    expect(bool{ canopen.on_emergency(
+      5, [&emergency](std::uint8_t, const canopen_emergency& p_emcy) {
+        emergency = p_emcy;
+      }) });
+    expect(bool{ canopen.on_heartbeat(
+      127, [&heartbeats](std::uint8_t p_node, canopen_nmt_state p_state) {
+        heartbeats.push_back(p_node);
+        heartbeats.push_back(static_cast<int>(p_state));
+      }) });
+
+    // Exercise
+    router({ .id = 0x185, .payload = { 1 }, .length = 1 });
+    router({ .id = 0x4FF, .payload = { 2 }, .length = 1 });
+    // TPDO2 of node 5 has no handler, node 6 is not attached
+    router({ .id = 0x285, .payload = { 3 }, .length = 1 });
+    router({ .id = 0x186, .payload = { 4 }, .length = 1 });
+    router({ .id = 0x085,
+             .payload = { 0x10, 0x81, 0x11, 1, 2, 3, 4, 5 },
+             .length = 8 });
+    router({ .id = 0x77F, .payload = { 0x85 }, .length = 1 });
+
+    // Verify
+    expect(pdos == std::vector<int>{ 11, 42 });
+    expect(that % 0x8110 == emergency.error_code);
+    expect(that % 0x11 == emergency.error_register);
+    expect(that % 5 == emergency.manufacturer_data[4]);
+    expect(heartbeats == std::vector<int>{ 127, 0x05 });
+    expect(canopen_nmt_state::operational == canopen.state(127));
+    expect(!canopen.state(5).has_value());
+  };
+
+  "canopen_dispatcher bounds its node table"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    mock_clock clock;
+    std::array<canopen_dispatcher::node, 2> nodes;
+    canopen_dispatcher canopen(router, clock, 100ms, nodes);
+
+    // Exercise + Verify
+    expect(!canopen.attach(0));
+    expect(!canopen.attach(128));
+    expect(bool{ canopen.attach(1) });
+    expect(bool{ canopen.attach(1) });
+    expect(bool{ canopen.attach(2) });
+    expect(!canopen.attach(3));
+    expect(!canopen.on_pdo(1, 5, can_router::noop));
+    expect(!canopen.on_pdo(3, 1, can_router::noop));
+    canopen.detach(1);
+    expect(bool{ canopen.attach(3) });
+  };
+
+  "canopen_dispatcher sends NMT commands"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    mock_clock clock;
+    std::array<canopen_dispatcher::node, 1> nodes;
+    canopen_dispatcher canopen(router, clock, 100ms, nodes);
+
+    // Exercise
+    expect(bool{ canopen.nmt(canopen_nmt_command::start, 5) });
+
+    // Verify
+    expect(that % 1 == can.m_sent.size());
+    expect(that % 0x000 == can.m_sent[0].id);
+    expect(that % 2 == can.m_sent[0].length);
+    expect(that % 0x01 == can.m_sent[0].payload[0]);
+    expect(that % 5 == can.m_sent[0].payload[1]);
+  };
+
+  "canopen_dispatcher SDO expedited and segmented transfers"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    mock_clock clock;
+    std::array<canopen_dispatcher::node, 1> nodes;
+    canopen_dispatcher canopen(router, clock, 100ms, nodes);
+    sdo_server server{ .m_node = 9, .m_object = { 0x11, 0x22, 0x33 } };
+    std::array<hal::byte, 32> buffer{};
+    std::vector<hal::byte> read;
+    auto result = canopen_sdo_abort::general;
+    auto on_done = [&read, &result](canopen_sdo_abort p_result,
+                                    std::span<const hal::byte> p_data) {
+      result = p_result;
+      read.assign(p_data.begin(), p_data.end());
+    };
+    expect(bool{ canopen.attach(9) });
+
+    // Exercise + Verify
+    // Expedited upload
+    expect(bool{ canopen.sdo_read(9, 0x1018, 1, buffer, on_done) });
+    expect(that % 0x609 == can.m_sent.front().id);
+    expect(that % 0x40 == can.m_sent.front().payload[0]);
+    expect(that % 0x18 == can.m_sent.front().payload[1]);
+    expect(that % 0x10 == can.m_sent.front().payload[2]);
+    expect(that % 0x01 == can.m_sent.front().payload[3]);
+    // Only one transfer per node at a time
+    expect(!canopen.sdo_read(9, 0x1018, 1, buffer, on_done));
+    serve(router, can, server);
+    expect(canopen_sdo_abort::none == result);
+    expect(read == server.m_object);
+
+    // Segmented download over three segments
+    std::vector<hal::byte> name(17);
+    for (std::size_t i = 0; i < name.size(); i++) {
+      name[i] = static_cast<hal::byte>('a' + i);
+    }
+    result = canopen_sdo_abort::general;
+    expect(bool{ canopen.sdo_write(9, 0x2000, 0, name, on_done) });
+    serve(router, can, server);
+    expect(canopen_sdo_abort::none == result);
+    expect(read.empty());
+    expect(server.m_object == name);
+
+    // Segmented upload of the same object
+    result = canopen_sdo_abort::general;
+    expect(bool{ canopen.sdo_read(9, 0x2000, 0, buffer, on_done) });
+    serve(router, can, server);
+    expect(canopen_sdo_abort::none == result);
+    expect(read == name);
+
+    // Expedited download
+    const std::array<hal::byte, 2> word = { 0xE8, 0x03 };
+    expect(bool{ canopen.sdo_write(9, 0x6040, 0, word, on_done) });
+    serve(router, can, server);
+    expect(canopen_sdo_abort::none == result);
+    expect(server.m_object == std::vector<hal::byte>{ 0xE8, 0x03 });
+  };
+
+  "canopen_dispatcher aborts failed SDO transfers"_test = []() {
+    // Setup
+    mock_can can;
+    can_router router(can);
+    mock_clock clock;
+    std::array<canopen_dispatcher::node, 1> nodes;
+    canopen_dispatcher canopen(router, clock, 100ms, nodes);
+    std::vector<hal::byte> long_object(20, 0xAA);
+    sdo_server server{ .m_node = 3, .m_object = long_object };
+    std::array<hal::byte, 8> small{};
+    auto result = canopen_sdo_abort::none;
+    auto on_done = [&result](canopen_sdo_abort p_result,
+                             std::span<const hal::byte>) {
+      result = p_result;
+    };
+    expect(bool{ canopen.attach(3) });
+
+    // Exercise + Verify
+    // Object does not fit in the buffer
+    expect(bool{ canopen.sdo_read(3, 0x2000, 0, small, on_done) });
+    serve(router, can, server);
+    expect(canopen_sdo_abort::out_of_memory == result);
+
+    // Server does not alternate the toggle bit
+    std::array<hal::byte, 32> buffer{};
+    server.m_corrupt_toggle = true;
+    expect(bool{ canopen.sdo_read(3, 0x2000, 0, buffer, on_done) });
+    serve(router, can, server);
+    expect(canopen_sdo_abort::toggle_bit == result);
+
+    // Server aborts
+    expect(bool{ canopen.sdo_read(3, 0x2000, 0, buffer, on_done) });
+    can.m_sent.clear();
+    router({ .id = 0x583,
+             .payload = { 0x80, 0x00, 0x20, 0x00, 0x00, 0x00, 0x02, 0x06 },
+             .length = 8 });
+    expect(that % 0x0602'0000 == static_cast<std::uint32_t>(result));
+    expect(can.m_sent.empty());
+
+    // Server never responds
+    result = canopen_sdo_abort::none;
+    clock.m_ticks = 1'000;
+    expect(bool{ canopen.sdo_read(3, 0x2000, 0, buffer, on_done) });
+    can.m_sent.clear();
+    clock.m_ticks = 100'999;
+    canopen.poll();
+    expect(canopen_sdo_abort::none == result);
+    clock.m_ticks = 101'000;
+    canopen.poll();
+    expect(canopen_sdo_abort::timeout == result);
+    expect(that % 1 == can.m_sent.size());
+    expect(that % 0x80 == can.m_sent.front().payload[0]);
+    expect(that % 0x05 == can.m_sent.front().payload[7]);
+  };
+};
+}  // namespace hal
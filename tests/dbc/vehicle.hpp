@@ -0,0 +1,343 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Generated from vehicle.dbc by dbc_codegen.py. Do not edit.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+
+#include <libhal-canrouter/can_multiplexer.hpp>
+#include <libhal-canrouter/can_router.hpp>
+#include <libhal-canrouter/can_signal.hpp>
+#include <libhal/can.hpp>
+
+namespace vehicle {
+/// EngineStatus
+struct engine_status_t
+{
+  static constexpr hal::can::id_t id = 0x100;
+  static constexpr std::uint8_t length = 8;
+
+  /// EngineSpeed [0, 16383.75] rpm
+  float engine_speed = 0.0f;
+  /// CoolantTemp [-40, 215] degC
+  float coolant_temp = 0.0f;
+  /// ThrottlePosition [0, 100] %
+  float throttle_position = 0.0f;
+  /// EngineRunning [0, 1]
+  bool engine_running = false;
+  /// Gear [0, 7]
+  std::uint8_t gear = 0;
+  /// Switch [0, 1]
+  bool switch_ = false;
+  /// Torque [-16384, 16383.5] Nm
+  float torque = 0.0f;
+
+  static constexpr auto can_fields()
+  {
+    return std::tuple{
+      hal::can_field{ &engine_status_t::engine_speed,
+                      { .start_bit = 0, .length = 16, .scale = 0.25f } },
+      hal::can_field{ &engine_status_t::coolant_temp,
+                      { .start_bit = 16, .length = 8, .offset = -40.0f } },
+      hal::can_field{ &engine_status_t::throttle_position,
+                      { .start_bit = 24, .length = 10, .scale = 0.1f } },
+      hal::can_field{ &engine_status_t::engine_running,
+                      { .start_bit = 34, .length = 1 } },
+      hal::can_field{ &engine_status_t::gear,
+                      { .start_bit = 36, .length = 3 } },
+      hal::can_field{ &engine_status_t::switch_,
+                      { .start_bit = 40, .length = 1 } },
+      hal::can_field{ &engine_status_t::torque,
+                      { .start_bit = 55,
+                        .length = 16,
+                        .byte_order = hal::can_byte_order::big_endian,
+                        .is_signed = true,
+                        .scale = 0.5f } },
+    };
+  }
+
+  static constexpr engine_status_t decode(
+    const hal::can::message_t& p_message)
+  {
+    return hal::can_decode<engine_status_t>(p_message);
+  }
+
+  [[nodiscard]] constexpr hal::can::message_t encode() const
+  {
+    return { .id = id,
+             .payload = hal::can_encode(*this),
+             .length = length };
+  }
+};
+
+/// WheelSpeed
+struct wheel_speed_t
+{
+  static constexpr hal::can::id_t id = 0x120;
+  static constexpr std::uint8_t length = 8;
+
+  /// FrontLeft [0, 655.35] km/h
+  float front_left = 0.0f;
+  /// FrontRight [0, 655.35] km/h
+  float front_right = 0.0f;
+  /// RearLeft [0, 655.35] km/h
+  float rear_left = 0.0f;
+  /// RearRight [0, 655.35] km/h
+  float rear_right = 0.0f;
+
+  static constexpr auto can_fields()
+  {
+    return std::tuple{
+      hal::can_field{ &wheel_speed_t::front_left,
+                      { .start_bit = 7,
+                        .length = 16,
+                        .byte_order = hal::can_byte_order::big_endian,
+                        .scale = 0.01f } },
+      hal::can_field{ &wheel_speed_t::front_right,
+                      { .start_bit = 23,
+                        .length = 16,
+                        .byte_order = hal::can_byte_order::big_endian,
+                        .scale = 0.01f } },
+      hal::can_field{ &wheel_speed_t::rear_left,
+                      { .start_bit = 39,
+                        .length = 16,
+                        .byte_order = hal::can_byte_order::big_endian,
+                        .scale = 0.01f } },
+      hal::can_field{ &wheel_speed_t::rear_right,
+                      { .start_bit = 55,
+                        .length = 16,
+                        .byte_order = hal::can_byte_order::big_endian,
+                        .scale = 0.01f } },
+    };
+  }
+
+  static constexpr wheel_speed_t decode(
+    const hal::can::message_t& p_message)
+  {
+    return hal::can_decode<wheel_speed_t>(p_message);
+  }
+
+  [[nodiscard]] constexpr hal::can::message_t encode() const
+  {
+    return { .id = id,
+             .payload = hal::can_encode(*this),
+             .length = length };
+  }
+};
+
+/// DiagnosticCounters
+struct diagnostic_counters_t
+{
+  static constexpr hal::can::id_t id = 0x18FEF1FE;
+  static constexpr std::uint8_t length = 4;
+  static constexpr std::uint8_t selector_byte = 0;
+
+  /// Mode [0, 255]
+  std::uint8_t mode = 0;
+
+  static constexpr auto can_fields()
+  {
+    return std::tuple{
+      hal::can_field{ &diagnostic_counters_t::mode,
+                      { .start_bit = 0, .length = 8 } },
+    };
+  }
+
+  static constexpr diagnostic_counters_t decode(
+    const hal::can::message_t& p_message)
+  {
+    return hal::can_decode<diagnostic_counters_t>(p_message);
+  }
+
+  [[nodiscard]] constexpr hal::can::message_t encode() const
+  {
+    return { .id = id,
+             .payload = hal::can_encode(*this),
+             .length = length };
+  }
+};
+
+/// DiagnosticCounters with Mode 0
+struct diagnostic_counters_m0_t
+{
+  static constexpr hal::can::id_t id = 0x18FEF1FE;
+  static constexpr std::uint8_t length = 4;
+  static constexpr std::uint8_t selector_byte = 0;
+  static constexpr std::uint8_t selector = 0;
+
+  /// Mode [0, 255]
+  std::uint8_t mode = selector;
+  /// Uptime [0, 16777215] s
+  std::uint32_t uptime = 0;
+
+  static constexpr auto can_fields()
+  {
+    return std::tuple{
+      hal::can_field{ &diagnostic_counters_m0_t::mode,
+                      { .start_bit = 0, .length = 8 } },
+      hal::can_field{ &diagnostic_counters_m0_t::uptime,
+                      { .start_bit = 8, .length = 24 } },
+    };
+  }
+
+  static constexpr diagnostic_counters_m0_t decode(
+    const hal::can::message_t& p_message)
+  {
+    return hal::can_decode<diagnostic_counters_m0_t>(p_message);
+  }
+
+  [[nodiscard]] constexpr hal::can::message_t encode() const
+  {
+    return { .id = id,
+             .payload = hal::can_encode(*this),
+             .length = length };
+  }
+};
+
+/// DiagnosticCounters with Mode 1
+struct diagnostic_counters_m1_t
+{
+  static constexpr hal::can::id_t id = 0x18FEF1FE;
+  static constexpr std::uint8_t length = 4;
+  static constexpr std::uint8_t selector_byte = 0;
+  static constexpr std::uint8_t selector = 1;
+
+  /// Mode [0, 255]
+  std::uint8_t mode = selector;
+  /// ErrorCount [0, 65535]
+  std::uint16_t error_count = 0;
+
+  static constexpr auto can_fields()
+  {
+    return std::tuple{
+      hal::can_field{ &diagnostic_counters_m1_t::mode,
+                      { .start_bit = 0, .length = 8 } },
+      hal::can_field{ &diagnostic_counters_m1_t::error_count,
+                      { .start_bit = 8, .length = 16 } },
+    };
+  }
+
+  static constexpr diagnostic_counters_m1_t decode(
+    const hal::can::message_t& p_message)
+  {
+    return hal::can_decode<diagnostic_counters_m1_t>(p_message);
+  }
+
+  [[nodiscard]] constexpr hal::can::message_t encode() const
+  {
+    return { .id = id,
+             .payload = hal::can_encode(*this),
+             .length = length };
+  }
+};
+
+/**
+ * @brief Register a typed route for every message that a handler accepts
+ *
+ * The handler is any object with `operator()` overloads taking the
+ * generated message types. Messages without a matching overload are not
+ * routed. Routes are removed when this object is destroyed.
+ *
+ * Multiplexed messages are routed through a can_multiplexer held by this
+ * object, so it cannot be moved. Each frame goes to the overload for its
+ * multiplexer value's type, or, if there is none, to the overload for the
+ * message's own type.
+ *
+ * @tparam Handler - overload set of message handlers
+ */
+template<typename Handler>
+class routes
+{
+public:
+  using route = std::optional<hal::can_router::route_item>;
+
+  /**
+   * @brief Register the routes
+   *
+   * @param p_router - router to register routes on
+   * @param p_handler - handler for decoded messages. Must outlive this
+   * object.
+   */
+  routes(hal::can_router& p_router, Handler& p_handler)
+    : m_engine_status(add<engine_status_t>(p_router, p_handler))
+    , m_wheel_speed(add<wheel_speed_t>(p_router, p_handler))
+    , m_diagnostic_counters(
+        add_multiplexed<diagnostic_counters_t,
+                        diagnostic_counters_m0_t,
+                        diagnostic_counters_m1_t>(
+          p_router, p_handler, m_diagnostic_counters_mux))
+  {
+  }
+
+  routes(routes& p_other) = delete;
+  routes& operator=(routes& p_other) = delete;
+
+private:
+  template<typename T>
+  static route add(hal::can_router& p_router, Handler& p_handler)
+  {
+    if constexpr (std::is_invocable_v<Handler&, const T&>) {
+      return p_router.add_typed_callback<T>(
+        T::id, [&p_handler](const T& p_message) { p_handler(p_message); });
+    } else {
+      return std::nullopt;
+    }
+  }
+
+  template<typename Message, typename... Pages, std::size_t N>
+  static route add_multiplexed(hal::can_router& p_router,
+                               Handler& p_handler,
+                               hal::can_multiplexer<N>& p_mux)
+  {
+    constexpr bool accepts_message =
+      std::is_invocable_v<Handler&, const Message&>;
+    if constexpr (accepts_message ||
+                  (std::is_invocable_v<Handler&, const Pages&> || ...)) {
+      (set_page<Pages>(p_mux, p_handler), ...);
+      if constexpr (accepts_message) {
+        p_mux.set_fallback([&p_handler](const hal::can::message_t& p_frame) {
+          p_handler(Message::decode(p_frame));
+        });
+      }
+      return p_router.add_message_callback(Message::id, std::ref(p_mux));
+    } else {
+      return std::nullopt;
+    }
+  }
+
+  template<typename Page, std::size_t N>
+  static void set_page(hal::can_multiplexer<N>& p_mux, Handler& p_handler)
+  {
+    if constexpr (std::is_invocable_v<Handler&, const Page&>) {
+      (void)p_mux.template set_typed_handler<Page>(
+        Page::selector,
+        [&p_handler](const Page& p_message) { p_handler(p_message); });
+    }
+  }
+
+  hal::can_multiplexer<2> m_diagnostic_counters_mux{
+    diagnostic_counters_t::selector_byte
+  };
+  route m_engine_status;
+  route m_wheel_speed;
+  route m_diagnostic_counters;
+};
+}  // namespace vehicle
@@ -14,9 +14,63 @@
 
 namespace hal {
 extern void can_router_test();
+extern void timer_wheel_test();
+extern void can_deadline_monitor_test();
+extern void can_bus_load_test();
+extern void can_flight_recorder_test();
+extern void can_capture_test();
+extern void can_signal_test();
+extern void dbc_codegen_test();
+extern void can_signal_batch_test();
+extern void can_multiplexer_test();
+extern void can_change_filter_test();
+extern void can_throttle_test();
+extern void can_fd_router_test();
+extern void can_acceptance_filter_test();
+extern void spsc_queue_test();
+extern void can_priority_dispatcher_test();
+extern void can_handler_budget_test();
+extern void can_latency_histogram_test();
+extern void can_correlator_test();
+extern void canopen_test();
+extern void can_liveness_monitor_test();
+extern void can_virtual_bus_test();
+extern void can_traffic_generator_test();
+extern void can_sharded_router_test();
+extern void can_diagnostics_test();
+#if defined(__linux__)
+extern void socketcan_test();
+#endif
 }  // namespace hal
 
 int main()
 {
   hal::can_router_test();
+  hal::timer_wheel_test();
+  hal::can_deadline_monitor_test();
+  hal::can_bus_load_test();
+  hal::can_flight_recorder_test();
+  hal::can_capture_test();
+  hal::can_signal_test();
+  hal::dbc_codegen_test();
+  hal::can_signal_batch_test();
+  hal::can_multiplexer_test();
+  hal::can_change_filter_test();
+  hal::can_throttle_test();
+  hal::can_fd_router_test();
+  hal::can_acceptance_filter_test();
+  hal::spsc_queue_test();
+  hal::can_priority_dispatcher_test();
+  hal::can_handler_budget_test();
+  hal::can_latency_histogram_test();
+  hal::can_correlator_test();
+  hal::canopen_test();
+  hal::can_liveness_monitor_test();
+  hal::can_virtual_bus_test();
+  hal::can_traffic_generator_test();
+  hal::can_sharded_router_test();
+  hal::can_diagnostics_test();
+#if defined(__linux__)
+  hal::socketcan_test();
+#endif
 }
\ No newline at end of file
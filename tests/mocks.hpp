@@ -0,0 +1,82 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <system_error>
+
+#include <libhal/can.hpp>
+#include <libhal/steady_clock.hpp>
+
+namespace hal {
+/// can driver that records what is sent and keeps the receive handler
+class mock_can : public hal::can
+{
+public:
+  /// The last message sent
+  message_t m_message{};
+  /// Every message sent, oldest first
+  std::deque<message_t> m_sent{};
+  /// The handler installed by on_receive()
+  hal::callback<handler> m_handler{};
+  /// When set, sends fail with this error and are not recorded
+  std::errc m_send_error{};
+
+private:
+  status driver_configure(const settings&) override
+  {
+    return success();
+  };
+
+  status driver_bus_on() override
+  {
+    return success();
+  }
+
+  result<send_t> driver_send(const message_t& p_message) override
+  {
+    if (m_send_error != std::errc{}) {
+      return hal::new_error(m_send_error);
+    }
+    m_message = p_message;
+    m_sent.push_back(p_message);
+    return send_t{};
+  };
+
+  void driver_on_receive(hal::callback<handler> p_handler) override
+  {
+    m_handler = p_handler;
+  }
+};
+
+class mock_clock : public hal::steady_clock
+{
+public:
+  // 1 MHz clock, so one tick is one microsecond
+  std::uint64_t m_ticks = 0;
+
+private:
+  frequency_t driver_frequency() override
+  {
+    return { .operating_frequency = 1'000'000.0f };
+  }
+
+  uptime_t driver_uptime() override
+  {
+    return { .ticks = m_ticks };
+  }
+};
+}  // namespace hal
@@ -0,0 +1,242 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/socketcan.hpp>
+
+#include <linux/can.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <libhal-canrouter/can_router.hpp>
+
+#include <boost/ut.hpp>
+
+namespace hal {
+namespace {
+/// Datagram socket pair standing in for a CAN interface. The driver gets one
+/// end and the test plays the bus on the other.
+struct loopback
+{
+  loopback()
+  {
+    std::array<int, 2> ends{};
+    static_cast<void>(
+      ::socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, ends.data()));
+    driver = ends[0];
+    bus = ends[1];
+  }
+
+  loopback(loopback& p_other) = delete;
+  loopback& operator=(loopback& p_other) = delete;
+
+  ~loopback()
+  {
+    ::close(bus);
+  }
+
+  void write(canid_t p_id, std::uint8_t p_length, hal::byte p_first = 0)
+  {
+    can_frame frame{};
+    frame.can_id = p_id;
+    frame.can_dlc = p_length;
+    frame.data[0] = p_first;
+    static_cast<void>(::send(bus, &frame, sizeof(frame), 0));
+  }
+
+  can_frame read()
+  {
+    can_frame frame{};
+    static_cast<void>(::recv(bus, &frame, sizeof(frame), 0));
+    return frame;
+  }
+
+  // Owned by the driver once handed to it
+  int driver = -1;
+  int bus = -1;
+};
+
+/// Wait for the receive thread to have handled a number of frames
+bool handled(const socketcan& p_can, std::uint64_t p_frames)
+{
+  using namespace std::chrono_literals;
+  const auto deadline = std::chrono::steady_clock::now() + 5s;
+  while (std::chrono::steady_clock::now() < deadline) {
+    const auto stats = p_can.stats();
+    if (stats.received + stats.dropped >= p_frames) {
+      return true;
+    }
+    std::this_thread::sleep_for(1ms);
+  }
+  return false;
+}
+}  // namespace
+
+void socketcan_test()
+{
+  using namespace boost::ut;
+
+  "socketcan reads queued frames in batches"_test = []() {
+    // Setup
+    loopback pair;
+    for (int i = 0; i < 100; i++) {
+      pair.write(0x120, 8, static_cast<hal::byte>(i));
+    }
+    pair.write(0x18FF'0001 | CAN_EFF_FLAG, 3);
+    pair.write(0x7FF | CAN_RTR_FLAG, 0);
+    pair.write(CAN_ERR_FLAG | 0x4, 8);
+    auto can = socketcan::create(pair.driver).value();
+    std::vector<can::message_t> received;
+    std::mutex received_lock;
+
+    // Exercise
+    // Starts the receive thread, which finds every frame already queued
+    can.on_receive([&](const can::message_t& p_message) {
+      std::lock_guard lock(received_lock);
+      received.push_back(p_message);
+    });
+    expect(handled(can, 103));
+
+    // Verify
+    std::lock_guard lock(received_lock);
+    const auto stats = can.stats();
+    expect(that % 102 == received.size());
+    for (int i = 0; i < 100; i++) {
+      expect(that % 0x120 == received[i].id);
+      expect(that % 8 == received[i].length);
+      expect(that % i == received[i].payload[0]);
+    }
+    expect(that % 0x18FF'0001 == received[100].id);
+    expect(that % 3 == received[100].length);
+    expect(!received[100].is_remote_request);
+    expect(that % 0x7FF == received[101].id);
+    expect(received[101].is_remote_request);
+    expect(that % 102 == stats.received);
+    expect(that % 1 == stats.dropped);
+    // 103 frames in batches of 32, one wake up for all of them
+    expect(that % 4 == stats.receive_calls);
+    expect(that % 1 == stats.wait_calls);
+  };
+
+  "socketcan receives frames sent while running"_test = []() {
+    // Setup
+    loopback pair;
+    auto can = socketcan::create(pair.driver).value();
+    can_router router(can);
+    std::atomic<int> calls = 0;
+    auto route = router.add_message_callback(
+      0x100, [&calls](const can::message_t&) { calls++; });
+
+    // Exercise
+    for (int i = 0; i < 10; i++) {
+      pair.write(0x100, 1);
+      expect(handled(can, i + 1));
+    }
+
+    // Verify
+    expect(that % 10 == calls.load());
+    expect(can.stats().wait_calls >= 10);
+  };
+
+  "socketcan sends standard, extended and remote frames"_test = []() {
+    // Setup
+    loopback pair;
+    auto can = socketcan::create(pair.driver).value();
+
+    // Exercise
+    expect(bool{ can.configure({ .baud_rate = 500.0e3f }) });
+    expect(bool{ can.bus_on() });
+    expect(bool{ can.send(
+      { .id = 0x123, .payload = { 0xAA, 0xBB }, .length = 2 }) });
+    expect(bool{ can.send({ .id = 0x1234'5678,
+                            .payload = { 1, 2, 3, 4, 5, 6, 7, 8 },
+                            .length = 9 }) });
+    expect(bool{ can.send({ .id = 0x456, .is_remote_request = true }) });
+    const auto standard = pair.read();
+    const auto extended = pair.read();
+    const auto remote = pair.read();
+
+    // Verify
+    expect(that % 0x123 == standard.can_id);
+    expect(that % 2 == standard.can_dlc);
+    expect(that % 0xAA == standard.data[0]);
+    expect(that % 0xBB == standard.data[1]);
+    expect(that % (0x1234'5678 | CAN_EFF_FLAG) == extended.can_id);
+    expect(that % 8 == extended.can_dlc);
+    expect(that % 8 == extended.data[7]);
+    expect(that % (0x456 | CAN_RTR_FLAG) == remote.can_id);
+    expect(that % 3 == can.stats().sent);
+  };
+
+  "socketcan handlers may install another handler"_test = []() {
+    // Setup
+    loopback pair;
+    auto can = socketcan::create(pair.driver).value();
+    std::atomic<int> first_calls = 0;
+    std::atomic<int> second_calls = 0;
+    auto second = [&second_calls](const can::message_t&) { second_calls++; };
+
+    // Exercise
+    can.on_receive([&](const can::message_t&) {
+      first_calls++;
+      can.on_receive(second);
+    });
+    pair.write(0x100, 1);
+    pair.write(0x100, 1);
+    pair.write(0x100, 1);
+
+    // Verify
+    expect(handled(can, 3));
+    expect(that % 1 == first_calls.load());
+    expect(that % 2 == second_calls.load());
+  };
+
+  "socketcan keeps receiving after being moved"_test = []() {
+    // Setup
+    loopback pair;
+    auto original = socketcan::create(pair.driver).value();
+    std::atomic<int> calls = 0;
+    original.on_receive([&calls](const can::message_t&) { calls++; });
+    pair.write(0x100, 1);
+    expect(handled(original, 1));
+
+    // Exercise
+    socketcan moved(std::move(original));
+    pair.write(0x100, 1);
+
+    // Verify
+    expect(handled(moved, 2));
+    expect(that % 2 == calls.load());
+  };
+
+  "socketcan::create() reports a socket it cannot wait on"_test = []() {
+    // Exercise + Verify
+    expect(!socketcan::create(-1));
+  };
+
+  "socketcan_open() rejects bad interface names"_test = []() {
+    // Exercise + Verify
+    expect(!socketcan_open(""));
+    expect(!socketcan_open("name_longer_than_ifnamsiz"));
+    expect(!socketcan_open("nocan9"));
+  };
+};
+}  // namespace hal
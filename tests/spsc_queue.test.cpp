@@ -0,0 +1,126 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/spsc_queue.hpp>
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <boost/ut.hpp>
+
+namespace hal {
+void spsc_queue_test()
+{
+  using namespace boost::ut;
+
+  "spsc_queue is first in first out"_test = []() {
+    // Setup
+    spsc_queue<int, 4> queue;
+    int value = 0;
+
+    // Exercise + Verify
+    expect(queue.empty());
+    expect(!queue.pop(value));
+    expect(queue.push(1));
+    expect(queue.push(2));
+    expect(queue.pop(value));
+    expect(that % 1 == value);
+    expect(queue.push(3));
+    expect(queue.push(4));
+    expect(queue.push(5));
+    expect(!queue.push(6));
+    expect(that % 4 == queue.size());
+    expect(that % 4 == queue.high_water());
+    for (int expected = 2; expected <= 5; expected++) {
+      expect(queue.pop(value));
+      expect(that % expected == value);
+    }
+    expect(queue.empty());
+  };
+
+  "spsc_queue visits queued elements in order"_test = []() {
+    // Setup
+    spsc_queue<int, 4> queue;
+    int value = 0;
+    expect(queue.push(1));
+    expect(queue.push(2));
+    expect(queue.pop(value));
+    expect(queue.push(3));
+    expect(queue.push(4));
+    expect(queue.push(5));
+    std::vector<int> visited;
+
+    // Exercise
+    queue.visit([&visited](int& p_value) {
+      visited.push_back(p_value);
+      p_value *= 10;
+    });
+
+    // Verify
+    expect(visited == std::vector<int>{ 2, 3, 4, 5 });
+    for (int expected = 20; expected <= 50; expected += 10) {
+      expect(queue.pop(value));
+      expect(that % expected == value);
+    }
+  };
+
+  "spsc_queue wraps its indexes"_test = []() {
+    // Setup
+    spsc_queue<std::uint32_t, 2> queue;
+    std::uint32_t value = 0;
+    int mismatches = 0;
+
+    // Exercise
+    for (std::uint32_t i = 0; i < 100'000; i++) {
+      static_cast<void>(queue.push(i));
+      static_cast<void>(queue.pop(value));
+      mismatches += value != i;
+    }
+
+    // Verify
+    expect(that % 0 == mismatches);
+    expect(queue.empty());
+  };
+
+  "spsc_queue passes every element between threads in order"_test = []() {
+    // Setup
+    constexpr std::uint32_t count = 200'000;
+    spsc_queue<std::uint32_t, 64> queue;
+    std::uint32_t mismatches = 0;
+
+    // Exercise
+    std::thread consumer([&queue, &mismatches]() {
+      std::uint32_t expected = 0;
+      std::uint32_t value = 0;
+      while (expected < count) {
+        if (queue.pop(value)) {
+          mismatches += value != expected;
+          expected++;
+        }
+      }
+    });
+    for (std::uint32_t i = 0; i < count;) {
+      if (queue.push(i)) {
+        i++;
+      }
+    }
+    consumer.join();
+
+    // Verify
+    expect(that % 0 == mismatches);
+    expect(queue.empty());
+  };
+};
+}  // namespace hal
@@ -0,0 +1,181 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libhal-canrouter/timer_wheel.hpp>
+
+#include <array>
+#include <random>
+
+#include <boost/ut.hpp>
+
+namespace hal {
+namespace {
+struct test_timer : public timer_wheel::timer
+{
+  std::uint64_t fired_at = 0;
+  int fire_count = 0;
+};
+}  // namespace
+
+void timer_wheel_test()
+{
+  using namespace boost::ut;
+
+  "timer_wheel::arm() + advance()"_test = []() {
+    // Setup
+    timer_wheel wheel(100);
+    test_timer timer;
+    int counter = 0;
+
+    // Exercise
+    wheel.arm(timer, 105);
+    wheel.advance(104, [&counter](timer_wheel::timer&) { counter++; });
+
+    // Verify
+    expect(that % 0 == counter);
+    expect(timer.pending());
+    expect(that % 1 == wheel.size());
+
+    // Exercise
+    wheel.advance(105, [&counter](timer_wheel::timer&) { counter++; });
+
+    // Verify
+    expect(that % 1 == counter);
+    expect(!timer.pending());
+    expect(that % 0 == wheel.size());
+  };
+
+  "timer_wheel::arm() re-arm moves deadline"_test = []() {
+    // Setup
+    timer_wheel wheel;
+    test_timer timer;
+    int counter = 0;
+    wheel.arm(timer, 10);
+
+    // Exercise
+    wheel.advance(9, [&counter](timer_wheel::timer&) { counter++; });
+    wheel.arm(timer, 5000);
+    wheel.advance(4999, [&counter](timer_wheel::timer&) { counter++; });
+
+    // Verify
+    expect(that % 0 == counter);
+    expect(that % 1 == wheel.size());
+
+    // Exercise
+    wheel.advance(5000, [&counter](timer_wheel::timer&) { counter++; });
+
+    // Verify
+    expect(that % 1 == counter);
+  };
+
+  "timer_wheel::cancel()"_test = []() {
+    // Setup
+    timer_wheel wheel;
+    test_timer timer;
+    int counter = 0;
+    wheel.arm(timer, 70);
+
+    // Exercise
+    wheel.cancel(timer);
+    wheel.cancel(timer);
+    wheel.advance(200, [&counter](timer_wheel::timer&) { counter++; });
+
+    // Verify
+    expect(that % 0 == counter);
+    expect(!timer.pending());
+    expect(that % 0 == wheel.size());
+  };
+
+  "timer_wheel::advance() fires every timer exactly on time"_test = []() {
+    // Setup
+    std::mt19937_64 rng(1234);
+    timer_wheel wheel(7);
+    std::array<test_timer, 500> timers{};
+    std::array<std::uint64_t, timers.size()> expected{};
+
+    for (std::size_t i = 0; i < timers.size(); i++) {
+      // Cover every level of the wheel and beyond its span
+      const auto range = (i % 5 == 4) ? timer_wheel::max_span * 3
+                                      : (std::uint64_t{ 1 } << (6 * (i % 5)));
+      expected[i] = 7 + 1 + (rng() % range);
+      wheel.arm(timers[i], expected[i]);
+    }
+
+    // Exercise
+    std::uint64_t now = 7;
+    bool early = false;
+    while (wheel.size() > 0) {
+      now += 1 + (rng() % 50000);
+      wheel.advance(now, [now, &early](timer_wheel::timer& p_timer) {
+        auto& timer = static_cast<test_timer&>(p_timer);
+        early = early || (now < p_timer.expiry());
+        timer.fired_at = now;
+        timer.fire_count++;
+      });
+    }
+
+    // Verify
+    expect(!early);
+    for (std::size_t i = 0; i < timers.size(); i++) {
+      expect(that % 1 == timers[i].fire_count);
+      // Must fire during the advance() call that first reached its expiry
+      expect(timers[i].fired_at >= expected[i]);
+      expect(timers[i].fired_at - expected[i] <= 50000);
+    }
+  };
+
+  "timer_wheel::advance() tick by tick"_test = []() {
+    // Setup
+    timer_wheel wheel;
+    std::array<test_timer, 64> timers{};
+    for (std::size_t i = 0; i < timers.size(); i++) {
+      wheel.arm(timers[i], (i * 97) + 1);
+    }
+
+    // Exercise
+    for (std::uint64_t tick = 0; tick < 64 * 97 + 2; tick++) {
+      wheel.advance(tick, [tick](timer_wheel::timer& p_timer) {
+        auto& timer = static_cast<test_timer&>(p_timer);
+        timer.fired_at = tick;
+        timer.fire_count++;
+      });
+    }
+
+    // Verify
+    for (std::size_t i = 0; i < timers.size(); i++) {
+      expect(that % 1 == timers[i].fire_count);
+      expect(that % ((i * 97) + 1) == timers[i].fired_at);
+    }
+  };
+
+  "timer_wheel::advance() callback can re-arm"_test = []() {
+    // Setup
+    timer_wheel wheel;
+    test_timer timer;
+    wheel.arm(timer, 3);
+
+    // Exercise
+    for (std::uint64_t tick = 0; tick <= 30; tick++) {
+      wheel.advance(tick, [&wheel, tick](timer_wheel::timer& p_timer) {
+        static_cast<test_timer&>(p_timer).fire_count++;
+        wheel.arm(p_timer, tick + 3);
+      });
+    }
+
+    // Verify
+    expect(that % 10 == timer.fire_count);
+    expect(timer.pending());
+  };
+};
+}  // namespace hal
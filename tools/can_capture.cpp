@@ -0,0 +1,242 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <libhal-canrouter/can_capture.hpp>
+#include <libhal-canrouter/can_router.hpp>
+
+#include "mapped_file.hpp"
+
+namespace {
+constexpr std::uint32_t candump_tick_frequency = 1'000'000;
+
+/// can driver that discards everything, used to replay into a can_router
+class null_can : public hal::can
+{
+private:
+  hal::status driver_configure(const settings&) override
+  {
+    return hal::success();
+  }
+
+  hal::status driver_bus_on() override
+  {
+    return hal::success();
+  }
+
+  hal::result<send_t> driver_send(const message_t&) override
+  {
+    return send_t{};
+  }
+
+  void driver_on_receive(hal::callback<handler>) override
+  {
+  }
+};
+
+int usage()
+{
+  std::fputs("usage:\n"
+             "  can_capture from-candump <input.log> <output.hcap>\n"
+             "  can_capture to-candump <input.hcap> <output.log>\n"
+             "  can_capture replay <input.hcap>\n",
+             stderr);
+  return 2;
+}
+
+int from_candump(const char* p_input, const char* p_output)
+{
+  mapped_file input(p_input);
+  if (!input.valid()) {
+    std::fprintf(stderr, "unable to map '%s'\n", p_input);
+    return 1;
+  }
+
+  std::FILE* output = std::fopen(p_output, "wb");
+  if (!output) {
+    std::fprintf(stderr, "unable to create '%s'\n", p_output);
+    return 1;
+  }
+
+  std::vector<hal::byte> buffer(1 << 16);
+  auto writer = hal::can_capture_writer::create(
+    buffer,
+    candump_tick_frequency,
+    [output](std::span<const hal::byte> p_data) -> hal::status {
+      if (std::fwrite(p_data.data(), 1, p_data.size(), output) !=
+          p_data.size()) {
+        return hal::new_error(std::errc::io_error);
+      }
+      return hal::success();
+    });
+  if (!writer) {
+    std::fclose(output);
+    return 1;
+  }
+
+  // Bus indexes are assigned in order of each interface's first appearance
+  std::vector<std::string> interfaces;
+  std::string_view text(reinterpret_cast<const char*>(input.bytes().data()),
+                        input.bytes().size());
+  std::size_t skipped = 0;
+
+  while (!text.empty()) {
+    const auto end = std::min(text.find('\n'), text.size());
+    const auto line = text.substr(0, end);
+    text.remove_prefix(std::min(end + 1, text.size()));
+
+    std::string_view interface;
+    auto record = hal::parse_candump(line, candump_tick_frequency, &interface);
+    if (!record) {
+      skipped += !line.empty();
+      continue;
+    }
+
+    std::size_t bus = 0;
+    while (bus < interfaces.size() && interfaces[bus] != interface) {
+      bus++;
+    }
+    if (bus == interfaces.size()) {
+      interfaces.emplace_back(interface);
+    }
+    record->bus = static_cast<std::uint8_t>(bus);
+
+    if (!writer.value().write(*record)) {
+      std::fputs("write failed\n", stderr);
+      std::fclose(output);
+      return 1;
+    }
+  }
+
+  const bool flushed = bool{ writer.value().flush() };
+  std::fclose(output);
+
+  for (std::size_t bus = 0; bus < interfaces.size(); bus++) {
+    std::fprintf(stderr, "bus %zu: %s\n", bus, interfaces[bus].c_str());
+  }
+  std::fprintf(stderr,
+               "%llu frames written, %zu lines skipped\n",
+               static_cast<unsigned long long>(writer.value().records()),
+               skipped);
+  return flushed ? 0 : 1;
+}
+
+int to_candump(const char* p_input, const char* p_output)
+{
+  mapped_file input(p_input);
+  if (!input.valid()) {
+    std::fprintf(stderr, "unable to map '%s'\n", p_input);
+    return 1;
+  }
+
+  auto reader = hal::can_capture_reader::create(input.bytes());
+  if (!reader) {
+    std::fprintf(stderr, "'%s' is not a capture file\n", p_input);
+    return 1;
+  }
+
+  std::FILE* output = std::fopen(p_output, "w");
+  if (!output) {
+    std::fprintf(stderr, "unable to create '%s'\n", p_output);
+    return 1;
+  }
+
+  const auto frequency = reader.value().tick_frequency();
+  std::array<char, 128> line{};
+  std::array<char, 8> interface{};
+
+  reader.value().for_each([&](const hal::can_capture_record& p_record) {
+    const auto length = std::snprintf(
+      interface.data(), interface.size(), "can%u", unsigned{ p_record.bus });
+    const auto text = hal::format_candump(
+      p_record,
+      std::string_view(interface.data(), static_cast<std::size_t>(length)),
+      frequency,
+      line);
+    std::fwrite(text.data(), 1, text.size(), output);
+    std::fputc('\n', output);
+  });
+
+  std::fclose(output);
+
+  if (reader.value().truncated()) {
+    std::fputs("warning: capture ends with a truncated record\n", stderr);
+  }
+  return 0;
+}
+
+int replay(const char* p_input)
+{
+  mapped_file input(p_input);
+  if (!input.valid()) {
+    std::fprintf(stderr, "unable to map '%s'\n", p_input);
+    return 1;
+  }
+
+  auto reader = hal::can_capture_reader::create(input.bytes());
+  if (!reader) {
+    std::fprintf(stderr, "'%s' is not a capture file\n", p_input);
+    return 1;
+  }
+
+  null_can bus;
+  hal::can_router router(bus);
+  std::uint64_t routed = 0;
+  auto route = router.add_message_callback(
+    0x100, [&routed](const hal::can::message_t&) { routed++; });
+
+  const auto start = std::chrono::steady_clock::now();
+  const auto frames = reader.value().for_each(
+    [&router](const hal::can_capture_record& p_record) {
+      router(p_record.message);
+    });
+  const auto stop = std::chrono::steady_clock::now();
+
+  const auto seconds = std::chrono::duration<double>(stop - start).count();
+  std::printf("%zu frames in %.3f s (%.2f Mframes/s), %llu routed to 0x100\n",
+              frames,
+              seconds,
+              seconds > 0.0 ? static_cast<double>(frames) / seconds / 1e6
+                            : 0.0,
+              static_cast<unsigned long long>(routed));
+  return 0;
+}
+}  // namespace
+
+int main(int p_argc, char** p_argv)
+{
+  if (p_argc < 2) {
+    return usage();
+  }
+
+  const std::string_view command = p_argv[1];
+
+  if (command == "from-candump" && p_argc == 4) {
+    return from_candump(p_argv[2], p_argv[3]);
+  }
+  if (command == "to-candump" && p_argc == 4) {
+    return to_candump(p_argv[2], p_argv[3]);
+  }
+  if (command == "replay" && p_argc == 3) {
+    return replay(p_argv[2]);
+  }
+
+  return usage();
+}
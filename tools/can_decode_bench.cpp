@@ -0,0 +1,252 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include <libhal-canrouter/can_router.hpp>
+#include <libhal-canrouter/can_signal.hpp>
+
+namespace {
+/// can driver that discards everything
+class null_can : public hal::can
+{
+private:
+  hal::status driver_configure(const settings&) override
+  {
+    return hal::success();
+  }
+
+  hal::status driver_bus_on() override
+  {
+    return hal::success();
+  }
+
+  hal::result<send_t> driver_send(const message_t&) override
+  {
+    return send_t{};
+  }
+
+  void driver_on_receive(hal::callback<handler>) override
+  {
+  }
+};
+
+/// Four 16 bit Intel signals with scale and offset
+struct wheel_speed_t
+{
+  float front_left = 0.0f;
+  float front_right = 0.0f;
+  float rear_left = 0.0f;
+  float rear_right = 0.0f;
+
+  static constexpr auto can_fields()
+  {
+    constexpr hal::can_signal speed{
+      .length = 16, .scale = 0.01f, .offset = -100.0f
+    };
+    auto at = [](hal::can_signal p_signal, std::uint8_t p_start) {
+      p_signal.start_bit = p_start;
+      return p_signal;
+    };
+
+    return std::tuple{
+      hal::can_field{ &wheel_speed_t::front_left, at(speed, 0) },
+      hal::can_field{ &wheel_speed_t::front_right, at(speed, 16) },
+      hal::can_field{ &wheel_speed_t::rear_left, at(speed, 32) },
+      hal::can_field{ &wheel_speed_t::rear_right, at(speed, 48) },
+    };
+  }
+};
+
+/// Motorola and Intel signals of mixed sign, width and member type
+struct powertrain_t
+{
+  std::int16_t torque = 0;
+  std::uint16_t rpm = 0;
+  std::uint8_t gear = 0;
+  bool brake = false;
+  float temperature = 0.0f;
+
+  static constexpr auto can_fields()
+  {
+    return std::tuple{
+      hal::can_field{ &powertrain_t::torque,
+                      { .start_bit = 7,
+                        .length = 12,
+                        .byte_order = hal::can_byte_order::big_endian,
+                        .is_signed = true } },
+      hal::can_field{ &powertrain_t::rpm,
+                      { .start_bit = 19,
+                        .length = 16,
+                        .byte_order = hal::can_byte_order::big_endian } },
+      hal::can_field{ &powertrain_t::gear, { .start_bit = 32, .length = 2 } },
+      hal::can_field{ &powertrain_t::brake, { .start_bit = 34, .length = 1 } },
+      hal::can_field{ &powertrain_t::temperature,
+                      { .start_bit = 40,
+                        .length = 8,
+                        .is_signed = true,
+                        .scale = 0.5f,
+                        .offset = 20.0f } },
+    };
+  }
+};
+
+wheel_speed_t unpack_wheel_speed(const std::array<hal::byte, 8>& p_payload)
+{
+  auto speed = [&p_payload](int p_byte) {
+    const auto raw = static_cast<std::uint16_t>(p_payload[p_byte] |
+                                                p_payload[p_byte + 1] << 8);
+    return static_cast<float>(raw) * 0.01f - 100.0f;
+  };
+  return { speed(0), speed(2), speed(4), speed(6) };
+}
+
+powertrain_t unpack_powertrain(const std::array<hal::byte, 8>& p_payload)
+{
+  powertrain_t result;
+
+  auto torque =
+    static_cast<std::int32_t>(p_payload[0] << 4 | p_payload[1] >> 4);
+  if (torque & 0x800) {
+    torque -= 0x1000;
+  }
+  result.torque = static_cast<std::int16_t>(torque);
+  result.rpm = static_cast<std::uint16_t>(
+    (p_payload[2] & 0x0F) << 12 | p_payload[3] << 4 | p_payload[4] >> 4);
+  result.gear = static_cast<std::uint8_t>(p_payload[4] & 0x03);
+  result.brake = p_payload[4] & 0x04;
+  result.temperature =
+    static_cast<float>(static_cast<std::int8_t>(p_payload[5])) * 0.5f + 20.0f;
+  return result;
+}
+
+float sum(const wheel_speed_t& p_speed)
+{
+  return p_speed.front_left + p_speed.front_right + p_speed.rear_left +
+         p_speed.rear_right;
+}
+
+float sum(const powertrain_t& p_powertrain)
+{
+  return static_cast<float>(p_powertrain.torque + p_powertrain.rpm +
+                            p_powertrain.gear + p_powertrain.brake) +
+         p_powertrain.temperature;
+}
+
+template<typename F>
+double measure(const std::vector<hal::can::message_t>& p_frames,
+               std::size_t p_rounds,
+               F&& p_function)
+{
+  const auto start = std::chrono::steady_clock::now();
+  for (std::size_t round = 0; round < p_rounds; round++) {
+    for (const auto& frame : p_frames) {
+      p_function(frame);
+    }
+  }
+  const auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(stop - start).count();
+}
+
+void report(const char* p_name, std::size_t p_frames, double p_seconds)
+{
+  std::printf("%-24s %8.2f ns/frame %10.1f Mframes/s\n",
+              p_name,
+              p_seconds * 1e9 / static_cast<double>(p_frames),
+              static_cast<double>(p_frames) / p_seconds / 1e6);
+}
+
+/// Times the hand written decoder against `can_decode()` directly and
+/// through router callbacks, for one message type.
+template<typename T, typename Unpack>
+void compare(const char* p_name,
+             Unpack p_unpack,
+             const std::vector<hal::can::message_t>& p_frames,
+             std::size_t p_rounds,
+             float& p_checksum)
+{
+  const auto total = p_frames.size() * p_rounds;
+  float checksum = 0.0f;
+  std::printf("%s\n", p_name);
+
+  auto seconds = measure(p_frames, p_rounds, [&](const auto& p_message) {
+    checksum += sum(p_unpack(p_message.payload));
+  });
+  report("  hand written", total, seconds);
+
+  seconds = measure(p_frames, p_rounds, [&](const auto& p_message) {
+    checksum += sum(hal::can_decode<T>(p_message));
+  });
+  report("  can_decode", total, seconds);
+
+  null_can can;
+  hal::can_router router(can);
+  {
+    auto route = router.add_message_callback(
+      p_frames.front().id, [&](const hal::can::message_t& p_message) {
+        checksum += sum(p_unpack(p_message.payload));
+      });
+    seconds = measure(p_frames, p_rounds, std::ref(router));
+    report("  router hand written", total, seconds);
+  }
+  {
+    auto route = router.add_typed_callback<T>(
+      p_frames.front().id,
+      [&](const T& p_decoded) { checksum += sum(p_decoded); });
+    seconds = measure(p_frames, p_rounds, std::ref(router));
+    report("  router typed callback", total, seconds);
+  }
+
+  p_checksum += checksum;
+}
+}  // namespace
+
+/// Compares `can_decode()` and typed router callbacks with hand written
+/// shift and mask decoding of the same signals. Frames carry random
+/// payloads, and every decoded field is folded into a checksum so no decode
+/// is optimized away.
+int main(int p_argc, char** p_argv)
+{
+  const std::size_t rounds =
+    p_argc > 1 ? std::strtoull(p_argv[1], nullptr, 10) : 100;
+  constexpr std::size_t frame_count = 100'000;
+
+  std::mt19937 rng(30);
+  std::uniform_int_distribution<int> byte_distribution(0, 255);
+  std::vector<hal::can::message_t> frames(frame_count);
+  for (auto& frame : frames) {
+    frame.id = 0x120;
+    frame.length = 8;
+    for (auto& byte : frame.payload) {
+      byte = static_cast<hal::byte>(byte_distribution(rng));
+    }
+  }
+
+  float checksum = 0.0f;
+  compare<wheel_speed_t>(
+    "wheel_speed_t", unpack_wheel_speed, frames, rounds, checksum);
+  compare<powertrain_t>(
+    "powertrain_t", unpack_powertrain, frames, rounds, checksum);
+
+  std::printf("checksum %f\n", static_cast<double>(checksum));
+  return 0;
+}
@@ -0,0 +1,129 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <libhal-canrouter/can_capture.hpp>
+#include <libhal-canrouter/can_diagnostics.hpp>
+
+#include "mapped_file.hpp"
+
+namespace {
+constexpr hal::can::id_t default_response_id = 0x7F1;
+
+int usage()
+{
+  std::fputs("usage:\n"
+             "  can_diagnostics <input.hcap> [response id, hex]\n",
+             stderr);
+  return 2;
+}
+
+void print(const hal::can_diagnostics_record& p_record)
+{
+  using type = hal::can_diagnostics_record_type;
+  switch (p_record.type) {
+    case type::begin:
+      std::printf("  version %u%s\n",
+                  unsigned{ p_record.version },
+                  p_record.truncated ? ", truncated" : "");
+      break;
+    case type::route:
+      std::printf("  route   0x%08X %10u hits\n",
+                  static_cast<unsigned>(p_record.id),
+                  static_cast<unsigned>(p_record.count));
+      break;
+    case type::counter:
+      std::printf("  counter %-10u %10u%s\n",
+                  unsigned{ p_record.key },
+                  static_cast<unsigned>(p_record.count),
+                  p_record.key == hal::can_diagnostics_format::unrouted_counter
+                    ? " unrouted frames"
+                    : "");
+      break;
+    case type::queue:
+      std::printf("  queue   %-10u %5u / %-5u high-water, %u dropped\n",
+                  unsigned{ p_record.key },
+                  unsigned{ p_record.high_water },
+                  unsigned{ p_record.capacity },
+                  static_cast<unsigned>(p_record.count));
+      break;
+    case type::bus_load:
+      std::printf("  bus load %6.2f%% %10u frames/s\n",
+                  static_cast<double>(p_record.load),
+                  static_cast<unsigned>(p_record.frames_per_second));
+      break;
+  }
+}
+}  // namespace
+
+/// Decodes the diagnostic snapshots a can_diagnostics_server streamed during
+/// a capture, as recorded by `can_capture from-candump`, and prints each
+/// snapshot with the time its last chunk was seen.
+int main(int p_argc, char** p_argv)
+{
+  if (p_argc < 2 || p_argc > 3) {
+    return usage();
+  }
+
+  auto response_id = default_response_id;
+  if (p_argc > 2) {
+    response_id =
+      static_cast<hal::can::id_t>(std::strtoul(p_argv[2], nullptr, 16));
+  }
+
+  mapped_file input(p_argv[1]);
+  if (!input.valid()) {
+    std::fprintf(stderr, "unable to map '%s'\n", p_argv[1]);
+    return 1;
+  }
+
+  auto reader = hal::can_capture_reader::create(input.bytes());
+  if (!reader) {
+    std::fprintf(stderr, "'%s' is not a capture file\n", p_argv[1]);
+    return 1;
+  }
+
+  const auto frequency = static_cast<double>(reader.value().tick_frequency());
+  std::vector<hal::byte> buffer(1 << 16);
+  hal::can_diagnostics_decoder decoder(buffer);
+  std::size_t snapshots = 0;
+  bool malformed = false;
+
+  reader.value().for_each([&](const hal::can_capture_record& p_record) {
+    if (p_record.message.id != response_id || !decoder.feed(p_record.message)) {
+      return;
+    }
+    snapshots++;
+    std::printf("snapshot %zu at %.6f s on bus %u\n",
+                snapshots,
+                static_cast<double>(p_record.timestamp) / frequency,
+                unsigned{ p_record.bus });
+    if (!hal::can_diagnostics_decoder::parse(decoder.snapshot(), print)) {
+      std::puts("  malformed record");
+      malformed = true;
+    }
+  });
+
+  std::fprintf(stderr,
+               "%zu snapshots decoded, %u discarded for lost chunks\n",
+               snapshots,
+               static_cast<unsigned>(decoder.discarded()));
+  if (reader.value().truncated()) {
+    std::fputs("warning: capture ends with a truncated record\n", stderr);
+  }
+  return malformed ? 1 : 0;
+}
@@ -0,0 +1,155 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <libhal-canrouter/can_sharded_router.hpp>
+#include <libhal-canrouter/can_signal.hpp>
+#include <libhal-canrouter/can_traffic_generator.hpp>
+
+namespace {
+constexpr std::size_t buses = 8;
+constexpr std::size_t streams_per_bus = 64;
+
+constexpr hal::can_signal signal{ .start_bit = 8,
+                                  .length = 16,
+                                  .scale = 0.1f,
+                                  .offset = -40.0f };
+
+/// Per-route state on its own cache line, as every route is only touched by
+/// the worker of its shard
+struct alignas(64) route_state
+{
+  float sum = 0.0f;
+};
+
+/// Stands in for gateway processing of a frame: decode a signal and iterate
+/// a little on it
+float process(const hal::can::message_t& p_message, unsigned p_work)
+{
+  auto value = signal.decode(p_message.payload);
+  for (unsigned i = 0; i < p_work; i++) {
+    value = value * 0.999f + 0.001f;
+  }
+  return value;
+}
+
+double run(std::size_t p_shards,
+           const std::vector<std::vector<hal::can::message_t>>& p_traffic,
+           std::vector<route_state>& p_states,
+           const std::vector<hal::can::id_t>& p_ids,
+           unsigned p_work)
+{
+  hal::can_sharded_router<> router(p_shards, buses);
+  std::vector<hal::can_sharded_router<>::route> routes;
+  routes.reserve(p_ids.size());
+  for (std::size_t i = 0; i < p_ids.size(); i++) {
+    routes.push_back(router.add_message_callback(
+      p_ids[i], [&state = p_states[i], p_work](const auto& p_message) {
+        state.sum += process(p_message, p_work);
+      }));
+  }
+
+  std::uint64_t total = 0;
+  for (const auto& frames : p_traffic) {
+    total += frames.size();
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> producers;
+  for (std::size_t bus = 0; bus < buses; bus++) {
+    producers.emplace_back([&router, &p_traffic, bus]() {
+      auto& input = router.input(bus);
+      for (const auto& message : p_traffic[bus]) {
+        while (!input.post(message)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  while (router.handled() < total) {
+    std::this_thread::yield();
+  }
+  const auto stop = std::chrono::steady_clock::now();
+
+  return static_cast<double>(total) /
+         std::chrono::duration<double>(stop - start).count();
+}
+}  // namespace
+
+/// Measures how routing throughput of eight aggregated buses scales with the
+/// number of shards. Each bus replays its own synthetic vehicle profile
+/// through one input, and handlers decode a signal plus a configurable
+/// amount of extra work per frame.
+///
+///     can_sharded_router_bench [frames per bus] [max shards] [work]
+int main(int p_argc, char** p_argv)
+{
+  const std::size_t frames =
+    p_argc > 1 ? std::strtoull(p_argv[1], nullptr, 10) : 250'000;
+  const std::size_t max_shards =
+    p_argc > 2 ? std::strtoull(p_argv[2], nullptr, 10)
+               : std::max(std::thread::hardware_concurrency(), 1U);
+  const unsigned work =
+    p_argc > 3 ? static_cast<unsigned>(std::strtoul(p_argv[3], nullptr, 10))
+               : 50;
+
+  std::vector<std::vector<hal::can::message_t>> traffic(buses);
+  std::vector<hal::can::id_t> ids;
+  for (std::size_t bus = 0; bus < buses; bus++) {
+    std::vector<hal::can_traffic_stream> profile(streams_per_bus);
+    hal::can_make_vehicle_profile(profile, bus + 1, 0.25f);
+    // Give every bus its own IDs, as a gateway would see
+    for (auto& stream : profile) {
+      stream.id += static_cast<hal::can::id_t>(bus);
+      ids.push_back(stream.id);
+    }
+    hal::can_traffic_generator generator(profile, bus + 1);
+    traffic[bus].reserve(frames);
+    for (std::size_t i = 0; i < frames; i++) {
+      traffic[bus].push_back(generator.next().message);
+    }
+  }
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+  std::vector<route_state> states(ids.size());
+  double baseline = 0.0;
+  for (std::size_t shards = 1; shards <= max_shards; shards++) {
+    const auto rate = run(shards, traffic, states, ids, work);
+    if (shards == 1) {
+      baseline = rate;
+    }
+    std::printf("%3zu shards %10.2f Mframes/s %6.2fx\n",
+                shards,
+                rate / 1e6,
+                rate / baseline);
+  }
+
+  // Keeps the handlers observable so no work is optimized away
+  float checksum = 0.0f;
+  for (const auto& state : states) {
+    checksum += state.sum;
+  }
+  std::printf("checksum %f\n", static_cast<double>(checksum));
+  return 0;
+}
@@ -0,0 +1,102 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <libhal-canrouter/can_signal_batch.hpp>
+
+namespace {
+constexpr hal::can_signal signal{ .start_bit = 19,
+                                  .length = 12,
+                                  .byte_order = hal::can_byte_order::big_endian,
+                                  .is_signed = true,
+                                  .scale = 0.5f,
+                                  .offset = -40.0f };
+
+template<typename F>
+double measure(F&& p_function)
+{
+  const auto start = std::chrono::steady_clock::now();
+  p_function();
+  const auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(stop - start).count();
+}
+
+void report(const char* p_name, std::size_t p_frames, double p_seconds)
+{
+  std::printf("%-18s %8.3f ms %10.1f Mframes/s\n",
+              p_name,
+              p_seconds * 1e3,
+              static_cast<double>(p_frames) / p_seconds / 1e6);
+}
+}  // namespace
+
+/// Compares per-frame decoding with the batch decoder on every instruction
+/// set available on this machine.
+int main(int p_argc, char** p_argv)
+{
+  const std::size_t frames =
+    p_argc > 1 ? std::strtoull(p_argv[1], nullptr, 10) : 10'000'000;
+  if (frames == 0) {
+    std::fprintf(stderr, "frame count must be a positive number\n");
+    return 1;
+  }
+
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> byte_distribution(0, 255);
+  std::vector<hal::can::message_t> messages(frames);
+  for (auto& message : messages) {
+    message.id = 0x120;
+    message.length = 8;
+    for (auto& byte : message.payload) {
+      byte = static_cast<hal::byte>(byte_distribution(rng));
+    }
+  }
+
+  std::vector<float> column(frames);
+  float checksum = 0.0f;
+
+  const auto per_frame = measure([&]() {
+    for (std::size_t i = 0; i < frames; i++) {
+      column[i] = signal.decode(messages[i].payload);
+    }
+  });
+  checksum += column[frames / 2];
+  report("per-frame", frames, per_frame);
+
+  constexpr std::pair<hal::can_batch_isa, const char*> isas[] = {
+    { hal::can_batch_isa::scalar, "batch scalar" },
+    { hal::can_batch_isa::sse2, "batch sse2" },
+    { hal::can_batch_isa::avx2, "batch avx2" },
+  };
+
+  for (const auto& [isa, name] : isas) {
+    if (isa > hal::can_batch_best_isa()) {
+      continue;
+    }
+    const auto seconds = measure(
+      [&]() { hal::can_batch_decode(messages, signal, column, isa); });
+    checksum += column[frames / 2];
+    report(name, frames, seconds);
+  }
+
+  // Keeps the decoded values observable so no loop is optimized away
+  std::printf("checksum %f\n", static_cast<double>(checksum));
+  return 0;
+}
@@ -0,0 +1,488 @@
+#!/usr/bin/env python3
+# Copyright 2023 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Generate a header-only C++ CAN message layer from a DBC file.
+
+For every message in the DBC the generated header contains a struct with one
+member per signal, its ID and length, a constexpr `can_fields()` description
+consumed by `hal::can_decode()` / `hal::can_encode()`, and `decode()` /
+`encode()` helpers. A `routes` class template registers a typed route on a
+`hal::can_router` for every message that a handler object accepts.
+
+Multiplexed messages get one more struct per multiplexer value, holding the
+plain signals and the signals of that value, and are routed through a
+`hal::can_multiplexer` on their selector byte. The multiplexor must be an
+unsigned, unscaled 8 bit signal aligned to a payload byte.
+
+usage: dbc_codegen.py <input.dbc> <output.hpp> [--namespace NAME]
+"""
+
+import argparse
+import pathlib
+import re
+import sys
+
+LICENSE = """\
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+"""
+
+MESSAGE_PATTERN = re.compile(
+    r"^BO_\s+(?P<id>\d+)\s+(?P<name>\w+)\s*:\s*(?P<length>\d+)\s+\w+")
+
+SIGNAL_PATTERN = re.compile(
+    r"^SG_\s+(?P<name>\w+)\s*(?P<mux>M|m\d+)?\s*:\s*"
+    r"(?P<start>\d+)\|(?P<length>\d+)@(?P<order>[01])(?P<sign>[+-])\s*"
+    r"\(\s*(?P<scale>[-+.\deE]+)\s*,\s*(?P<offset>[-+.\deE]+)\s*\)\s*"
+    r"\[\s*(?P<minimum>[-+.\deE]+)\s*\|\s*(?P<maximum>[-+.\deE]+)\s*\]\s*"
+    r"\"(?P<unit>[^\"]*)\"")
+
+EXTENDED_ID_FLAG = 0x80000000
+
+# Appended to signal names that would otherwise be C++ keywords
+CPP_KEYWORDS = frozenset("""
+    alignas alignof and and_eq asm auto bitand bitor bool break case catch
+    char char8_t char16_t char32_t class co_await co_return co_yield compl
+    concept const const_cast consteval constexpr constinit continue decltype
+    default delete do double dynamic_cast else enum explicit export extern
+    false float for friend goto if inline int long mutable namespace new
+    noexcept not not_eq nullptr operator or or_eq private protected public
+    register reinterpret_cast requires return short signed sizeof static
+    static_assert static_cast struct switch template this thread_local throw
+    true try typedef typeid typename union unsigned using virtual void
+    volatile wchar_t while xor xor_eq
+""".split())
+
+
+class Signal:
+    def __init__(self, match):
+        self.dbc_name = match["name"]
+        self.name = snake_case(self.dbc_name)
+        if self.name in CPP_KEYWORDS:
+            self.name += "_"
+        mux = match["mux"] or ""
+        self.multiplexor = mux == "M"
+        self.mux_value = int(mux[1:]) if mux.startswith("m") else None
+        self.start_bit = int(match["start"])
+        self.length = int(match["length"])
+        self.big_endian = match["order"] == "0"
+        self.signed = match["sign"] == "-"
+        self.scale = float(match["scale"])
+        self.offset = float(match["offset"])
+        self.minimum = match["minimum"]
+        self.maximum = match["maximum"]
+        self.unit = match["unit"]
+
+    @property
+    def multiplexed(self):
+        return self.mux_value is not None
+
+    @property
+    def selector_byte(self):
+        """Payload byte holding this signal, or None if it spans several"""
+        if self.length != 8 or self.signed or not self.is_raw:
+            return None
+        if self.start_bit % 8 != (7 if self.big_endian else 0):
+            return None
+        return self.start_bit // 8
+
+    @property
+    def is_raw(self):
+        return self.scale == 1.0 and self.offset == 0.0
+
+    @property
+    def cpp_type(self):
+        if not self.is_raw:
+            return "float"
+        if self.length == 1 and not self.signed:
+            return "bool"
+        for width in (8, 16, 32, 64):
+            if self.length <= width:
+                break
+        return f"std::{'' if self.signed else 'u'}int{width}_t"
+
+    @property
+    def initializer(self):
+        return {"float": "0.0f", "bool": "false"}.get(self.cpp_type, "0")
+
+
+class Message:
+    def __init__(self, match):
+        raw_id = int(match["id"])
+        self.dbc_name = match["name"]
+        self.name = snake_case(self.dbc_name)
+        self.id = raw_id & ~EXTENDED_ID_FLAG
+        self.length = int(match["length"])
+        self.signals = []
+
+    @property
+    def multiplexor(self):
+        return next((s for s in self.signals if s.multiplexor), None)
+
+    @property
+    def plain_signals(self):
+        return [s for s in self.signals if not s.multiplexed]
+
+    @property
+    def mux_values(self):
+        return sorted({s.mux_value for s in self.signals if s.multiplexed})
+
+    def page_name(self, p_value):
+        return f"{self.name}_m{p_value}"
+
+
+def snake_case(p_name):
+    name = re.sub(r"([a-z0-9])([A-Z])", r"\1_\2", p_name)
+    name = re.sub(r"([A-Z]+)([A-Z][a-z])", r"\1_\2", name)
+    return name.lower()
+
+
+def float_literal(p_value):
+    text = repr(float(p_value))
+    if "e" not in text and "." not in text:
+        text += ".0"
+    return text + "f"
+
+
+def parse(p_text, p_path):
+    messages = []
+    for number, line in enumerate(p_text.splitlines(), start=1):
+        line = line.strip()
+        if line.startswith("BO_ "):
+            match = MESSAGE_PATTERN.match(line)
+            if not match:
+                sys.exit(f"{p_path}:{number}: malformed message: {line}")
+            message = Message(match)
+            if message.length > 8:
+                sys.exit(f"{p_path}:{number}: {message.dbc_name} is "
+                         f"{message.length} bytes long, classic CAN frames "
+                         "hold at most 8")
+            messages.append(message)
+        elif line.startswith("SG_ "):
+            match = SIGNAL_PATTERN.match(line)
+            if not match or not messages:
+                sys.exit(f"{p_path}:{number}: malformed signal: {line}")
+            signal = Signal(match)
+            if signal.length == 0 or signal.length > 64:
+                sys.exit(f"{p_path}:{number}: unsupported signal length")
+            message = messages[-1]
+            if signal.multiplexor and message.multiplexor:
+                sys.exit(f"{p_path}:{number}: {message.dbc_name} has more "
+                         "than one multiplexor, which is not supported")
+            if signal.multiplexor and signal.selector_byte is None:
+                sys.exit(f"{p_path}:{number}: multiplexor {signal.dbc_name} "
+                         "must be an unsigned, unscaled 8 bit signal aligned "
+                         "to a payload byte")
+            if signal.multiplexed and signal.mux_value > 255:
+                sys.exit(f"{p_path}:{number}: multiplexer value of "
+                         f"{signal.dbc_name} does not fit a byte")
+            message.signals.append(signal)
+    # DBC files use a pseudo message to hold unassigned signals
+    messages = [m for m in messages
+                if m.dbc_name != "VECTOR__INDEPENDENT_SIG_MSG"]
+    for message in messages:
+        if message.mux_values and not message.multiplexor:
+            sys.exit(f"{p_path}: {message.dbc_name} has multiplexed signals "
+                     "but no multiplexor")
+    return messages
+
+
+def emit_field(p_struct, p_signal):
+    options = [f".start_bit = {p_signal.start_bit}",
+               f".length = {p_signal.length}"]
+    if p_signal.big_endian:
+        options.append(".byte_order = hal::can_byte_order::big_endian")
+    if p_signal.signed:
+        options.append(".is_signed = true")
+    if p_signal.scale != 1.0:
+        options.append(f".scale = {float_literal(p_signal.scale)}")
+    if p_signal.offset != 0.0:
+        options.append(f".offset = {float_literal(p_signal.offset)}")
+
+    first = f"      hal::can_field{{ &{p_struct}_t::{p_signal.name},"
+    indent = " " * len("      hal::can_field{ ")
+    single = f"{indent}{{ " + ", ".join(options) + " } },"
+    if len(single) <= 80:
+        return f"{first}\n{single}"
+    separator = f",\n{indent}  "
+    return f"{first}\n{indent}{{ " + separator.join(options) + " } },"
+
+
+def emit_struct(p_message, p_struct, p_title, p_signals, p_selector=None):
+    multiplexor = p_message.multiplexor
+    out = []
+    out.append(f"/// {p_title}")
+    out.append(f"struct {p_struct}_t")
+    out.append("{")
+    out.append(f"  static constexpr hal::can::id_t id = 0x{p_message.id:X};")
+    out.append(f"  static constexpr std::uint8_t length = {p_message.length};")
+    if multiplexor:
+        out.append("  static constexpr std::uint8_t selector_byte = "
+                   f"{multiplexor.selector_byte};")
+    if p_selector is not None:
+        out.append("  static constexpr std::uint8_t selector = "
+                   f"{p_selector};")
+    out.append("")
+
+    for signal in p_signals:
+        unit = f" {signal.unit}" if signal.unit else ""
+        initializer = signal.initializer
+        if signal.multiplexor and p_selector is not None:
+            initializer = "selector"
+        out.append(f"  /// {signal.dbc_name} [{signal.minimum}, "
+                   f"{signal.maximum}]{unit}")
+        out.append(f"  {signal.cpp_type} {signal.name} = {initializer};")
+    if p_signals:
+        out.append("")
+
+    out.append("  static constexpr auto can_fields()")
+    out.append("  {")
+    if p_signals:
+        out.append("    return std::tuple{")
+        for signal in p_signals:
+            out.append(emit_field(p_struct, signal))
+        out.append("    };")
+    else:
+        out.append("    return std::tuple<>{};")
+    out.append("  }")
+    out.append("")
+    out.append(f"  static constexpr {p_struct}_t decode(")
+    out.append("    const hal::can::message_t& p_message)")
+    out.append("  {")
+    out.append(f"    return hal::can_decode<{p_struct}_t>(p_message);")
+    out.append("  }")
+    out.append("")
+    out.append("  [[nodiscard]] constexpr hal::can::message_t encode() const")
+    out.append("  {")
+    out.append("    return { .id = id,")
+    out.append("             .payload = hal::can_encode(*this),")
+    out.append("             .length = length };")
+    out.append("  }")
+    out.append("};")
+    return "\n".join(out)
+
+
+def emit_message(p_message):
+    out = [emit_struct(p_message, p_message.name, p_message.dbc_name,
+                       p_message.plain_signals)]
+    multiplexor = p_message.multiplexor
+    for value in p_message.mux_values:
+        signals = p_message.plain_signals + [
+            s for s in p_message.signals if s.mux_value == value]
+        out.append("")
+        out.append(emit_struct(
+            p_message, p_message.page_name(value),
+            f"{p_message.dbc_name} with {multiplexor.dbc_name} {value}",
+            signals, value))
+    return "\n".join(out)
+
+
+MULTIPLEXED_HELPERS = """
+  template<typename Message, typename... Pages, std::size_t N>
+  static route add_multiplexed(hal::can_router& p_router,
+                               Handler& p_handler,
+                               hal::can_multiplexer<N>& p_mux)
+  {
+    constexpr bool accepts_message =
+      std::is_invocable_v<Handler&, const Message&>;
+    if constexpr (accepts_message ||
+                  (std::is_invocable_v<Handler&, const Pages&> || ...)) {
+      (set_page<Pages>(p_mux, p_handler), ...);
+      if constexpr (accepts_message) {
+        p_mux.set_fallback([&p_handler](const hal::can::message_t& p_frame) {
+          p_handler(Message::decode(p_frame));
+        });
+      }
+      return p_router.add_message_callback(Message::id, std::ref(p_mux));
+    } else {
+      return std::nullopt;
+    }
+  }
+
+  template<typename Page, std::size_t N>
+  static void set_page(hal::can_multiplexer<N>& p_mux, Handler& p_handler)
+  {
+    if constexpr (std::is_invocable_v<Handler&, const Page&>) {
+      (void)p_mux.template set_typed_handler<Page>(
+        Page::selector,
+        [&p_handler](const Page& p_message) { p_handler(p_message); });
+    }
+  }"""
+
+
+def emit_route_init(p_prefix, p_message):
+    name = p_message.name
+    if not p_message.mux_values:
+        single = f"    {p_prefix} m_{name}(add<{name}_t>(p_router, p_handler))"
+        if len(single) <= 80:
+            return [single]
+        return [f"    {p_prefix} m_{name}(",
+                f"        add<{name}_t>(p_router, p_handler))"]
+
+    types = [f"{name}_t"] + [f"{p_message.page_name(v)}_t"
+                             for v in p_message.mux_values]
+    arguments = f"p_router, p_handler, m_{name}_mux"
+    single = (f"    {p_prefix} m_{name}(add_multiplexed<{', '.join(types)}>("
+              f"{arguments}))")
+    if len(single) <= 80:
+        return [single]
+    out = [f"    {p_prefix} m_{name}("]
+    indent = " " * len("        add_multiplexed<")
+    for index, type_name in enumerate(types):
+        head = "        add_multiplexed<" if index == 0 else indent
+        tail = ">(" if index == len(types) - 1 else ","
+        out.append(f"{head}{type_name}{tail}")
+    out.append(f"          {arguments}))")
+    return out
+
+
+def emit_routes(p_messages):
+    multiplexed = [m for m in p_messages if m.mux_values]
+    out = []
+    out.append("/**")
+    out.append(" * @brief Register a typed route for every message that a "
+               "handler accepts")
+    out.append(" *")
+    out.append(" * The handler is any object with `operator()` overloads "
+               "taking the")
+    out.append(" * generated message types. Messages without a matching "
+               "overload are not")
+    out.append(" * routed. Routes are removed when this object is destroyed.")
+    if multiplexed:
+        out.append(" *")
+        out.append(" * Multiplexed messages are routed through a "
+                   "can_multiplexer held by this")
+        out.append(" * object, so it cannot be moved. Each frame goes to "
+                   "the overload for its")
+        out.append(" * multiplexer value's type, or, if there is none, to "
+                   "the overload for the")
+        out.append(" * message's own type.")
+    out.append(" *")
+    out.append(" * @tparam Handler - overload set of message handlers")
+    out.append(" */")
+    out.append("template<typename Handler>")
+    out.append("class routes")
+    out.append("{")
+    out.append("public:")
+    out.append("  using route = std::optional<hal::can_router::route_item>;")
+    out.append("")
+    out.append("  /**")
+    out.append("   * @brief Register the routes")
+    out.append("   *")
+    out.append("   * @param p_router - router to register routes on")
+    out.append("   * @param p_handler - handler for decoded messages. Must "
+               "outlive this")
+    out.append("   * object.")
+    out.append("   */")
+    out.append("  routes(hal::can_router& p_router, Handler& p_handler)")
+    for index, message in enumerate(p_messages):
+        out.extend(emit_route_init(":" if index == 0 else ",", message))
+    out.append("  {")
+    out.append("  }")
+    if multiplexed:
+        out.append("")
+        out.append("  routes(routes& p_other) = delete;")
+        out.append("  routes& operator=(routes& p_other) = delete;")
+    out.append("")
+    out.append("private:")
+    out.append("  template<typename T>")
+    out.append("  static route add(hal::can_router& p_router, "
+               "Handler& p_handler)")
+    out.append("  {")
+    out.append("    if constexpr (std::is_invocable_v<Handler&, const T&>) {")
+    out.append("      return p_router.add_typed_callback<T>(")
+    out.append("        T::id, [&p_handler](const T& p_message) "
+               "{ p_handler(p_message); });")
+    out.append("    } else {")
+    out.append("      return std::nullopt;")
+    out.append("    }")
+    out.append("  }")
+    if multiplexed:
+        out.extend(MULTIPLEXED_HELPERS.splitlines())
+    if p_messages:
+        out.append("")
+    for message in multiplexed:
+        pages = max(message.mux_values) + 1
+        out.append(f"  hal::can_multiplexer<{pages}> m_{message.name}_mux{{")
+        out.append(f"    {message.name}_t::selector_byte")
+        out.append("  };")
+    for message in p_messages:
+        out.append(f"  route m_{message.name};")
+    out.append("};")
+    return "\n".join(out)
+
+
+def generate(p_messages, p_namespace, p_source_name):
+    out = [LICENSE]
+    out.append(f"// Generated from {p_source_name} by dbc_codegen.py. "
+               "Do not edit.")
+    out.append("")
+    out.append("#pragma once")
+    out.append("")
+    multiplexed = any(m.mux_values for m in p_messages)
+    includes = ["cstdint", "optional", "tuple", "type_traits"]
+    if multiplexed:
+        includes += ["cstddef", "functional"]
+    for include in sorted(includes):
+        out.append(f"#include <{include}>")
+    out.append("")
+    if multiplexed:
+        out.append("#include <libhal-canrouter/can_multiplexer.hpp>")
+    out.append("#include <libhal-canrouter/can_router.hpp>")
+    out.append("#include <libhal-canrouter/can_signal.hpp>")
+    out.append("#include <libhal/can.hpp>")
+    out.append("")
+    out.append(f"namespace {p_namespace} {{")
+    for message in p_messages:
+        out.append(emit_message(message))
+        out.append("")
+    out.append(emit_routes(p_messages))
+    out.append(f"}}  // namespace {p_namespace}")
+    return "\n".join(out) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", type=pathlib.Path)
+    parser.add_argument("output", type=pathlib.Path)
+    parser.add_argument("--namespace", default=None,
+                        help="C++ namespace, defaults to the input file name")
+    args = parser.parse_args()
+
+    text = args.input.read_text(encoding="latin-1")
+    messages = parse(text, args.input)
+    namespace = args.namespace or snake_case(args.input.stem)
+    header = generate(messages, namespace, args.input.name)
+
+    # Leave the output untouched when nothing changed to avoid rebuilds
+    if args.output.exists() and args.output.read_text() == header:
+        return
+    args.output.parent.mkdir(parents=True, exist_ok=True)
+    args.output.write_text(header)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,99 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <span>
+#include <utility>
+
+#include <libhal/units.hpp>
+
+/**
+ * @brief Read-only memory mapping of an entire file
+ *
+ * Gives zero-copy access to a capture file so can_capture_reader can decode
+ * straight out of the page cache.
+ */
+class mapped_file
+{
+public:
+  /**
+   * @brief Map a file into memory
+   *
+   * @param p_path - path of the file to map
+   */
+  explicit mapped_file(const char* p_path)
+  {
+    const int descriptor = ::open(p_path, O_RDONLY);
+    if (descriptor < 0) {
+      return;
+    }
+
+    struct stat status
+    {};
+    if (::fstat(descriptor, &status) == 0 && status.st_size > 0) {
+      const auto size = static_cast<std::size_t>(status.st_size);
+      void* address =
+        ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+      if (address != MAP_FAILED) {
+        ::madvise(address, size, MADV_SEQUENTIAL);
+        m_data = static_cast<const hal::byte*>(address);
+        m_size = size;
+      }
+    }
+
+    ::close(descriptor);
+  }
+
+  mapped_file(mapped_file& p_other) = delete;
+  mapped_file& operator=(mapped_file& p_other) = delete;
+
+  ~mapped_file()
+  {
+    if (m_data) {
+      ::munmap(const_cast<hal::byte*>(m_data), m_size);
+    }
+  }
+
+  /**
+   * @brief Determine if the file was mapped
+   *
+   * @return true - the file contents are available
+   * @return false - the file could not be opened, is empty or mmap failed
+   */
+  [[nodiscard]] bool valid() const
+  {
+    return m_data != nullptr;
+  }
+
+  /**
+   * @brief Contents of the file
+   *
+   * @return std::span<const hal::byte> - mapped bytes
+   */
+  [[nodiscard]] std::span<const hal::byte> bytes() const
+  {
+    return { m_data, m_size };
+  }
+
+private:
+  const hal::byte* m_data = nullptr;
+  std::size_t m_size = 0;
+};
@@ -0,0 +1,152 @@
+// Copyright 2023 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <linux/can.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <libhal-canrouter/can_router.hpp>
+#include <libhal-canrouter/socketcan.hpp>
+
+namespace {
+constexpr std::size_t burst = 64;
+
+/// Writes frames to the bus end in bursts with sendmmsg(), so the sender
+/// costs little next to the driver being measured.
+void send_frames(int p_socket, std::size_t p_frames)
+{
+  std::array<can_frame, burst> frames{};
+  std::array<iovec, burst> vectors{};
+  std::array<mmsghdr, burst> headers{};
+  for (std::size_t i = 0; i < burst; i++) {
+    frames[i].can_id = 0x100 + i % 16;
+    frames[i].can_dlc = 8;
+    vectors[i] = { .iov_base = &frames[i], .iov_len = sizeof(can_frame) };
+    headers[i].msg_hdr.msg_iov = &vectors[i];
+    headers[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  std::size_t sent = 0;
+  while (sent < p_frames) {
+    const auto count =
+      static_cast<unsigned int>(std::min(burst, p_frames - sent));
+    const int result = ::sendmmsg(p_socket, headers.data(), count, 0);
+    if (result > 0) {
+      sent += static_cast<std::size_t>(result);
+    } else if (errno == EAGAIN || errno == ENOBUFS) {
+      std::this_thread::yield();
+    } else {
+      std::perror("sendmmsg");
+      return;
+    }
+  }
+}
+}  // namespace
+
+/// Measures frames per second and system calls per frame of the SocketCAN
+/// driver delivering into a can_router. Uses a socketpair standing in for
+/// an interface, or a real or virtual interface when one is named:
+///
+///     socketcan_bench 1000000 vcan0
+int main(int p_argc, char** p_argv)
+{
+  const std::size_t frames =
+    p_argc > 1 ? std::strtoull(p_argv[1], nullptr, 10) : 1'000'000;
+
+  int driver_socket = -1;
+  int bus_socket = -1;
+  if (p_argc > 2) {
+    auto driver_end = hal::socketcan_open(p_argv[2]);
+    auto bus_end = hal::socketcan_open(p_argv[2]);
+    if (!driver_end || !bus_end) {
+      std::fprintf(stderr, "cannot open interface %s\n", p_argv[2]);
+      return 1;
+    }
+    driver_socket = driver_end.value();
+    bus_socket = bus_end.value();
+  } else {
+    std::array<int, 2> ends{};
+    const int type = SOCK_DGRAM | SOCK_CLOEXEC;
+    if (::socketpair(AF_UNIX, type, 0, ends.data()) < 0) {
+      std::perror("socketpair");
+      return 1;
+    }
+    driver_socket = ends[0];
+    bus_socket = ends[1];
+  }
+
+  auto created = hal::socketcan::create(driver_socket);
+  if (!created) {
+    std::fprintf(stderr, "cannot set up the receive thread\n");
+    return 1;
+  }
+  auto can = std::move(created).value();
+  hal::can_router router(can);
+  std::atomic<std::uint64_t> sum = 0;
+  std::vector<hal::can_router::route_item> routes;
+  routes.reserve(16);
+  for (std::size_t i = 0; i < 16; i++) {
+    routes.push_back(router.add_message_callback(
+      static_cast<hal::can::id_t>(0x100 + i),
+      [&sum](const hal::can::message_t& p_message) {
+        sum.fetch_add(p_message.length, std::memory_order_relaxed);
+      }));
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  std::thread sender(send_frames, bus_socket, frames);
+  // A real interface drops frames when the socket buffer overflows, so stop
+  // waiting once nothing has arrived for a while
+  auto stop = start;
+  std::uint64_t last = 0;
+  while (last < frames) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    const auto now = std::chrono::steady_clock::now();
+    const auto received = can.stats().received;
+    if (received != last) {
+      last = received;
+      stop = now;
+    } else if (now - stop > std::chrono::milliseconds(500)) {
+      break;
+    }
+  }
+  sender.join();
+  ::close(bus_socket);
+
+  const auto stats = can.stats();
+  const auto seconds = std::chrono::duration<double>(stop - start).count();
+  const auto received = static_cast<double>(stats.received);
+  const auto syscalls =
+    static_cast<double>(stats.wait_calls + stats.receive_calls);
+  std::printf("%10.0f frames/s\n", received / seconds);
+  std::printf("%10llu frames lost\n",
+              static_cast<unsigned long long>(frames - stats.received));
+  std::printf("%10.3f syscalls/frame (%llu epoll_wait, %llu recvmmsg)\n",
+              syscalls / received,
+              static_cast<unsigned long long>(stats.wait_calls),
+              static_cast<unsigned long long>(stats.receive_calls));
+  std::printf("checksum %llu\n", static_cast<unsigned long long>(sum.load()));
+  return 0;
+}